@@ -32,6 +32,10 @@ const uint16_t DATAGRAM_CONV_SIZEOF = 8;
 // crc长度
 const uint16_t DATAGAM_CRC_SIZEOF = 2;
 
+// 会话id的最高位, 由握手的一方置位, 此后crc为CRC32C的低16位, 否则为CRC-16
+// 因此serverId须小于2^31
+const uint64_t DATAGRAM_CONV_CRC32C = 1ULL << 63;
+
 // 握手消息长度, sizeof(uint64_t)
 const uint16_t DATAGAM_HANDSHAKE_SIZEOF = 8;
 
@@ -1,5 +1,6 @@
 
 #include <assert.h>
+#include <endian.h>
 #include <stdlib.h>
 
 #include <boost/bind.hpp>
@@ -8,6 +9,8 @@
 #include <boost/random/random_device.hpp>
 
 
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Crc32c.h>
 #include <muduo/base/Logging.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/EventLoopThreadPool.h>
@@ -23,6 +26,26 @@ using namespace muduo;
 using namespace muduo::net;
 using namespace muduo::net::rudp;
 
+namespace {
+
+// the word UdpSocket::SteerReusePort() loads of a datagram, the low half of
+// convId in little endian, and the other way round
+uint32_t steeringKey(uint32_t convIndex) {
+    return be32toh(htole32(convIndex));
+}
+
+// the 2-byte checksum of a datagram
+uint16_t datagramChecksum(uint64_t convId, const void* data, std::size_t len) {
+    if (convId & DATAGRAM_CONV_CRC32C) {
+        return static_cast<uint16_t>(Crc32c::value(data, len));
+    }
+    boost::crc_16_type crc16;
+    crc16.process_bytes(data, len);
+    return crc16.checksum();
+}
+
+}
+
 
 ReliableUdpServer::ReliableUdpServer(EventLoop* loop,
                                      const InetAddress& listenAddr,
@@ -33,31 +56,41 @@ ReliableUdpServer::ReliableUdpServer(EventLoop* loop,
       ipPort_(listenAddr_.toIpPort()),
       name_(nameArg),
       serverId_(serverId),
-      numSockets_(1),
+      numSockets_(0),
       mssSize_(DATAGRAM_MSS_V4),
       maxWindowSize_(64),
-      random_(boost::random::random_device()()),
       threadPool_(new EventLoopThreadPool(loop_, name_)),
       connectionCallback_(DefaultConnectionCallback),
       messageCallback_(DefaultMessageCallback) {
+    // the top bit of convId flags CRC32C
+    if ((uint64_t(serverId) << 32) & DATAGRAM_CONV_CRC32C) {
+        LOG_FATAL << "ReliableUdpServer [" << name_ << "] serverId " << serverId
+                  << " not less than 2^31";
+    }
 }
 
 ReliableUdpServer::~ReliableUdpServer() {
     loop_->assertInLoopThread();
     LOG_DEBUG << "ReliableUdpServer::~ReliableUdpServer [" << name_ << "] destructing";
 
-    for (int i = 0; i < kConnectionsMapNum; ++i) {
+    // the loops are still running, each shard is let go of in its loop
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        CountDownLatch latch(1);
+        shards_[i].loop->runInLoop(
+                boost::bind(&ReliableUdpServer::destroyShard, &shards_[i], &latch));
+        latch.wait();
+    }
+}
 
-        MutexLockGuard lock(mutex_[i]);
-        for (auto iter(connectionsMaps_[i].begin());
-                iter != connectionsMaps_[i].end(); ++iter) {
-            auto conn = iter->second;
-            iter->second.reset();
-            conn->getLoop()->runInLoop(
-                    boost::bind(&ReliableUdpConnection::ConnectDestroyed, conn));
-            conn.reset();
-        }
+void ReliableUdpServer::destroyShard(Shard* shard, CountDownLatch* latch) {
+    shard->loop->assertInLoopThread();
+    ConnectionMap connections;
+    connections.swap(shard->connections);
+    for (auto iter(connections.begin()); iter != connections.end(); ++iter) {
+        iter->second->ConnectDestroyed();
     }
+    shard->socket.reset();
+    latch->countDown();
 }
 
 void ReliableUdpServer::setThreadNum(int numThreads) {
@@ -82,18 +115,37 @@ void ReliableUdpServer::setMaxWindowSize(uint16_t maxWindowSize) {
 void ReliableUdpServer::Start() {
     if (started_.getAndSet(1) == 0) {
         threadPool_->start(threadInitCallback_);
-        for (int i = 0; i < numSockets_; ++i) {
+        std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+        int numSockets = numSockets_ > 0 ? numSockets_ : static_cast<int>(loops.size());
+        boost::random::random_device seed;
+        for (int i = 0; i < numSockets; ++i) {
+            Shard* shard = new Shard(loops[i % loops.size()], seed());
             char buf[name_.size() + 32];
             ::snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-            auto socket = UdpServerSocket::MakeUdpServerSocket(threadPool_->getNextLoop(), listenAddr_, buf);
-            socket->SetMessageCallback(boost::bind(&ReliableUdpServer::handleUdpMessage, this, _1, _2, _3, _4));
-            sockets_.push_back(socket);
-            socket->Start();
+            shard->socket = UdpServerSocket::MakeUdpServerSocket(shard->loop, listenAddr_, buf);
+            shard->socket->SetMessageCallback(boost::bind(&ReliableUdpServer::handleUdpMessage, this,
+                        shards_.size(), _1, _2, _3, _4));
+            shards_.push_back(shard);
+
+            // one by one, the index of a socket in the SO_REUSEPORT group
+            // is in the order of binding
+            CountDownLatch latch(1);
+            shard->socket->Start();
+            shard->loop->runInLoop(boost::bind(&CountDownLatch::countDown, &latch));
+            latch.wait();
+        }
+
+        if (shards_.size() > 1) {
+            int error = shards_[0].socket->SteerReusePort(0, static_cast<uint32_t>(shards_.size()));
+            if (error != 0) {
+                LOG_WARN << "ReliableUdpServer [" << name_ << "] no steering by conv, errno = "
+                         << error << ", datagrams on a wrong socket are forwarded";
+            }
         }
     }
 }
 
-void ReliableUdpServer::handleUdpMessage(const UdpServerSocketPtr& socket,
+void ReliableUdpServer::handleUdpMessage(size_t index, const UdpServerSocketPtr& socket,
         Buffer* buf, Timestamp, const InetAddress& address) {
     uint64_t convId;
     if (buf->readableBytes() < sizeof(convId)) {
@@ -102,75 +154,98 @@ void ReliableUdpServer::handleUdpMessage(const UdpServerSocketPtr& socket,
 
     DatagramDeserialize(convId, buf->peek(), 0);
 
-    if ((convId >> 32) != serverId_) {
+    if (((convId & ~DATAGRAM_CONV_CRC32C) >> 32) != serverId_) {
         return;
     }
 
-    if (!checkCrcchecksum(buf->peek(), buf->readableBytes())) {
+    if (!checkCrcchecksum(convId, buf->peek(), buf->readableBytes())) {
         return;
     }
     std::size_t processBytes = buf->readableBytes() - sizeof(convId) - sizeof(uint16_t);
+    const char* message = buf->peek() + sizeof(convId);
 
-    uint32_t index = static_cast<uint32_t>(convId & 0xffffffff);
+    uint32_t convIndex = static_cast<uint32_t>(convId & 0xffffffff);
 
-    if (index == 0) {
-        if (loop_->isInLoopThread()) {
-            newConnectionInLoop(socket, buf->peek() + sizeof(convId) , processBytes, address);
+    if (convIndex == 0) {
+        Shard& origin = shards_[index];
+        if (origin.inConnectingIpPortSet.find(address.toIpPort()) != origin.inConnectingIpPortSet.end()) {
+            return;
+        }
+        origin.inConnectingIpPortSet.insert(address.toIpPort());
+
+        // the handshakes all go to the first socket, spread the connections
+        size_t target = static_cast<size_t>(nextShard_.getAndAdd(1)) % shards_.size();
+        EventLoop* ioLoop = shards_[target].loop;
+        uint64_t convFlags = convId & DATAGRAM_CONV_CRC32C;
+        if (ioLoop->isInLoopThread()) {
+            newConnectionInLoop(target, index, convFlags, message, processBytes, address);
         } else {
-            loop_->queueInLoop(boost::bind(&ReliableUdpServer::newConnectionInLoop, shared_from_this(),
-                        socket, string(buf->peek() + sizeof(convId) , processBytes), address));
+            ioLoop->queueInLoop(boost::bind(&ReliableUdpServer::newConnectionInLoop, shared_from_this(),
+                        target, index, convFlags, string(message, processBytes), address));
         }
         return;
     }
 
-    ReliableUdpConnectionPtr conn;
-    {
-
-        int connectionsIndex  = convId % kConnectionsMapNum;
-        MutexLockGuard lock(mutex_[connectionsIndex]);
-        auto connIter = connectionsMaps_[connectionsIndex].find(convId);
-        if (connIter != connectionsMaps_[connectionsIndex].end()) {
-            conn = connIter->second;
+    if (!processMessage(index, convId, message, processBytes, address)) {
+        size_t owner = shardOf(convIndex);
+        if (owner != index) {
+            shards_[owner].loop->queueInLoop(boost::bind(&ReliableUdpServer::handleForwardedMessage,
+                        shared_from_this(), owner, convId, string(message, processBytes), address));
+        } else {
+            onConnectionReset(convId, socket, address);
         }
     }
+}
 
-    if (!conn) {
-        onConnectionReset(convId, socket, address);
-        return;
+void ReliableUdpServer::handleForwardedMessage(size_t index, uint64_t convId,
+        const StringPiece& message, const InetAddress& address) {
+    if (!processMessage(index, convId, message.data(), message.size(), address)) {
+        onConnectionReset(convId, shards_[index].socket, address);
     }
+}
 
+bool ReliableUdpServer::processMessage(size_t index, uint64_t convId,
+        const void* message, std::size_t len, const InetAddress& address) {
+    shards_[index].loop->assertInLoopThread();
 
+    const ConnectionMap& connections = shards_[index].connections;
+    auto connIter = connections.find(convId);
+    if (connIter == connections.end()) {
+        return false;
+    }
 
-    if (processBytes == 0) {
+    ReliableUdpConnectionPtr conn = connIter->second;
+    if (len == 0) {
         conn->Close();
     }
 
-    conn->Process(buf->peek() + sizeof(convId), processBytes, address);
+    conn->Process(message, len, address);
+    return true;
+}
+
+size_t ReliableUdpServer::shardOf(uint32_t convIndex) const {
+    return steeringKey(convIndex) % shards_.size();
 }
 
-bool ReliableUdpServer::checkCrcchecksum(const void* buffer, std::size_t n) {
+bool ReliableUdpServer::checkCrcchecksum(uint64_t convId, const void* buffer, std::size_t n) {
     uint16_t checksum;
 
     if (n >= sizeof(checksum)) {
         std::memcpy(&checksum,
                 static_cast<const char*>(buffer) + n - sizeof(checksum),
                 sizeof(checksum));
-        boost::crc_16_type crc16;
-        crc16.process_bytes(buffer, n - sizeof(checksum));
-        return crc16.checksum() == checksum;
+        return datagramChecksum(convId, buffer, n - sizeof(checksum)) == checksum;
     }
     return false;
 }
 
 void ReliableUdpServer::onConnectionReset(uint64_t convId, const UdpServerSocketPtr& socket, const InetAddress& address) {
-    boost::crc_16_type crc16;
     char buf[DATAGRAM_CONV_SIZEOF + DATAGAM_CRC_SIZEOF];
     std::size_t index = 0;
 
     index = DatagramSerialize(convId, buf, index);
-    crc16.process_bytes(buf, index);
 
-    uint16_t checksum = crc16.checksum();
+    uint16_t checksum = datagramChecksum(convId, buf, index);
     index = DatagramSerialize(checksum, buf, index);
 
     socket->SendTo(buf, index, address);
@@ -181,69 +256,70 @@ void ReliableUdpServer::onConnectionFlush(uint64_t convId, const UdpServerSocket
     char buf[DATAGRAM_CONV_SIZEOF + DATAGAM_CRC_SIZEOF + len];
     std::size_t index = 0;
 
-    boost::crc_16_type crc16;
-
     index = DatagramSerialize(convId, buf, index);
     index = DatagramSerialize(data, len,  buf, index);
-    crc16.process_bytes(buf, index);
-    uint16_t checksum = crc16.checksum();
+    uint16_t checksum = datagramChecksum(convId, buf, index);
     index = DatagramSerialize(checksum, buf, index);
 
     socket->SendTo(buf, index, address);
 }
 
-void ReliableUdpServer::removeConnection(uint64_t convId, const ReliableUdpConnectionPtr& conn) {
-    if (loop_->isInLoopThread()) {
-        removeConnectionInLoop(convId, conn);
+void ReliableUdpServer::removeConnection(size_t index, uint64_t convId, const ReliableUdpConnectionPtr& conn) {
+    EventLoop* ioLoop = shards_[index].loop;
+    if (ioLoop->isInLoopThread()) {
+        removeConnectionInLoop(index, convId, conn);
     } else {
-        loop_->queueInLoop(boost::bind(&ReliableUdpServer::removeConnectionInLoop, this, convId, conn));
+        ioLoop->queueInLoop(boost::bind(&ReliableUdpServer::removeConnectionInLoop, this, index, convId, conn));
     }
 }
 
-void ReliableUdpServer::removeConnectionInLoop(uint64_t convId, const ReliableUdpConnectionPtr& conn) {
-
-    uint32_t index = static_cast<uint32_t>(convId & 0xffffffff);
-    size_t n = convIndexs_.erase(index);
+void ReliableUdpServer::removeConnectionInLoop(size_t index, uint64_t convId, const ReliableUdpConnectionPtr& conn) {
+    Shard& shard = shards_[index];
+    uint32_t convIndex = static_cast<uint32_t>(convId & 0xffffffff);
+    size_t n = shard.convIndexs.erase(convIndex);
     (void)n;
     assert(n == 1);
-    {
-        int connectionsIndex = convId % kConnectionsMapNum;
-        MutexLockGuard lock(mutex_[connectionsIndex]);
-        n = connectionsMaps_[connectionsIndex].erase(convId);
-        assert(n == 1);
-    }
+    n = shard.connections.erase(convId);
+    assert(n == 1);
     auto ioLoop = conn->getLoop();
     ioLoop->runInLoop(boost::bind(&ReliableUdpConnection::ConnectDestroyed, conn));
 }
 
 
-uint64_t ReliableUdpServer::genConvId() {
-    uint32_t index = random_();
-    auto iter = convIndexs_.lower_bound(index);
-    while (iter != convIndexs_.end() && *iter == index) {
-        ++iter;
-        ++index;
+// a conv index not in use, steered to the socket of index
+uint64_t ReliableUdpServer::genConvId(size_t index, uint64_t convFlags) {
+    Shard& shard = shards_[index];
+    const uint32_t numShards = static_cast<uint32_t>(shards_.size());
+
+    uint32_t key = static_cast<uint32_t>(shard.random());
+    key = key / numShards * numShards;
+    if (key > UINT32_MAX - numShards) {
+        key -= numShards;
+    }
+    key += static_cast<uint32_t>(index);
+    while (steeringKey(key) == 0 || shard.convIndexs.count(steeringKey(key)) > 0) {
+        // wraps around to the same remainder, numShards divides 2^32 or not
+        key = key > UINT32_MAX - numShards ? static_cast<uint32_t>(index) : key + numShards;
     }
-    convIndexs_.insert(index);
 
-    uint64_t convId = (uint64_t(serverId_) << 32) | index;
+    uint32_t convIndex = steeringKey(key);
+    shard.convIndexs.insert(convIndex);
+
+    uint64_t convId = convFlags | (uint64_t(serverId_) << 32) | convIndex;
     return convId;
 }
 
-void ReliableUdpServer::newConnectionInLoop(const UdpServerSocketPtr& socket,
+void ReliableUdpServer::newConnectionInLoop(size_t target, size_t origin, uint64_t convFlags,
         const StringPiece& message, const InetAddress& address) {
-    newConnectionInLoop(socket, message.data(), message.size(), address);
+    newConnectionInLoop(target, origin, convFlags, message.data(), message.size(), address);
 }
 
-void ReliableUdpServer::newConnectionInLoop(const UdpServerSocketPtr& socket,
+void ReliableUdpServer::newConnectionInLoop(size_t target, size_t origin, uint64_t convFlags,
         const void* message, std::size_t len , const InetAddress& address) {
+    Shard& shard = shards_[target];
+    shard.loop->assertInLoopThread();
 
-    if (inConnectingIpPortSet_.find(address.toIpPort()) != inConnectingIpPortSet_.end()) {
-        return;
-    }
-    inConnectingIpPortSet_.insert(address.toIpPort());
-
-    uint64_t convId = genConvId();
+    uint64_t convId = genConvId(target, convFlags);
     char buf[64];
     snprintf(buf, sizeof buf, "-%s#%ld", ipPort_.c_str(), convId);
     string connName = name_ + buf;
@@ -252,48 +328,38 @@ void ReliableUdpServer::newConnectionInLoop(const UdpServerSocketPtr& socket,
              << "] - new connection [" << connName
              << "] from " << address.toIpPort();
 
-    ReliableUdpConnectionPtr conn(new ReliableUdpConnection(socket->getLoop(),
+    ReliableUdpConnectionPtr conn(new ReliableUdpConnection(shard.loop,
                 connName, listenAddr_, address, maxWindowSize_, mssSize_));
     conn->setConnectionCallback(connectionCallback_);
     conn->SetMessageCallback(messageCallback_);
-    conn->setCloseCallback(boost::bind(&ReliableUdpServer::removeConnection, shared_from_this(), convId, _1));
+    conn->setCloseCallback(boost::bind(&ReliableUdpServer::removeConnection, shared_from_this(), target, convId, _1));
     conn->setConnectionFlushCallback(boost::bind(&ReliableUdpServer::onConnectionFlush, shared_from_this(),
-                convId, socket, _1, _2, _3));
-    conn->setEstablishCallback(boost::bind(&ReliableUdpServer::onConnectionEstablishCallback, shared_from_this(), convId, address,  _1, _2));
+                convId, shard.socket, _1, _2, _3));
+    conn->setEstablishCallback(boost::bind(&ReliableUdpServer::onConnectionEstablishCallback, shared_from_this(),
+                target, origin, convId, address,  _1, _2));
     conn->setAckDelay(true, 1);
 
-    {
-        int connectionsIndex = convId % kConnectionsMapNum;
-        MutexLockGuard lock(mutex_[connectionsIndex]);
-        connectionsMaps_[connectionsIndex][convId] = conn;
-    }
-
-    if (socket->getLoop()->isInLoopThread()) {
-        conn->ConnectEstablished(message, len);
-    } else {
-        socket->getLoop()->queueInLoop(boost::bind(&ReliableUdpConnection::ConnectEstablished,
-                    conn, string(static_cast<const char*>(message), static_cast<int>(len))));
-    }
+    shard.connections[convId] = conn;
 
+    conn->ConnectEstablished(message, len);
 }
 
-void ReliableUdpServer::onConnectionEstablishCallback(uint64_t convId, const InetAddress& address,  const ReliableUdpConnectionPtr& conn, bool isSuccess) {
+// in the loop of target
+void ReliableUdpServer::onConnectionEstablishCallback(size_t target, size_t origin, uint64_t convId,
+        const InetAddress& address, const ReliableUdpConnectionPtr& conn, bool isSuccess) {
+    if (!isSuccess) {
+        shards_[target].connections.erase(convId);
+    }
 
-    if (loop_->isInLoopThread()) {
-        onConnectionEstablishCallbackInLoop(convId, address, conn, isSuccess);
+    EventLoop* ioLoop = shards_[origin].loop;
+    if (ioLoop->isInLoopThread()) {
+        onConnectionEstablishCallbackInLoop(origin, address);
     } else {
-        loop_->queueInLoop(boost::bind(&ReliableUdpServer::onConnectionEstablishCallbackInLoop, shared_from_this(), convId, address, conn, isSuccess));
+        ioLoop->queueInLoop(boost::bind(&ReliableUdpServer::onConnectionEstablishCallbackInLoop,
+                    shared_from_this(), origin, address));
     }
 }
 
-void ReliableUdpServer::onConnectionEstablishCallbackInLoop(uint64_t convId, const InetAddress& addres, const ReliableUdpConnectionPtr& conn, bool isSuccess) {
-
-    if (!isSuccess) {
-
-       int connectionIndex = convId % kConnectionsMapNum;
-       MutexLockGuard lock(mutex_[connectionIndex]);
-       connectionsMaps_[connectionIndex].erase(convId);
-    }
-    inConnectingIpPortSet_.erase(addres.toIpPort());
+void ReliableUdpServer::onConnectionEstablishCallbackInLoop(size_t origin, const InetAddress& addres) {
+    shards_[origin].inConnectingIpPortSet.erase(addres.toIpPort());
 }
-
@@ -7,6 +7,7 @@
 
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/random.hpp>
 #include <boost/unordered_set.hpp>
@@ -25,6 +26,9 @@
 
 
 namespace muduo {
+
+class CountDownLatch;
+
 namespace net {
 
 class EventLoop;
@@ -32,8 +36,11 @@ class EventLoopThreadPool;
 
 namespace rudp {
 
-const int kConnectionsMapNum = 32;
-
+// Each socket of the SO_REUSEPORT group has a loop, and the connections
+// made on it.  The conv index of a connection is chosen so that a BPF program
+// steers its datagrams to its socket, then a connection is handled in one
+// loop only.  Without the BPF program, datagrams received on a wrong socket
+// are forwarded to the right loop.
 class ReliableUdpServer : boost::noncopyable,
                           public boost::enable_shared_from_this<ReliableUdpServer> {
     public:
@@ -41,13 +48,14 @@ class ReliableUdpServer : boost::noncopyable,
         ReliableUdpServer(EventLoop* loop,
                          const InetAddress& listenAddr,
                          const string& nameArg,
-                         uint32_t serverId);
+                         uint32_t serverId);  // less than 2^31
         ~ReliableUdpServer();
         const string& ipPort() const { return ipPort_; }
         const string& name() const { return name_; }
         EventLoop* getLoop() const { return loop_; }
 
         void setThreadNum(int numThreads);
+        // a socket per loop by default
         void setSocketNum(int socketNum);
 
         void setMssSize(uint16_t mssSize);
@@ -66,31 +74,55 @@ class ReliableUdpServer : boost::noncopyable,
         void Start();
     private:
 
-        void newConnectionInLoop(const UdpServerSocketPtr& socket, const void* message,
-                std::size_t len, const InetAddress& address);
-        void newConnectionInLoop(const UdpServerSocketPtr& socket, const StringPiece& message,
-                const InetAddress& address);
-        void removeConnection(uint64_t convId, const ReliableUdpConnectionPtr& conn);
-        void removeConnectionInLoop(uint64_t convId, const ReliableUdpConnectionPtr& conn);
-        void handleUdpMessage(const UdpServerSocketPtr& socket,
+        typedef std::map<uint64_t, ReliableUdpConnectionPtr> ConnectionMap;
+        typedef std::set<string> InConnectingIpPortSet;
+
+        // of a socket, touched in its loop only
+        struct Shard {
+            Shard(EventLoop* ioLoop, uint32_t seed)
+                : loop(ioLoop), random(seed) {}
+
+            EventLoop* loop;
+            UdpServerSocketPtr socket;
+            ConnectionMap connections;
+            boost::random::mt19937 random;
+            std::set<uint32_t> convIndexs;
+            // handshakes received on this socket
+            InConnectingIpPortSet inConnectingIpPortSet;
+        };
+
+        static void destroyShard(Shard* shard, CountDownLatch* latch);
+
+        // in the loop of target, the handshake received in the loop of origin,
+        // convFlags of its convId kept in the new one
+        void newConnectionInLoop(size_t target, size_t origin, uint64_t convFlags,
+                const void* message, std::size_t len, const InetAddress& address);
+        void newConnectionInLoop(size_t target, size_t origin, uint64_t convFlags,
+                const StringPiece& message, const InetAddress& address);
+        void removeConnection(size_t index, uint64_t convId, const ReliableUdpConnectionPtr& conn);
+        void removeConnectionInLoop(size_t index, uint64_t convId, const ReliableUdpConnectionPtr& conn);
+        void handleUdpMessage(size_t index, const UdpServerSocketPtr& socket,
                 Buffer* buf, Timestamp, const InetAddress& address);
+        void handleForwardedMessage(size_t index, uint64_t convId, const StringPiece& message,
+                const InetAddress& address);
+        bool processMessage(size_t index, uint64_t convId, const void* message,
+                std::size_t len, const InetAddress& address);
 
-        uint64_t genConvId();
-        bool checkCrcchecksum(const void* buffer, std::size_t n);
+        uint64_t genConvId(size_t index, uint64_t convFlags);
+        // the socket of a conv index
+        size_t shardOf(uint32_t convIndex) const;
+        // CRC-16 or CRC32C, by the flag of convId
+        bool checkCrcchecksum(uint64_t convId, const void* buffer, std::size_t n);
 
-        void onConnectionEstablishCallback(uint64_t convId, const InetAddress& address,
-                const ReliableUdpConnectionPtr& conn, bool success);
-        void onConnectionEstablishCallbackInLoop(uint64_t convId, const InetAddress& addres,
-                const ReliableUdpConnectionPtr& conn, bool success);
+        void onConnectionEstablishCallback(size_t target, size_t origin, uint64_t convId,
+                const InetAddress& address, const ReliableUdpConnectionPtr& conn, bool success);
+        void onConnectionEstablishCallbackInLoop(size_t origin, const InetAddress& addres);
 
         void onConnectionReset(uint64_t convId, const UdpServerSocketPtr& socket,
                 const InetAddress& address);
         void onConnectionFlush(uint64_t convId, const UdpServerSocketPtr& socket,
                 const InetAddress& address, const void* data, std::size_t len);
     private:
-        typedef std::map<uint64_t, ReliableUdpConnectionPtr> ConnectionMap;
-        typedef std::set<string> InConnectingIpPortSet;
-
         EventLoop* loop_;
         const InetAddress listenAddr_;
         const string ipPort_;
@@ -102,23 +134,16 @@ class ReliableUdpServer : boost::noncopyable,
         uint16_t maxWindowSize_;
 
 
-        boost::random::mt19937 random_;
-        std::set<uint32_t> convIndexs_;
-
-
-        std::vector<UdpServerSocketPtr> sockets_;
         boost::shared_ptr<EventLoopThreadPool> threadPool_;
+        // destroyed before the loops of threadPool_
+        boost::ptr_vector<Shard> shards_;
+        AtomicInt32 nextShard_;
 
         ConnectionCallback connectionCallback_;
         MessageCallback messageCallback_;
 
         ThreadInitCallback threadInitCallback_;
         AtomicInt32 started_;
-
-        mutable MutexLock mutex_[kConnectionsMapNum];
-        ConnectionMap connectionsMaps_[kConnectionsMapNum];
-
-        InConnectingIpPortSet inConnectingIpPortSet_;
 };
 }
 }
@@ -93,6 +93,11 @@ class UdpServerSocket : boost::noncopyable, public boost::enable_shared_from_thi
             assert(size > 0);
             sendBufferSize_ = 0;
         }
+
+        // see UdpSocket::SteerReusePort(), once bound by Start()
+        int SteerReusePort(uint32_t offset, uint32_t groupSize) {
+            return socket_.SteerReusePort(offset, groupSize);
+        }
     private:
         // in loop execute
         void startInLoop();
@@ -1,12 +1,17 @@
 
 #include <netinet/ip.h>
 #include <netdb.h>
+#include <linux/filter.h>
 
 #include <muduo/base/Logging.h>
 
 
 #include "UdpSocket.h"
 
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
 #define HANDLE_EINTR(x) \
     ({ \
         decltype(x) eintrWrapperResult; \
@@ -204,6 +209,31 @@ int UdpSocket::SetSendBufferSize(int32_t size) {
 }
 
 
+int UdpSocket::SteerReusePort(uint32_t offset, uint32_t groupSize) {
+    assert(IsConnected());
+    assert(groupSize > 0);
+
+    // a datagram too short loads nothing and goes to the first socket
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, offset },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, groupSize },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog program;
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+
+    int rv = setsockopt(sockfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                        &program, sizeof(program));
+    int lastError = errno;
+    if (rv < 0) {
+        LOG_SYSERR << "::setsockopt SO_ATTACH_REUSEPORT_CBPF";
+    }
+
+    return rv == 0 ? 0 : lastError;
+}
+
+
 ssize_t UdpSocket::Read(void* buf, size_t len) {
     return RecvFrom(buf, len, NULL);
 }
@@ -126,6 +126,12 @@ struct SockaddrStorage {
             int SetReceiveBufferSize(int32_t size);
             int SetSendBufferSize(int32_t size);
 
+            // a datagram goes to the socket of index
+            // (big endian uint32 at offset of the payload) % groupSize
+            // in the SO_REUSEPORT group, in the order of binding,
+            // returns 0 or errno
+            int SteerReusePort(uint32_t offset, uint32_t groupSize);
+
             int sockfd() const { return sockfd_; }
 
             bool IsConnected() const { return sockfd_ != kInvalidSocket; }
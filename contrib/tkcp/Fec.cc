@@ -1,5 +1,7 @@
 #include <cassert>
 
+#include <algorithm>
+
 
 #include <muduo/base/Logging.h>
 
@@ -7,11 +9,12 @@
 #include "Coding.h"
 #include "TkcpDefine.h"
 #include "Packet.h"
+#include "ReedSolomon.h"
 
 namespace muduo {
 namespace net{
 
-Fec::Fec(int redundant)
+RedundantFec::RedundantFec(int redundant)
     : redundant_(redundant), 
       sendSeq_(0) {
     bzero(receivedSeqs_, sizeof(receivedSeqs_));
@@ -19,10 +22,10 @@ Fec::Fec(int redundant)
 
 }
 
-int Fec::Mtu() {
+int RedundantFec::Mtu() {
     return (UDP_MIN_MTU - packet::udp::kPacketHeadLength - (redundant_+1)*FecHeadLen) / (redundant_+1);
 }
-void Fec::Send(const char* data, size_t size) {
+void RedundantFec::Send(const char* data, size_t size) {
      assert(size <= static_cast<size_t>(Mtu()));
      sendBuffers_[0].retrieveAll();
      for (std::vector<Buffer>::size_type i = 0; i < sendBuffers_.size() - 1; ++i) {
@@ -39,7 +42,7 @@ void Fec::Send(const char* data, size_t size) {
 
 }
 
-void Fec::Input(const char* data, size_t size) {
+void RedundantFec::Input(const char* data, size_t size) {
     inputBuf_.append(data, size);
     while (inputBuf_.readableBytes() > 0) {
          uint16_t seq = DecodeUint16(&inputBuf_);
@@ -53,5 +56,212 @@ void Fec::Input(const char* data, size_t size) {
     }
     assert(inputBuf_.readableBytes() == 0);
 }
+namespace {
+
+uint16_t peekUint16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+}
+
+const int ReedSolomonFec::HeadLen;
+const int ReedSolomonFec::MaxShards;
+const int ReedSolomonFec::GroupWindow;
+
+ReedSolomonFec::ReedSolomonFec(int dataShards, int parityShards)
+    : dataShards_(dataShards),
+      parityShards_(parityShards),
+      encoder_(new ReedSolomon(dataShards, parityShards)),
+      sendGroup_(0),
+      sendIndex_(0),
+      sendShardSize_(0),
+      sendShards_((dataShards + parityShards) * shardCapacity()),
+      recovered_(0) {
+    assert(dataShards > 0 && parityShards > 0);
+    assert(dataShards + parityShards <= MaxShards);
+}
+
+ReedSolomonFec::~ReedSolomonFec() {
+}
+
+size_t ReedSolomonFec::shardCapacity() {
+    return UDP_MIN_MTU - packet::udp::kPacketHeadLength - HeadLen;
+}
+
+int ReedSolomonFec::Mtu() {
+    return static_cast<int>(shardCapacity() - sizeof(uint16_t));
+}
+
+void ReedSolomonFec::Send(const char* data, size_t size) {
+    assert(size <= static_cast<size_t>(Mtu()));
+    const size_t capacity = shardCapacity();
+    uint8_t* shard = &sendShards_[sendIndex_ * capacity];
+    shard[0] = static_cast<uint8_t>(size >> 8);
+    shard[1] = static_cast<uint8_t>(size);
+    ::memcpy(shard + sizeof(uint16_t), data, size);
+    size_t len = size + sizeof(uint16_t);
+    sendShard(sendIndex_, shard, len);
+    sendShardSize_ = std::max(sendShardSize_, len);
+
+    if (++sendIndex_ < dataShards_) {
+        return;
+    }
+
+    const uint8_t* dataShards[MaxShards];
+    uint8_t* parityShards[MaxShards];
+    for (int i = 0; i < dataShards_; ++i) {
+        uint8_t* p = &sendShards_[i * capacity];
+        size_t n = peekUint16(p) + sizeof(uint16_t);
+        ::memset(p + n, 0, sendShardSize_ - n);
+        dataShards[i] = p;
+    }
+    for (int i = 0; i < parityShards_; ++i) {
+        parityShards[i] = &sendShards_[(dataShards_ + i) * capacity];
+    }
+    encoder_->Encode(dataShards, parityShards, sendShardSize_);
+    for (int i = 0; i < parityShards_; ++i) {
+        sendShard(dataShards_ + i, parityShards[i], sendShardSize_);
+    }
+
+    ++sendGroup_;
+    sendIndex_ = 0;
+    sendShardSize_ = 0;
+}
+
+void ReedSolomonFec::sendShard(int index, const uint8_t* shard, size_t len) {
+    outBuffer_.retrieveAll();
+    EncodeUint16(&outBuffer_, sendGroup_);
+    EncodeUint8(&outBuffer_, static_cast<uint8_t>(index));
+    EncodeUint8(&outBuffer_, static_cast<uint8_t>(dataShards_));
+    EncodeUint8(&outBuffer_, static_cast<uint8_t>(parityShards_));
+    outBuffer_.append(shard, len);
+    sendOutCallback_(outBuffer_.peek(), outBuffer_.readableBytes());
+}
+
+void ReedSolomonFec::Input(const char* data, size_t size) {
+    if (size < static_cast<size_t>(HeadLen)) {
+        return;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    uint16_t seq = peekUint16(p);
+    int index = p[2];
+    int dataShards = p[3];
+    int parityShards = p[4];
+    const uint8_t* shard = p + HeadLen;
+    size_t len = size - HeadLen;
+    if (dataShards == 0 || parityShards == 0 || dataShards + parityShards > MaxShards
+        || index >= dataShards + parityShards || len > shardCapacity()) {
+        LOG_WARN << "ReedSolomonFec::Input bad shard " << index << " of "
+                 << dataShards << "+" << parityShards << ", " << len << " bytes";
+        return;
+    }
+    bool isData = index < dataShards;
+    if (isData && (len < sizeof(uint16_t) || peekUint16(shard) + sizeof(uint16_t) > len)) {
+        return;
+    }
+
+    Group* group = groupOf(seq, dataShards, parityShards);
+    if (group == NULL) {
+        // too old to recover, kcp drops it if a duplicate
+        if (isData) {
+            recvOutCallback_(reinterpret_cast<const char*>(shard) + sizeof(uint16_t), peekUint16(shard));
+        }
+        return;
+    }
+    if (group->present[index]) {
+        return;
+    }
+    group->present[index] = true;
+    ++group->received;
+    ::memcpy(&group->shards[index * shardCapacity()], shard, len);
+
+    if (isData) {
+        // delivered already if rebuilt
+        if (!group->done) {
+            recvOutCallback_(reinterpret_cast<const char*>(shard) + sizeof(uint16_t), peekUint16(shard));
+        }
+    } else {
+        group->shardSize = len;
+    }
+
+    if (!group->done && group->received >= dataShards) {
+        recover(group);
+    }
+}
+
+ReedSolomonFec::Group* ReedSolomonFec::groupOf(uint16_t seq, int dataShards, int parityShards) {
+    Group* group = &groups_[seq % GroupWindow];
+    if (group->used && group->seq == seq) {
+        if (group->dataShards != dataShards || group->parityShards != parityShards) {
+            return NULL;
+        }
+        return group;
+    }
+    if (group->used && static_cast<int16_t>(seq - group->seq) < 0) {
+        return NULL;
+    }
+
+    group->seq = seq;
+    group->used = true;
+    group->done = false;
+    group->dataShards = dataShards;
+    group->parityShards = parityShards;
+    group->received = 0;
+    group->shardSize = 0;
+    ::memset(group->present, 0, sizeof(group->present));
+    group->shards.resize((dataShards + parityShards) * shardCapacity());
+    return group;
+}
+
+void ReedSolomonFec::recover(Group* group) {
+    group->done = true;
+    const int dataShards = group->dataShards;
+    const size_t capacity = shardCapacity();
+
+    int missing = 0;
+    for (int i = 0; i < dataShards; ++i) {
+        if (!group->present[i]) {
+            ++missing;
+        }
+    }
+    if (missing == 0) {
+        return;
+    }
+
+    // of the longest segment, padded with zeros
+    const size_t shardSize = group->shardSize;
+    assert(shardSize > 0);
+    uint8_t* shards[MaxShards];
+    for (int i = 0; i < dataShards + group->parityShards; ++i) {
+        shards[i] = &group->shards[i * capacity];
+        if (i < dataShards && group->present[i]) {
+            size_t n = peekUint16(shards[i]) + sizeof(uint16_t);
+            if (n > shardSize) {
+                return;
+            }
+            ::memset(shards[i] + n, 0, shardSize - n);
+        }
+    }
+
+    if (!decoder_ || decoder_->DataShards() != dataShards
+        || decoder_->ParityShards() != group->parityShards) {
+        decoder_.reset(new ReedSolomon(dataShards, group->parityShards));
+    }
+    if (!decoder_->Reconstruct(shards, group->present, shardSize)) {
+        return;
+    }
+
+    for (int i = 0; i < dataShards; ++i) {
+        if (group->present[i]) {
+            continue;
+        }
+        size_t n = peekUint16(shards[i]);
+        if (n + sizeof(uint16_t) <= shardSize) {
+            ++recovered_;
+            recvOutCallback_(reinterpret_cast<const char*>(shards[i]) + sizeof(uint16_t), n);
+        }
+    }
+}
+
 }
 }
@@ -2,9 +2,12 @@
 
 #include <cstdint>
 #include <stdlib.h>
+#include <string.h>
 
 #include <boost/unordered_set.hpp>
 #include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <vector>
 
 #include <muduo/net/Buffer.h>
@@ -12,8 +15,28 @@
 namespace  muduo {
 namespace net {
 
+class ReedSolomon;
+
 typedef boost::function<void(const char*, size_t)> FecOutCallback;
-class Fec {
+
+// Between kcp and the udp socket, Send() takes a kcp segment of at most
+// Mtu() bytes, Input() takes a datagram of the peer.
+class Fec : boost::noncopyable {
+    public:
+        virtual ~Fec() {}
+        virtual int Mtu() = 0;
+        virtual void Send(const char* data, size_t size) = 0;
+        virtual void Input(const char* data, size_t size) = 0;
+        void setSendOutCallback(const FecOutCallback& cb) { sendOutCallback_ = cb; }
+        void setRecvOutCallback(const FecOutCallback& cb) { recvOutCallback_ = cb; }
+
+    protected:
+        FecOutCallback sendOutCallback_;
+        FecOutCallback recvOutCallback_;
+};
+
+// A datagram carries the segment and the previous redundant segments again.
+class RedundantFec : public Fec {
     private:
         int redundant_;
         uint16_t sendSeq_;
@@ -21,8 +44,6 @@ class Fec {
         uint16_t receivedSeqs_[ReceivedSeqsLen];
 
 
-        FecOutCallback sendOutCallback_;
-        FecOutCallback recvOutCallback_;
         Buffer inputBuf_;
 
         std::vector<Buffer> sendBuffers_;
@@ -32,12 +53,69 @@ class Fec {
     public:
         const static int FecHeadLen = sizeof(uint16_t) + sizeof(uint16_t);
     public:
-        Fec(int redundant = 0);
+        RedundantFec(int redundant = 0);
         int Mtu();
         void Send(const char* data, size_t size);
         void Input(const char* data, size_t size);
-        void setSendOutCallback(const FecOutCallback& cb) { sendOutCallback_ = cb; }
-        void setRecvOutCallback(const FecOutCallback& cb) { recvOutCallback_ = cb; }
+};
+
+// Every dataShards segments are followed by parityShards parity datagrams of
+// Reed-Solomon, any dataShards of a group rebuild the lost segments.
+// Segments are sent as they come, a group not full is not protected.
+//
+// A datagram is [group:2][index:1][dataShards:1][parityShards:1] then a
+// segment as [len:2][data] or a parity shard of the longest of the group.
+class ReedSolomonFec : public Fec {
+    public:
+        const static int HeadLen = 5;
+        const static int MaxShards = 64;
+        // groups kept for recovery
+        const static int GroupWindow = 16;
+
+        ReedSolomonFec(int dataShards, int parityShards);
+        ~ReedSolomonFec();
+        int Mtu();
+        void Send(const char* data, size_t size);
+        void Input(const char* data, size_t size);
+
+        // segments delivered by recovery
+        int64_t Recovered() const { return recovered_; }
+
+    private:
+        struct Group {
+            Group() : seq(0), used(false), done(false), dataShards(0), parityShards(0),
+                      received(0), shardSize(0) {
+                ::memset(present, 0, sizeof(present));
+            }
+            uint16_t seq;
+            bool used;
+            bool done;
+            int dataShards;
+            int parityShards;
+            int received;
+            size_t shardSize;  // of parity shards, 0 if none received
+            bool present[MaxShards];
+            std::vector<uint8_t> shards;  // of shardCapacity() each
+        };
+
+        static size_t shardCapacity();
+        void sendShard(int index, const uint8_t* shard, size_t len);
+        Group* groupOf(uint16_t seq, int dataShards, int parityShards);
+        void recover(Group* group);
+
+        const int dataShards_;
+        const int parityShards_;
+        boost::scoped_ptr<ReedSolomon> encoder_;
+        boost::scoped_ptr<ReedSolomon> decoder_;
+
+        uint16_t sendGroup_;
+        int sendIndex_;
+        size_t sendShardSize_;
+        std::vector<uint8_t> sendShards_;
+        Buffer outBuffer_;
+
+        Group groups_[GroupWindow];
+        int64_t recovered_;
 };
 }
 }
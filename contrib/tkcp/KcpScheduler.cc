@@ -0,0 +1,67 @@
+#include <assert.h>
+
+#include <boost/bind.hpp>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+
+#include "KcpScheduler.h"
+#include "TkcpConnection.h"
+
+namespace muduo {
+namespace net {
+
+KcpScheduler::KcpScheduler(EventLoop* loop)
+    : loop_(CHECK_NOTNULL(loop)) {
+}
+
+KcpScheduler::~KcpScheduler() {
+    if (timerTime_.valid()) {
+        loop_->cancel(timer_);
+    }
+}
+
+void KcpScheduler::Add(Timestamp when, TkcpConnection* conn) {
+    loop_->assertInLoopThread();
+    bool inserted = entries_.insert(Entry(when, conn)).second;
+    (void)inserted;
+    assert(inserted);
+    arm(when);
+}
+
+void KcpScheduler::Remove(Timestamp when, TkcpConnection* conn) {
+    loop_->assertInLoopThread();
+    size_t n = entries_.erase(Entry(when, conn));
+    (void)n;
+    assert(n == 1);
+    // the timer is left armed, it finds nothing due
+}
+
+void KcpScheduler::arm(Timestamp when) {
+    if (timerTime_.valid()) {
+        if (!(when < timerTime_)) {
+            return;
+        }
+        loop_->cancel(timer_);
+    }
+    timerTime_ = when;
+    timer_ = loop_->runAt(when, boost::bind(&KcpScheduler::onTimer, this));
+}
+
+void KcpScheduler::onTimer() {
+    timerTime_ = Timestamp::invalid();
+    Timestamp now(Timestamp::now());
+    // one at a time, a session may add itself again, later than now, or
+    // remove others
+    while (!entries_.empty() && !(now < entries_.begin()->first)) {
+        TkcpConnection* conn = entries_.begin()->second;
+        entries_.erase(entries_.begin());
+        conn->onKcpDue(now);
+    }
+    if (!entries_.empty()) {
+        arm(entries_.begin()->first);
+    }
+}
+
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <set>
+#include <utility>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/TimerId.h>
+
+namespace muduo {
+namespace net {
+
+class EventLoop;
+class TkcpConnection;
+
+// The kcp sessions of a loop, ordered by when ikcp_check() says they are
+// due, with one timer of the loop for the earliest of them instead of a
+// timer of each.  A session with nothing to send, resend or acknowledge is
+// not in it at all, until it inputs or sends again.
+class KcpScheduler : boost::noncopyable {
+    public:
+        explicit KcpScheduler(EventLoop* loop);
+        // in the loop
+        ~KcpScheduler();
+
+        EventLoop* getLoop() const { return loop_; }
+        size_t Size() const { return entries_.size(); }
+
+        // in the loop, a session is in once at most
+        void Add(Timestamp when, TkcpConnection* conn);
+        void Remove(Timestamp when, TkcpConnection* conn);
+
+    private:
+        typedef std::pair<Timestamp, TkcpConnection*> Entry;
+        typedef std::set<Entry> EntrySet;
+
+        void arm(Timestamp when);
+        void onTimer();
+
+        EventLoop* loop_;
+        EntrySet entries_;
+        TimerId timer_;
+        // of timer_, invalid if not armed
+        Timestamp timerTime_;
+};
+
+typedef boost::shared_ptr<KcpScheduler> KcpSchedulerPtr;
+
+}
+}
@@ -76,6 +76,14 @@ enum UdpPacketId {
     kData          = 104,
 };
 
+// an optional byte after kConnectSyn, the FEC the client is able to use,
+// and after kConnectSynAck, the one the server agrees on.  Peers not
+// knowing it ignore it, and use kFecRedundant.
+enum FecModeE {
+    kFecRedundant = 0,
+    kFecReedSolomon = 1,
+};
+
 string PacketIdToString(uint8_t packetId);
 
 } // namespace udp
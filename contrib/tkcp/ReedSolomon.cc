@@ -0,0 +1,237 @@
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "ReedSolomon.h"
+
+namespace muduo {
+namespace net {
+
+namespace {
+
+// GF(2^8) of x^8 + x^4 + x^3 + x^2 + 1, generated by 2
+struct GaloisField {
+    GaloisField() {
+        int x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = exp[i + 255] = static_cast<uint8_t>(x);
+            log[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11d;
+            }
+        }
+        log[0] = 0;
+
+        // c * x = c * low nibble of x ^ c * high nibble of x
+        for (int c = 0; c < 256; ++c) {
+            for (int n = 0; n < 16; ++n) {
+                low[c][n] = mul(static_cast<uint8_t>(c), static_cast<uint8_t>(n));
+                high[c][n] = mul(static_cast<uint8_t>(c), static_cast<uint8_t>(n << 4));
+            }
+        }
+    }
+
+    uint8_t mul(uint8_t a, uint8_t b) const {
+        return (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+    }
+
+    uint8_t inverse(uint8_t a) const {
+        assert(a != 0);
+        return exp[255 - log[a]];
+    }
+
+    uint8_t power(uint8_t a, int n) const {
+        if (n == 0) {
+            return 1;
+        }
+        return a == 0 ? 0 : exp[(log[a] * n) % 255];
+    }
+
+    uint8_t exp[510];
+    uint8_t log[256];
+    uint8_t low[256][16] __attribute__((aligned(16)));
+    uint8_t high[256][16] __attribute__((aligned(16)));
+};
+
+const GaloisField gf;
+
+// n x n, returns false if singular
+bool invert(std::vector<uint8_t>* matrix, int n) {
+    std::vector<uint8_t>& m = *matrix;
+    std::vector<uint8_t> result(n * n, 0);
+    for (int i = 0; i < n; ++i) {
+        result[i * n + i] = 1;
+    }
+
+    for (int col = 0; col < n; ++col) {
+        int pivot = col;
+        while (pivot < n && m[pivot * n + col] == 0) {
+            ++pivot;
+        }
+        if (pivot == n) {
+            return false;
+        }
+        if (pivot != col) {
+            for (int k = 0; k < n; ++k) {
+                std::swap(m[pivot * n + k], m[col * n + k]);
+                std::swap(result[pivot * n + k], result[col * n + k]);
+            }
+        }
+
+        uint8_t scale = gf.inverse(m[col * n + col]);
+        for (int k = 0; k < n; ++k) {
+            m[col * n + k] = gf.mul(m[col * n + k], scale);
+            result[col * n + k] = gf.mul(result[col * n + k], scale);
+        }
+
+        for (int row = 0; row < n; ++row) {
+            uint8_t factor = m[row * n + col];
+            if (row == col || factor == 0) {
+                continue;
+            }
+            for (int k = 0; k < n; ++k) {
+                m[row * n + k] ^= gf.mul(factor, m[col * n + k]);
+                result[row * n + k] ^= gf.mul(factor, result[col * n + k]);
+            }
+        }
+    }
+    m.swap(result);
+    return true;
+}
+
+}
+
+const int ReedSolomon::kMaxShards;
+
+ReedSolomon::ReedSolomon(int dataShards, int parityShards)
+    : dataShards_(dataShards),
+      parityShards_(parityShards) {
+    assert(dataShards > 0 && parityShards > 0);
+    assert(dataShards + parityShards <= kMaxShards);
+
+    const int total = TotalShards();
+    std::vector<uint8_t> vandermonde(total * dataShards_);
+    for (int r = 0; r < total; ++r) {
+        for (int c = 0; c < dataShards_; ++c) {
+            vandermonde[r * dataShards_ + c] = gf.power(static_cast<uint8_t>(r), c);
+        }
+    }
+
+    // times the inverse of the top square, the data shards are themselves
+    std::vector<uint8_t> top(vandermonde.begin(), vandermonde.begin() + dataShards_ * dataShards_);
+    bool invertible = invert(&top, dataShards_);
+    (void)invertible;
+    assert(invertible);
+
+    matrix_.assign(total * dataShards_, 0);
+    for (int r = 0; r < total; ++r) {
+        for (int c = 0; c < dataShards_; ++c) {
+            uint8_t v = 0;
+            for (int k = 0; k < dataShards_; ++k) {
+                v ^= gf.mul(vandermonde[r * dataShards_ + k], top[k * dataShards_ + c]);
+            }
+            matrix_[r * dataShards_ + c] = v;
+        }
+    }
+}
+
+void ReedSolomon::Encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const {
+    for (int p = 0; p < parityShards_; ++p) {
+        const uint8_t* row = &matrix_[(dataShards_ + p) * dataShards_];
+        ::memset(parity[p], 0, len);
+        for (int j = 0; j < dataShards_; ++j) {
+            MulAdd(parity[p], data[j], row[j], len);
+        }
+    }
+}
+
+bool ReedSolomon::Reconstruct(uint8_t* const* shards, const bool* present, size_t len) const {
+    // the first dataShards present
+    std::vector<int> rows;
+    rows.reserve(dataShards_);
+    for (int i = 0; i < TotalShards() && static_cast<int>(rows.size()) < dataShards_; ++i) {
+        if (present[i]) {
+            rows.push_back(i);
+        }
+    }
+    if (static_cast<int>(rows.size()) < dataShards_) {
+        return false;
+    }
+
+    std::vector<uint8_t> decode(dataShards_ * dataShards_);
+    for (int r = 0; r < dataShards_; ++r) {
+        ::memcpy(&decode[r * dataShards_], &matrix_[rows[r] * dataShards_], dataShards_);
+    }
+    if (!invert(&decode, dataShards_)) {
+        return false;
+    }
+
+    for (int i = 0; i < dataShards_; ++i) {
+        if (present[i]) {
+            continue;
+        }
+        ::memset(shards[i], 0, len);
+        for (int j = 0; j < dataShards_; ++j) {
+            MulAdd(shards[i], shards[rows[j]], decode[i * dataShards_ + j], len);
+        }
+    }
+    return true;
+}
+
+void ReedSolomon::MulAdd(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+    if (c == 0) {
+        return;
+    }
+
+    size_t i = 0;
+    if (c == 1) {
+        for (; i < len; ++i) {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+
+#if defined(__AVX2__)
+    const __m256i low = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(gf.low[c])));
+    const __m256i high = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(gf.high[c])));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i l = _mm256_shuffle_epi8(low, _mm256_and_si256(s, mask));
+        __m256i h = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+        d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), d);
+    }
+#elif defined(__SSSE3__)
+    const __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(gf.low[c]));
+    const __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(gf.high[c]));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i l = _mm_shuffle_epi8(low, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), d);
+    }
+#endif
+    const uint8_t* lowTable = gf.low[c];
+    const uint8_t* highTable = gf.high[c];
+    for (; i < len; ++i) {
+        dst[i] ^= static_cast<uint8_t>(lowTable[src[i] & 0x0f] ^ highTable[src[i] >> 4]);
+    }
+}
+
+}
+}
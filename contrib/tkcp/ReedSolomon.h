@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace muduo {
+namespace net {
+
+// Systematic Reed-Solomon erasure code over GF(256), the encoding matrix is
+// a Vandermonde matrix made systematic, so that any dataShards of the
+// shards rebuild the others.
+//
+// Shards are of the same length, the region multiplication is with PSHUFB
+// nibble tables under SSSE3 or AVX2.
+class ReedSolomon : boost::noncopyable {
+    public:
+        static const int kMaxShards = 256;
+
+        ReedSolomon(int dataShards, int parityShards);
+
+        int DataShards() const { return dataShards_; }
+        int ParityShards() const { return parityShards_; }
+        int TotalShards() const { return dataShards_ + parityShards_; }
+
+        // parity[i] of len bytes, from data[0, dataShards)
+        void Encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const;
+
+        // rebuilds the data shards not present from any dataShards of
+        // shards[0, totalShards), all of len bytes, parity shards are left
+        // alone, returns false if too few are present
+        bool Reconstruct(uint8_t* const* shards, const bool* present, size_t len) const;
+
+        // dst ^= c * src
+        static void MulAdd(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len);
+
+    private:
+        const int dataShards_;
+        const int parityShards_;
+        // totalShards x dataShards, identity on top
+        std::vector<uint8_t> matrix_;
+};
+
+}
+}
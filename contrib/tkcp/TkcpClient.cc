@@ -28,6 +28,8 @@ TkcpClient::TkcpClient(EventLoop* loop,
       name_(nameArg),
       peerAddress_(peerAddress),
       redundant_(redundant),
+      fecDataShards_(0),
+      fecParityShards_(0),
       tcpClient_(loop_, peerAddress, nameArg),
       socket_(new UdpClientSocket(loop_, "tkcp")){
     tcpClient_.setConnectionCallback(boost::bind(&TkcpClient::newTcpConnection, this, _1));
@@ -74,6 +76,7 @@ void TkcpClient::newTcpConnection(const TcpConnectionPtr& conn) {
         conn->setConnectionCallback(boost::bind(&TkcpConnection::onTcpConnection, conn_, _1));
         conn->setMessageCallback(boost::bind(&TkcpConnection::onTcpMessage, conn_, _1, _2, _3));
 
+        conn_->SetFecShards(fecDataShards_, fecParityShards_);
         conn_->SetTkcpConnectionCallback(connectionCallback_);
         conn_->SetTkcpMessageCallback(messageCallback_);
         conn_->SetTkcpCloseCallback(boost::bind(&TkcpClient::removeTckpconnection, this, _1));
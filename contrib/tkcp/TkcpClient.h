@@ -54,6 +54,12 @@ class TkcpClient : public boost::noncopyable {
             messageCallback_ = cb ;
         }
 
+        // see TkcpConnection::SetFecShards()
+        void SetFecShards(int dataShards, int parityShards) {
+            fecDataShards_ = dataShards;
+            fecParityShards_ = parityShards;
+        }
+
 
 
     public:
@@ -73,6 +79,8 @@ class TkcpClient : public boost::noncopyable {
         const string name_;
         InetAddress peerAddress_;
         int redundant_;
+        int fecDataShards_;
+        int fecParityShards_;
 
         TkcpConnectionCallback connectionCallback_;
         TkcpMessageCallback messageCallback_;
@@ -22,10 +22,6 @@ namespace net {
 
 
 const int kMicroSecondsPerMillissecond = 1000;
-const int kMillissecondsPerSecond = 1000;
-static double MillisecondToSecond(int millisecond) {
-    return static_cast<double>(millisecond) / kMillissecondsPerSecond;
-}
 
 
 static uint32_t TimestampToMillisecond(const Timestamp time) {
@@ -64,11 +60,14 @@ TkcpConnection::TkcpConnection(uint32_t conv,
       kcpInited_(false),
       kcpcb_(NULL),
       kcpRecvBuf_(2048),
+      fecDataShards_(0),
+      fecParityShards_(0),
+      fecMode_(packet::udp::kFecRedundant),
       trySendConnectSynTimes(0),
       udpAvailble_(true),
       kcpState_(0){
 
-    fec_.reset(new Fec(redundant));
+    fec_.reset(new RedundantFec(redundant));
     fec_->setSendOutCallback(boost::bind(&TkcpConnection::onFecSendData, this, _1, _2));
     fec_->setRecvOutCallback(boost::bind(&TkcpConnection::onFecRecvData, this, _1, _2));
 
@@ -77,6 +76,7 @@ TkcpConnection::TkcpConnection(uint32_t conv,
 
 TkcpConnection::~TkcpConnection() {
     assert(kcpcb_ == NULL);
+    assert(!kcpDue_.valid());
 
     LOG_DEBUG << "TkcpConnection::dtor[" << name_ << "] at" << this
               << " state=" << stateToString();
@@ -152,9 +152,7 @@ void TkcpConnection::SendInLoop(const void *data, size_t len) {
 
 void TkcpConnection::sendKcpMsg(const void *data, size_t len) {
     ikcp_send(kcpcb_, static_cast<const char*>(data), static_cast<int>(len));
-    if (!(kcpState_ & KcpStateE::kUpdating)) {
-        postImmediatelyUpdateKcp();
-    }
+    postFlushKcp();
 }
 
 void TkcpConnection::sendTcpMsg(const void *data, size_t len) {
@@ -215,10 +213,10 @@ void TkcpConnection::InputUdpMessage(Buffer* buf, const InetAddress& peerAddress
             buf->retrieveAll();
             break;
         case packet::udp::kConnectSyn:
-            onConnectSyn();
+            onConnectSyn(buf);
             break;
         case packet::udp::kConnectSynAck:
-            onConnectSyncAck();
+            onConnectSyncAck(buf);
             break;
         case packet::udp::kPingRequest:
             onPingRequest();
@@ -232,18 +230,37 @@ void TkcpConnection::InputUdpMessage(Buffer* buf, const InetAddress& peerAddress
     }
 }
 
-void TkcpConnection::onConnectSyn() {
+void TkcpConnection::onConnectSyn(Buffer* buf) {
+    // server, kcp is made on the kTransportMode after this
+    if (buf->readableBytes() >= sizeof(uint8_t)
+        && DecodeUint8(buf) == packet::udp::kFecReedSolomon
+        && fecDataShards_ > 0
+        && state_ == kTcpConnected
+        && fecMode_ != packet::udp::kFecReedSolomon) {
+        useReedSolomonFec();
+    }
+    buf->retrieveAll();
+
     Buffer sendbuf(8);
     EncodeUint32(&sendbuf, conv_);
     EncodeUint8(&sendbuf, packet::udp::kConnectSynAck);
+    if (fecMode_ == packet::udp::kFecReedSolomon) {
+        EncodeUint8(&sendbuf, packet::udp::kFecReedSolomon);
+    }
 
     udpOutputCallback_(shared_from_this(), sendbuf.peek(), sendbuf.readableBytes());
 }
 
-void TkcpConnection::onConnectSyncAck() {
+void TkcpConnection::onConnectSyncAck(Buffer* buf) {
      if (state_ != kUdpConnectSynSend) {
         return;
     }
+    if (buf->readableBytes() >= sizeof(uint8_t)
+        && DecodeUint8(buf) == packet::udp::kFecReedSolomon
+        && fecDataShards_ > 0) {
+        useReedSolomonFec();
+    }
+    buf->retrieveAll();
     initKcp(); // client
     udpPingTimer_ = loop_->runEvery(60, boost::bind(&TkcpConnection::udpPingRequest, this));
     tcpPingTimer_ = loop_->runAfter(120, boost::bind(&TkcpConnection::tcpPingRequest, this));
@@ -270,11 +287,29 @@ void TkcpConnection::initKcp() {
     ikcp_nodelay(kcpcb_, 1, 200, 2, 1);
     ikcp_wndsize(kcpcb_, 128, 128);
     ikcp_setmtu(kcpcb_, fec_->Mtu());
+    if (!kcpScheduler_) {
+        kcpScheduler_.reset(new KcpScheduler(loop_));
+    }
+    Timestamp now(Timestamp::now());
+    ikcp_update(kcpcb_, TimestampToMillisecond(now));
+    scheduleKcp(now);
+}
 
+void TkcpConnection::SetFecShards(int dataShards, int parityShards) {
+    assert(dataShards >= 0 && parityShards >= 0);
+    assert(dataShards == 0 || parityShards > 0);
+    assert(dataShards + parityShards <= ReedSolomonFec::MaxShards);
+    fecDataShards_ = dataShards;
+    fecParityShards_ = parityShards;
+}
 
-    nextKcpTime_ = ikcp_update(kcpcb_, TimestampToMillisecond(Timestamp::now()));
-    updateKcpTimer_ = loop_->runEvery(MillisecondToSecond(50),
-                    boost::bind(&TkcpConnection::onUpdateKcp, this));
+void TkcpConnection::useReedSolomonFec() {
+    assert(kcpcb_ == NULL);
+    LOG_DEBUG << name_ << " Reed-Solomon FEC " << fecDataShards_ << "+" << fecParityShards_;
+    fec_.reset(new ReedSolomonFec(fecDataShards_, fecParityShards_));
+    fec_->setSendOutCallback(boost::bind(&TkcpConnection::onFecSendData, this, _1, _2));
+    fec_->setRecvOutCallback(boost::bind(&TkcpConnection::onFecRecvData, this, _1, _2));
+    fecMode_ = packet::udp::kFecReedSolomon;
 }
 
 void TkcpConnection::onPingRequest() {
@@ -307,7 +342,9 @@ void TkcpConnection::onUdpData(const char* buf, size_t len) {
 
 void TkcpConnection::onFecRecvData(const char* data, size_t len) {
     ikcp_input(kcpcb_, data, static_cast<int>(len));
-    immediatelyUpdateKcp();
+    recvKcp();
+    // the acks, with what is sent in the meantime
+    postFlushKcp();
 }
 
 
@@ -333,7 +370,7 @@ void TkcpConnection::onTcpConnection(const TcpConnectionPtr& conn) {
 
         loop_->cancel(udpPingTimer_);
         loop_->cancel(tcpPingTimer_);
-        loop_->cancel(updateKcpTimer_);
+        unscheduleKcp();
 
         TkcpConnectionPtr guardThis(shared_from_this());
         tkcpConnectionCallback_(guardThis);
@@ -413,6 +450,9 @@ void TkcpConnection::sendConnectSyn(){
     Buffer sendbuf(8);
     EncodeUint32(&sendbuf, conv_);
     EncodeUint8(&sendbuf, packet::udp::kConnectSyn);
+    if (fecDataShards_ > 0) {
+        EncodeUint8(&sendbuf, packet::udp::kFecReedSolomon);
+    }
     udpOutputCallback_(shared_from_this(), sendbuf.peek(), sendbuf.readableBytes());
     connectSyncAckTimer_ = loop_->runAfter(1.0,
                                            boost::bind(&TkcpConnection::sendConnectSyn, this));
@@ -477,12 +517,12 @@ void TkcpConnection::ConnectDestroyed() {
 
         loop_->cancel(udpPingTimer_);
         loop_->cancel(tcpPingTimer_);
-        loop_->cancel(updateKcpTimer_ );
 
         setState(kDisconnected);
         tkcpConnectionCallback_(shared_from_this());
     }
     tcpConnectionPtr_.reset();
+    unscheduleKcp();
     if (kcpcb_ != NULL) {
         ikcp_release(kcpcb_);
         kcpcb_ = NULL;
@@ -507,71 +547,69 @@ void TkcpConnection::Close() {
     forceClose();
 }
 
-/*
-            onUpdateKcp();
-            void immediatelyUpdateKcp();
-            void immediatelyUpdateKcp(uint32_t now);
-            void postImmediatelyUpdateKcp();
-            void updateKcp(uint32_t now, bool fromeTimer);
 
+
+void TkcpConnection::onKcpDue(Timestamp now) {
+    // removed from kcpScheduler_ already
+    kcpDue_ = Timestamp::invalid();
+    ikcp_update(kcpcb_, TimestampToMillisecond(now));
+    scheduleKcp(now);
+}
+
+void TkcpConnection::recvKcp() {
     int nr = ikcp_recv(kcpcb_, kcpRecvBuf_.beginWrite(), static_cast<int>(kcpRecvBuf_.writableBytes()));
-    if (nr > 0) {
-        kcpRecvBuf_.hasWritten(nr);
-        tkcpMessageCallback_(shared_from_this(), &kcpRecvBuf_);
-        kcpRecvBuf_.retrieveAll();
-    } else if (nr == -3) {
-        int size = ikcp_peeksize(kcpcb_);
-        kcpRecvBuf_.ensureWritableBytes(static_cast<size_t>(size));
-        nr = ikcp_recv(kcpcb_, kcpRecvBuf_.beginWrite(), static_cast<int>(kcpRecvBuf_.writableBytes()));
+    while (nr != -1) {
         if (nr > 0) {
             kcpRecvBuf_.hasWritten(nr);
             tkcpMessageCallback_(shared_from_this(), &kcpRecvBuf_);
             kcpRecvBuf_.retrieveAll();
+        } else {
+            int size = ikcp_peeksize(kcpcb_);
+            kcpRecvBuf_.ensureWritableBytes(static_cast<size_t>(size));
         }
+        nr = ikcp_recv(kcpcb_, kcpRecvBuf_.beginWrite(), static_cast<int>(kcpRecvBuf_.writableBytes()));
     }
-*/
-
+}
 
-void TkcpConnection::onUpdateKcp() {
-    uint32_t current = TimestampToMillisecond(Timestamp::now());
-    if (current > nextKcpTime_) {
-        updateKcp(current);
+// once a loop iteration, whatever was input and sent in it
+void TkcpConnection::postFlushKcp() {
+    if (!(kcpState_ & KcpStateE::kPosting)) {
+        kcpState_ |= KcpStateE::kPosting;
+        loop_->queueInLoop(boost::bind(&TkcpConnection::flushKcp, shared_from_this()));
     }
 }
-void TkcpConnection::immediatelyUpdateKcp() {
-    uint32_t current =TimestampToMillisecond(Timestamp::now());
-    immediatelyUpdateKcp(current);
-}
 
-void TkcpConnection::immediatelyUpdateKcp(uint32_t current) {
+void TkcpConnection::flushKcp() {
     kcpState_ &= ~KcpStateE::kPosting;
-    updateKcp(current);
+    if (kcpcb_ == NULL || state_ == kDisconnected) {
+        return;
+    }
+    Timestamp now(Timestamp::now());
+    // ikcp_update() flushes on its interval only
+    kcpcb_->current = TimestampToMillisecond(now);
+    ikcp_flush(kcpcb_);
+    scheduleKcp(now);
 }
 
-void TkcpConnection::postImmediatelyUpdateKcp() {
-    if (!(kcpState_ & KcpStateE::kPosting)) {
-        kcpState_ |= KcpStateE::kPosting;
-        loop_->queueInLoop(boost::bind(&TkcpConnection::immediatelyUpdateKcp, shared_from_this()));
+void TkcpConnection::scheduleKcp(Timestamp now) {
+    unscheduleKcp();
+    if (ikcp_waitsnd(kcpcb_) == 0 && kcpcb_->ackcount == 0 && kcpcb_->probe == 0) {
+        return;
+    }
+    uint32_t current = TimestampToMillisecond(now);
+    int32_t wait = static_cast<int32_t>(ikcp_check(kcpcb_, current) - current);
+    if (wait < 1) {
+        wait = 1;
     }
+    kcpDue_ = Timestamp(now.microSecondsSinceEpoch() + wait * kMicroSecondsPerMillissecond);
+    kcpScheduler_->Add(kcpDue_, this);
 }
 
-void TkcpConnection::updateKcp(uint32_t current) {
-    kcpState_ |= KcpStateE::kUpdating;
-    int nr = ikcp_recv(kcpcb_, kcpRecvBuf_.beginWrite(), static_cast<int>(kcpRecvBuf_.writableBytes()));;
-    while (nr != -1) {
-        if (nr > 0) {
-            kcpRecvBuf_.hasWritten(nr);
-            tkcpMessageCallback_(shared_from_this(), &kcpRecvBuf_);
-            kcpRecvBuf_.retrieveAll();
-        } else {
-            int size = ikcp_peeksize(kcpcb_);
-            kcpRecvBuf_.ensureWritableBytes(static_cast<size_t>(size));
-        }
-        nr = ikcp_recv(kcpcb_, kcpRecvBuf_.beginWrite(), static_cast<int>(kcpRecvBuf_.writableBytes()));
+void TkcpConnection::unscheduleKcp() {
+    if (kcpDue_.valid()) {
+        kcpScheduler_->Remove(kcpDue_, this);
+        kcpDue_ = Timestamp::invalid();
     }
-    kcpState_ &= ~KcpStateE::kUpdating;
-
-    nextKcpTime_ = ikcp_update(kcpcb_, current);
 }
 
 }
@@ -16,6 +16,7 @@
 
 
 #include "TkcpCallback.h"
+#include "KcpScheduler.h"
 
 
 
@@ -46,6 +47,14 @@ namespace net {
 
 
 
+            // Reed-Solomon FEC if the peer is able to, before the handshake,
+            // the redundant segments otherwise, 0 dataShards to disable
+            void SetFecShards(int dataShards, int parityShards);
+
+            // the scheduler of the kcp sessions of the loop, before the
+            // handshake, one of its own otherwise
+            void SetKcpScheduler(const KcpSchedulerPtr& scheduler) { kcpScheduler_ = scheduler; }
+
             void SetUdpOutCallback(const UdpOutputCallback& cb) { udpOutputCallback_ = cb; }
             void SetTkcpCloseCallback(const TkcpCloseCallback& cb) { tkcpCloseCallback_ = cb; }
             void SetTkcpConnectionCallback(const TkcpConnectionCallback& cb) { tkcpConnectionCallback_ = cb; }
@@ -78,17 +87,20 @@ namespace net {
             void SendInLoop(const StringPiece& message);
             void SendInLoop(const void *message, size_t len);
             //for udp begin
-            void onConnectSyn();
-            void onConnectSyncAck();
+            void onConnectSyn(Buffer* buf);
+            void onConnectSyncAck(Buffer* buf);
             void onConnectAck();
             void onPingRequest();
             void onPingReply();
             void initKcp();
-            void onUpdateKcp();
-            void immediatelyUpdateKcp();
-            void immediatelyUpdateKcp(uint32_t current);
-            void postImmediatelyUpdateKcp();
-            void updateKcp(uint32_t current);
+            void useReedSolomonFec();
+            friend class KcpScheduler;
+            void onKcpDue(Timestamp now);
+            void recvKcp();
+            void postFlushKcp();
+            void flushKcp();
+            void scheduleKcp(Timestamp now);
+            void unscheduleKcp();
 
             void sendKcpMsg(const void *data, size_t len);
             void onUdpData(const char* buf, size_t len);
@@ -122,8 +134,7 @@ namespace net {
             };
 
             enum KcpStateE {
-                kUpdating = 0x1,
-                kPosting  = 0x2,
+                kPosting  = 0x1,
             };
 
             const char* stateToString() const;
@@ -149,6 +160,9 @@ namespace net {
             struct IKCPCB* kcpcb_;
             Buffer kcpRecvBuf_;
             boost::shared_ptr<Fec> fec_;
+            int fecDataShards_;
+            int fecParityShards_;
+            uint8_t fecMode_;
             Buffer udpSendBuf_;
             UdpOutputCallback udpOutputCallback_;
 
@@ -164,8 +178,9 @@ namespace net {
             bool udpAvailble_;
 
             uint32_t kcpState_;
-            TimerId updateKcpTimer_;
-            uint32_t nextKcpTime_;
+            KcpSchedulerPtr kcpScheduler_;
+            // in kcpScheduler_ at, invalid if not
+            Timestamp kcpDue_;
 
 
             TimerId udpPingTimer_;
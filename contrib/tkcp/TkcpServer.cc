@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <boost/bind.hpp>
 
+#include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
 
 #include "TkcpServer.h"
@@ -24,43 +25,94 @@ TkcpServer::TkcpServer(EventLoop* loop,
       listenAddress_(listenAddress),
       name_(nameArg),
       redundant_(redundant),
+      fecDataShards_(0),
+      fecParityShards_(0),
       tkcpConnectionCallback_(defaultTkcpConnectionCallback),
       tkcpMessageCallback_(defaultTkcpMessageCallback),
-      nextConv_(1),
-      socket_(new UdpServerSocket(loop_, listenAddress_, "Tkcp")),
       tcpserver_(loop, listenAddress_, "Tkcp") {
 
     tcpserver_.setConnectionCallback(boost::bind(&TkcpServer::newTcpConnection, this, _1));
-    socket_->SetMessageCallback(boost::bind(&TkcpServer::onUdpMessage, this, _1, _2, _3, _4));
+    tcpserver_.setThreadInitCallback(boost::bind(&TkcpServer::newShard, this, _1));
 }
 
 TkcpServer::~TkcpServer() {
     loop_->assertInLoopThread();
     LOG_TRACE << "TkcpServer::~TkcpServer [" << name_ << "] destructing";
 
-    for (ConnectionMap::iterator it(connections_.begin());
-         it != connections_.end(); ++it) {
+    // the IO loops are still running, each shard is let go of in its loop
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        CountDownLatch latch(1);
+        shards_[i].loop->runInLoop(boost::bind(&TkcpServer::destroyShard, &shards_[i], &latch));
+        latch.wait();
+    }
+}
 
-        TkcpConnectionPtr sess = it->second;
-        it->second.reset();
-        sess->getLoop()->runInLoop(boost::bind(&TkcpConnection::ConnectDestroyed, sess));
-        sess.reset();
+void TkcpServer::destroyShard(Shard* shard, CountDownLatch* latch) {
+    shard->loop->assertInLoopThread();
+    ConnectionMap connections;
+    connections.swap(shard->connections);
+    for (ConnectionMap::iterator it(connections.begin()); it != connections.end(); ++it) {
+        it->second->ConnectDestroyed();
     }
+    shard->socket.reset();
+    shard->scheduler.reset();
+    latch->countDown();
 }
 
 void TkcpServer::Start() {
     if (started_.getAndSet(1) == 0) {
+        // the shards are made in the order of the IO loops
         tcpserver_.start();
-        socket_->Start();
+
+        uint32_t numShards = static_cast<uint32_t>(shards_.size());
+        if (numShards > 1) {
+            // conv is the first uint32 of a datagram, in network byte order
+            int error = shards_[0].socket->SteerReusePort(0, numShards);
+            if (error != 0) {
+                LOG_WARN << "TkcpServer [" << name_ << "] no steering by conv, errno = " << error
+                         << ", datagrams on a wrong loop are forwarded";
+            }
+        }
+    }
+}
+
+// in ioLoop, before it loops, one by one
+void TkcpServer::newShard(EventLoop* ioLoop) {
+    size_t index = shards_.size();
+    Shard* shard = new Shard;
+    shard->loop = ioLoop;
+    shard->nextConv = 1;
+    shard->scheduler.reset(new KcpScheduler(ioLoop));
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "Tkcp%zd", index);
+    shard->socket.reset(new UdpServerSocket(ioLoop, listenAddress_, buf));
+    shard->socket->SetMessageCallback(
+        boost::bind(&TkcpServer::onUdpMessage, this, index, _1, _2, _3, _4));
+    // bound here, in the order of the shards in the SO_REUSEPORT group
+    shard->socket->Start();
+    shards_.push_back(shard);
+}
+
+size_t TkcpServer::shardOf(EventLoop* ioLoop) const {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        if (shards_[i].loop == ioLoop) {
+            return i;
+        }
     }
+    assert(false);
+    return 0;
 }
 
 void TkcpServer::newTcpConnection(const TcpConnectionPtr& conn) {
     if (conn->connected()) {
-        uint32_t conv = nextConv_++;
+        size_t index = shardOf(conn->getLoop());
+        Shard& shard = shards_[index];
+        uint32_t conv = shard.nextConv++ * static_cast<uint32_t>(shards_.size())
+                        + static_cast<uint32_t>(index);
 
         char buf[64];
-        snprintf(buf, sizeof(buf), "-%s-%d:%d", conn->name().c_str(), listenAddress_.toPort(),  conv);
+        snprintf(buf, sizeof(buf), "-%s-%d:%u", conn->name().c_str(), listenAddress_.toPort(),  conv);
         string sessName = name_ + buf;
 
         LOG_INFO << "TkcpServer::newTkcpConnection [" << name_
@@ -71,46 +123,71 @@ void TkcpServer::newTcpConnection(const TcpConnectionPtr& conn) {
         conn->setConnectionCallback(boost::bind(&TkcpConnection::onTcpConnection, sess, _1));
         conn->setMessageCallback(boost::bind(&TkcpConnection::onTcpMessage, sess, _1, _2, _3));
 
-        connections_[conv] = sess;
+        shard.connections[conv] = sess;
+        sess->SetFecShards(fecDataShards_, fecParityShards_);
+        sess->SetKcpScheduler(shard.scheduler);
         sess->SetTkcpConnectionCallback(tkcpConnectionCallback_);
         sess->SetTkcpMessageCallback(tkcpMessageCallback_);
-        sess->SetTkcpCloseCallback(boost::bind(&TkcpServer::removeTckpSession, this, _1));
-        sess->SetUdpOutCallback(boost::bind(&TkcpServer::outPutUdpMessage, this, _1, _2, _3));
+        sess->SetTkcpCloseCallback(boost::bind(&TkcpServer::removeTckpSession, this, index, _1));
+        sess->SetUdpOutCallback(boost::bind(&TkcpServer::outPutUdpMessage, this, index, _1, _2, _3));
 
         sess->getLoop()->runInLoop(boost::bind(&TkcpConnection::SyncUdpConnectionInfo, sess));
     }
 
 }
 
-int TkcpServer::outPutUdpMessage(const TkcpConnectionPtr& sess, const char* buf, size_t len) {
-    socket_->SendTo(buf, len, sess->peerUdpAddress());
+int TkcpServer::outPutUdpMessage(size_t index, const TkcpConnectionPtr& sess, const char* buf, size_t len) {
+    shards_[index].socket->SendTo(buf, len, sess->peerUdpAddress());
     return 0;
 }
 
-void TkcpServer::removeTckpSession(const TkcpConnectionPtr& sess) {
-    loop_->runInLoop(boost::bind(&TkcpServer::removeTckpSessionInLoop, this, sess));
+void TkcpServer::removeTckpSession(size_t index, const TkcpConnectionPtr& sess) {
+    shards_[index].loop->runInLoop(boost::bind(&TkcpServer::removeTckpSessionInLoop, this, index, sess));
 }
 
-void TkcpServer::removeTckpSessionInLoop(const TkcpConnectionPtr& sess) {
-    loop_->assertInLoopThread();
+void TkcpServer::removeTckpSessionInLoop(size_t index, const TkcpConnectionPtr& sess) {
+    shards_[index].loop->assertInLoopThread();
 
-    size_t n = connections_.erase(sess->conv());
+    size_t n = shards_[index].connections.erase(sess->conv());
     (void)n;
     assert(n == 1);
     LOG_DEBUG << sess->name() << " count " << sess.use_count();
     EventLoop* ioLoop = sess->getLoop();
-    ioLoop->runInLoop(boost::bind(&TkcpConnection::ConnectDestroyed, sess));
+    ioLoop->queueInLoop(boost::bind(&TkcpConnection::ConnectDestroyed, sess));
 }
 
-void TkcpServer::onUdpMessage(const UdpServerSocketPtr& socket, Buffer* buf, Timestamp time,
+void TkcpServer::onUdpMessage(size_t index, const UdpServerSocketPtr& socket, Buffer* buf, Timestamp time,
                                      const InetAddress& peerAddress){
+    if (buf->readableBytes() < sizeof(uint32_t)) {
+        return;
+    }
     uint32_t conv = static_cast<uint32_t>(buf->peekInt32());
 
-    ConnectionMap::const_iterator iter = connections_.find(conv);
-
+    const ConnectionMap& connections = shards_[index].connections;
+    ConnectionMap::const_iterator iter = connections.find(conv);
 
-    if (iter != connections_.end()) {
+    if (iter != connections.end()) {
         iter->second->InputUdpMessage(buf, peerAddress);
+    } else {
+        size_t owner = conv % shards_.size();
+        if (owner != index) {
+            shards_[owner].loop->queueInLoop(
+                boost::bind(&TkcpServer::onForwardedUdpMessage, this, owner,
+                            buf->retrieveAllAsString(), peerAddress));
+        }
+    }
+}
+
+void TkcpServer::onForwardedUdpMessage(size_t index, const string& message,
+                                       const InetAddress& peerAddress) {
+    Buffer buf;
+    buf.append(message);
+    uint32_t conv = static_cast<uint32_t>(buf.peekInt32());
+
+    const ConnectionMap& connections = shards_[index].connections;
+    ConnectionMap::const_iterator iter = connections.find(conv);
+    if (iter != connections.end()) {
+        iter->second->InputUdpMessage(&buf, peerAddress);
     }
 }
 
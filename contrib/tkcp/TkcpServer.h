@@ -7,6 +7,7 @@
 
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 #include <muduo/base/Atomic.h>
 #include <muduo/base/Types.h>
@@ -22,11 +23,19 @@
 
 namespace muduo {
 
+class CountDownLatch;
+
 namespace net {
 
 class UdpServerSocket;
 typedef boost::shared_ptr<UdpServerSocket> UdpServerSocketPtr;
 
+// Each IO loop owns a SO_REUSEPORT UDP socket and the sessions of its TCP
+// connections.  conv % number of loops is the loop of a session, a BPF
+// program steers the datagrams of a conv to the socket of that loop, so that
+// a session is handled in one loop only.  Without the BPF program, the
+// kernel picks a socket by the peer, and datagrams received on a wrong
+// socket are forwarded to the right loop.
 class TkcpServer : public boost::noncopyable {
     public:
         TkcpServer(EventLoop* loop,
@@ -40,6 +49,11 @@ class TkcpServer : public boost::noncopyable {
         const string& name() const { return name_; }
         EventLoop* getLoop() const { return loop_; }
 
+        // before Start()
+        void SetThreadNum(int numThreads) {
+            tcpserver_.setThreadNum(numThreads);
+        }
+
         void Start();
 
         void SetTkcpConnectionCallback(const TkcpConnectionCallback& cb) {
@@ -50,35 +64,57 @@ class TkcpServer : public boost::noncopyable {
             tkcpMessageCallback_ = cb;
         }
 
+        // see TkcpConnection::SetFecShards()
+        void SetFecShards(int dataShards, int parityShards) {
+            fecDataShards_ = dataShards;
+            fecParityShards_ = parityShards;
+        }
+
     public:
     private:
+        typedef boost::unordered_map<uint32_t, TkcpConnectionPtr> ConnectionMap;
+
+        // of an IO loop, touched in the loop only
+        struct Shard {
+            EventLoop* loop;
+            UdpServerSocketPtr socket;
+            KcpSchedulerPtr scheduler;
+            ConnectionMap connections;
+            uint32_t nextConv;
+        };
+
+        void newShard(EventLoop* ioLoop);
+        static void destroyShard(Shard* shard, CountDownLatch* latch);
+        size_t shardOf(EventLoop* ioLoop) const;
+
         void newTcpConnection(const TcpConnectionPtr& conn);
 
-        void removeTckpSession(const TkcpConnectionPtr& sess);
-        void removeTckpSessionInLoop(const TkcpConnectionPtr& sess);
+        void removeTckpSession(size_t index, const TkcpConnectionPtr& sess);
+        void removeTckpSessionInLoop(size_t index, const TkcpConnectionPtr& sess);
 
-        void onUdpMessage(const UdpServerSocketPtr& socket, Buffer* buf, Timestamp time,
+        void onUdpMessage(size_t index, const UdpServerSocketPtr& socket, Buffer* buf, Timestamp time,
                                      const InetAddress& peerAddress);
-        int outPutUdpMessage(const TkcpConnectionPtr& sess, const char* buf, size_t len);
+        void onForwardedUdpMessage(size_t index, const string& message,
+                                   const InetAddress& peerAddress);
+        int outPutUdpMessage(size_t index, const TkcpConnectionPtr& sess, const char* buf, size_t len);
 
     private:
 
-    typedef boost::unordered_map<uint32_t, TkcpConnectionPtr> ConnectionMap;
     EventLoop* loop_;
     const InetAddress listenAddress_;
     const string name_;
     int redundant_;
+    int fecDataShards_;
+    int fecParityShards_;
 
     TkcpConnectionCallback tkcpConnectionCallback_;
     TkcpMessageCallback tkcpMessageCallback_;
 
     AtomicInt32 started_;
 
-    uint32_t nextConv_;
-    ConnectionMap connections_;
-
-    UdpServerSocketPtr socket_;
     TcpServer tcpserver_;
+    // destroyed before the IO loops of tcpserver_
+    boost::ptr_vector<Shard> shards_;
 };
 
 
@@ -35,7 +35,7 @@ void Stop(EventLoop* loop) {
 int main(int argc, char* argv[])
 {
     if (argc < 3) {
-        printf("arg err Usage: ip port\n");
+        printf("arg err Usage: ip port [threads]\n");
         return 1;
     }
     Logger::setLogLevel(Logger::INFO);
@@ -48,6 +48,9 @@ int main(int argc, char* argv[])
     TkcpServer server(&loop, listenAddress, "test",2);
     server.SetTkcpConnectionCallback(OnConnection);
     server.SetTkcpMessageCallback(OnMessage);
+    if (argc > 3) {
+        server.SetThreadNum(atoi(argv[3]));
+    }
 
 
     server.Start();
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <deque>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <muduo/base/Timestamp.h>
+#include <contrib/tkcp/Fec.h>
+#include <contrib/tkcp/ReedSolomon.h>
+#include <contrib/tkcp/ikcp.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Two kcp endpoints over a simulated link of random loss, with the FEC of
+// tkcp in between, a bulk transfer one way for a while of simulated time.
+// Goodput is of the bytes kcp delivers, overhead is of the bytes on the wire
+// both ways over them.
+//
+// fec_bench [seconds] [one way delay ms]
+
+const int kMessageSize = 1000;
+
+struct Datagram {
+    uint32_t deliverTime;
+    string data;
+};
+
+struct Endpoint;
+
+struct Link {
+    double loss;
+    uint32_t delay;
+    std::deque<Datagram> queue;
+    int64_t wireBytes;
+    Endpoint* to;
+};
+
+struct Endpoint {
+    ikcpcb* kcp;
+    boost::scoped_ptr<Fec> fec;
+    Link* out;
+    uint32_t now;
+
+    void onFecSend(const char* data, size_t len) {
+        out->wireBytes += static_cast<int64_t>(len);
+        if (static_cast<double>(rand()) / RAND_MAX < out->loss) {
+            return;
+        }
+        Datagram datagram = { now + out->delay, string(data, len) };
+        out->queue.push_back(datagram);
+    }
+
+    void onFecRecv(const char* data, size_t len) {
+        ikcp_input(kcp, data, static_cast<long>(len));
+    }
+};
+
+int kcpOutput(const char* buf, int len, ikcpcb*, void* user) {
+    static_cast<Endpoint*>(user)->fec->Send(buf, static_cast<size_t>(len));
+    return 0;
+}
+
+Fec* newFec(int redundant, int dataShards, int parityShards) {
+    if (dataShards > 0) {
+        return new ReedSolomonFec(dataShards, parityShards);
+    }
+    return new RedundantFec(redundant);
+}
+
+void setup(Endpoint* endpoint, Fec* fec, Link* out) {
+    endpoint->fec.reset(fec);
+    endpoint->fec->setSendOutCallback(boost::bind(&Endpoint::onFecSend, endpoint, _1, _2));
+    endpoint->fec->setRecvOutCallback(boost::bind(&Endpoint::onFecRecv, endpoint, _1, _2));
+    endpoint->out = out;
+    endpoint->now = 0;
+    endpoint->kcp = ikcp_create(1, endpoint);
+    ikcp_setoutput(endpoint->kcp, kcpOutput);
+    ikcp_nodelay(endpoint->kcp, 1, 10, 2, 1);
+    ikcp_wndsize(endpoint->kcp, 128, 128);
+    ikcp_setmtu(endpoint->kcp, fec->Mtu());
+}
+
+void deliver(Link* link, uint32_t now) {
+    while (!link->queue.empty() && link->queue.front().deliverTime <= now) {
+        Datagram datagram;
+        datagram.data.swap(link->queue.front().data);
+        link->queue.pop_front();
+        link->to->fec->Input(datagram.data.data(), datagram.data.size());
+    }
+}
+
+void simulate(const char* scheme, int redundant, int dataShards, int parityShards,
+              double loss, int seconds, uint32_t delay) {
+    srand(1);
+    Endpoint sender, receiver;
+    Link forward = { loss, delay, std::deque<Datagram>(), 0, &receiver };
+    Link backward = { loss, delay, std::deque<Datagram>(), 0, &sender };
+    setup(&sender, newFec(redundant, dataShards, parityShards), &forward);
+    setup(&receiver, newFec(redundant, dataShards, parityShards), &backward);
+
+    char message[kMessageSize] = { 0 };
+    char received[kMessageSize * 2];
+    int64_t goodput = 0;
+    const uint32_t end = static_cast<uint32_t>(seconds) * 1000;
+    for (uint32_t now = 0; now < end; ++now) {
+        sender.now = receiver.now = now;
+        while (ikcp_waitsnd(sender.kcp) < 256) {
+            ikcp_send(sender.kcp, message, kMessageSize);
+        }
+        deliver(&forward, now);
+        deliver(&backward, now);
+        // read before the acks are flushed, or they tell a full window
+        int n;
+        while ((n = ikcp_recv(receiver.kcp, received, sizeof(received))) > 0) {
+            goodput += n;
+        }
+        ikcp_update(sender.kcp, now);
+        ikcp_update(receiver.kcp, now);
+    }
+
+    int64_t recovered = 0;
+    if (dataShards > 0) {
+        recovered = static_cast<ReedSolomonFec*>(receiver.fec.get())->Recovered();
+    }
+    printf("%-12s loss %4.1f%%  goodput %8.1f KiB/s  wire/goodput %5.2f  recovered %lld\n",
+           scheme, loss * 100,
+           static_cast<double>(goodput) / 1024 / seconds,
+           goodput > 0 ? static_cast<double>(forward.wireBytes + backward.wireBytes) / static_cast<double>(goodput) : 0.0,
+           static_cast<long long>(recovered));
+
+    ikcp_release(sender.kcp);
+    ikcp_release(receiver.kcp);
+}
+
+void benchCodec(int dataShards, int parityShards, size_t shardSize) {
+    ReedSolomon rs(dataShards, parityShards);
+    std::vector<std::vector<uint8_t> > storage(dataShards + parityShards,
+                                               std::vector<uint8_t>(shardSize));
+    std::vector<uint8_t*> shards;
+    for (size_t i = 0; i < storage.size(); ++i) {
+        for (size_t j = 0; j < shardSize; ++j) {
+            storage[i][j] = static_cast<uint8_t>(rand());
+        }
+        shards.push_back(&storage[i][0]);
+    }
+
+    const int kRounds = 20000;
+    Timestamp start(Timestamp::now());
+    for (int i = 0; i < kRounds; ++i) {
+        rs.Encode(&shards[0], &shards[dataShards], shardSize);
+    }
+    double encode = timeDifference(Timestamp::now(), start);
+
+    // the first parityShards data shards lost
+    bool present[ReedSolomon::kMaxShards];
+    for (int i = 0; i < dataShards + parityShards; ++i) {
+        present[i] = i >= parityShards || i >= dataShards;
+    }
+    start = Timestamp::now();
+    for (int i = 0; i < kRounds; ++i) {
+        rs.Reconstruct(&shards[0], present, shardSize);
+    }
+    double reconstruct = timeDifference(Timestamp::now(), start);
+
+    double bytes = static_cast<double>(kRounds) * dataShards * static_cast<double>(shardSize);
+    printf("RS %d+%d of %zd bytes: encode %.0f MiB/s, reconstruct %d lost %.0f MiB/s\n",
+           dataShards, parityShards, shardSize,
+           bytes / encode / 1024 / 1024, parityShards,
+           bytes / reconstruct / 1024 / 1024);
+}
+
+int main(int argc, char* argv[]) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 20;
+    uint32_t delay = argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : 30;
+
+    benchCodec(10, 3, 538);
+    benchCodec(4, 2, 538);
+
+    const double losses[] = { 0.0, 0.02, 0.05, 0.10, 0.20 };
+    for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); ++i) {
+        simulate("none", 0, 0, 0, losses[i], seconds, delay);
+        simulate("redundant 1", 1, 0, 0, losses[i], seconds, delay);
+        simulate("redundant 2", 2, 0, 0, losses[i], seconds, delay);
+        simulate("rs 10+3", 0, 10, 3, losses[i], seconds, delay);
+        simulate("rs 4+2", 0, 4, 2, losses[i], seconds, delay);
+        printf("\n");
+    }
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <muduo/base/Logging.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <contrib/tkcp/TkcpClient.h>
+#include <contrib/tkcp/TkcpServer.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Many kcp sessions over the loopback, a server and its clients in one
+// process, each session sending a message every interval, or none at all.
+// The cpu time of the process is of the kcp updates mostly.
+//
+// idle_bench [sessions] [seconds] [interval ms, 0 for idle] [server threads]
+
+int g_sessions = 1000;
+double g_seconds = 5.0;
+int g_interval = 0;
+
+AtomicInt32 g_connected;
+int64_t g_echoed = 0;
+std::vector<TkcpClientPtr> g_clients;
+std::vector<TkcpConnectionPtr> g_conns;
+
+double cpuSeconds() {
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+           + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000;
+}
+
+void onServerMessage(const TkcpConnectionPtr& conn, Buffer* buf) {
+    conn->Send(buf);
+}
+
+void onClientConnection(const TkcpConnectionPtr& conn) {
+    if (conn->Connected()) {
+        g_conns.push_back(conn);
+        g_connected.increment();
+    }
+}
+
+void onClientMessage(const TkcpConnectionPtr&, Buffer* buf) {
+    ++g_echoed;
+    buf->retrieveAll();
+}
+
+void sendAll() {
+    for (size_t i = 0; i < g_conns.size(); ++i) {
+        g_conns[i]->Send("ping");
+    }
+}
+
+void report(double cpuStart, Timestamp start) {
+    double elapsed = timeDifference(Timestamp::now(), start);
+    double cpu = cpuSeconds() - cpuStart;
+    printf("%d sessions, interval %d ms: cpu %.1f%%, %.0f echoes/s\n",
+           g_connected.get(), g_interval, cpu / elapsed * 100,
+           static_cast<double>(g_echoed) / elapsed);
+    fflush(stdout);
+    // the sessions are not torn down
+    _exit(0);
+}
+
+// in the loop of the clients, once all connected
+void measure(EventLoop* loop) {
+    if (g_connected.get() < g_sessions) {
+        loop->runAfter(0.1, boost::bind(measure, loop));
+        return;
+    }
+    if (g_interval > 0) {
+        loop->runEvery(g_interval / 1000.0, sendAll);
+    }
+    g_echoed = 0;
+    loop->runAfter(g_seconds, boost::bind(report, cpuSeconds(), Timestamp::now()));
+}
+
+void startClients(EventLoop* loop, const InetAddress& serverAddr) {
+    for (int i = 0; i < g_sessions; ++i) {
+        TkcpClientPtr client(new TkcpClient(loop, serverAddr, "IdleClient"));
+        client->SetConnectionCallback(onClientConnection);
+        client->SetMessageCallback(onClientMessage);
+        client->Connect();
+        g_clients.push_back(client);
+    }
+    // the handshakes settled
+    loop->runAfter(1.0, boost::bind(measure, loop));
+}
+
+int main(int argc, char* argv[]) {
+    g_sessions = argc > 1 ? atoi(argv[1]) : 1000;
+    g_seconds = argc > 2 ? atof(argv[2]) : 5.0;
+    g_interval = argc > 3 ? atoi(argv[3]) : 0;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+
+    Logger::setLogLevel(Logger::WARN);
+    InetAddress serverAddr("127.0.0.1", 9989);
+    EventLoop loop;
+    TkcpServer server(&loop, serverAddr, "IdleServer");
+    server.SetThreadNum(threads);
+    server.SetTkcpMessageCallback(onServerMessage);
+    server.Start();
+
+    EventLoopThread clientThread;
+    EventLoop* clientLoop = clientThread.startLoop();
+    clientLoop->runInLoop(boost::bind(startClients, clientLoop, serverAddr));
+    loop.loop();
+}
@@ -63,6 +63,17 @@ class LengthHeaderCodec : boost::noncopyable
     conn->send(&buf);
   }
 
+  // for sending one message to many connections
+  static muduo::net::SharedPayload encode(const muduo::StringPiece& message)
+  {
+    int32_t len = static_cast<int32_t>(message.size());
+    int32_t be32 = muduo::net::sockets::hostToNetwork32(len);
+    boost::shared_ptr<muduo::string> payload(
+        new muduo::string(reinterpret_cast<const char*>(&be32), sizeof be32));
+    payload->append(message.data(), message.size());
+    return payload;
+  }
+
  private:
   StringMessageCallback messageCallback_;
   const static size_t kHeaderLen = sizeof(int32_t);
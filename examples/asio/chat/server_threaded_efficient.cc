@@ -2,6 +2,7 @@
 
 #include <muduo/base/Logging.h>
 #include <muduo/base/Mutex.h>
+#include <muduo/net/Broadcaster.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpServer.h>
 
@@ -70,13 +71,10 @@ class ChatServer : boost::noncopyable
                        const string& message,
                        Timestamp)
   {
-    ConnectionListPtr connections = getConnectionList();;
-    for (ConnectionList::iterator it = connections->begin();
-        it != connections->end();
-        ++it)
-    {
-      codec_.send(get_pointer(*it), message);
-    }
+    ConnectionListPtr connections = getConnectionList();
+    // encoded once, one post to each IO loop
+    broadcast(connections->begin(), connections->end(),
+              LengthHeaderCodec::encode(message));
   }
 
   ConnectionListPtr getConnectionList()
@@ -61,7 +61,8 @@ class ChatServer : boost::noncopyable
                        const string& message,
                        Timestamp)
   {
-    EventLoop::Functor f = boost::bind(&ChatServer::distributeMessage, this, message);
+    EventLoop::Functor f = boost::bind(&ChatServer::distributeMessage, this,
+                                       LengthHeaderCodec::encode(message));
     LOG_DEBUG;
 
     MutexLockGuard lock(mutex_);
@@ -76,14 +77,14 @@ class ChatServer : boost::noncopyable
 
   typedef std::set<TcpConnectionPtr> ConnectionList;
 
-  void distributeMessage(const string& message)
+  void distributeMessage(const SharedPayload& payload)
   {
     LOG_DEBUG << "begin";
     for (ConnectionList::iterator it = LocalConnections::instance().begin();
         it != LocalConnections::instance().end();
         ++it)
     {
-      codec_.send(get_pointer(*it), message);
+      (*it)->send(payload);
     }
     LOG_DEBUG << "end";
   }
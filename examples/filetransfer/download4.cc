@@ -0,0 +1,70 @@
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpServer.h>
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+void onHighWaterMark(const TcpConnectionPtr& conn, size_t len)
+{
+  LOG_INFO << "HighWaterMark " << len;
+}
+
+const char* g_file = NULL;
+
+// file content never enters user space, sendfile(2) does the copying.
+void onConnection(const TcpConnectionPtr& conn)
+{
+  LOG_INFO << "FileServer - " << conn->peerAddress().toIpPort() << " -> "
+           << conn->localAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+  if (conn->connected())
+  {
+    LOG_INFO << "FileServer - Sending file " << g_file
+             << " to " << conn->peerAddress().toIpPort();
+    conn->setHighWaterMarkCallback(onHighWaterMark, 64*1024);
+
+    int fd = ::open(g_file, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0)
+    {
+      conn->sendFile(fd, 0, st.st_size);
+      conn->shutdown();
+    }
+    else
+    {
+      conn->shutdown();
+      LOG_INFO << "FileServer - no such file";
+    }
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  LOG_INFO << "pid = " << getpid();
+  if (argc > 1)
+  {
+    g_file = argv[1];
+
+    EventLoop loop;
+    InetAddress listenAddr(2021);
+    TcpServer server(&loop, listenAddr, "FileServer");
+    server.setConnectionCallback(onConnection);
+    server.start();
+    loop.loop();
+  }
+  else
+  {
+    fprintf(stderr, "Usage: %s file_for_downloading\n", argv[0]);
+  }
+}
+
@@ -1,13 +1,19 @@
 #include "codec.h"
 
 #include <muduo/base/Logging.h>
+#include <muduo/net/Broadcaster.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
 #include <muduo/net/TcpServer.h>
 
 #include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/unordered_map.hpp>
 
-#include <map>
+#include <algorithm>
 #include <set>
+#include <vector>
 #include <stdio.h>
 
 using namespace muduo;
@@ -16,8 +22,10 @@ using namespace muduo::net;
 namespace pubsub
 {
 
+// in the loop of the connection
 typedef std::set<string> ConnectionSubscription;
 
+// in the loop of its shard
 class Topic : public muduo::copyable
 {
  public:
@@ -28,49 +36,50 @@ class Topic : public muduo::copyable
 
   void add(const TcpConnectionPtr& conn)
   {
-    audiences_.insert(conn);
+    Audience::iterator it = std::lower_bound(audiences_.begin(), audiences_.end(), conn);
+    if (it == audiences_.end() || *it != conn)
+    {
+      audiences_.insert(it, conn);
+    }
     if (lastPubTime_.valid())
     {
-      conn->send(makeMessage());
+      conn->send(message_);
     }
   }
 
   void remove(const TcpConnectionPtr& conn)
   {
-    audiences_.erase(conn);
+    Audience::iterator it = std::lower_bound(audiences_.begin(), audiences_.end(), conn);
+    if (it != audiences_.end() && *it == conn)
+    {
+      audiences_.erase(it);
+    }
   }
 
   void publish(const string& content, Timestamp time)
   {
-    content_ = content;
     lastPubTime_ = time;
-    string message = makeMessage();
-    for (std::set<TcpConnectionPtr>::iterator it = audiences_.begin();
-         it != audiences_.end();
-         ++it)
-    {
-      (*it)->send(message);
-    }
+    message_.reset(new string("pub " + topic_ + "\r\n" + content + "\r\n"));
+    // one post to each loop of the audience, the message is not copied
+    broadcast(audiences_.begin(), audiences_.end(), message_);
   }
 
  private:
-
-  string makeMessage()
-  {
-    return "pub " + topic_ + "\r\n" + content_ + "\r\n";
-  }
+  // a flat set, sorted for subscribing, contiguous for publishing
+  typedef std::vector<TcpConnectionPtr> Audience;
 
   string topic_;
-  string content_;
+  SharedPayload message_;
   Timestamp lastPubTime_;
-  std::set<TcpConnectionPtr> audiences_;
+  Audience audiences_;
 };
 
 class PubSubServer : boost::noncopyable
 {
  public:
   PubSubServer(muduo::net::EventLoop* loop,
-               const muduo::net::InetAddress& listenAddr)
+               const muduo::net::InetAddress& listenAddr,
+               int numThreads)
     : loop_(loop),
       server_(loop, listenAddr, "PubSubServer")
   {
@@ -78,15 +87,52 @@ class PubSubServer : boost::noncopyable
         boost::bind(&PubSubServer::onConnection, this, _1));
     server_.setMessageCallback(
         boost::bind(&PubSubServer::onMessage, this, _1, _2, _3));
+    server_.setThreadNum(numThreads);
     loop_->runEvery(1.0, boost::bind(&PubSubServer::timePublish, this));
   }
 
   void start()
   {
     server_.start();
+    // no connection is accepted before this returns to the loop
+    std::vector<EventLoop*> loops = server_.threadPool()->getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+      shards_.push_back(new TopicShard(loops[i]));
+    }
   }
 
  private:
+  // The topics of one IO loop, touched only in it.
+  struct TopicShard : boost::noncopyable
+  {
+    explicit TopicShard(EventLoop* loopArg)
+      : loop(loopArg)
+    {
+    }
+
+    Topic& getTopic(const string& topic)
+    {
+      TopicMap::iterator it = topics.find(topic);
+      if (it == topics.end())
+      {
+        it = topics.insert(make_pair(topic, Topic(topic))).first;
+      }
+      return it->second;
+    }
+
+    typedef boost::unordered_map<string, Topic> TopicMap;
+    EventLoop* loop;
+    TopicMap topics;
+  };
+
+  // The same loop as EventLoopThreadPool::getLoopForHash(), which only
+  // the base loop may call, while commands come from every IO loop.
+  TopicShard& shardOf(const string& topic)
+  {
+    return shards_[boost::hash<string>()(topic) % shards_.size()];
+  }
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     if (conn->connected())
@@ -97,11 +143,12 @@ class PubSubServer : boost::noncopyable
     {
       const ConnectionSubscription& connSub
         = boost::any_cast<const ConnectionSubscription&>(conn->getContext());
-      // subtle: doUnsubscribe will erase *it, so increase before calling.
       for (ConnectionSubscription::const_iterator it = connSub.begin();
-           it != connSub.end();)
+           it != connSub.end(); ++it)
       {
-        doUnsubscribe(conn, *it++);
+        TopicShard& shard = shardOf(*it);
+        shard.loop->runInLoop(
+            boost::bind(&PubSubServer::unsubscribeInShard, &shard, conn, *it));
       }
     }
   }
@@ -157,19 +204,26 @@ class PubSubServer : boost::noncopyable
     ConnectionSubscription* connSub
       = boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
 
-    connSub->insert(topic);
-    getTopic(topic).add(conn);
+    if (connSub->insert(topic).second)
+    {
+      TopicShard& shard = shardOf(topic);
+      shard.loop->runInLoop(
+          boost::bind(&PubSubServer::subscribeInShard, &shard, conn, topic));
+    }
   }
 
   void doUnsubscribe(const TcpConnectionPtr& conn,
                      const string& topic)
   {
     LOG_INFO << conn->name() << " unsubscribes " << topic;
-    getTopic(topic).remove(conn);
-    // topic could be the one to be destroyed, so don't use it after erasing.
     ConnectionSubscription* connSub
       = boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
-    connSub->erase(topic);
+    if (connSub->erase(topic) > 0)
+    {
+      TopicShard& shard = shardOf(topic);
+      shard.loop->runInLoop(
+          boost::bind(&PubSubServer::unsubscribeInShard, &shard, conn, topic));
+    }
   }
 
   void doPublish(const string& source,
@@ -177,22 +231,36 @@ class PubSubServer : boost::noncopyable
                  const string& content,
                  Timestamp time)
   {
-    getTopic(topic).publish(content, time);
+    TopicShard& shard = shardOf(topic);
+    shard.loop->runInLoop(
+        boost::bind(&PubSubServer::publishInShard, &shard, topic, content, time));
   }
 
-  Topic& getTopic(const string& topic)
+  static void subscribeInShard(TopicShard* shard,
+                               const TcpConnectionPtr& conn,
+                               const string& topic)
   {
-    std::map<string, Topic>::iterator it = topics_.find(topic);
-    if (it == topics_.end())
-    {
-      it = topics_.insert(make_pair(topic, Topic(topic))).first;
-    }
-    return it->second;
+    shard->getTopic(topic).add(conn);
+  }
+
+  static void unsubscribeInShard(TopicShard* shard,
+                                 const TcpConnectionPtr& conn,
+                                 const string& topic)
+  {
+    shard->getTopic(topic).remove(conn);
+  }
+
+  static void publishInShard(TopicShard* shard,
+                             const string& topic,
+                             const string& content,
+                             Timestamp time)
+  {
+    shard->getTopic(topic).publish(content, time);
   }
 
   EventLoop* loop_;
   TcpServer server_;
-  std::map<string, Topic> topics_;
+  boost::ptr_vector<TopicShard> shards_;
 };
 
 }
@@ -202,18 +270,14 @@ int main(int argc, char* argv[])
   if (argc > 1)
   {
     uint16_t port = static_cast<uint16_t>(atoi(argv[1]));
+    int numThreads = argc > 2 ? atoi(argv[2]) : 0;
     EventLoop loop;
-    if (argc > 2)
-    {
-      //int inspectPort = atoi(argv[2]);
-    }
-    pubsub::PubSubServer server(&loop, InetAddress(port));
+    pubsub::PubSubServer server(&loop, InetAddress(port), numThreads);
     server.start();
     loop.loop();
   }
   else
   {
-    printf("Usage: %s pubsub_port [inspect_port]\n", argv[0]);
+    printf("Usage: %s pubsub_port [num_threads]\n", argv[0]);
   }
 }
-
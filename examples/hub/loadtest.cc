@@ -0,0 +1,147 @@
+#include "pubsub.h"
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+using namespace pubsub;
+
+// Subscribes many clients to one topic, and publishes to it as fast as the
+// hub delivers, with a few messages in flight.  Reports each second the
+// messages delivered to subscribers, that is publishes times the fan-out.
+//
+// usage: hub_loadtest hub_ip:port fanout [threads] [seconds] [message_size]
+
+const char* kTopic = "loadtest";
+const int kInFlight = 8;
+
+EventLoop* g_loop;
+PubSubClient* g_publisher;
+int g_fanout = 0;
+int g_seconds = 10;
+string g_content;
+AtomicInt32 g_subscribed;
+AtomicInt64 g_delivered;
+int64_t g_published = 0;  // in g_loop
+int64_t g_lastDelivered = 0;
+int64_t g_lastPublished = 0;
+Timestamp g_lastReport;
+int g_reports = 0;
+
+void publishOne()
+{
+  if (g_publisher->publish(kTopic, g_content))
+  {
+    ++g_published;
+  }
+}
+
+void onSubscription(const string&, const string&, Timestamp)
+{
+  // a publish delivered to everyone makes room for the next one
+  if (g_delivered.incrementAndGet() % g_fanout == 0)
+  {
+    g_loop->queueInLoop(publishOne);
+  }
+}
+
+void report()
+{
+  Timestamp now = Timestamp::now();
+  double seconds = timeDifference(now, g_lastReport);
+  int64_t delivered = g_delivered.get();
+  printf("fanout %d: %.0f messages/s delivered, %.0f publishes/s, %.1f MiB/s\n",
+         g_fanout,
+         static_cast<double>(delivered - g_lastDelivered) / seconds,
+         static_cast<double>(g_published - g_lastPublished) / seconds,
+         static_cast<double>(delivered - g_lastDelivered)
+           * static_cast<double>(g_content.size()) / seconds / 1024 / 1024);
+  g_lastReport = now;
+  g_lastDelivered = delivered;
+  g_lastPublished = g_published;
+  if (++g_reports >= g_seconds)
+  {
+    g_loop->quit();
+  }
+}
+
+void startPublishing()
+{
+  LOG_WARN << "all " << g_fanout << " subscribed, publishing";
+  g_lastReport = Timestamp::now();
+  g_loop->runEvery(1.0, report);
+  for (int i = 0; i < kInFlight; ++i)
+  {
+    publishOne();
+  }
+}
+
+void onSubscriberConnection(PubSubClient* client)
+{
+  if (client->connected())
+  {
+    client->subscribe(kTopic, onSubscription);
+    if (g_subscribed.incrementAndGet() == g_fanout)
+    {
+      // lets the hub take the last subscriptions first
+      g_loop->runAfter(1.0, startPublishing);
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    printf("Usage: %s hub_ip:port fanout [threads] [seconds] [message_size]\n", argv[0]);
+    return 0;
+  }
+
+  string hostport = argv[1];
+  size_t colon = hostport.find(':');
+  if (colon == string::npos)
+  {
+    printf("Usage: %s hub_ip:port fanout [threads] [seconds] [message_size]\n", argv[0]);
+    return 0;
+  }
+  InetAddress hubAddr(hostport.substr(0, colon),
+                      static_cast<uint16_t>(atoi(hostport.c_str() + colon + 1)));
+  g_fanout = atoi(argv[2]);
+  int threads = argc > 3 ? atoi(argv[3]) : 1;
+  g_seconds = argc > 4 ? atoi(argv[4]) : 10;
+  g_content.assign(argc > 5 ? atoi(argv[5]) : 100, 'x');
+  Logger::setLogLevel(Logger::WARN);
+
+  EventLoop loop;
+  g_loop = &loop;
+  EventLoopThreadPool pool(&loop, "subscribers");
+  pool.setThreadNum(threads);
+  pool.start();
+
+  PubSubClient publisher(&loop, hubAddr, "publisher");
+  g_publisher = &publisher;
+  publisher.start();
+
+  boost::ptr_vector<PubSubClient> subscribers;
+  for (int i = 0; i < g_fanout; ++i)
+  {
+    subscribers.push_back(new PubSubClient(pool.getNextLoop(), hubAddr, "subscriber"));
+    subscribers.back().setConnectionCallback(onSubscriberConnection);
+    subscribers.back().start();
+    usleep(200);
+  }
+  loop.loop();
+  // PubSubClient can't be destroyed while its loop is running
+  fflush(stdout);
+  _exit(0);
+}
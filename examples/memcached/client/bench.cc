@@ -1,6 +1,7 @@
 #include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/Endian.h>
 #include <muduo/net/EventLoopThreadPool.h>
 #include <muduo/net/TcpClient.h>
 
@@ -14,6 +15,13 @@ namespace po = boost::program_options;
 using namespace muduo;
 using namespace muduo::net;
 
+// the binary protocol of memcached
+const size_t kBinaryHeaderSize = 24;
+const uint8_t kBinaryGet = 0x00;
+const uint8_t kBinarySet = 0x01;
+const uint8_t kBinaryNoop = 0x0a;
+const uint8_t kBinaryGetKQ = 0x0d;
+
 class Client : boost::noncopyable
 {
  public:
@@ -30,6 +38,8 @@ class Client : boost::noncopyable
          int requests,
          int keys,
          int valuelen,
+         bool binary,
+         int multiget,
          CountDownLatch* connected,
          CountDownLatch* finished)
     : name_(name),
@@ -40,6 +50,8 @@ class Client : boost::noncopyable
       requests_(requests),
       keys_(keys),
       valuelen_(valuelen),
+      binary_(binary),
+      multiget_(multiget),
       value_(valuelen_, 'a'),
       connected_(connected),
       finished_(finished)
@@ -77,7 +89,33 @@ class Client : boost::noncopyable
                  Buffer* buffer,
                  Timestamp receiveTime)
   {
-    if (op_ == kSet)
+    if (binary_)
+    {
+      // a set or a get is answered by a response of its opcode,
+      // a multi-get by the noop after the quiet gets
+      const uint8_t last = op_ == kSet ? kBinarySet : (multiget_ > 1 ? kBinaryNoop : kBinaryGet);
+      while (buffer->readableBytes() >= kBinaryHeaderSize)
+      {
+        uint32_t bodylen = 0;
+        memcpy(&bodylen, buffer->peek() + 8, sizeof bodylen);
+        size_t len = kBinaryHeaderSize + sockets::networkToHost32(bodylen);
+        if (buffer->readableBytes() < len)
+        {
+          break;
+        }
+        uint8_t opcode = static_cast<uint8_t>(buffer->peek()[1]);
+        buffer->retrieve(len);
+        if (opcode == last)
+        {
+          ++acked_;
+          if (sent_ < requests_)
+          {
+            send();
+          }
+        }
+      }
+    }
+    else if (op_ == kSet)
     {
       while (buffer->readableBytes() > 0)
       {
@@ -125,10 +163,64 @@ class Client : boost::noncopyable
     }
   }
 
+  static void appendBinaryRequest(Buffer* buf,
+                                  uint8_t opcode,
+                                  StringPiece extras,
+                                  StringPiece key,
+                                  StringPiece value)
+  {
+    buf->appendInt8(static_cast<int8_t>(0x80));
+    buf->appendInt8(static_cast<int8_t>(opcode));
+    buf->appendInt16(static_cast<int16_t>(key.size()));
+    buf->appendInt8(static_cast<int8_t>(extras.size()));
+    buf->appendInt8(0);  // data type
+    buf->appendInt16(0);  // vbucket
+    buf->appendInt32(extras.size() + key.size() + value.size());
+    buf->appendInt32(0);  // opaque
+    buf->appendInt64(0);  // cas
+    buf->append(extras.data(), extras.size());
+    buf->append(key.data(), key.size());
+    buf->append(value.data(), value.size());
+  }
+
+  void fillBinary(Buffer* buf)
+  {
+    char key[256];
+    if (op_ == kSet)
+    {
+      snprintf(key, sizeof key, "%s%d", name_.c_str(), sent_ % keys_);
+      ++sent_;
+      uint32_t extras[2] = { sockets::hostToNetwork32(42), 0 };  // flags, exptime
+      appendBinaryRequest(buf, kBinarySet,
+                          StringPiece(reinterpret_cast<const char*>(extras), sizeof extras),
+                          key, StringPiece(value_.data(), valuelen_));
+    }
+    else if (multiget_ > 1)
+    {
+      for (int i = 0; i < multiget_; ++i)
+      {
+        snprintf(key, sizeof key, "%s%d", name_.c_str(), (sent_ * multiget_ + i) % keys_);
+        appendBinaryRequest(buf, kBinaryGetKQ, StringPiece(), key, StringPiece());
+      }
+      ++sent_;
+      appendBinaryRequest(buf, kBinaryNoop, StringPiece(), StringPiece(), StringPiece());
+    }
+    else
+    {
+      snprintf(key, sizeof key, "%s%d", name_.c_str(), sent_ % keys_);
+      ++sent_;
+      appendBinaryRequest(buf, kBinaryGet, StringPiece(), key, StringPiece());
+    }
+  }
+
   void fill(Buffer* buf)
   {
     char req[256];
-    if (op_ == kSet)
+    if (binary_)
+    {
+      fillBinary(buf);
+    }
+    else if (op_ == kSet)
     {
       snprintf(req, sizeof req, "set %s%d 42 0 %d\r\n", name_.c_str(), sent_ % keys_, valuelen_);
       ++sent_;
@@ -137,9 +229,14 @@ class Client : boost::noncopyable
     }
     else
     {
-      snprintf(req, sizeof req, "get %s%d\r\n", name_.c_str(), sent_ % keys_);
+      buf->append("get");
+      for (int i = 0; i < multiget_; ++i)
+      {
+        snprintf(req, sizeof req, " %s%d", name_.c_str(), (sent_ * multiget_ + i) % keys_);
+        buf->append(req);
+      }
       ++sent_;
-      buf->append(req);
+      buf->append("\r\n");
     }
   }
 
@@ -152,6 +249,8 @@ class Client : boost::noncopyable
   const int requests_;
   const int keys_;
   const int valuelen_;
+  const bool binary_;
+  const int multiget_;  // keys per get
   string value_;
   CountDownLatch* const connected_;
   CountDownLatch* const finished_;
@@ -168,6 +267,8 @@ int main(int argc, char* argv[])
   int requests = 100000;
   int keys = 10000;
   bool set = false;
+  bool binary = false;
+  int multiget = 1;
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -179,6 +280,8 @@ int main(int argc, char* argv[])
       ("requests,r", po::value<int>(&requests), "Number of requests per clients")
       ("keys,k", po::value<int>(&keys), "Number of keys per clients")
       ("set,s", "Get or Set")
+      ("binary,b", "Binary protocol")
+      ("multiget,m", po::value<int>(&multiget), "Number of keys per get")
       ;
 
   po::variables_map vm;
@@ -191,6 +294,7 @@ int main(int argc, char* argv[])
     return 0;
   }
   set = vm.count("set");
+  binary = vm.count("binary");
 
   InetAddress serverAddr(hostIp, tcpport);
   LOG_WARN << "Connecting " << serverAddr.toIpPort();
@@ -221,6 +325,8 @@ int main(int argc, char* argv[])
                                 requests,
                                 keys,
                                 valuelen,
+                                binary,
+                                multiget,
                                 &connected,
                                 &finished));
   }
@@ -237,4 +343,8 @@ int main(int argc, char* argv[])
   double seconds = timeDifference(end, start);
   LOG_WARN << seconds << " sec";
   LOG_WARN << 1.0 * clients * requests / seconds << " QPS";
+  if (!set && multiget > 1)
+  {
+    LOG_WARN << 1.0 * clients * requests * multiget / seconds << " keys per second";
+  }
 }
@@ -1,39 +1,96 @@
 #include "Item.h"
+#include "SlabAllocator.h"
 
 #include <muduo/base/LogStream.h>
 #include <muduo/net/Buffer.h>
 
 #include <boost/unordered_map.hpp>
 
+#include <new>
 #include <string.h> // memcpy
 #include <stdio.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
-Item::Item(StringPiece keyArg,
+size_t Item::hashKey(StringPiece key)
+{
+  return boost::hash_range(key.begin(), key.end());
+}
+
+ItemPtr Item::makeItem(SlabAllocator* slabs,
+                       StringPiece keyArg,
+                       uint32_t flagsArg,
+                       int exptimeArg,
+                       int valuelen,
+                       uint64_t casArg)
+{
+  size_t bytes = totalBytes(keyArg.size(), valuelen);
+  int cls = slabs->classOf(bytes);
+  void* chunk = cls >= 0 ? slabs->allocate(cls, bytes) : NULL;
+  if (chunk == NULL)
+  {
+    return ItemPtr();
+  }
+  return ItemPtr(new (chunk) Item(slabs, cls, keyArg, flagsArg, exptimeArg, valuelen, casArg));
+}
+
+ItemPtr Item::makeItem(StringPiece keyArg,
+                       uint32_t flagsArg,
+                       int exptimeArg,
+                       int valuelen,
+                       uint64_t casArg)
+{
+  void* block = ::malloc(totalBytes(keyArg.size(), valuelen));
+  return ItemPtr(new (block) Item(NULL, 0, keyArg, flagsArg, exptimeArg, valuelen, casArg));
+}
+
+Item::Item(SlabAllocator* slabs,
+           int slabClass,
+           StringPiece keyArg,
            uint32_t flagsArg,
            int exptimeArg,
            int valuelen,
            uint64_t casArg)
-  : keylen_(keyArg.size()),
+  : prev_(NULL),
+    next_(NULL),
+    slabs_(slabs),
+    cas_(casArg),
+    hash_(hashKey(keyArg)),
     flags_(flagsArg),
     rel_exptime_(exptimeArg),
     valuelen_(valuelen),
     receivedBytes_(0),
-    cas_(casArg),
-    hash_(boost::hash_range(keyArg.begin(), keyArg.end())),
-    data_(static_cast<char*>(::malloc(totalLen())))
+    keylen_(static_cast<uint8_t>(keyArg.size())),
+    slabClass_(static_cast<uint8_t>(slabClass)),
+    referenced_(0)
 {
+  assert(keyArg.size() <= 250);
   assert(valuelen_ >= 2);
   assert(receivedBytes_ < totalLen());
   append(keyArg.data(), keylen_);
 }
 
-void Item::append(const char* data, size_t len)
+void Item::destroy(const Item* item)
+{
+  SlabAllocator* slabs = item->slabs_;
+  int cls = item->slabClass_;
+  size_t bytes = item->totalBytes();
+  item->~Item();
+  if (slabs)
+  {
+    slabs->deallocate(cls, const_cast<Item*>(item), bytes);
+  }
+  else
+  {
+    ::free(const_cast<Item*>(item));
+  }
+}
+
+void Item::append(const char* buf, size_t len)
 {
   assert(len <= neededBytes());
-  memcpy(data_ + receivedBytes_, data, len);
+  memcpy(data() + receivedBytes_, buf, len);
   receivedBytes_ += static_cast<int>(len);
   assert(receivedBytes_ <= totalLen());
 }
@@ -41,7 +98,7 @@ void Item::append(const char* data, size_t len)
 void Item::output(Buffer* out, bool needCas) const
 {
   out->append("VALUE ");
-  out->append(data_, keylen_);
+  out->append(data(), keylen_);
   LogStream buf;
   buf << ' ' << flags_ << ' ' << valuelen_-2;
   if (needCas)
@@ -56,8 +113,62 @@ void Item::output(Buffer* out, bool needCas) const
 void Item::resetKey(StringPiece k)
 {
   assert(k.size() <= 250);
-  keylen_ = k.size();
+  keylen_ = static_cast<uint8_t>(k.size());
   receivedBytes_ = 0;
   append(k.data(), k.size());
-  hash_ = boost::hash_range(k.begin(), k.end());
+  hash_ = hashKey(k);
+}
+
+void ItemList::pushFront(const Item* item)
+{
+  assert(item->prev_ == NULL && item->next_ == NULL);
+  item->next_ = head_;
+  if (head_)
+  {
+    head_->prev_ = item;
+  }
+  else
+  {
+    tail_ = item;
+  }
+  head_ = item;
+  ++size_;
+}
+
+void ItemList::remove(const Item* item)
+{
+  if (item->prev_)
+  {
+    item->prev_->next_ = item->next_;
+  }
+  else
+  {
+    assert(head_ == item);
+    head_ = item->next_;
+  }
+  if (item->next_)
+  {
+    item->next_->prev_ = item->prev_;
+  }
+  else
+  {
+    assert(tail_ == item);
+    tail_ = item->prev_;
+  }
+  item->prev_ = NULL;
+  item->next_ = NULL;
+  --size_;
+}
+
+const Item* ItemList::victim(int maxSkips)
+{
+  // second chance: a touched item goes back to the front, untouched
+  for (int i = 0; i < maxSkips && tail_ && tail_->referenced_; ++i)
+  {
+    const Item* item = tail_;
+    __sync_lock_release(&item->referenced_);
+    remove(item);
+    pushFront(item);
+  }
+  return tail_;
 }
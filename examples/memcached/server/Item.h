@@ -5,9 +5,8 @@
 #include <muduo/base/StringPiece.h>
 #include <muduo/base/Types.h>
 
-#include <boost/make_shared.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/shared_ptr.hpp>
 
 using muduo::string;
 using muduo::StringPiece;
@@ -21,10 +20,17 @@ class Buffer;
 }
 
 class Item;
-typedef boost::shared_ptr<Item> ItemPtr;  // TODO: use unique_ptr
-typedef boost::shared_ptr<const Item> ConstItemPtr;  // TODO: use unique_ptr
+class SlabAllocator;
+typedef boost::intrusive_ptr<Item> ItemPtr;
+typedef boost::intrusive_ptr<const Item> ConstItemPtr;
+
+void intrusive_ptr_add_ref(const Item* item);
+void intrusive_ptr_release(const Item* item);
 
 // Item is immutable once added into hash table
+//
+// The key and the value follow the header in the same block, which is a
+// chunk of SlabAllocator, or from malloc for items never stored.
 class Item : boost::noncopyable
 {
  public:
@@ -39,30 +45,32 @@ class Item : boost::noncopyable
     kCas,
   };
 
+  /// in a chunk of slabs, returns NULL if it is out of memory
+  static ItemPtr makeItem(SlabAllocator* slabs,
+                          StringPiece keyArg,
+                          uint32_t flagsArg,
+                          int exptimeArg,
+                          int valuelen,
+                          uint64_t casArg);
+
+  /// from malloc, for keys to look up
   static ItemPtr makeItem(StringPiece keyArg,
                           uint32_t flagsArg,
                           int exptimeArg,
                           int valuelen,
-                          uint64_t casArg)
-  {
-    return boost::make_shared<Item>(keyArg, flagsArg, exptimeArg, valuelen, casArg);
-    //return ItemPtr(new Item(keyArg, flagsArg, exptimeArg, valuelen, casArg));
-  }
+                          uint64_t casArg);
 
-  Item(StringPiece keyArg,
-       uint32_t flagsArg,
-       int exptimeArg,
-       int valuelen,
-       uint64_t casArg);
+  /// the same as hash() of an item of this key
+  static size_t hashKey(StringPiece key);
 
-  ~Item()
+  static size_t totalBytes(size_t keylen, int valuelen)
   {
-    ::free(data_);
+    return sizeof(Item) + keylen + valuelen;
   }
 
   muduo::StringPiece key() const
   {
-    return muduo::StringPiece(data_, keylen_);
+    return muduo::StringPiece(data(), keylen_);
   }
 
   uint32_t flags() const
@@ -77,7 +85,7 @@ class Item : boost::noncopyable
 
   const char* value() const
   {
-    return data_+keylen_;
+    return data()+keylen_;
   }
 
   size_t valueLength() const
@@ -95,6 +103,31 @@ class Item : boost::noncopyable
     return hash_;
   }
 
+  /// -1 if from malloc
+  int slabClass() const
+  {
+    return slabs_ ? slabClass_ : -1;
+  }
+
+  size_t totalBytes() const
+  {
+    return totalBytes(keylen_, valuelen_);
+  }
+
+  int refCount() const
+  {
+    return refs_.get();
+  }
+
+  /// marks it used for CLOCK, in the lock of its hash table shard
+  void touch() const
+  {
+    if (!referenced_)
+    {
+      __sync_lock_test_and_set(&referenced_, 1);
+    }
+  }
+
   void setCas(uint64_t casArg)
   {
     cas_ = casArg;
@@ -105,13 +138,13 @@ class Item : boost::noncopyable
     return totalLen() - receivedBytes_;
   }
 
-  void append(const char* data, size_t len);
+  void append(const char* buf, size_t len);
 
   bool endsWithCRLF() const
   {
     return receivedBytes_ == totalLen()
-        && data_[totalLen()-2] == '\r'
-        && data_[totalLen()-1] == '\n';
+        && data()[totalLen()-2] == '\r'
+        && data()[totalLen()-1] == '\n';
   }
 
   void output(muduo::net::Buffer* out, bool needCas = false) const;
@@ -119,16 +152,78 @@ class Item : boost::noncopyable
   void resetKey(StringPiece k);
 
  private:
+  friend class ItemList;
+  friend void intrusive_ptr_add_ref(const Item* item);
+  friend void intrusive_ptr_release(const Item* item);
+
+  Item(SlabAllocator* slabs,
+       int slabClass,
+       StringPiece keyArg,
+       uint32_t flagsArg,
+       int exptimeArg,
+       int valuelen,
+       uint64_t casArg);
+
+  static void destroy(const Item* item);
+
   int totalLen() const { return keylen_ + valuelen_; }
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+  const char* data() const { return reinterpret_cast<const char*>(this + 1); }
 
-  int            keylen_;
+  mutable const Item* prev_;  // in ItemList
+  mutable const Item* next_;
+  SlabAllocator* const slabs_;
+  uint64_t       cas_;
+  size_t         hash_;
   const uint32_t flags_;
   const int      rel_exptime_;
   const int      valuelen_;
   int            receivedBytes_;  // FIXME: remove this member
-  uint64_t       cas_;
-  size_t         hash_;
-  char*          data_;
+  mutable muduo::AtomicInt32 refs_;
+  uint8_t        keylen_;
+  const uint8_t  slabClass_;
+  mutable volatile uint8_t referenced_;
+  // followed by key and value
+};
+
+inline void intrusive_ptr_add_ref(const Item* item)
+{
+  item->refs_.increment();
+}
+
+inline void intrusive_ptr_release(const Item* item)
+{
+  if (item->refs_.decrementAndGet() == 0)
+  {
+    Item::destroy(item);
+  }
+}
+
+// Items of a slab class, the newest first, for CLOCK eviction.
+// Not thread safe.
+class ItemList : boost::noncopyable
+{
+ public:
+  ItemList()
+    : head_(NULL),
+      tail_(NULL),
+      size_(0)
+  {
+  }
+
+  size_t size() const { return size_; }
+
+  void pushFront(const Item* item);
+  void remove(const Item* item);
+
+  /// the oldest item not touched since it was last passed over,
+  /// or the oldest after maxSkips of them; NULL if empty
+  const Item* victim(int maxSkips);
+
+ private:
+  const Item* head_;
+  const Item* tail_;
+  size_t size_;
 };
 
 #endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEM_H
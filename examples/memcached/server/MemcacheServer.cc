@@ -2,15 +2,43 @@
 
 #include <muduo/base/Atomic.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/ProcessInfo.h>
+#include <muduo/net/Buffer.h>
 #include <muduo/net/EventLoop.h>
 
 #include <boost/bind.hpp>
 
+#include <algorithm>
+
 using namespace muduo;
 using namespace muduo::net;
 
 muduo::AtomicInt64 g_cas;
 
+namespace
+{
+const int kEvictTries = 16;
+const int kMaxSkips = 64;  // of recently used items, when evicting
+
+const size_t kLongestKey = 250;
+const size_t kLargestValue = 1024*1024 + 2;
+
+void appendStat(Buffer* out, const char* name, int64_t value)
+{
+  LogStream buf;
+  buf << "STAT " << name << ' ' << value << "\r\n";
+  out->append(buf.buffer().data(), buf.buffer().length());
+}
+
+void appendStat(Buffer* out, int cls, const char* name, int64_t value)
+{
+  LogStream buf;
+  // numbered from 1 as in memcached
+  buf << "STAT " << cls + 1 << ':' << name << ' ' << value << "\r\n";
+  out->append(buf.buffer().data(), buf.buffer().length());
+}
+}
+
 MemcacheServer::Options::Options()
 {
   bzero(this, sizeof(*this));
@@ -18,12 +46,18 @@ MemcacheServer::Options::Options()
 
 struct MemcacheServer::Stats
 {
+  Stats() : totalConnections(0) { }
+  int64_t totalConnections;  // guarded by mutex_
 };
 
 MemcacheServer::MemcacheServer(muduo::net::EventLoop* loop, const Options& options)
   : loop_(loop),
     options_(options),
     startTime_(::time(NULL)-1),
+    slabs_(options.maxMemory,
+           sizeof(Item) + 32,
+           Item::totalBytes(kLongestKey, kLargestValue),
+           1.25),
     server_(loop, InetAddress(options.tcpport), "muduo-memcached"),
     stats_(new Stats)
 {
@@ -45,9 +79,89 @@ void MemcacheServer::stop()
   loop_->runAfter(3.0, boost::bind(&EventLoop::quit, loop_));
 }
 
+ItemPtr MemcacheServer::makeItem(StringPiece key,
+                                 uint32_t flags,
+                                 int exptime,
+                                 int valuelen,
+                                 uint64_t cas)
+{
+  ItemPtr item(Item::makeItem(&slabs_, key, flags, exptime, valuelen, cas));
+  int cls = slabs_.classOf(Item::totalBytes(key.size(), valuelen));
+  for (int i = 0; !item && cls >= 0 && i < kEvictTries; ++i)
+  {
+    // the chunk comes back once the last reader lets the item go
+    if (!evict(cls))
+    {
+      break;
+    }
+    item = Item::makeItem(&slabs_, key, flags, exptime, valuelen, cas);
+  }
+  if (!item && cls >= 0)
+  {
+    MutexLockGuard lock(clocks_[cls].mutex);
+    ++clocks_[cls].outOfMemory;
+  }
+  return item;
+}
+
+bool MemcacheServer::evict(int cls)
+{
+  char key[kLongestKey];
+  size_t keylen = 0;
+  size_t hash = 0;
+  const Item* victim = NULL;
+  {
+    ItemClock& clock = clocks_[cls];
+    MutexLockGuard lock(clock.mutex);
+    victim = clock.items.victim(kMaxSkips);
+    if (victim == NULL)
+    {
+      return false;
+    }
+    // alive as long as it is listed, but may leave its shard once unlocked
+    keylen = victim->key().size();
+    memcpy(key, victim->key().data(), keylen);
+    hash = victim->hash();
+  }
+
+  MapWithLock& shard = shards_[hash % kShards];
+  MutexLockGuard lock(shard.mutex);
+  ItemMap::const_iterator it = shard.items.find(KeyRef(StringPiece(key, static_cast<int>(keylen)), hash),
+                                                KeyRefHash(), KeyRefEqual());
+  // only compared, the key may have been stored again meanwhile
+  if (it != shard.items.end() && it->get() == victim)
+  {
+    unlink(*it);
+    shard.items.erase(it);
+    MutexLockGuard clockLock(clocks_[cls].mutex);
+    ++clocks_[cls].evictions;
+  }
+  return true;
+}
+
+void MemcacheServer::link(const ConstItemPtr& item)
+{
+  ItemClock& clock = clocks_[item->slabClass()];
+  MutexLockGuard lock(clock.mutex);
+  clock.items.pushFront(item.get());
+}
+
+void MemcacheServer::unlink(const ConstItemPtr& item)
+{
+  ItemClock& clock = clocks_[item->slabClass()];
+  MutexLockGuard lock(clock.mutex);
+  clock.items.remove(item.get());
+}
+
 bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
 {
   assert(item->neededBytes() == 0);
+  assert(item->slabClass() >= 0);
+  if (policy == Item::kAppend || policy == Item::kPrepend)
+  {
+    return appendItem(item, policy, exists);
+  }
+
   MutexLock& mutex = shards_[item->hash() % kShards].mutex;
   ItemMap& items = shards_[item->hash() % kShards].items;
   MutexLockGuard lock(mutex);
@@ -58,9 +172,11 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
     item->setCas(g_cas.incrementAndGet());
     if (*exists)
     {
+      unlink(*it);
       items.erase(it);
     }
     items.insert(item);
+    link(item);
   }
   else
   {
@@ -74,6 +190,7 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       {
         item->setCas(g_cas.incrementAndGet());
         items.insert(item);
+        link(item);
       }
     }
     else if (policy == Item::kReplace)
@@ -81,39 +198,10 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       if (*exists)
       {
         item->setCas(g_cas.incrementAndGet());
+        unlink(*it);
         items.erase(it);
         items.insert(item);
-      }
-      else
-      {
-        return false;
-      }
-    }
-    else if (policy == Item::kAppend || policy == Item::kPrepend)
-    {
-      if (*exists)
-      {
-        const ConstItemPtr& oldItem = *it;
-        int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
-        ItemPtr newItem(Item::makeItem(item->key(),
-                                       oldItem->flags(),
-                                       oldItem->rel_exptime(),
-                                       newLen,
-                                       g_cas.incrementAndGet()));
-        if (policy == Item::kAppend)
-        {
-          newItem->append(oldItem->value(), oldItem->valueLength() - 2);
-          newItem->append(item->value(), item->valueLength());
-        }
-        else
-        {
-          newItem->append(item->value(), item->valueLength() - 2);
-          newItem->append(oldItem->value(), oldItem->valueLength());
-        }
-        assert(newItem->neededBytes() == 0);
-        assert(newItem->endsWithCRLF());
-        items.erase(it);
-        items.insert(newItem);
+        link(item);
       }
       else
       {
@@ -125,8 +213,10 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       if (*exists && (*it)->cas() == item->cas())
       {
         item->setCas(g_cas.incrementAndGet());
+        unlink(*it);
         items.erase(it);
         items.insert(item);
+        link(item);
       }
       else
       {
@@ -141,13 +231,113 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
   return true;
 }
 
+// copies the value out of the lock, which also lets the old item be
+// evicted to make room for the new one
+bool MemcacheServer::appendItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
+{
+  MutexLock& mutex = shards_[item->hash() % kShards].mutex;
+  ItemMap& items = shards_[item->hash() % kShards].items;
+  while (true)
+  {
+    ConstItemPtr oldItem;
+    {
+      MutexLockGuard lock(mutex);
+      ItemMap::const_iterator it = items.find(item);
+      *exists = it != items.end();
+      if (!*exists)
+      {
+        return false;
+      }
+      oldItem = *it;
+    }
+
+    int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
+    ItemPtr newItem(makeItem(item->key(),
+                             oldItem->flags(),
+                             oldItem->rel_exptime(),
+                             newLen,
+                             0));
+    if (!newItem)
+    {
+      return false;
+    }
+    if (policy == Item::kAppend)
+    {
+      newItem->append(oldItem->value(), oldItem->valueLength() - 2);
+      newItem->append(item->value(), item->valueLength());
+    }
+    else
+    {
+      newItem->append(item->value(), item->valueLength() - 2);
+      newItem->append(oldItem->value(), oldItem->valueLength());
+    }
+    assert(newItem->neededBytes() == 0);
+    assert(newItem->endsWithCRLF());
+
+    MutexLockGuard lock(mutex);
+    ItemMap::const_iterator it = items.find(item);
+    if (it != items.end() && *it == oldItem)
+    {
+      newItem->setCas(g_cas.incrementAndGet());
+      unlink(*it);
+      items.erase(it);
+      items.insert(newItem);
+      link(newItem);
+      return true;
+    }
+    // changed meanwhile, do it again
+  }
+}
+
 ConstItemPtr MemcacheServer::getItem(const ConstItemPtr& key) const
 {
   MutexLock& mutex = shards_[key->hash() % kShards].mutex;
   const ItemMap& items = shards_[key->hash() % kShards].items;
   MutexLockGuard lock(mutex);
   ItemMap::const_iterator it = items.find(key);
-  return it != items.end() ? *it : ConstItemPtr();
+  if (it != items.end())
+  {
+    (*it)->touch();
+    return *it;
+  }
+  return ConstItemPtr();
+}
+
+void MemcacheServer::getItems(const std::vector<StringPiece>& keys,
+                              std::vector<ConstItemPtr>* items) const
+{
+  items->clear();
+  items->resize(keys.size());
+  // (shard, index of key), in order of shards
+  std::vector<std::pair<size_t, size_t> > order;
+  std::vector<size_t> hashes;
+  order.reserve(keys.size());
+  hashes.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    hashes.push_back(Item::hashKey(keys[i]));
+    order.push_back(std::make_pair(hashes.back() % kShards, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  size_t i = 0;
+  while (i < order.size())
+  {
+    const MapWithLock& shard = shards_[order[i].first];
+    MutexLockGuard lock(shard.mutex);
+    do
+    {
+      size_t index = order[i].second;
+      ItemMap::const_iterator it = shard.items.find(KeyRef(keys[index], hashes[index]),
+                                                    KeyRefHash(), KeyRefEqual());
+      if (it != shard.items.end())
+      {
+        (*it)->touch();
+        (*items)[index] = *it;
+      }
+      ++i;
+    } while (i < order.size() && order[i].first == order[i-1].first);
+  }
 }
 
 bool MemcacheServer::deleteItem(const ConstItemPtr& key)
@@ -155,7 +345,90 @@ bool MemcacheServer::deleteItem(const ConstItemPtr& key)
   MutexLock& mutex = shards_[key->hash() % kShards].mutex;
   ItemMap& items = shards_[key->hash() % kShards].items;
   MutexLockGuard lock(mutex);
-  return items.erase(key) == 1;
+  ItemMap::const_iterator it = items.find(key);
+  if (it != items.end())
+  {
+    unlink(*it);
+    items.erase(it);
+    return true;
+  }
+  return false;
+}
+
+bool MemcacheServer::printStats(StringPiece what, Buffer* out) const
+{
+  int64_t items = 0;
+  int64_t evictions = 0;
+  int64_t requested = 0;
+  int activeSlabs = 0;
+  for (int cls = 0; cls < slabs_.numClasses(); ++cls)
+  {
+    SlabAllocator::ClassStats slab = slabs_.stats(cls);
+    int64_t classItems = 0;
+    int64_t classEvictions = 0;
+    int64_t classOutOfMemory = 0;
+    {
+      const ItemClock& clock = clocks_[cls];
+      MutexLockGuard lock(clock.mutex);
+      classItems = static_cast<int64_t>(clock.items.size());
+      classEvictions = clock.evictions;
+      classOutOfMemory = clock.outOfMemory;
+    }
+    items += classItems;
+    evictions += classEvictions;
+    requested += static_cast<int64_t>(slab.requestedBytes);
+    if (slab.pages == 0)
+    {
+      continue;
+    }
+    ++activeSlabs;
+    if (what == "slabs")
+    {
+      appendStat(out, cls, "chunk_size", static_cast<int64_t>(slab.chunkSize));
+      appendStat(out, cls, "total_pages", static_cast<int64_t>(slab.pages));
+      appendStat(out, cls, "total_chunks", static_cast<int64_t>(slab.totalChunks));
+      appendStat(out, cls, "used_chunks", static_cast<int64_t>(slab.usedChunks));
+      appendStat(out, cls, "free_chunks", static_cast<int64_t>(slab.totalChunks - slab.usedChunks));
+      appendStat(out, cls, "mem_requested", static_cast<int64_t>(slab.requestedBytes));
+      appendStat(out, cls, "curr_items", classItems);
+      appendStat(out, cls, "evictions", classEvictions);
+      appendStat(out, cls, "outofmemory", classOutOfMemory);
+    }
+  }
+
+  if (what == "slabs")
+  {
+    appendStat(out, "active_slabs", activeSlabs);
+    appendStat(out, "total_malloced", static_cast<int64_t>(slabs_.allocatedBytes()));
+  }
+  else if (what.empty())
+  {
+    time_t now = ::time(NULL);
+    int64_t connections = 0;
+    int64_t totalConnections = 0;
+    {
+      MutexLockGuard lock(mutex_);
+      connections = static_cast<int64_t>(sessions_.size());
+      totalConnections = stats_->totalConnections;
+    }
+    appendStat(out, "pid", ProcessInfo::pid());
+    appendStat(out, "uptime", now - startTime_);
+    appendStat(out, "time", now);
+    appendStat(out, "threads", options_.threads);
+    appendStat(out, "curr_connections", connections);
+    appendStat(out, "total_connections", totalConnections);
+    appendStat(out, "curr_items", items);
+    appendStat(out, "bytes", requested);
+    appendStat(out, "limit_maxbytes", static_cast<int64_t>(slabs_.memoryLimit()));
+    appendStat(out, "total_malloced", static_cast<int64_t>(slabs_.allocatedBytes()));
+    appendStat(out, "evictions", evictions);
+  }
+  else
+  {
+    return false;
+  }
+  out->append("END\r\n");
+  return true;
 }
 
 void MemcacheServer::onConnection(const TcpConnectionPtr& conn)
@@ -166,6 +439,7 @@ void MemcacheServer::onConnection(const TcpConnectionPtr& conn)
     MutexLockGuard lock(mutex_);
     assert(sessions_.find(conn->name()) == sessions_.end());
     sessions_[conn->name()] = session;
+    ++stats_->totalConnections;
     // assert(sessions_.size() == stats_.current_conns);
   }
   else
@@ -3,6 +3,7 @@
 
 #include "Item.h"
 #include "Session.h"
+#include "SlabAllocator.h"
 
 #include <muduo/base/Mutex.h>
 #include <muduo/net/TcpServer.h>
@@ -13,6 +14,8 @@
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 
+#include <vector>
+
 class MemcacheServer : boost::noncopyable
 {
  public:
@@ -23,6 +26,7 @@ class MemcacheServer : boost::noncopyable
     uint16_t udpport;
     uint16_t gperfport;
     int threads;
+    size_t maxMemory;  // in bytes of slab pages, 0 for unlimited
   };
 
   MemcacheServer(muduo::net::EventLoop* loop, const Options&);
@@ -34,18 +38,39 @@ class MemcacheServer : boost::noncopyable
 
   time_t startTime() const { return startTime_; }
 
+  /// in the slabs, evicting items of its size if the memory is all used,
+  /// returns NULL if none could be evicted
+  ItemPtr makeItem(StringPiece key,
+                   uint32_t flags,
+                   int exptime,
+                   int valuelen,
+                   uint64_t cas);
   bool storeItem(const ItemPtr& item, Item::UpdatePolicy policy, bool* exists);
   ConstItemPtr getItem(const ConstItemPtr& key) const;
+  /// looks up keys grouped by shard, taking the lock of each shard once,
+  /// items[i] is NULL if keys[i] is not found
+  void getItems(const std::vector<StringPiece>& keys,
+                std::vector<ConstItemPtr>* items) const;
   bool deleteItem(const ConstItemPtr& key);
 
+  /// "" or "slabs", returns false for other kinds of stats
+  bool printStats(StringPiece what, muduo::net::Buffer* out) const;
+
  private:
   void onConnection(const muduo::net::TcpConnectionPtr& conn);
+  bool appendItem(const ItemPtr& item, Item::UpdatePolicy policy, bool* exists);
+  bool evict(int slabClass);
+  // with the lock of the shard of item
+  void link(const ConstItemPtr& item);
+  void unlink(const ConstItemPtr& item);
 
   struct Stats;
 
   muduo::net::EventLoop* loop_;  // not own
   Options options_;
   const time_t startTime_;
+  // before anything holding items, which go back to it
+  SlabAllocator slabs_;
 
   mutable muduo::MutexLock mutex_;
   boost::unordered_map<string, SessionPtr> sessions_;
@@ -69,14 +94,54 @@ class MemcacheServer : boost::noncopyable
 
   typedef boost::unordered_set<ConstItemPtr, Hash, Equal> ItemMap;
 
+  // to look up by a key without making an item
+  struct KeyRef
+  {
+    KeyRef(StringPiece k, size_t h) : key(k), hash(h) { }
+    StringPiece key;
+    size_t hash;
+  };
+
+  struct KeyRefHash
+  {
+    size_t operator()(const KeyRef& x) const
+    {
+      return x.hash;
+    }
+  };
+
+  struct KeyRefEqual
+  {
+    bool operator()(const KeyRef& x, const ConstItemPtr& y) const
+    {
+      return x.key == y->key();
+    }
+
+    bool operator()(const ConstItemPtr& x, const KeyRef& y) const
+    {
+      return x->key() == y.key;
+    }
+  };
+
   struct MapWithLock
   {
     ItemMap items;
     mutable muduo::MutexLock mutex;
   };
 
+  // the items stored of a slab class, for eviction
+  struct ItemClock
+  {
+    ItemClock() : evictions(0), outOfMemory(0) { }
+    ItemList items;
+    int64_t evictions;
+    int64_t outOfMemory;
+    mutable muduo::MutexLock mutex;
+  };
+
   const static int kShards = 4096;
 
+  boost::array<ItemClock, SlabAllocator::kMaxClasses> clocks_;
   boost::array<MapWithLock, kShards> shards_;
 
   // NOT guarded by mutex_, but here because server_ has to destructs before
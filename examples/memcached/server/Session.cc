@@ -1,6 +1,8 @@
 #include "Session.h"
 #include "MemcacheServer.h"
 
+#include <muduo/net/Endian.h>
+
 #ifdef HAVE_TCMALLOC
 #include <gperftools/malloc_extension.h>
 #endif
@@ -14,8 +16,121 @@ static bool isBinaryProtocol(uint8_t firstByte)
 }
 
 const int kLongestKeySize = 250;
+const int kLargestValueSize = 1024*1024;
 string Session::kLongestKey(kLongestKeySize, 'x');
 
+// the binary protocol of memcached
+namespace
+{
+const uint8_t kRequestMagic = 0x80;
+const uint8_t kResponseMagic = 0x81;
+const size_t kBinaryHeaderSize = 24;
+
+enum Opcode
+{
+  kGet = 0x00,
+  kSet = 0x01,
+  kAdd = 0x02,
+  kReplace = 0x03,
+  kDelete = 0x04,
+  kQuit = 0x07,
+  kGetQ = 0x09,
+  kNoop = 0x0a,
+  kVersion = 0x0b,
+  kGetK = 0x0c,
+  kGetKQ = 0x0d,
+  kAppend = 0x0e,
+  kPrepend = 0x0f,
+  kSetQ = 0x11,
+  kAddQ = 0x12,
+  kReplaceQ = 0x13,
+  kDeleteQ = 0x14,
+  kQuitQ = 0x17,
+  kAppendQ = 0x19,
+  kPrependQ = 0x1a,
+};
+
+enum Status
+{
+  kSuccess = 0x0000,
+  kKeyNotFound = 0x0001,
+  kKeyExists = 0x0002,
+  kValueTooLarge = 0x0003,
+  kInvalidArguments = 0x0004,
+  kItemNotStored = 0x0005,
+  kUnknownCommand = 0x0081,
+  kOutOfMemory = 0x0082,
+};
+
+bool isGet(uint8_t opcode)
+{
+  return opcode == kGet || opcode == kGetQ || opcode == kGetK || opcode == kGetKQ;
+}
+
+bool isUpdate(uint8_t opcode)
+{
+  return (kSet <= opcode && opcode <= kReplace)
+      || (kSetQ <= opcode && opcode <= kReplaceQ)
+      || opcode == kAppend || opcode == kPrepend
+      || opcode == kAppendQ || opcode == kPrependQ;
+}
+
+// replies only on failures
+bool isQuiet(uint8_t opcode)
+{
+  return opcode == kGetQ || opcode == kGetKQ || opcode == kSetQ || opcode == kAddQ
+      || opcode == kReplaceQ || opcode == kDeleteQ || opcode == kQuitQ
+      || opcode == kAppendQ || opcode == kPrependQ;
+}
+
+const char* statusMessage(uint16_t status)
+{
+  switch (status)
+  {
+    case kKeyNotFound: return "Not found";
+    case kKeyExists: return "Data exists for key.";
+    case kValueTooLarge: return "Too large.";
+    case kInvalidArguments: return "Invalid arguments";
+    case kItemNotStored: return "Not stored.";
+    case kUnknownCommand: return "Unknown command";
+    case kOutOfMemory: return "Out of memory";
+    default: return "";
+  }
+}
+}
+
+struct Session::BinaryHeader
+{
+  explicit BinaryHeader(const char* data)
+  {
+    using namespace muduo::net::sockets;
+    uint16_t be16 = 0;
+    uint32_t be32 = 0;
+    uint64_t be64 = 0;
+    magic = static_cast<uint8_t>(data[0]);
+    opcode = static_cast<uint8_t>(data[1]);
+    memcpy(&be16, data + 2, sizeof be16);
+    keylen = networkToHost16(be16);
+    extlen = static_cast<uint8_t>(data[4]);
+    memcpy(&be32, data + 8, sizeof be32);
+    bodylen = networkToHost32(be32);
+    memcpy(&opaque, data + 12, sizeof opaque);  // returned as is
+    memcpy(&be64, data + 16, sizeof be64);
+    cas = networkToHost64(be64);
+  }
+
+  // a request with its body, if all received
+  size_t totalLength() const { return kBinaryHeaderSize + bodylen; }
+
+  uint8_t magic;
+  uint8_t opcode;
+  uint16_t keylen;
+  uint8_t extlen;
+  uint32_t bodylen;
+  uint32_t opaque;
+  uint64_t cas;
+};
+
 template <typename InputIterator, typename Token>
 bool Session::SpaceSeparator::operator()(InputIterator& next, InputIterator end, Token& tok)
 {
@@ -90,7 +205,10 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
       assert(protocol_ == kAscii || protocol_ == kBinary);
       if (protocol_ == kBinary)
       {
-        // FIXME
+        if (!processBinaryRequest(buf))
+        {
+          break;
+        }
       }
       else  // ASCII protocol
       {
@@ -131,21 +249,31 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
     }
   }
   bytesRead_ += initialReadable - buf->readableBytes();
+  // replies to all requests received, in one write
+  flush();
 }
 
 void Session::receiveValue(muduo::net::Buffer* buf)
 {
   assert(currItem_.get());
   assert(state_ == kReceiveValue);
-  // if (protocol_ == kBinary)
-
-  const size_t avail = std::min(buf->readableBytes(), currItem_->neededBytes());
-  assert(currItem_.unique());
+  // values of the binary protocol come without "\r\n"
+  const size_t trailer = protocol_ == kBinary ? 2 : 0;
+  const size_t avail = std::min(buf->readableBytes(), currItem_->neededBytes() - trailer);
+  assert(currItem_->refCount() == 1);
   currItem_->append(buf->peek(), avail);
   buf->retrieve(avail);
+  if (currItem_->neededBytes() == trailer && trailer > 0)
+  {
+    currItem_->append("\r\n", trailer);
+  }
   if (currItem_->neededBytes() == 0)
   {
-    if (currItem_->endsWithCRLF())
+    if (protocol_ == kBinary)
+    {
+      storeBinary();
+    }
+    else if (currItem_->endsWithCRLF())
     {
       bool exists = false;
       if (owner_->storeItem(currItem_, policy_, &exists))
@@ -238,7 +366,7 @@ bool Session::processRequest(StringPiece request)
   {
     bool cas = command_ == "gets";
 
-    // FIXME: send multiple chunks with write complete callback.
+    keys_.clear();
     while (beg != tok.end())
     {
       StringPiece key = *beg;
@@ -248,29 +376,38 @@ bool Session::processRequest(StringPiece request)
         reply("CLIENT_ERROR bad command line format\r\n");
         return true;
       }
-
-      needle_->resetKey(key);
-      ConstItemPtr item = owner_->getItem(needle_);
+      keys_.push_back(key);
       ++beg;
-      if (item)
-      {
-        item->output(&outputBuf_, cas);
-      }
     }
-    outputBuf_.append("END\r\n");
 
-    if (conn_->outputBuffer()->writableBytes() > 65536 + outputBuf_.readableBytes())
+    // FIXME: send multiple chunks with write complete callback.
+    owner_->getItems(keys_, &items_);
+    for (size_t i = 0; i < items_.size(); ++i)
     {
-      LOG_DEBUG << "shrink output buffer from " << conn_->outputBuffer()->internalCapacity();
-      conn_->outputBuffer()->shrink(65536 + outputBuf_.readableBytes());
+      if (items_[i])
+      {
+        items_[i]->output(&outputBuf_, cas);
+      }
     }
-
-    conn_->send(&outputBuf_);
+    items_.clear();
+    outputBuf_.append("END\r\n");
   }
   else if (command_ == "delete")
   {
     doDelete(beg, tok.end());
   }
+  else if (command_ == "stats")
+  {
+    StringPiece what;
+    if (beg != tok.end())
+    {
+      what = *beg;
+    }
+    if (!owner_->printStats(what, &outputBuf_))
+    {
+      reply("ERROR\r\n");
+    }
+  }
   else if (command_ == "version")
   {
 #ifdef HAVE_TCMALLOC
@@ -289,11 +426,13 @@ bool Session::processRequest(StringPiece request)
 #endif
   else if (command_ == "quit")
   {
+    flush();
     conn_->shutdown();
   }
   else if (command_ == "shutdown")
   {
     // "ERROR: shutdown not enabled"
+    flush();
     conn_->shutdown();
     owner_->stop();
   }
@@ -318,10 +457,36 @@ void Session::reply(muduo::StringPiece msg)
 {
   if (!noreply_)
   {
-    conn_->send(msg.data(), msg.size());
+    outputBuf_.append(msg.data(), msg.size());
   }
 }
 
+void Session::flush()
+{
+  if (outputBuf_.readableBytes() > 0)
+  {
+    conn_->send(&outputBuf_);
+  }
+}
+
+int Session::relativeExptime(time_t exptime) const
+{
+  int rel_exptime = static_cast<int>(exptime);
+  if (exptime > 60*60*24*30)
+  {
+    rel_exptime = static_cast<int>(exptime - owner_->startTime());
+    if (rel_exptime < 1)
+    {
+      rel_exptime = 1;
+    }
+  }
+  else
+  {
+    // rel_exptime = exptime + currentTime;
+  }
+  return rel_exptime;
+}
+
 bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::iterator end)
 {
   if (command_ == "set")
@@ -352,19 +517,7 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
   Reader r(beg, end);
   good = good && r.read(&flags) && r.read(&exptime) && r.read(&bytes);
 
-  int rel_exptime = static_cast<int>(exptime);
-  if (exptime > 60*60*24*30)
-  {
-    rel_exptime = static_cast<int>(exptime - owner_->startTime());
-    if (rel_exptime < 1)
-    {
-      rel_exptime = 1;
-    }
-  }
-  else
-  {
-    // rel_exptime = exptime + currentTime;
-  }
+  int rel_exptime = relativeExptime(exptime);
 
   if (good && policy_ == Item::kCas)
   {
@@ -376,7 +529,7 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     reply("CLIENT_ERROR bad command line format\r\n");
     return true;
   }
-  if (bytes > 1024*1024)
+  if (bytes > kLargestValueSize)
   {
     reply("SERVER_ERROR object too large for cache\r\n");
     needle_->resetKey(key);
@@ -387,8 +540,20 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
   }
   else
   {
-    currItem_ = Item::makeItem(key, flags, rel_exptime, bytes + 2, cas);
-    state_ = kReceiveValue;
+    currItem_ = owner_->makeItem(key, flags, rel_exptime, bytes + 2, cas);
+    if (currItem_)
+    {
+      state_ = kReceiveValue;
+    }
+    else
+    {
+      // as memcached, the old value goes as it would have been replaced
+      reply("SERVER_ERROR out of memory storing object\r\n");
+      needle_->resetKey(key);
+      owner_->deleteItem(needle_);
+      bytesToDiscard_ = bytes + 2;
+      state_ = kDiscardValue;
+    }
     return false;
   }
 }
@@ -421,3 +586,315 @@ void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     }
   }
 }
+
+// returns false if it needs more data
+bool Session::processBinaryRequest(muduo::net::Buffer* buf)
+{
+  if (buf->readableBytes() < kBinaryHeaderSize)
+  {
+    return false;
+  }
+  BinaryHeader header(buf->peek());
+  if (header.magic != kRequestMagic
+      || header.bodylen > static_cast<uint32_t>(kLargestValueSize + kLongestKeySize + 1024))
+  {
+    LOG_INFO << "Bad binary request, magic " << static_cast<int>(header.magic)
+             << " body length " << header.bodylen;
+    flush();
+    conn_->shutdown();
+    buf->retrieveAll();
+    return false;
+  }
+  if (isGet(header.opcode))
+  {
+    return doBinaryGets(buf);
+  }
+  if (isUpdate(header.opcode))
+  {
+    return doBinaryUpdate(header, buf);
+  }
+  if (buf->readableBytes() < header.totalLength())
+  {
+    return false;
+  }
+
+  ++requestsProcessed_;
+  opcode_ = header.opcode;
+  opaque_ = header.opaque;
+  noreply_ = isQuiet(opcode_);
+  StringPiece key(buf->peek() + kBinaryHeaderSize + header.extlen, header.keylen);
+  bool quit = false;
+  if (header.extlen + header.keylen > header.bodylen)
+  {
+    replyBinary(kInvalidArguments);
+  }
+  else if (opcode_ == kDelete || opcode_ == kDeleteQ)
+  {
+    if (key.empty() || key.size() > kLongestKeySize || header.extlen != 0)
+    {
+      replyBinary(kInvalidArguments);
+    }
+    else
+    {
+      needle_->resetKey(key);
+      replyBinary(owner_->deleteItem(needle_) ? kSuccess : kKeyNotFound);
+    }
+  }
+  else if (opcode_ == kNoop)
+  {
+    replyBinary(kSuccess);
+  }
+  else if (opcode_ == kVersion)
+  {
+    StringPiece version("0.01 muduo");
+    appendBinaryHeader(opcode_, kSuccess, opaque_, 0, 0, 0, version.size());
+    outputBuf_.append(version.data(), version.size());
+  }
+  else if (opcode_ == kQuit || opcode_ == kQuitQ)
+  {
+    replyBinary(kSuccess);
+    quit = true;
+  }
+  else
+  {
+    replyBinary(kUnknownCommand);
+    LOG_INFO << "Unknown binary command: " << static_cast<int>(opcode_);
+  }
+  buf->retrieve(header.totalLength());
+  resetRequest();
+
+  if (quit)
+  {
+    flush();
+    conn_->shutdown();
+    buf->retrieveAll();
+    return false;
+  }
+  return true;
+}
+
+// Takes all gets in a row, as a client sends getq and getkq for many keys
+// followed by a noop, to look them up together.
+bool Session::doBinaryGets(muduo::net::Buffer* buf)
+{
+  gets_.clear();
+  keys_.clear();
+  const char* next = buf->peek();
+  while (static_cast<size_t>(buf->beginWrite() - next) >= kBinaryHeaderSize)
+  {
+    BinaryHeader header(next);
+    if (header.magic != kRequestMagic
+        || !isGet(header.opcode)
+        || static_cast<size_t>(buf->beginWrite() - next) < header.totalLength())
+    {
+      break;
+    }
+    BinaryGet get = { header.opcode, header.opaque, true };
+    if (header.extlen != 0 || header.keylen != header.bodylen
+        || header.keylen == 0 || header.keylen > kLongestKeySize)
+    {
+      get.good = false;
+    }
+    gets_.push_back(get);
+    keys_.push_back(get.good ? StringPiece(next + kBinaryHeaderSize, header.keylen)
+                             : StringPiece());
+    next += header.totalLength();
+  }
+  if (gets_.empty())
+  {
+    return false;
+  }
+
+  owner_->getItems(keys_, &items_);
+  for (size_t i = 0; i < gets_.size(); ++i)
+  {
+    const BinaryGet& get = gets_[i];
+    const ConstItemPtr& item = items_[i];
+    if (!get.good)
+    {
+      appendBinaryError(get.opcode, kInvalidArguments, get.opaque);
+    }
+    else if (item)
+    {
+      bool withKey = get.opcode == kGetK || get.opcode == kGetKQ;
+      StringPiece key = withKey ? item->key() : StringPiece();
+      size_t valuelen = item->valueLength() - 2;
+      appendBinaryHeader(get.opcode, kSuccess, get.opaque, item->cas(),
+                         sizeof(uint32_t), key.size(), valuelen);
+      outputBuf_.appendInt32(static_cast<int32_t>(item->flags()));
+      outputBuf_.append(key.data(), key.size());
+      outputBuf_.append(item->value(), valuelen);
+    }
+    else if (!isQuiet(get.opcode))
+    {
+      appendBinaryError(get.opcode, kKeyNotFound, get.opaque);
+    }
+  }
+  requestsProcessed_ += gets_.size();
+  items_.clear();
+  buf->retrieve(next - buf->peek());
+  return true;
+}
+
+// receives the value as the ASCII protocol does, after the key and extras
+bool Session::doBinaryUpdate(const BinaryHeader& header, muduo::net::Buffer* buf)
+{
+  const bool isAppend = header.opcode == kAppend || header.opcode == kPrepend
+      || header.opcode == kAppendQ || header.opcode == kPrependQ;
+  const size_t extlen = isAppend ? 0 : 2 * sizeof(uint32_t);
+  if (header.extlen + header.keylen > header.bodylen)
+  {
+    flush();
+    conn_->shutdown();
+    buf->retrieveAll();
+    return false;
+  }
+  if (buf->readableBytes() < kBinaryHeaderSize + header.extlen + header.keylen)
+  {
+    return false;
+  }
+
+  ++requestsProcessed_;
+  opcode_ = header.opcode;
+  opaque_ = header.opaque;
+  noreply_ = isQuiet(opcode_);
+  switch (opcode_)
+  {
+    case kSet: case kSetQ:
+      policy_ = header.cas == 0 ? Item::kSet : Item::kCas;
+      break;
+    case kAdd: case kAddQ:
+      policy_ = Item::kAdd;
+      break;
+    case kReplace: case kReplaceQ:
+      policy_ = Item::kReplace;
+      break;
+    case kAppend: case kAppendQ:
+      policy_ = Item::kAppend;
+      break;
+    default:
+      policy_ = Item::kPrepend;
+  }
+
+  const char* extras = buf->peek() + kBinaryHeaderSize;
+  StringPiece key(extras + header.extlen, header.keylen);
+  const size_t valuelen = header.bodylen - header.extlen - header.keylen;
+  uint16_t status = kSuccess;
+  if (header.extlen != extlen || key.empty() || key.size() > kLongestKeySize)
+  {
+    status = kInvalidArguments;
+  }
+  else if (valuelen > static_cast<size_t>(kLargestValueSize))
+  {
+    status = kValueTooLarge;
+  }
+  else
+  {
+    uint32_t flags = 0;
+    uint32_t exptime = 0;
+    if (extlen > 0)
+    {
+      memcpy(&flags, extras, sizeof flags);
+      memcpy(&exptime, extras + sizeof flags, sizeof exptime);
+    }
+    currItem_ = owner_->makeItem(key,
+                                 sockets::networkToHost32(flags),
+                                 relativeExptime(sockets::networkToHost32(exptime)),
+                                 static_cast<int>(valuelen) + 2,
+                                 header.cas);
+    if (!currItem_)
+    {
+      status = kOutOfMemory;
+    }
+  }
+
+  if (status != kSuccess && status != kInvalidArguments)
+  {
+    // as the ASCII protocol, the old value goes as it would have been replaced
+    needle_->resetKey(key);
+    owner_->deleteItem(needle_);
+  }
+  buf->retrieve(kBinaryHeaderSize + header.extlen + header.keylen);
+  if (status == kSuccess)
+  {
+    state_ = kReceiveValue;
+    receiveValue(buf);
+  }
+  else
+  {
+    replyBinary(status);
+    bytesToDiscard_ = valuelen;
+    if (bytesToDiscard_ > 0)
+    {
+      state_ = kDiscardValue;
+    }
+    else
+    {
+      resetRequest();
+    }
+  }
+  return true;
+}
+
+void Session::storeBinary()
+{
+  bool exists = false;
+  if (owner_->storeItem(currItem_, policy_, &exists))
+  {
+    if (!noreply_)
+    {
+      appendBinaryHeader(opcode_, kSuccess, opaque_, currItem_->cas(), 0, 0, 0);
+    }
+  }
+  else if (policy_ == Item::kAdd || (policy_ == Item::kCas && exists))
+  {
+    replyBinary(kKeyExists);
+  }
+  else if (policy_ == Item::kAppend || policy_ == Item::kPrepend)
+  {
+    replyBinary(kItemNotStored);
+  }
+  else
+  {
+    replyBinary(kKeyNotFound);
+  }
+}
+
+// for the current request, with no value; quiet ones reply only errors
+void Session::replyBinary(uint16_t status)
+{
+  if (status != kSuccess)
+  {
+    appendBinaryError(opcode_, status, opaque_);
+  }
+  else if (!noreply_)
+  {
+    appendBinaryHeader(opcode_, status, opaque_, 0, 0, 0, 0);
+  }
+}
+
+void Session::appendBinaryError(uint8_t opcode, uint16_t status, uint32_t opaque)
+{
+  StringPiece message(statusMessage(status));
+  appendBinaryHeader(opcode, status, opaque, 0, 0, 0, message.size());
+  outputBuf_.append(message.data(), message.size());
+}
+
+void Session::appendBinaryHeader(uint8_t opcode,
+                                 uint16_t status,
+                                 uint32_t opaque,
+                                 uint64_t cas,
+                                 size_t extlen,
+                                 size_t keylen,
+                                 size_t valuelen)
+{
+  outputBuf_.appendInt8(static_cast<int8_t>(kResponseMagic));
+  outputBuf_.appendInt8(static_cast<int8_t>(opcode));
+  outputBuf_.appendInt16(static_cast<int16_t>(keylen));
+  outputBuf_.appendInt8(static_cast<int8_t>(extlen));
+  outputBuf_.appendInt8(0);  // data type
+  outputBuf_.appendInt16(static_cast<int16_t>(status));
+  outputBuf_.appendInt32(static_cast<int32_t>(extlen + keylen + valuelen));
+  outputBuf_.append(&opaque, sizeof opaque);
+  outputBuf_.appendInt64(static_cast<int64_t>(cas));
+}
@@ -12,6 +12,8 @@
 #include <boost/noncopyable.hpp>
 #include <boost/tokenizer.hpp>
 
+#include <vector>
+
 using muduo::string;
 
 class MemcacheServer;
@@ -24,9 +26,11 @@ class Session : boost::noncopyable,
     : owner_(owner),
       conn_(conn),
       state_(kNewCommand),
-      protocol_(kAscii), // FIXME
+      protocol_(kAuto),
       noreply_(false),
       policy_(Item::kInvalid),
+      opcode_(0),
+      opaque_(0),
       bytesToDiscard_(0),
       needle_(Item::makeItem(kLongestKey, 0, 0, 2, 0)),
       bytesRead_(0),
@@ -40,7 +44,7 @@ class Session : boost::noncopyable,
   {
     LOG_INFO << "requests processed: " << requestsProcessed_
              << " input buffer size: " << conn_->inputBuffer()->internalCapacity()
-             << " output buffer size: " << conn_->outputBuffer()->internalCapacity();
+             << " output bytes pending: " << conn_->outputBytes();
   }
 
  private:
@@ -71,6 +75,25 @@ class Session : boost::noncopyable,
   bool processRequest(muduo::StringPiece request);
   void resetRequest();
   void reply(muduo::StringPiece msg);
+  // sends what all replies appended
+  void flush();
+  int relativeExptime(time_t exptime) const;
+
+  // binary protocol
+  struct BinaryHeader;
+  bool processBinaryRequest(muduo::net::Buffer* buf);
+  bool doBinaryGets(muduo::net::Buffer* buf);
+  bool doBinaryUpdate(const BinaryHeader& header, muduo::net::Buffer* buf);
+  void storeBinary();
+  void replyBinary(uint16_t status);
+  void appendBinaryError(uint8_t opcode, uint16_t status, uint32_t opaque);
+  void appendBinaryHeader(uint8_t opcode,
+                          uint16_t status,
+                          uint32_t opaque,
+                          uint64_t cas,
+                          size_t extlen,
+                          size_t keylen,
+                          size_t valuelen);
 
   struct SpaceSeparator
   {
@@ -95,12 +118,25 @@ class Session : boost::noncopyable,
   string command_;
   bool noreply_;
   Item::UpdatePolicy policy_;
+  uint8_t opcode_;   // binary only
+  uint32_t opaque_;  // binary only
   ItemPtr currItem_;
   size_t bytesToDiscard_;
   // cached
   ItemPtr needle_;
   muduo::net::Buffer outputBuf_;
 
+  // multi-get, reused
+  struct BinaryGet
+  {
+    uint8_t opcode;
+    uint32_t opaque;
+    bool good;
+  };
+  std::vector<BinaryGet> gets_;
+  std::vector<muduo::StringPiece> keys_;
+  std::vector<ConstItemPtr> items_;
+
   // per session stats
   size_t bytesRead_;
   size_t requestsProcessed_;
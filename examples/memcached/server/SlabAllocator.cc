@@ -0,0 +1,168 @@
+#include "SlabAllocator.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+using namespace muduo;
+
+const size_t SlabAllocator::kPageSize;
+const int SlabAllocator::kMaxClasses;
+
+namespace
+{
+const size_t kAlignment = 8;
+
+size_t alignUp(size_t n)
+{
+  return (n + kAlignment - 1) & ~(kAlignment - 1);
+}
+}
+
+SlabAllocator::SlabClass::SlabClass()
+  : chunkSize(0),
+    pageBytes(0),
+    freeList(NULL),
+    unused(NULL),
+    unusedBytes(0),
+    usedChunks(0),
+    requestedBytes(0)
+{
+}
+
+SlabAllocator::SlabAllocator(size_t memoryLimit,
+                             size_t minChunk,
+                             size_t maxChunk,
+                             double factor)
+  : memoryLimit_(memoryLimit),
+    numClasses_(0),
+    classes_(new SlabClass[kMaxClasses]),
+    allocatedBytes_(0)
+{
+  assert(factor > 1.0);
+  assert(minChunk >= sizeof(void*));
+  size_t size = alignUp(minChunk);
+  while (numClasses_ < kMaxClasses - 1 && size < maxChunk)
+  {
+    classes_[numClasses_++].chunkSize = size;
+    size_t next = alignUp(static_cast<size_t>(static_cast<double>(size) * factor));
+    size = next > size ? next : size + kAlignment;
+  }
+  classes_[numClasses_++].chunkSize = alignUp(maxChunk);
+
+  for (int i = 0; i < numClasses_; ++i)
+  {
+    SlabClass& sc = classes_[i];
+    // the largest classes have pages of one chunk
+    sc.pageBytes = sc.chunkSize < kPageSize
+        ? kPageSize / sc.chunkSize * sc.chunkSize : sc.chunkSize;
+  }
+}
+
+SlabAllocator::~SlabAllocator()
+{
+  for (int i = 0; i < numClasses_; ++i)
+  {
+    for (size_t j = 0; j < classes_[i].pages.size(); ++j)
+    {
+      ::free(classes_[i].pages[j]);
+    }
+  }
+}
+
+int SlabAllocator::classOf(size_t bytes) const
+{
+  // few classes, and the small ones are the common ones
+  for (int i = 0; i < numClasses_; ++i)
+  {
+    if (bytes <= classes_[i].chunkSize)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void* SlabAllocator::allocate(int cls, size_t bytes)
+{
+  assert(0 <= cls && cls < numClasses_);
+  SlabClass& sc = classes_[cls];
+  assert(bytes <= sc.chunkSize);
+  MutexLockGuard lock(sc.mutex);
+  void* chunk = NULL;
+  if (sc.freeList)
+  {
+    chunk = sc.freeList;
+    sc.freeList = *static_cast<void**>(chunk);
+  }
+  else if (sc.unusedBytes >= sc.chunkSize || newPage(&sc))
+  {
+    // carved lazily, so that a page costs memory as it fills up
+    chunk = sc.unused;
+    sc.unused += sc.chunkSize;
+    sc.unusedBytes -= sc.chunkSize;
+  }
+
+  if (chunk)
+  {
+    ++sc.usedChunks;
+    sc.requestedBytes += bytes;
+  }
+  return chunk;
+}
+
+void SlabAllocator::deallocate(int cls, void* chunk, size_t bytes)
+{
+  assert(0 <= cls && cls < numClasses_);
+  SlabClass& sc = classes_[cls];
+  MutexLockGuard lock(sc.mutex);
+  *static_cast<void**>(chunk) = sc.freeList;
+  sc.freeList = chunk;
+  --sc.usedChunks;
+  sc.requestedBytes -= bytes;
+}
+
+// with sc->mutex held
+bool SlabAllocator::newPage(SlabClass* sc)
+{
+  {
+    MutexLockGuard lock(mutex_);
+    if (memoryLimit_ > 0
+        && allocatedBytes_ + sc->pageBytes > memoryLimit_
+        && !sc->pages.empty())
+    {
+      return false;
+    }
+    allocatedBytes_ += sc->pageBytes;
+  }
+  char* page = static_cast<char*>(::malloc(sc->pageBytes));
+  if (page == NULL)
+  {
+    MutexLockGuard lock(mutex_);
+    allocatedBytes_ -= sc->pageBytes;
+    return false;
+  }
+  sc->pages.push_back(page);
+  sc->unused = page;
+  sc->unusedBytes = sc->pageBytes;
+  return true;
+}
+
+SlabAllocator::ClassStats SlabAllocator::stats(int cls) const
+{
+  assert(0 <= cls && cls < numClasses_);
+  const SlabClass& sc = classes_[cls];
+  MutexLockGuard lock(sc.mutex);
+  ClassStats result;
+  result.chunkSize = sc.chunkSize;
+  result.pages = sc.pages.size();
+  result.totalChunks = sc.pages.size() * (sc.pageBytes / sc.chunkSize);
+  result.usedChunks = sc.usedChunks;
+  result.requestedBytes = sc.requestedBytes;
+  return result;
+}
+
+size_t SlabAllocator::allocatedBytes() const
+{
+  MutexLockGuard lock(mutex_);
+  return allocatedBytes_;
+}
@@ -0,0 +1,78 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+
+#include <muduo/base/Mutex.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <vector>
+
+// Chunks of size classes growing by a factor, carved from pages of 1MiB,
+// as in memcached.  A page once given to a class stays there, chunks freed
+// are reused only by the same class.
+//
+// The memory limit caps pages, not chunks in use.  A class that has no free
+// chunk when the limit is reached fails to allocate, the caller then evicts
+// items of that class.  Every class may have its first page regardless, so
+// that no size is left without memory.
+class SlabAllocator : boost::noncopyable
+{
+ public:
+  static const size_t kPageSize = 1024 * 1024;
+  static const int kMaxClasses = 64;
+
+  struct ClassStats
+  {
+    size_t chunkSize;
+    size_t pages;
+    size_t totalChunks;
+    size_t usedChunks;
+    size_t requestedBytes;  // in used chunks
+  };
+
+  /// memoryLimit of 0 is unlimited
+  SlabAllocator(size_t memoryLimit, size_t minChunk, size_t maxChunk, double factor);
+  ~SlabAllocator();
+
+  size_t memoryLimit() const { return memoryLimit_; }
+  size_t maxChunkSize() const { return classes_[numClasses_-1].chunkSize; }
+  int numClasses() const { return numClasses_; }
+
+  /// returns -1 if bytes is larger than the largest chunk
+  int classOf(size_t bytes) const;
+
+  /// returns NULL if the class has no free chunk and the limit is reached
+  void* allocate(int cls, size_t bytes);
+  void deallocate(int cls, void* chunk, size_t bytes);
+
+  ClassStats stats(int cls) const;
+  /// of all pages
+  size_t allocatedBytes() const;
+
+ private:
+  struct SlabClass
+  {
+    SlabClass();
+    size_t chunkSize;
+    size_t pageBytes;
+    mutable muduo::MutexLock mutex;
+    std::vector<char*> pages;
+    void* freeList;  // linked through the first word of free chunks
+    char* unused;    // not yet handed out in the newest page
+    size_t unusedBytes;
+    size_t usedChunks;
+    size_t requestedBytes;
+  };
+
+  bool newPage(SlabClass* sc);
+
+  const size_t memoryLimit_;
+  int numClasses_;
+  boost::scoped_array<SlabClass> classes_;
+
+  mutable muduo::MutexLock mutex_;
+  size_t allocatedBytes_;  // guarded by mutex_
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
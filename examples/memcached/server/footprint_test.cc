@@ -1,4 +1,5 @@
 #include "MemcacheServer.h"
+#include <muduo/base/ProcessInfo.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/inspect/ProcessInspector.h>
 
@@ -10,6 +11,14 @@
 
 using namespace muduo::net;
 
+long rssKiB()
+{
+  string status = muduo::ProcessInfo::procStatus();
+  size_t pos = status.find("VmRSS:");
+  return pos != string::npos ? atol(status.c_str() + pos + 6) : 0;
+}
+
+// usage: memcached_footprint [items] [keylen] [valuelen] [memory MiB]
 int main(int argc, char* argv[])
 {
 #ifdef HAVE_TCMALLOC
@@ -20,17 +29,25 @@ int main(int argc, char* argv[])
   int valuelen = argc > 3 ? atoi(argv[3]) : 100;
   EventLoop loop;
   MemcacheServer::Options options;
+  options.maxMemory = (argc > 4 ? atoi(argv[4]) : 0) * 1024L * 1024;
   MemcacheServer server(&loop, options);
 
-  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\n",
-         sizeof(Item), getpid(), items, keylen, valuelen);
+  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\nmemory = %zd\n",
+         sizeof(Item), getpid(), items, keylen, valuelen, options.maxMemory);
+  long rssBefore = rssKiB();
+  int failed = 0;
   char key[256] = { 0 };
   string value;
   for (int i = 0; i < items; ++i)
   {
     snprintf(key, sizeof key, "%0*d", keylen, i);
     value.assign(valuelen, "0123456789"[i % 10]);
-    ItemPtr item(Item::makeItem(key, 0, 0, valuelen+2, 1));
+    ItemPtr item(server.makeItem(key, 0, 0, valuelen+2, 1));
+    if (!item)
+    {
+      ++failed;
+      continue;
+    }
     item->append(value.data(), value.size());
     item->append("\r\n", 2);
     assert(item->endsWithCRLF());
@@ -39,10 +56,34 @@ int main(int argc, char* argv[])
     assert(stored); (void) stored;
     assert(!exists);
   }
+  long rssAfter = rssKiB();
   Inspector::ArgList arg;
   printf("==========\n%s\n",
          ProcessInspector::overview(HttpRequest::kGet, arg).c_str());
-  // TODO: print bytes per item, overhead percent
+
+  Buffer stats;
+  server.printStats("", &stats);
+  server.printStats("slabs", &stats);
+  printf("==========\n%s", stats.retrieveAllAsString().c_str());
+  // some may have been evicted under a memory limit
+  int stored = 0;
+  ItemPtr needle(Item::makeItem(string(keylen, 'x'), 0, 0, 2, 0));
+  for (int i = 0; i < items; ++i)
+  {
+    snprintf(key, sizeof key, "%0*d", keylen, i);
+    needle->resetKey(key);
+    if (server.getItem(needle))
+    {
+      ++stored;
+    }
+  }
+  // the cost of an item beyond its key and value, "\r\n" included,
+  // from the memory taken by storing all of them
+  double payload = keylen + valuelen + 2;
+  double perItem = stored > 0 ? static_cast<double>(rssAfter - rssBefore) * 1024 / stored : 0;
+  printf("==========\nstored = %d, failed = %d\n", stored, failed);
+  printf("bytes per item = %.1f, payload = %.0f, overhead = %.1f bytes, %.1f%%\n",
+         perItem, payload, perItem - payload, (perItem - payload) * 100 / payload);
   fflush(stdout);
 #ifdef HAVE_TCMALLOC
   char buf[8192];
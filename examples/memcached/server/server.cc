@@ -14,6 +14,7 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
   options->tcpport = 11211;
   options->gperfport = 11212;
   options->threads = 4;
+  size_t memoryMiB = 64;
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -22,11 +23,13 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
       ("udpport,U", po::value<uint16_t>(&options->udpport), "UDP port")
       ("gperf,g", po::value<uint16_t>(&options->gperfport), "port for gperftools")
       ("threads,t", po::value<int>(&options->threads), "Number of worker threads")
+      ("memory,m", po::value<size_t>(&memoryMiB), "Memory for items in MiB, 0 for unlimited")
       ;
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
   po::notify(vm);
+  options->maxMemory = memoryMiB * 1024 * 1024;
 
   if (vm.count("help"))
   {
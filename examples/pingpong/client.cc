@@ -145,7 +145,7 @@ class Client : boost::noncopyable
       LOG_WARN << static_cast<double>(totalBytesRead) / static_cast<double>(totalMessagesRead)
                << " average message size";
       LOG_WARN << static_cast<double>(totalBytesRead) / (timeout_ * 1024 * 1024)
-               << " MiB/s throughput";
+               << " MiB/s throughput with " << conn->getLoop()->pollerName();
       conn->getLoop()->queueInLoop(boost::bind(&Client::quit, this));
     }
   }
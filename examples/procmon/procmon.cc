@@ -138,7 +138,7 @@ class Procmon : boost::noncopyable
     if (req.path() == "/")
     {
       resp->setContentType("text/html");
-      fillOverview(req.query());
+      fillOverview(req.query().as_string());
       resp->setBody(response_.retrieveAllAsString());
     }
     else if (req.path() == "/cmdline")
@@ -8,6 +8,7 @@
 
 #include "codec.h"
 
+#include <muduo/base/Crc32c.h>
 #include <muduo/base/Logging.h>
 #include <muduo/net/Endian.h>
 #include <muduo/net/protorpc/google-inl.h>
@@ -19,7 +20,22 @@
 using namespace muduo;
 using namespace muduo::net;
 
-void ProtobufCodec::fillEmptyBuffer(Buffer* buf, const google::protobuf::Message& message)
+namespace
+{
+  int32_t checksum(ProtobufCodec::ChecksumType type, const char* buf, int len)
+  {
+    if (type == ProtobufCodec::kCrc32c)
+    {
+      return static_cast<int32_t>(Crc32c::value(buf, static_cast<size_t>(len)));
+    }
+    return static_cast<int32_t>(
+        ::adler32(1, reinterpret_cast<const Bytef*>(buf), len));
+  }
+}
+
+void ProtobufCodec::fillEmptyBuffer(Buffer* buf,
+                                    const google::protobuf::Message& message,
+                                    ChecksumType type)
 {
   // buf->retrieveAll();
   assert(buf->readableBytes() == 0);
@@ -43,13 +59,11 @@ void ProtobufCodec::fillEmptyBuffer(Buffer* buf, const google::protobuf::Message
   }
   buf->hasWritten(byte_size);
 
-  int32_t checkSum = static_cast<int32_t>(
-      ::adler32(1,
-                reinterpret_cast<const Bytef*>(buf->peek()),
-                static_cast<int>(buf->readableBytes())));
+  int32_t checkSum = checksum(type, buf->peek(), static_cast<int>(buf->readableBytes()));
   buf->appendInt32(checkSum);
   assert(buf->readableBytes() == sizeof nameLen + nameLen + byte_size + sizeof checkSum);
-  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
+  int32_t flag = type == kCrc32c ? kCrc32cFlag : 0;
+  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()) | flag);
   buf->prepend(&len, sizeof len);
 }
 
@@ -118,7 +132,9 @@ void ProtobufCodec::onMessage(const TcpConnectionPtr& conn,
 {
   while (buf->readableBytes() >= kMinMessageLen + kHeaderLen)
   {
-    const int32_t len = buf->peekInt32();
+    const int32_t size = buf->peekInt32();
+    const ChecksumType type = (size & kCrc32cFlag) ? kCrc32c : kAdler32;
+    const int32_t len = size & ~kCrc32cFlag;
     if (len > kMaxMessageLen || len < kMinMessageLen)
     {
       errorCallback_(conn, buf, receiveTime, kInvalidLength);
@@ -127,7 +143,7 @@ void ProtobufCodec::onMessage(const TcpConnectionPtr& conn,
     else if (buf->readableBytes() >= implicit_cast<size_t>(len + kHeaderLen))
     {
       ErrorCode errorCode = kNoError;
-      MessagePtr message = parse(buf->peek()+kHeaderLen, len, &errorCode);
+      MessagePtr message = parse(buf->peek()+kHeaderLen, len, &errorCode, type);
       if (errorCode == kNoError && message)
       {
         messageCallback_(conn, message, receiveTime);
@@ -163,16 +179,13 @@ google::protobuf::Message* ProtobufCodec::createMessage(const std::string& typeN
   return message;
 }
 
-MessagePtr ProtobufCodec::parse(const char* buf, int len, ErrorCode* error)
+MessagePtr ProtobufCodec::parse(const char* buf, int len, ErrorCode* error, ChecksumType type)
 {
   MessagePtr message;
 
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kHeaderLen);
-  int32_t checkSum = static_cast<int32_t>(
-      ::adler32(1,
-                reinterpret_cast<const Bytef*>(buf),
-                static_cast<int>(len - kHeaderLen)));
+  int32_t checkSum = checksum(type, buf, len - kHeaderLen);
   if (checkSum == expectedCheckSum)
   {
     // get message type name
@@ -20,11 +20,11 @@
 
 // struct ProtobufTransportFormat __attribute__ ((__packed__))
 // {
-//   int32_t  len;
+//   int32_t  len;      // with kCrc32cFlag if checkSum is CRC32C
 //   int32_t  nameLen;
 //   char     typeName[nameLen];
 //   char     protobufData[len-nameLen-8];
-//   int32_t  checkSum; // adler32 of nameLen, typeName and protobufData
+//   int32_t  checkSum; // adler32 of nameLen, typeName and protobufData, or CRC32C
 // }
 
 typedef boost::shared_ptr<google::protobuf::Message> MessagePtr;
@@ -46,6 +46,15 @@ class ProtobufCodec : boost::noncopyable
     kParseError,
   };
 
+  // adler32 is sent by default, both are received
+  enum ChecksumType
+  {
+    kAdler32,
+    kCrc32c,
+  };
+
+  const static int32_t kCrc32cFlag = 0x40000000; // above kMaxMessageLen
+
   typedef boost::function<void (const muduo::net::TcpConnectionPtr&,
                                 const MessagePtr&,
                                 muduo::Timestamp)> ProtobufMessageCallback;
@@ -57,16 +66,20 @@ class ProtobufCodec : boost::noncopyable
 
   explicit ProtobufCodec(const ProtobufMessageCallback& messageCb)
     : messageCallback_(messageCb),
-      errorCallback_(defaultErrorCallback)
+      errorCallback_(defaultErrorCallback),
+      checksumType_(kAdler32)
   {
   }
 
   ProtobufCodec(const ProtobufMessageCallback& messageCb, const ErrorCallback& errorCb)
     : messageCallback_(messageCb),
-      errorCallback_(errorCb)
+      errorCallback_(errorCb),
+      checksumType_(kAdler32)
   {
   }
 
+  void setChecksumType(ChecksumType type) { checksumType_ = type; }
+
   void onMessage(const muduo::net::TcpConnectionPtr& conn,
                  muduo::net::Buffer* buf,
                  muduo::Timestamp receiveTime);
@@ -76,14 +89,16 @@ class ProtobufCodec : boost::noncopyable
   {
     // FIXME: serialize to TcpConnection::outputBuffer()
     muduo::net::Buffer buf;
-    fillEmptyBuffer(&buf, message);
+    fillEmptyBuffer(&buf, message, checksumType_);
     conn->send(&buf);
   }
 
   static const muduo::string& errorCodeToString(ErrorCode errorCode);
-  static void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
+  static void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message,
+                              ChecksumType type = kAdler32);
   static google::protobuf::Message* createMessage(const std::string& type_name);
-  static MessagePtr parse(const char* buf, int len, ErrorCode* errorCode);
+  static MessagePtr parse(const char* buf, int len, ErrorCode* errorCode,
+                          ChecksumType type = kAdler32);
 
  private:
   static void defaultErrorCallback(const muduo::net::TcpConnectionPtr&,
@@ -93,6 +108,7 @@ class ProtobufCodec : boost::noncopyable
 
   ProtobufMessageCallback messageCallback_;
   ErrorCallback errorCallback_;
+  ChecksumType checksumType_;
 
   const static int kHeaderLen = sizeof(int32_t);
   const static int kMinMessageLen = 2*kHeaderLen + 2; // nameLen + typeName + checkSum
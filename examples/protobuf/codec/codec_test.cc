@@ -242,6 +242,39 @@ void testOnMessage()
   }
 }
 
+void testCrc32c()
+{
+  muduo::Query query;
+  query.set_id(1);
+  query.set_questioner("Chen Shuo");
+  query.add_question("Running?");
+
+  Buffer buf;
+  ProtobufCodec::fillEmptyBuffer(&buf, query, ProtobufCodec::kCrc32c);
+
+  const int32_t size = buf.readInt32();
+  assert(size & ProtobufCodec::kCrc32cFlag);
+  const int32_t len = size & ~ProtobufCodec::kCrc32cFlag;
+  assert(len == static_cast<int32_t>(buf.readableBytes()));
+
+  ProtobufCodec::ErrorCode errorCode = ProtobufCodec::kNoError;
+  MessagePtr message = ProtobufCodec::parse(buf.peek(), len, &errorCode);
+  assert(errorCode == ProtobufCodec::kCheckSumError);
+
+  message = ProtobufCodec::parse(buf.peek(), len, &errorCode, ProtobufCodec::kCrc32c);
+  assert(errorCode == ProtobufCodec::kNoError);
+  assert(message != NULL);
+  assert(message->DebugString() == query.DebugString());
+
+  // received by a codec sending adler32
+  g_count = 0;
+  Buffer input;
+  ProtobufCodec::fillEmptyBuffer(&input, query, ProtobufCodec::kCrc32c);
+  ProtobufCodec codec(onMessage);
+  codec.onMessage(muduo::net::TcpConnectionPtr(), &input, muduo::Timestamp());
+  assert(g_count == 1);
+}
+
 int main()
 {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -256,6 +289,8 @@ int main()
   puts("");
   testOnMessage();
   puts("");
+  testCrc32c();
+  puts("");
 
   puts("All pass!!!");
 
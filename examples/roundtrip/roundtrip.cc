@@ -69,7 +69,7 @@ void clientConnectionCallback(const TcpConnectionPtr& conn)
 int64_t total = 0;
 int64_t count = 0;
 
-void clientMessageCallback(const TcpConnectionPtr&,
+void clientMessageCallback(const TcpConnectionPtr& conn,
                            Buffer* buffer,
                            muduo::Timestamp receiveTime)
 {
@@ -87,7 +87,7 @@ void clientMessageCallback(const TcpConnectionPtr&,
 
     total += back - send;
     ++count;
-    LOG_INFO << "avg round trip " << total / count;
+    LOG_INFO << "avg round trip " << total / count << " with " << conn->getLoop()->pollerName();
   }
 }
 
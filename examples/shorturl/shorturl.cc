@@ -24,8 +24,8 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
   LOG_INFO << "Headers " << req.methodString() << " " << req.path();
   if (!benchmark)
   {
-    const std::map<string, string>& headers = req.headers();
-    for (std::map<string, string>::const_iterator it = headers.begin();
+    const HttpRequest::HeaderList& headers = req.headers();
+    for (HttpRequest::HeaderList::const_iterator it = headers.begin();
         it != headers.end();
         ++it)
     {
@@ -35,7 +35,7 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
 
   // TODO: support PUT and DELETE to create new redirections on-the-fly.
 
-  std::map<string, string>::const_iterator it = redirections.find(req.path());
+  std::map<string, string>::const_iterator it = redirections.find(req.path().as_string());
   if (it != redirections.end())
   {
     resp->setStatusCode(HttpResponse::k301MovedPermanently);
@@ -2,10 +2,33 @@
 #include <muduo/base/LogFile.h>
 #include <muduo/base/Timestamp.h>
 
+#include <algorithm>
 #include <stdio.h>
 
 using namespace muduo;
 
+AsyncLogging::Stage::Stage()
+  : current(new StagedBuffer),
+    owned(1)
+{
+}
+
+AsyncLogging::Stage::~Stage()
+{
+  std::vector<StagedBuffer*> buffers;
+  buffers.swap(spare);
+  full.popAll(&buffers);
+  recycled.popAll(&buffers);
+  for (size_t i = 0; i < buffers.size(); ++i)
+  {
+    if (buffers[i] != current)
+    {
+      delete buffers[i];
+    }
+  }
+  delete current;
+}
+
 AsyncLogging::AsyncLogging(const string& basename,
                            size_t rollSize,
                            int flushInterval)
@@ -17,113 +40,382 @@ AsyncLogging::AsyncLogging(const string& basename,
     latch_(1),
     mutex_(),
     cond_(mutex_),
-    currentBuffer_(new Buffer),
-    nextBuffer_(new Buffer),
-    buffers_()
+    notFull_(mutex_),
+    stages_(),
+    pending_(false),
+    policy_(kDropOnOverflow),
+    format_(kText),
+    compress_(false),
+    maxTotalBytes_(0),
+    backend_(FileUtil::AppendFile::kStdio),
+    maxQueuedBuffers_(25 * detail::kLargeBuffer / detail::kMediumBuffer)
+{
+  MCHECK(pthread_key_create(&stageKey_, &AsyncLogging::releaseStage));
+}
+
+AsyncLogging::~AsyncLogging()
+{
+  if (running_)
+  {
+    stop();
+  }
+  // threads exiting later must not touch the stages
+  MCHECK(pthread_key_delete(stageKey_));
+}
+
+void AsyncLogging::setOverflowPolicy(OverflowPolicy policy, size_t maxQueuedBytes)
 {
-  currentBuffer_->bzero();
-  nextBuffer_->bzero();
-  buffers_.reserve(16);
+  assert(!running_);
+  policy_ = policy;
+  maxQueuedBuffers_ = static_cast<int>(maxQueuedBytes / detail::kMediumBuffer);
+  if (maxQueuedBuffers_ < 1)
+  {
+    maxQueuedBuffers_ = 1;
+  }
+}
+
+void AsyncLogging::stop()
+{
+  {
+  muduo::MutexLockGuard lock(mutex_);
+  running_ = false;
+  cond_.notify();
+  notFull_.notifyAll();
+  }
+  thread_.join();
 }
 
 void AsyncLogging::append(const char* logline, int len)
 {
+  StagedBuffer* current = reserve(len);
+  if (current)
+  {
+    current->buffer.append(logline, len);
+    __atomic_store_n(&current->committed, current->buffer.length(), __ATOMIC_RELEASE);
+  }
+}
+
+void AsyncLogging::appendRecord(const char* record, int len)
+{
+  assert(format_ != kText);
+  uint16_t length = static_cast<uint16_t>(len);
+  StagedBuffer* current = reserve(static_cast<int>(sizeof length) + len);
+  if (current)
+  {
+    current->buffer.append(reinterpret_cast<const char*>(&length), sizeof length);
+    current->buffer.append(record, len);
+    __atomic_store_n(&current->committed, current->buffer.length(), __ATOMIC_RELEASE);
+  }
+}
+
+// the buffer of this thread with room for len bytes, or NULL if dropped
+AsyncLogging::StagedBuffer* AsyncLogging::reserve(int len)
+{
+  Stage* stage = static_cast<Stage*>(pthread_getspecific(stageKey_));
+  if (stage == NULL)
+  {
+    stage = registerThread();
+  }
+  // only this thread writes to its current buffer
+  StagedBuffer* current = stage->current;
+  if (current->buffer.avail() <= len)
+  {
+    current = handOff(stage);
+    if (current == NULL)
+    {
+      dropped_.increment();
+    }
+  }
+  return current;
+}
+
+// at thread exit, frees the spares, a stage left unowned keeps only current
+void AsyncLogging::releaseStage(void* arg)
+{
+  Stage* stage = static_cast<Stage*>(arg);
+  stage->recycled.popAll(&stage->spare);
+  for (size_t i = 0; i < stage->spare.size(); ++i)
+  {
+    delete stage->spare[i];
+  }
+  stage->spare.clear();
+  __atomic_store_n(&stage->owned, 0, __ATOMIC_RELEASE);
+}
+
+// the stage of a thread that has exited is reused, with what it left unflushed
+AsyncLogging::Stage* AsyncLogging::registerThread()
+{
+  Stage* stage = NULL;
+  {
   muduo::MutexLockGuard lock(mutex_);
-  if (currentBuffer_->avail() > len)
+  for (size_t i = 0; i < stages_.size() && stage == NULL; ++i)
   {
-    currentBuffer_->append(logline, len);
+    int unowned = 0;
+    if (__atomic_compare_exchange_n(&stages_[i].owned, &unowned, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+      stage = &stages_[i];
+    }
   }
-  else
+  if (stage == NULL)
   {
-    buffers_.push_back(currentBuffer_.release());
+    stage = new Stage;
+    stages_.push_back(stage);
+  }
+  }
+  MCHECK(pthread_setspecific(stageKey_, stage));
+  return stage;
+}
 
-    if (nextBuffer_)
+// queues the current buffer of the stage to the backend, returns a fresh one,
+// or NULL if the line is to be dropped
+AsyncLogging::StagedBuffer* AsyncLogging::handOff(Stage* stage)
+{
+  // concurrent callers may overshoot the limit by a buffer each
+  if (queuedBuffers_.get() >= maxQueuedBuffers_)
+  {
+    if (policy_ == kDropOnOverflow)
     {
-      currentBuffer_ = boost::ptr_container::move(nextBuffer_);
+      return NULL;
     }
-    else
+    muduo::MutexLockGuard lock(mutex_);
+    while (queuedBuffers_.get() >= maxQueuedBuffers_ && running_)
     {
-      currentBuffer_.reset(new Buffer); // Rarely happens
+      notFull_.wait();
     }
-    currentBuffer_->append(logline, len);
-    cond_.notify();
   }
+  queuedBuffers_.increment();
+  StagedBuffer* fresh = takeFree(stage);
+  // in this order, so that the backend that sees the fresh buffer
+  // also finds the full one in the queue, see writeStages()
+  stage->full.push(stage->current);
+  __atomic_store_n(&stage->current, fresh, __ATOMIC_RELEASE);
+
+  muduo::MutexLockGuard lock(mutex_);
+  pending_ = true;
+  cond_.notify();
+  return fresh;
 }
 
-void AsyncLogging::threadFunc()
+AsyncLogging::StagedBuffer* AsyncLogging::takeFree(Stage* stage)
 {
-  assert(running_ == true);
-  latch_.countDown();
-  LogFile output(basename_, rollSize_, false);
-  BufferPtr newBuffer1(new Buffer);
-  BufferPtr newBuffer2(new Buffer);
-  newBuffer1->bzero();
-  newBuffer2->bzero();
-  BufferVector buffersToWrite;
-  buffersToWrite.reserve(16);
-  while (running_)
-  {
-    assert(newBuffer1 && newBuffer1->length() == 0);
-    assert(newBuffer2 && newBuffer2->length() == 0);
-    assert(buffersToWrite.empty());
+  if (stage->spare.empty())
+  {
+    stage->recycled.popAll(&stage->spare);
+    // keeps two, like the backend of the old double buffering
+    while (stage->spare.size() > 2)
+    {
+      delete stage->spare.back();
+      stage->spare.pop_back();
+    }
+  }
+  StagedBuffer* fresh = NULL;
+  if (stage->spare.empty())
+  {
+    fresh = new StagedBuffer;
+  }
+  else
+  {
+    fresh = stage->spare.back();
+    stage->spare.pop_back();
+    fresh->buffer.reset();
+    fresh->committed = 0;
+  }
+  return fresh;
+}
 
+void AsyncLogging::writeStages(const std::vector<Stage*>& stages, LogFile* output)
+{
+  std::vector<StagedBuffer*> full;
+  for (size_t i = 0; i < stages.size(); ++i)
+  {
+    Stage* stage = stages[i];
+    // current before the queue, pairs with handOff()
+    StagedBuffer* current = __atomic_load_n(&stage->current, __ATOMIC_ACQUIRE);
+    full.clear();
+    stage->full.popAll(&full);
+
+    bool currentIsFull = false;
+    for (size_t j = 0; j < full.size(); ++j)
     {
-      muduo::MutexLockGuard lock(mutex_);
-      if (buffers_.empty())  // unusual usage!
+      StagedBuffer* buf = full[j];
+      write(buf->buffer.data() + buf->flushed,
+            buf->buffer.length() - buf->flushed, output);
+      buf->flushed = 0;
+      currentIsFull = currentIsFull || buf == current;
+      if (__atomic_load_n(&stage->owned, __ATOMIC_ACQUIRE))
       {
-        cond_.waitForSeconds(flushInterval_);
+        stage->recycled.push(buf);
       }
-      buffers_.push_back(currentBuffer_.release());
-      currentBuffer_ = boost::ptr_container::move(newBuffer1);
-      buffersToWrite.swap(buffers_);
-      if (!nextBuffer_)
+      else
       {
-        nextBuffer_ = boost::ptr_container::move(newBuffer2);
+        // its thread has exited, the next owner allocates if it needs more
+        delete buf;
       }
+      queuedBuffers_.decrement();
     }
 
-    assert(!buffersToWrite.empty());
-
-    if (buffersToWrite.size() > 25)
+    if (!currentIsFull)
     {
-      char buf[256];
-      snprintf(buf, sizeof buf, "Dropped log messages at %s, %zd larger buffers\n",
-               Timestamp::now().toFormattedString().c_str(),
-               buffersToWrite.size()-2);
-      fputs(buf, stderr);
-      output.append(buf, static_cast<int>(strlen(buf)));
-      buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end());
+      // a partly filled buffer, its owner keeps appending past committed
+      int committed = __atomic_load_n(&current->committed, __ATOMIC_ACQUIRE);
+      write(current->buffer.data() + current->flushed,
+            committed - current->flushed, output);
+      current->flushed = committed;
     }
+  }
+}
 
-    for (size_t i = 0; i < buffersToWrite.size(); ++i)
+void AsyncLogging::write(const char* data, int len, LogFile* output)
+{
+  if (format_ == kText)
+  {
+    output->append(data, len);
+    return;
+  }
+  // whole records, each after its length
+  const char* end = data + len;
+  while (data < end)
+  {
+    uint16_t length = 0;
+    memcpy(&length, data, sizeof length);
+    writeRecord(data, static_cast<int>(sizeof length) + length, output);
+    data += sizeof length + length;
+  }
+}
+
+// @c framed is a record after its length
+void AsyncLogging::writeRecord(const char* framed, int len, LogFile* output)
+{
+  const char* record = framed + sizeof(uint16_t);
+  const int recordLen = len - static_cast<int>(sizeof(uint16_t));
+  if (format_ == kDecodedRecords)
+  {
+    LogStream line;
+    if (decoder_.decode(record, recordLen, &line))
     {
-      // FIXME: use unbuffered stdio FILE ? or use ::writev ?
-      output.append(buffersToWrite[i].data(), buffersToWrite[i].length());
+      output->append(line.buffer().data(), line.buffer().length());
     }
+    return;
+  }
+
+  // one append, as LogFile may roll after any of them, and a file must
+  // start with its header and define each string before using it
+  recordBuf_.clear();
+  if (output->writtenBytes() == 0)
+  {
+    // a new file, readable on its own
+    writtenStrings_.clear();
+    detail::LogFileHeader header;
+    memcpy(header.magic, "muduolog", sizeof header.magic);
+    header.byteOrder = detail::kLogByteOrder;
+    header.pointerSize = sizeof(void*);
+    uint16_t length = 1 + sizeof header;
+    recordBuf_.append(reinterpret_cast<const char*>(&length), sizeof length);
+    recordBuf_ += detail::kLogRecordFileHeader;
+    recordBuf_.append(reinterpret_cast<const char*>(&header), sizeof header);
+  }
 
-    if (buffersToWrite.size() > 2)
+  if (recordLen > static_cast<int>(sizeof(detail::LogLineHeader))
+      && record[0] == detail::kLogRecordLine)
+  {
+    detail::LogLineHeader header;
+    memcpy(&header, record + 1, sizeof header);
+    const char* strings[2] = { header.file, header.func };
+    for (int i = 0; i < 2; ++i)
     {
-      // drop non-bzero-ed buffers, avoid trashing
-      buffersToWrite.resize(2);
+      if (strings[i] && writtenStrings_.insert(strings[i]).second)
+      {
+        // defines the string at this address for the decoder
+        size_t n = i == 0 ? header.fileLength : strlen(strings[i]);
+        n = std::min(n, static_cast<size_t>(detail::kSmallBuffer));
+        uint64_t address = reinterpret_cast<uintptr_t>(strings[i]);
+        uint16_t length = static_cast<uint16_t>(1 + sizeof address + n);
+        recordBuf_.append(reinterpret_cast<const char*>(&length), sizeof length);
+        recordBuf_ += detail::kLogRecordString;
+        recordBuf_.append(reinterpret_cast<const char*>(&address), sizeof address);
+        recordBuf_.append(strings[i], n);
+      }
     }
+  }
 
-    if (!newBuffer1)
+  if (recordBuf_.empty())
+  {
+    output->append(framed, len);
+  }
+  else
+  {
+    recordBuf_.append(framed, len);
+    output->append(recordBuf_.data(), static_cast<int>(recordBuf_.size()));
+  }
+}
+
+void AsyncLogging::writeText(const char* text, int len, LogFile* output)
+{
+  if (format_ != kRawRecords)
+  {
+    output->append(text, len);
+    return;
+  }
+  char buf[sizeof(uint16_t) + 1 + 256];
+  uint16_t length = static_cast<uint16_t>(1 + std::min(len, 256));
+  memcpy(buf, &length, sizeof length);
+  buf[sizeof length] = detail::kLogRecordText;
+  memcpy(buf + sizeof length + 1, text, length - 1);
+  writeRecord(buf, static_cast<int>(sizeof length + length), output);
+}
+
+void AsyncLogging::threadFunc()
+{
+  assert(running_ == true);
+  latch_.countDown();
+  LogFile output(basename_, rollSize_, false);
+  output.setCompressRolledFiles(compress_);
+  output.setMaxTotalBytes(maxTotalBytes_);
+  if (backend_ != FileUtil::AppendFile::kStdio)
+  {
+    output.setFileBackend(backend_);
+  }
+  std::vector<Stage*> stages;
+  int64_t reportedDrops = 0;
+  bool running = true;
+  while (running)
+  {
     {
-      assert(!buffersToWrite.empty());
-      newBuffer1 = buffersToWrite.pop_back();
-      newBuffer1->reset();
+      muduo::MutexLockGuard lock(mutex_);
+      if (!pending_ && running_)
+      {
+        cond_.waitForSeconds(flushInterval_);
+      }
+      pending_ = false;
+      // one more round after stop(), for what was appended before it
+      running = running_;
+      stages.clear();
+      for (size_t i = 0; i < stages_.size(); ++i)
+      {
+        stages.push_back(&stages_[i]);
+      }
     }
 
-    if (!newBuffer2)
+    writeStages(stages, &output);
+
+    int64_t dropped = dropped_.get();
+    if (dropped > reportedDrops)
     {
-      assert(!buffersToWrite.empty());
-      newBuffer2 = buffersToWrite.pop_back();
-      newBuffer2->reset();
+      char buf[256];
+      snprintf(buf, sizeof buf, "Dropped %lld log messages at %s\n",
+               static_cast<long long>(dropped - reportedDrops),
+               Timestamp::now().toFormattedString().c_str());
+      fputs(buf, stderr);
+      writeText(buf, static_cast<int>(strlen(buf)), &output);
+      reportedDrops = dropped;
     }
 
-    buffersToWrite.clear();
+    if (policy_ == kBlockOnOverflow)
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      notFull_.notifyAll();
+    }
     output.flush();
   }
-  output.flush();
 }
-
@@ -1,38 +1,77 @@
 #ifndef MUDUO_BASE_ASYNCLOGGING_H
 #define MUDUO_BASE_ASYNCLOGGING_H
 
-#include <muduo/base/BlockingQueue.h>
-#include <muduo/base/BoundedBlockingQueue.h>
+#include <muduo/base/Atomic.h>
 #include <muduo/base/CountDownLatch.h>
+#include <muduo/base/FileUtil.h>
+#include <muduo/base/LogDecoder.h>
+#include <muduo/base/MpscQueue.h>
 #include <muduo/base/Mutex.h>
 #include <muduo/base/Thread.h>
 #include <muduo/base/LogStream.h>
 
 #include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/scoped_ptr.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
+#include <set>
+#include <pthread.h>
+
 namespace muduo
 {
 
+class LogFile;
+
+///
+/// Writes log lines to a LogFile from a background thread.
+///
+/// Each logging thread appends to its own staging buffer without locking,
+/// full buffers are handed to the backend through a lock-free queue.
+/// Lines of one thread keep their order, lines of different threads
+/// are grouped per thread within each flush.
+///
 class AsyncLogging : boost::noncopyable
 {
  public:
+  /// What append() does when the backend falls behind.
+  enum OverflowPolicy
+  {
+    kDropOnOverflow,   // discards the line, counted in droppedMessages()
+    kBlockOnOverflow,  // waits for the backend
+  };
+
+  /// What is appended, and what is written to the file.
+  enum Format
+  {
+    kText,            // lines by append()
+    kDecodedRecords,  // records by appendRecord(), written as text
+    kRawRecords,      // records by appendRecord(), written as they are,
+                      // for the logdecoder tool, formatting nothing at all
+  };
 
   AsyncLogging(const string& basename,
                size_t rollSize,
                int flushInterval = 3);
 
-  ~AsyncLogging()
-  {
-    if (running_)
-    {
-      stop();
-    }
-  }
+  ~AsyncLogging();
+
+  /// Bounds the bytes waiting for the backend, must be called before start().
+  /// Defaults to dropping beyond 100MB.
+  void setOverflowPolicy(OverflowPolicy policy, size_t maxQueuedBytes);
+
+  /// Must be called before start().
+  void setFormat(Format format) { format_ = format; }
+
+  /// See LogFile::setCompressRolledFiles(), must be called before start().
+  void setCompressRolledFiles(bool on) { compress_ = on; }
+  /// See LogFile::setMaxTotalBytes(), must be called before start().
+  void setMaxTotalBytes(size_t maxBytes) { maxTotalBytes_ = maxBytes; }
+  /// See LogFile::setFileBackend(), must be called before start().
+  void setFileBackend(FileUtil::AppendFile::Backend backend) { backend_ = backend; }
 
   void append(const char* logline, int len);
+  /// For Logger::setRecordOutput().
+  void appendRecord(const char* record, int len);
 
   void start()
   {
@@ -41,12 +80,10 @@ class AsyncLogging : boost::noncopyable
     latch_.wait();
   }
 
-  void stop()
-  {
-    running_ = false;
-    cond_.notify();
-    thread_.join();
-  }
+  void stop();
+
+  int64_t droppedMessages() const
+  { return dropped_.get(); }
 
  private:
 
@@ -54,11 +91,41 @@ class AsyncLogging : boost::noncopyable
   AsyncLogging(const AsyncLogging&);  // ptr_container
   void operator=(const AsyncLogging&);  // ptr_container
 
-  void threadFunc();
+  typedef muduo::detail::FixedBuffer<muduo::detail::kMediumBuffer> Buffer;
+
+  struct StagedBuffer : boost::noncopyable
+  {
+    StagedBuffer() : committed(0), flushed(0) { buffer.bzero(); }
+
+    Buffer buffer;
+    int committed;  /* atomic */  // bytes the backend may read
+    int flushed;    // bytes the backend has written, backend only
+  };
 
-  typedef muduo::detail::FixedBuffer<muduo::detail::kLargeBuffer> Buffer;
-  typedef boost::ptr_vector<Buffer> BufferVector;
-  typedef BufferVector::auto_type BufferPtr;
+  // staging area of one logging thread
+  struct Stage : boost::noncopyable
+  {
+    Stage();
+    ~Stage();
+
+    StagedBuffer* current;  /* atomic */
+    MpscQueue<StagedBuffer*> full;  // to the backend
+    MpscQueue<StagedBuffer*> recycled;  // back from the backend
+    std::vector<StagedBuffer*> spare;  // owner only
+    int owned;  /* atomic */  // a live thread is appending to it
+  };
+
+  static void releaseStage(void* stage);
+  Stage* registerThread();
+  StagedBuffer* reserve(int len);
+  StagedBuffer* handOff(Stage* stage);
+  StagedBuffer* takeFree(Stage* stage);
+
+  void threadFunc();
+  void writeStages(const std::vector<Stage*>& stages, LogFile* output);
+  void write(const char* data, int len, LogFile* output);
+  void writeRecord(const char* record, int len, LogFile* output);
+  void writeText(const char* text, int len, LogFile* output);
 
   const int flushInterval_;
   bool running_;
@@ -68,9 +135,21 @@ class AsyncLogging : boost::noncopyable
   muduo::CountDownLatch latch_;
   muduo::MutexLock mutex_;
   muduo::Condition cond_;
-  BufferPtr currentBuffer_;
-  BufferPtr nextBuffer_;
-  BufferVector buffers_;
+  muduo::Condition notFull_;
+  pthread_key_t stageKey_;
+  boost::ptr_vector<Stage> stages_;  // @GuardedBy mutex_, only grows
+  bool pending_;  // @GuardedBy mutex_, some buffer was handed off
+  OverflowPolicy policy_;
+  Format format_;
+  bool compress_;
+  size_t maxTotalBytes_;
+  FileUtil::AppendFile::Backend backend_;
+  LogDecoder decoder_;  // backend only
+  std::set<const char*> writtenStrings_;  // backend only, in the current file
+  string recordBuf_;  // backend only, what writeRecord() appends at once
+  int maxQueuedBuffers_;
+  AtomicInt32 queuedBuffers_;
+  mutable AtomicInt64 dropped_;
 };
 
 }
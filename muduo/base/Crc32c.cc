@@ -0,0 +1,126 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/base/Crc32c.h>
+
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+// reflected 0x1EDC6F41
+const uint32_t kPolynomial = 0x82F63B78;
+
+// table[k][b] is the crc of byte b followed by k zero bytes
+struct Tables
+{
+  Tables()
+  {
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+      uint32_t crc = b;
+      for (int i = 0; i < 8; ++i)
+      {
+        crc = (crc >> 1) ^ (kPolynomial & (0u - (crc & 1)));
+      }
+      table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+      for (int k = 1; k < 8; ++k)
+      {
+        table[k][b] = (table[k-1][b] >> 8) ^ table[0][table[k-1][b] & 0xff];
+      }
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+const Tables tables;
+
+inline uint32_t load32(const uint8_t* p)
+{
+  uint32_t word;
+  ::memcpy(&word, p, sizeof word);
+  return word;
+}
+
+// crc not inverted, little endian words
+uint32_t slicingBy8(uint32_t crc, const uint8_t* p, size_t len)
+{
+  const uint32_t (*t)[256] = tables.table;
+  for (; len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; --len)
+  {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  }
+  for (; len >= 8; len -= 8, p += 8)
+  {
+    uint32_t low = load32(p) ^ crc;
+    uint32_t high = load32(p + 4);
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff]
+        ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+        ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff]
+        ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+  }
+  for (; len > 0; --len)
+  {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+#if defined(__SSE4_2__)
+uint32_t sse42(uint32_t crc, const uint8_t* p, size_t len)
+{
+  for (; len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; --len)
+  {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  uint64_t crc64 = crc;
+  for (; len >= 8; len -= 8, p += 8)
+  {
+    uint64_t word;
+    ::memcpy(&word, p, sizeof word);
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; len > 0; --len)
+  {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+}  // namespace
+
+uint32_t Crc32c::extend(uint32_t crc, const void* data, size_t len)
+{
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(__SSE4_2__)
+  return ~sse42(~crc, p, len);
+#else
+  return ~slicingBy8(~crc, p, len);
+#endif
+}
+
+uint32_t Crc32c::extendPortable(uint32_t crc, const void* data, size_t len)
+{
+  return ~slicingBy8(~crc, static_cast<const uint8_t*>(data), len);
+}
+
+bool Crc32c::hardwareAccelerated()
+{
+#if defined(__SSE4_2__)
+  return true;
+#else
+  return false;
+#endif
+}
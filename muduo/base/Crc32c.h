@@ -0,0 +1,39 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#ifndef MUDUO_BASE_CRC32C_H
+#define MUDUO_BASE_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// CRC-32C (Castagnoli), as of iSCSI, SCTP and ext4.
+///
+/// With the crc32 instruction of SSE 4.2 if the build targets it,
+/// slicing-by-8 tables otherwise.
+///
+namespace Crc32c
+{
+
+/// crc of data following the data of crc, extend(0, ...) to start
+uint32_t extend(uint32_t crc, const void* data, size_t len);
+
+inline uint32_t value(const void* data, size_t len)
+{
+  return extend(0, data, len);
+}
+
+/// slicing-by-8 always, for tests and benchmarks
+uint32_t extendPortable(uint32_t crc, const void* data, size_t len);
+
+bool hardwareAccelerated();
+
+}  // namespace Crc32c
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_CRC32C_H
@@ -12,30 +12,84 @@
 
 #include <boost/static_assert.hpp>
 
+#include <algorithm>
+#include <limits>
+
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 using namespace muduo;
 
-FileUtil::AppendFile::AppendFile(StringArg filename)
-  : fp_(::fopen(filename.c_str(), "ae")),  // 'e' for O_CLOEXEC
-    writtenBytes_(0)
+const size_t FileUtil::AppendFile::kBlockSize;
+const size_t FileUtil::AppendFile::kBlockBufferSize;
+const off_t FileUtil::AppendFile::kPreallocateSize;
+
+FileUtil::AppendFile::AppendFile(StringArg filename, Backend backend)
+  : backend_(backend),
+    fp_(NULL),
+    writtenBytes_(0),
+    fd_(-1),
+    blocks_(NULL),
+    bufferedBytes_(0),
+    blocksOffset_(0),
+    allocatedEnd_(0),
+    writebackStart_(0)
 {
-  assert(fp_);
-  ::setbuffer(fp_, buffer_, sizeof buffer_);
-  // posix_fadvise POSIX_FADV_DONTNEED ?
+  if (backend_ != kStdio)
+  {
+    openBlocks(filename);
+  }
+  if (backend_ == kStdio)
+  {
+    fp_ = ::fopen(filename.c_str(), "ae");  // 'e' for O_CLOEXEC
+    assert(fp_);
+    ::setbuffer(fp_, buffer_, sizeof buffer_);
+    // posix_fadvise POSIX_FADV_DONTNEED ?
+  }
 }
 
 FileUtil::AppendFile::~AppendFile()
 {
-  ::fclose(fp_);
+  if (backend_ == kStdio)
+  {
+    ::fclose(fp_);
+  }
+  else
+  {
+    flush();
+    // gives back the extents preallocated past the end
+    ::ftruncate(fd_, blocksOffset_ + static_cast<off_t>(bufferedBytes_));
+    ::close(fd_);
+    ::free(blocks_);
+  }
 }
 
 void FileUtil::AppendFile::append(const char* logline, const size_t len)
 {
+  if (backend_ != kStdio)
+  {
+    size_t n = 0;
+    while (n < len)
+    {
+      size_t x = std::min(len - n, kBlockBufferSize - bufferedBytes_);
+      memcpy(blocks_ + bufferedBytes_, logline + n, x);
+      bufferedBytes_ += x;
+      n += x;
+      if (bufferedBytes_ == kBlockBufferSize)
+      {
+        writeBlocks();
+      }
+    }
+    writtenBytes_ += len;
+    return;
+  }
+
   size_t n = write(logline, len);
   size_t remain = len - n;
   while (remain > 0)
@@ -59,6 +113,12 @@ void FileUtil::AppendFile::append(const char* logline, const size_t len)
 
 void FileUtil::AppendFile::flush()
 {
+  if (backend_ != kStdio)
+  {
+    writeBlocks();
+    writeTail();
+    return;
+  }
   ::fflush(fp_);
 }
 
@@ -68,6 +128,139 @@ size_t FileUtil::AppendFile::write(const char* logline, size_t len)
   return ::fwrite_unlocked(logline, 1, len, fp_);
 }
 
+void FileUtil::AppendFile::openBlocks(StringArg filename)
+{
+  // O_RDWR for reading back the block an existing file ends in
+  int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+  if (backend_ == kDirectIO)
+  {
+    fd_ = ::open(filename.c_str(), flags | O_DIRECT, 0666);
+    if (fd_ < 0)
+    {
+      // tmpfs, for one
+      backend_ = kPreallocate;
+    }
+  }
+  if (fd_ < 0)
+  {
+    fd_ = ::open(filename.c_str(), flags, 0666);
+  }
+
+  struct stat st;
+  void* blocks = NULL;
+  if (fd_ < 0
+      || ::fstat(fd_, &st) != 0
+      || ::posix_memalign(&blocks, kBlockSize, kBlockBufferSize) != 0)
+  {
+    fprintf(stderr, "AppendFile: falls back to stdio for %s, %s\n",
+            filename.c_str(), strerror_tl(errno));
+    if (fd_ >= 0)
+    {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    backend_ = kStdio;
+    return;
+  }
+  blocks_ = static_cast<char*>(blocks);
+
+  // appends from the block the file ends in, as it has to be written whole
+  blocksOffset_ = st.st_size / kBlockSize * kBlockSize;
+  bufferedBytes_ = static_cast<size_t>(st.st_size - blocksOffset_);
+  if (bufferedBytes_ > 0
+      && ::pread(fd_, blocks_, kBlockSize, blocksOffset_) != static_cast<ssize_t>(bufferedBytes_))
+  {
+    fprintf(stderr, "AppendFile: falls back to stdio for %s, %s\n",
+            filename.c_str(), strerror_tl(errno));
+    ::close(fd_);
+    fd_ = -1;
+    ::free(blocks_);
+    blocks_ = NULL;
+    backend_ = kStdio;
+    return;
+  }
+  allocatedEnd_ = st.st_size;
+  writebackStart_ = blocksOffset_;
+}
+
+// writes the whole blocks of blocks_, keeps the rest
+void FileUtil::AppendFile::writeBlocks()
+{
+  size_t whole = bufferedBytes_ / kBlockSize * kBlockSize;
+  if (whole == 0)
+  {
+    return;
+  }
+  off_t end = blocksOffset_ + static_cast<off_t>(whole);
+  if (end > allocatedEnd_)
+  {
+    // no block allocation on the way of later writes
+    off_t len = std::max(kPreallocateSize, end - allocatedEnd_);
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocatedEnd_, len) == 0)
+    {
+      allocatedEnd_ += len;
+    }
+    else
+    {
+      // not supported, or the disk is full, stops trying
+      allocatedEnd_ = std::numeric_limits<off_t>::max();
+    }
+  }
+
+  pwriteAll(blocks_, whole, blocksOffset_);
+  if (backend_ == kPreallocate)
+  {
+    // starts writeback now, instead of in a burst that stalls a later write
+    ::sync_file_range(fd_, writebackStart_, end - writebackStart_, SYNC_FILE_RANGE_WRITE);
+    writebackStart_ = end;
+  }
+
+  blocksOffset_ = end;
+  bufferedBytes_ -= whole;
+  memmove(blocks_, blocks_ + whole, bufferedBytes_);
+}
+
+// writes the partial block at the end, which stays in blocks_ for
+// being written again whole
+void FileUtil::AppendFile::writeTail()
+{
+  if (bufferedBytes_ == 0)
+  {
+    return;
+  }
+  if (backend_ == kDirectIO)
+  {
+    int flags = ::fcntl(fd_, F_GETFL);
+    ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+    pwriteAll(blocks_, bufferedBytes_, blocksOffset_);
+    ::fcntl(fd_, F_SETFL, flags);
+  }
+  else
+  {
+    pwriteAll(blocks_, bufferedBytes_, blocksOffset_);
+  }
+}
+
+bool FileUtil::AppendFile::pwriteAll(const char* data, size_t len, off_t offset)
+{
+  size_t n = 0;
+  while (n < len)
+  {
+    ssize_t x = ::pwrite(fd_, data + n, len - n, offset + static_cast<off_t>(n));
+    if (x < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      fprintf(stderr, "AppendFile::append() failed %s\n", strerror_tl(errno));
+      return false;
+    }
+    n += static_cast<size_t>(x);
+  }
+  return true;
+}
+
 FileUtil::ReadSmallFile::ReadSmallFile(StringArg filename)
   : fd_(::open(filename.c_str(), O_RDONLY | O_CLOEXEC)),
     err_(0)
@@ -66,7 +66,14 @@ int readFile(StringArg filename,
 class AppendFile : boost::noncopyable
 {
  public:
-  explicit AppendFile(StringArg filename);
+  enum Backend
+  {
+    kStdio,        // FILE* with a 64KB buffer
+    kPreallocate,  // fallocate()d extents, whole blocks, early writeback
+    kDirectIO,     // kPreallocate with O_DIRECT, the page cache bypassed
+  };
+
+  explicit AppendFile(StringArg filename, Backend backend = kStdio);
 
   ~AppendFile();
 
@@ -76,13 +83,34 @@ class AppendFile : boost::noncopyable
 
   size_t writtenBytes() const { return writtenBytes_; }
 
+  /// kStdio if the file system took none of the others.
+  Backend backend() const { return backend_; }
+
  private:
 
   size_t write(const char* logline, size_t len);
 
+  void openBlocks(StringArg filename);
+  void writeBlocks();
+  void writeTail();
+  bool pwriteAll(const char* data, size_t len, off_t offset);
+
+  static const size_t kBlockSize = 4096;
+  static const size_t kBlockBufferSize = 256*1024;
+  static const off_t kPreallocateSize = 8*1024*1024;
+
+  Backend backend_;
   FILE* fp_;
   char buffer_[64*1024];
   size_t writtenBytes_;
+
+  // for kPreallocate and kDirectIO
+  int fd_;
+  char* blocks_;  // kBlockSize aligned, kBlockBufferSize bytes
+  size_t bufferedBytes_;
+  off_t blocksOffset_;  // in the file, of blocks_[0]
+  off_t allocatedEnd_;
+  off_t writebackStart_;
 };
 }
 
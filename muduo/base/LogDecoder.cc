@@ -0,0 +1,217 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/base/LogDecoder.h>
+
+#include <muduo/base/Logging.h>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::detail;
+
+namespace muduo
+{
+extern const char* LogLevelName[Logger::NUM_LOG_LEVELS];
+}
+
+namespace
+{
+
+template<typename T>
+bool replay(const char** p, const char* end, LogStream* out)
+{
+  T v;
+  if (static_cast<size_t>(end - *p) < sizeof v)
+  {
+    return false;
+  }
+  memcpy(&v, *p, sizeof v);
+  *p += sizeof v;
+  *out << v;
+  return true;
+}
+
+}
+
+LogDecoder::LogDecoder()
+  : fromFile_(false),
+    hasZone_(false),
+    lastSecond_(0),
+    lastTid_(0),
+    tidStringLength_(0)
+{
+}
+
+void LogDecoder::setTimeZone(const TimeZone& tz)
+{
+  hasZone_ = true;
+  zone_ = tz;
+  lastSecond_ = 0;
+}
+
+bool LogDecoder::decode(const char* record, int len, LogStream* out)
+{
+  if (len < 1)
+  {
+    return false;
+  }
+  switch (record[0])
+  {
+    case kLogRecordLine:
+      return decodeLine(record, len, true, out);
+    case kLogRecordText:
+      out->append(record + 1, len - 1);
+      return true;
+    case kLogRecordString:
+      {
+        uint64_t address = 0;
+        if (len < static_cast<int>(1 + sizeof address))
+        {
+          return false;
+        }
+        memcpy(&address, record + 1, sizeof address);
+        strings_[address].assign(record + 1 + sizeof address,
+                                 len - 1 - sizeof address);
+        return true;
+      }
+    case kLogRecordFileHeader:
+      {
+        LogFileHeader header;
+        if (len != static_cast<int>(1 + sizeof header))
+        {
+          return false;
+        }
+        memcpy(&header, record + 1, sizeof header);
+        fromFile_ = true;
+        strings_.clear();
+        return memcmp(header.magic, "muduolog", sizeof header.magic) == 0
+            && header.byteOrder == kLogByteOrder
+            && header.pointerSize == sizeof(void*);
+      }
+    default:
+      return false;
+  }
+}
+
+bool LogDecoder::decodeUnfinished(const char* record, int len, LogStream* out)
+{
+  return len > 0 && record[0] == kLogRecordLine
+      && decodeLine(record, len, false, out);
+}
+
+// in the order of Logger::Impl
+bool LogDecoder::decodeLine(const char* record, int len, bool finished, LogStream* out)
+{
+  LogLineHeader header;
+  if (len < static_cast<int>(1 + sizeof header))
+  {
+    return false;
+  }
+  memcpy(&header, record + 1, sizeof header);
+  if (header.level < 0 || header.level >= Logger::NUM_LOG_LEVELS)
+  {
+    return false;
+  }
+
+  formatLogTime(*out, header.microSecondsSinceEpoch,
+                hasZone_ ? zone_ : Logger::timeZone(), time_, &lastSecond_);
+  if (header.tid != lastTid_ || tidStringLength_ == 0)
+  {
+    lastTid_ = header.tid;
+    tidStringLength_ = snprintf(tidString_, sizeof tidString_, "%5d ", header.tid);
+  }
+  out->append(tidString_, tidStringLength_);
+  out->append(LogLevelName[header.level], 6);
+  if (header.savedErrno != 0)
+  {
+    *out << strerror_tl(header.savedErrno) << " (errno=" << header.savedErrno << ") ";
+  }
+  if (header.func)
+  {
+    *out << lookup(header.func, -1) << ' ';
+  }
+
+  if (!decodeArgs(record + 1 + sizeof header, record + len, out))
+  {
+    return false;
+  }
+
+  if (finished)
+  {
+    *out << " - " << lookup(header.file, header.fileLength) << ':' << header.line << '\n';
+  }
+  return true;
+}
+
+bool LogDecoder::decodeArgs(const char* p, const char* end, LogStream* out)
+{
+  bool ok = true;
+  while (ok && p < end)
+  {
+    char type = *p++;
+    switch (type)
+    {
+      case kLogArgChar:
+        ok = replay<char>(&p, end, out);
+        break;
+      case kLogArgString:
+        {
+          uint16_t len = 0;
+          ok = static_cast<size_t>(end - p) >= sizeof len;
+          if (ok)
+          {
+            memcpy(&len, p, sizeof len);
+            p += sizeof len;
+            ok = end - p >= len;
+          }
+          if (ok)
+          {
+            out->append(p, len);
+            p += len;
+          }
+        }
+        break;
+      case kLogArgInt:
+        ok = replay<int>(&p, end, out);
+        break;
+      case kLogArgUInt:
+        ok = replay<unsigned int>(&p, end, out);
+        break;
+      case kLogArgLong:
+        ok = replay<long>(&p, end, out);
+        break;
+      case kLogArgULong:
+        ok = replay<unsigned long>(&p, end, out);
+        break;
+      case kLogArgLongLong:
+        ok = replay<long long>(&p, end, out);
+        break;
+      case kLogArgULongLong:
+        ok = replay<unsigned long long>(&p, end, out);
+        break;
+      case kLogArgDouble:
+        ok = replay<double>(&p, end, out);
+        break;
+      case kLogArgPointer:
+        ok = replay<const void*>(&p, end, out);
+        break;
+      default:
+        ok = false;
+        break;
+    }
+  }
+  return ok;
+}
+
+StringPiece LogDecoder::lookup(const char* address, int len) const
+{
+  if (!fromFile_)
+  {
+    return len >= 0 ? StringPiece(address, len) : StringPiece(address);
+  }
+  std::map<uint64_t, string>::const_iterator it =
+    strings_.find(reinterpret_cast<uintptr_t>(address));
+  return it != strings_.end() ? StringPiece(it->second) : StringPiece("?");
+}
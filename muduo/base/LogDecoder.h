@@ -0,0 +1,102 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#ifndef MUDUO_BASE_LOGDECODER_H
+#define MUDUO_BASE_LOGDECODER_H
+
+#include <muduo/base/LogStream.h>
+#include <muduo/base/TimeZone.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <map>
+#include <stdint.h>
+#include <time.h>
+
+namespace muduo
+{
+
+namespace detail
+{
+
+// A record is a kind byte followed by its body.
+enum LogRecordKind
+{
+  kLogRecordLine = 1,  // LogLineHeader, then arguments, see LogArgType
+  kLogRecordText,      // a formatted line
+  kLogRecordString,    // uint64_t address, then the string at it
+  kLogRecordFileHeader,  // LogFileHeader
+};
+
+// what Logger used to format the prefix and suffix of a line,
+// file and func are static strings of the process that logged it
+struct LogLineHeader
+{
+  int64_t microSecondsSinceEpoch;
+  const char* file;
+  const char* func;  // NULL if not logged
+  int32_t line;
+  int32_t tid;
+  int32_t savedErrno;
+  int16_t fileLength;
+  int8_t level;
+};
+
+struct LogFileHeader
+{
+  char magic[8];  // "muduolog"
+  uint32_t byteOrder;  // kLogByteOrder as written
+  uint32_t pointerSize;
+};
+
+const uint32_t kLogByteOrder = 0x01020304;
+
+void formatLogTime(LogStream& s, int64_t microSecondsSinceEpoch,
+                   const TimeZone& tz, char cache[32], time_t* lastSecond);
+
+}
+
+///
+/// Formats the binary records of Logger::setRecordOutput() into the text
+/// Logger would have produced, byte for byte.
+///
+/// Records of this process refer to file names and function names by address.
+/// Once it has decoded the header of a file of AsyncLogging::kRawRecords,
+/// they refer to the strings defined earlier in the file instead.
+/// Such files are only readable on the same machine architecture.
+///
+class LogDecoder : boost::noncopyable
+{
+ public:
+  LogDecoder();
+
+  /// Uses @c tz instead of the zone of Logger::setTimeZone().
+  void setTimeZone(const TimeZone& tz);
+
+  /// Appends the text of the record to @c out, nothing for definitions.
+  /// Returns false if the record is malformed.
+  bool decode(const char* record, int len, LogStream* out);
+
+  /// For LogStream, a line still being recorded, without its suffix.
+  bool decodeUnfinished(const char* record, int len, LogStream* out);
+
+ private:
+  bool decodeLine(const char* record, int len, bool finished, LogStream* out);
+  bool decodeArgs(const char* args, const char* end, LogStream* out);
+  StringPiece lookup(const char* address, int len) const;
+
+  bool fromFile_;
+  bool hasZone_;
+  TimeZone zone_;
+  char time_[32];
+  time_t lastSecond_;
+  int lastTid_;
+  char tidString_[32];
+  int tidStringLength_;
+  std::map<uint64_t, string> strings_;  // by address in the logging process
+};
+
+}
+
+#endif  // MUDUO_BASE_LOGDECODER_H
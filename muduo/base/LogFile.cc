@@ -1,14 +1,207 @@
 #include <muduo/base/LogFile.h>
 
+#include <muduo/base/BlockingQueue.h>
 #include <muduo/base/FileUtil.h>
 #include <muduo/base/ProcessInfo.h>
+#include <muduo/base/Thread.h>
+
+#ifdef HAVE_ZLIB
+#include <muduo/base/GzipFile.h>
+#endif
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
 
 #include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 using namespace muduo;
 
+namespace muduo
+{
+namespace detail
+{
+
+// Runs in its own thread, so that a roll costs the append path
+// no more than opening the next file.
+// Reports to stderr, for it serves the logging itself.
+class LogArchiver : boost::noncopyable
+{
+ public:
+  typedef boost::function<void ()> Task;
+  typedef boost::scoped_ptr<FileUtil::AppendFile> FilePtr;
+
+  explicit LogArchiver(const string& basename)
+    : thread_(boost::bind(&LogArchiver::threadFunc, this), "LogArchiver")
+  {
+    size_t slash = basename.rfind('/');
+    if (slash == string::npos)
+    {
+      dir_ = ".";
+      prefix_ = basename;
+    }
+    else
+    {
+      dir_ = slash == 0 ? "/" : basename.substr(0, slash);
+      prefix_ = basename.substr(slash + 1);
+    }
+    prefix_ += '.';
+    thread_.start();
+  }
+
+  ~LogArchiver()
+  {
+    // finishes what was queued before it
+    queue_.put(Task());
+    thread_.join();
+  }
+
+  /// Takes over @c rolled, the file of @c rolledName.
+  void archive(boost::scoped_ptr<FileUtil::AppendFile>* rolled,
+               const string& rolledName,
+               const string& currentName,
+               bool compress,
+               size_t maxTotalBytes)
+  {
+    // not a shared_ptr, whose last owner could be the caller
+    FilePtr* file = new FilePtr;
+    file->swap(*rolled);
+    queue_.put(boost::bind(&LogArchiver::archiveInThread, this,
+                           file, rolledName, currentName, compress, maxTotalBytes));
+  }
+
+ private:
+  void threadFunc()
+  {
+    while (Task task = queue_.take())
+    {
+      task();
+    }
+  }
+
+  void archiveInThread(FilePtr* file,
+                       const string& rolledName,
+                       const string& currentName,
+                       bool compress,
+                       size_t maxTotalBytes)
+  {
+    delete file;  // flushes and closes
+    if (compress)
+    {
+      compressFile(rolledName);
+    }
+    if (maxTotalBytes > 0)
+    {
+      removeOldFiles(currentName, maxTotalBytes);
+    }
+  }
+
+  static void compressFile(const string& filename)
+  {
+#ifdef HAVE_ZLIB
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      fprintf(stderr, "LogArchiver: cannot open %s\n", filename.c_str());
+      return;
+    }
+
+    // never seen half written as basename.*.log.gz
+    string tmpName = filename + ".gz.tmp";
+    bool ok = false;
+    {
+      GzipFile out = GzipFile::openForWriteTruncate(tmpName);
+      if (out.valid())
+      {
+        out.setBuffer(kBufferSize);
+        char buf[kBufferSize];
+        ssize_t n = 0;
+        ok = true;
+        while (ok && (n = ::read(fd, buf, sizeof buf)) > 0)
+        {
+          ok = out.write(StringPiece(buf, static_cast<int>(n))) == n;
+        }
+        ok = ok && n == 0;
+      }
+    }
+    ::close(fd);
+
+    string gzName = filename + ".gz";
+    if (ok && ::rename(tmpName.c_str(), gzName.c_str()) == 0)
+    {
+      ::unlink(filename.c_str());
+    }
+    else
+    {
+      fprintf(stderr, "LogArchiver: failed to compress %s\n", filename.c_str());
+      ::unlink(tmpName.c_str());
+    }
+#endif
+  }
+
+  // Names of a basename sort by the time they were rolled.
+  void removeOldFiles(const string& currentName, size_t maxTotalBytes)
+  {
+    DIR* dir = ::opendir(dir_.c_str());
+    if (dir == NULL)
+    {
+      return;
+    }
+    std::vector<std::pair<string, size_t> > files;
+    while (struct dirent* entry = ::readdir(dir))
+    {
+      StringPiece name(entry->d_name);
+      if (name.starts_with(prefix_) && (endsWith(name, ".log") || endsWith(name, ".log.gz")))
+      {
+        string path = dir_ + '/' + entry->d_name;
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+          files.push_back(std::make_pair(path, static_cast<size_t>(st.st_size)));
+        }
+      }
+    }
+    ::closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    string current = dir_ + '/' + currentName.substr(currentName.rfind('/') + 1);
+    size_t total = 0;
+    for (size_t i = files.size(); i > 0; --i)
+    {
+      const string& path = files[i-1].first;
+      total += files[i-1].second;
+      if (total > maxTotalBytes && path != current)
+      {
+        ::unlink(path.c_str());
+      }
+    }
+  }
+
+  static bool endsWith(StringPiece name, StringPiece suffix)
+  {
+    return name.size() >= suffix.size()
+        && memcmp(name.data() + name.size() - suffix.size(), suffix.data(), suffix.size()) == 0;
+  }
+
+  static const int kBufferSize = 64*1024;
+
+  string dir_;
+  string prefix_;
+  BlockingQueue<Task> queue_;
+  Thread thread_;
+};
+
+}
+}
+
 LogFile::LogFile(const string& basename,
                  size_t rollSize,
                  bool threadSafe,
@@ -22,7 +215,10 @@ LogFile::LogFile(const string& basename,
     mutex_(threadSafe ? new MutexLock : NULL),
     startOfPeriod_(0),
     lastRoll_(0),
-    lastFlush_(0)
+    lastFlush_(0),
+    backend_(FileUtil::AppendFile::kStdio),
+    compress_(false),
+    maxTotalBytes_(0)
 {
   rollFile();
 }
@@ -31,6 +227,68 @@ LogFile::~LogFile()
 {
 }
 
+void LogFile::setCompressRolledFiles(bool on)
+{
+#ifndef HAVE_ZLIB
+  if (on)
+  {
+    fprintf(stderr, "LogFile: built without zlib, rolled files stay as they are\n");
+    on = false;
+  }
+#endif
+  if (mutex_)
+  {
+    MutexLockGuard lock(*mutex_);
+    compress_ = on;
+    startArchiver();
+  }
+  else
+  {
+    compress_ = on;
+    startArchiver();
+  }
+}
+
+void LogFile::setMaxTotalBytes(size_t maxBytes)
+{
+  if (mutex_)
+  {
+    MutexLockGuard lock(*mutex_);
+    maxTotalBytes_ = maxBytes;
+    startArchiver();
+  }
+  else
+  {
+    maxTotalBytes_ = maxBytes;
+    startArchiver();
+  }
+}
+
+void LogFile::setFileBackend(FileUtil::AppendFile::Backend backend)
+{
+  if (mutex_)
+  {
+    MutexLockGuard lock(*mutex_);
+    backend_ = backend;
+    file_.reset();  // the new one appends to what it flushes
+    file_.reset(new FileUtil::AppendFile(filename_, backend_));
+  }
+  else
+  {
+    backend_ = backend;
+    file_.reset();
+    file_.reset(new FileUtil::AppendFile(filename_, backend_));
+  }
+}
+
+void LogFile::startArchiver()
+{
+  if (!archiver_ && (compress_ || maxTotalBytes_ > 0))
+  {
+    archiver_.reset(new detail::LogArchiver(basename_));
+  }
+}
+
 void LogFile::append(const char* logline, int len)
 {
   if (mutex_)
@@ -57,6 +315,16 @@ void LogFile::flush()
   }
 }
 
+size_t LogFile::writtenBytes() const
+{
+  if (mutex_)
+  {
+    MutexLockGuard lock(*mutex_);
+    return file_->writtenBytes();
+  }
+  return file_->writtenBytes();
+}
+
 void LogFile::append_unlocked(const char* logline, int len)
 {
   file_->append(logline, len);
@@ -97,7 +365,14 @@ bool LogFile::rollFile()
     lastRoll_ = now;
     lastFlush_ = now;
     startOfPeriod_ = start;
-    file_.reset(new FileUtil::AppendFile(filename));
+    if (archiver_ && file_)
+    {
+      // closing the rolled file may block as long as writing to it
+      archiver_->archive(&file_, filename_, filename,
+                         compress_, maxTotalBytes_);
+    }
+    file_.reset(new FileUtil::AppendFile(filename, backend_));
+    filename_.swap(filename);
     return true;
   }
   return false;
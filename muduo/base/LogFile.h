@@ -1,6 +1,7 @@
 #ifndef MUDUO_BASE_LOGFILE_H
 #define MUDUO_BASE_LOGFILE_H
 
+#include <muduo/base/FileUtil.h>
 #include <muduo/base/Mutex.h>
 #include <muduo/base/Types.h>
 
@@ -10,9 +11,9 @@
 namespace muduo
 {
 
-namespace FileUtil
+namespace detail
 {
-class AppendFile;
+class LogArchiver;
 }
 
 class LogFile : boost::noncopyable
@@ -25,13 +26,26 @@ class LogFile : boost::noncopyable
           int checkEveryN = 1024);
   ~LogFile();
 
+  /// Gzips each rolled file into basename.*.log.gz in a background thread,
+  /// if built with zlib.
+  void setCompressRolledFiles(bool on);
+  /// Deletes the oldest files of this basename, compressed or not,
+  /// once they take more than @c maxBytes in total, 0 for no limit.
+  void setMaxTotalBytes(size_t maxBytes);
+  /// Reopens the current file with @c backend, and every file after it.
+  void setFileBackend(FileUtil::AppendFile::Backend backend);
+
   void append(const char* logline, int len);
   void flush();
   bool rollFile();
+  /// Of the current file, 0 right after it rolls.
+  size_t writtenBytes() const;
 
  private:
   void append_unlocked(const char* logline, int len);
 
+  void startArchiver();
+
   static string getLogFileName(const string& basename, time_t* now);
 
   const string basename_;
@@ -46,6 +60,13 @@ class LogFile : boost::noncopyable
   time_t lastRoll_;
   time_t lastFlush_;
   boost::scoped_ptr<FileUtil::AppendFile> file_;
+  string filename_;
+  FileUtil::AppendFile::Backend backend_;
+
+  bool compress_;
+  size_t maxTotalBytes_;
+  // closes, compresses and deletes rolled files off the append path
+  boost::scoped_ptr<detail::LogArchiver> archiver_;
 
   const static int kRollPerSeconds_ = 60*60*24;
 };
@@ -1,10 +1,14 @@
 #include <muduo/base/LogStream.h>
 
+#include <muduo/base/LogDecoder.h>
+
 #include <algorithm>
 #include <limits>
 #include <boost/static_assert.hpp>
 #include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/type_traits/make_unsigned.hpp>
 #include <assert.h>
+#include <math.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -23,34 +27,383 @@ namespace muduo
 namespace detail
 {
 
-const char digits[] = "9876543210123456789";
-const char* zero = digits + 9;
-BOOST_STATIC_ASSERT(sizeof(digits) == 20);
+const char digitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+BOOST_STATIC_ASSERT(sizeof digitPairs == 201);
+
+const uint64_t kPowersOf10[] =
+{
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+};
 
 const char digitsHex[] = "0123456789ABCDEF";
 BOOST_STATIC_ASSERT(sizeof digitsHex == 17);
 
-// Efficient Integer to String Conversions, by Matthew Wilson.
+// number of decimal digits, 1 for 0
+inline int countDigits(uint64_t v)
+{
+  // log10(v) from log2(v), at most one too large
+  int t = (64 - __builtin_clzll(v | 1)) * 1233 >> 12;
+  return t + (v >= kPowersOf10[t] || t == 0 ? 1 : 0);
+}
+
+// writes the digits of u backwards to end, two at a time
+template<typename U>
+void writeDigits(char* end, U u)
+{
+  while (u >= 100)
+  {
+    const char* pair = digitPairs + static_cast<int>(u % 100) * 2;
+    u /= 100;
+    end -= 2;
+    end[0] = pair[0];
+    end[1] = pair[1];
+  }
+  if (u >= 10)
+  {
+    const char* pair = digitPairs + static_cast<int>(u) * 2;
+    end[-2] = pair[0];
+    end[-1] = pair[1];
+  }
+  else
+  {
+    end[-1] = static_cast<char>('0' + u);
+  }
+}
+
+// digits are counted first, so they are written in place, not reversed
 template<typename T>
 size_t convert(char buf[], T value)
 {
-  T i = value;
+  typedef typename boost::make_unsigned<T>::type U;
+  U u = static_cast<U>(value);
   char* p = buf;
+  if (value < 0)
+  {
+    *p++ = '-';
+    u = static_cast<U>(0 - u);
+  }
+  p += countDigits(u);
+  writeDigits(p, u);
+  return p - buf;
+}
 
-  do
+// Grisu2 by Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers", after the implementation of Milo Yip.
+// The digits always read back as the same double, and are the shortest
+// such for all but a tiny fraction of values.
+
+struct DiyFp
+{
+  DiyFp(uint64_t fArg, int eArg) : f(fArg), e(eArg) { }
+
+  explicit DiyFp(double d)
   {
-    int lsd = static_cast<int>(i % 10);
-    i /= 10;
-    *p++ = zero[lsd];
-  } while (i != 0);
+    uint64_t bits = 0;
+    memcpy(&bits, &d, sizeof bits);
+    int biased = static_cast<int>((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & kSignificandMask;
+    if (biased != 0)
+    {
+      f = significand + kHiddenBit;
+      e = biased - kExponentBias;
+    }
+    else
+    {
+      f = significand;
+      e = 1 - kExponentBias;
+    }
+  }
 
-  if (value < 0)
+  DiyFp operator-(const DiyFp& rhs) const
+  {
+    return DiyFp(f - rhs.f, e);
+  }
+
+  // rounded upper 64 bits of the product
+  DiyFp operator*(const DiyFp& rhs) const
+  {
+    unsigned __int128 p = static_cast<unsigned __int128>(f) * rhs.f;
+    uint64_t h = static_cast<uint64_t>(p >> 64);
+    uint64_t l = static_cast<uint64_t>(p);
+    if (l & (1ULL << 63))
+    {
+      ++h;
+    }
+    return DiyFp(h, e + rhs.e + 64);
+  }
+
+  DiyFp normalize() const
+  {
+    int s = __builtin_clzll(f);
+    return DiyFp(f << s, e - s);
+  }
+
+  // the neighbours halfway to the adjacent doubles, with the same exponent
+  void normalizedBoundaries(DiyFp* minus, DiyFp* plus) const
+  {
+    DiyFp pl = DiyFp((f << 1) + 1, e - 1).normalize();
+    DiyFp mi = (f == kHiddenBit) ? DiyFp((f << 2) - 1, e - 2)
+                                 : DiyFp((f << 1) - 1, e - 1);
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *plus = pl;
+    *minus = mi;
+  }
+
+  static const uint64_t kSignificandMask = 0x000FFFFFFFFFFFFFULL;
+  static const uint64_t kHiddenBit = 0x0010000000000000ULL;
+  static const int kExponentBias = 0x3FF + 52;
+
+  uint64_t f;
+  int e;
+};
+
+// 10^k for k = -348, -340, ..., 340
+const uint64_t kCachedPowersF[] =
+{
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+const int16_t kCachedPowersE[] =
+{
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// a power 10^-K that brings the exponent of the product to [-60, -32]
+DiyFp cachedPower(int e, int* K)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;  // dk must be positive
+  int k = static_cast<int>(dk);
+  if (dk - k > 0.0)
+  {
+    ++k;
+  }
+  int index = (k >> 3) + 1;
+  *K = -(-348 + index * 8);
+  return DiyFp(kCachedPowersF[index], kCachedPowersE[index]);
+}
+
+void grisuRound(char* buffer, int len, uint64_t delta, uint64_t rest,
+                uint64_t tenKappa, uint64_t distance)
+{
+  while (rest < distance && delta - rest >= tenKappa
+         && (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+  {
+    buffer[len - 1]--;
+    rest += tenKappa;
+  }
+}
+
+void digitGen(const DiyFp& w, const DiyFp& mp, uint64_t delta,
+              char* buffer, int* len, int* K)
+{
+  const DiyFp one(1ULL << -mp.e, mp.e);
+  const DiyFp distance = mp - w;
+  uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = countDigits(p1);
+  *len = 0;
+
+  while (kappa > 0)
+  {
+    uint32_t pow10 = static_cast<uint32_t>(kPowersOf10[kappa - 1]);
+    uint32_t d = p1 / pow10;
+    p1 %= pow10;
+    if (d || *len)
+    {
+      buffer[(*len)++] = static_cast<char>('0' + d);
+    }
+    --kappa;
+    uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (rest <= delta)
+    {
+      *K += kappa;
+      grisuRound(buffer, *len, delta, rest, kPowersOf10[kappa] << -one.e, distance.f);
+      return;
+    }
+  }
+
+  for (;;)
+  {
+    p2 *= 10;
+    delta *= 10;
+    char d = static_cast<char>(p2 >> -one.e);
+    if (d || *len)
+    {
+      buffer[(*len)++] = static_cast<char>('0' + d);
+    }
+    p2 &= one.f - 1;
+    --kappa;
+    if (p2 < delta)
+    {
+      *K += kappa;
+      int index = -kappa;
+      grisuRound(buffer, *len, delta, p2, one.f,
+                 distance.f * (index < 20 ? kPowersOf10[index] : 0));
+      return;
+    }
+  }
+}
+
+// value > 0, the digits times 10^K
+void grisu2(double value, char* buffer, int* len, int* K)
+{
+  const DiyFp v(value);
+  DiyFp minus(0, 0), plus(0, 0);
+  v.normalizedBoundaries(&minus, &plus);
+
+  const DiyFp cached = cachedPower(plus.e, K);
+  const DiyFp w = v.normalize() * cached;
+  DiyFp wPlus = plus * cached;
+  DiyFp wMinus = minus * cached;
+  wMinus.f++;
+  wPlus.f--;
+  digitGen(w, wPlus, wPlus.f - wMinus.f, buffer, len, K);
+}
+
+char* writeExponent(char* p, int exp)
+{
+  *p++ = 'e';
+  if (exp < 0)
   {
     *p++ = '-';
+    exp = -exp;
+  }
+  else
+  {
+    *p++ = '+';
+  }
+  // at least two digits, as printf
+  if (exp >= 100)
+  {
+    *p++ = static_cast<char>('0' + exp / 100);
+    exp %= 100;
+  }
+  *p++ = digitPairs[exp * 2];
+  *p++ = digitPairs[exp * 2 + 1];
+  return p;
+}
+
+// the layout of %g, with as many digits as needed to read back the same
+// double, like repr() of Python
+size_t convertDouble(char buf[], double value)
+{
+  char* p = buf;
+  if (value != value)
+  {
+    memcpy(p, signbit(value) ? "-nan" : "nan", 4);
+    return signbit(value) ? 4 : 3;
+  }
+  if (signbit(value))
+  {
+    *p++ = '-';
+    value = -value;
+  }
+  if (value == 0.0)
+  {
+    *p++ = '0';
+    return p - buf;
+  }
+  if (value > std::numeric_limits<double>::max())
+  {
+    memcpy(p, "inf", 3);
+    return p + 3 - buf;
   }
-  *p = '\0';
-  std::reverse(buf, p);
 
+  char digits[20];
+  int len = 0;
+  int K = 0;
+  grisu2(value, digits, &len, &K);
+  const int exp10 = len + K - 1;  // of the first digit
+
+  if (exp10 < -4 || exp10 >= 16)
+  {
+    *p++ = digits[0];
+    if (len > 1)
+    {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    p = writeExponent(p, exp10);
+  }
+  else if (K >= 0)
+  {
+    // 1234e2 -> 123400
+    memcpy(p, digits, len);
+    p += len;
+    memset(p, '0', K);
+    p += K;
+  }
+  else if (exp10 >= 0)
+  {
+    // 1234e-2 -> 12.34
+    memcpy(p, digits, exp10 + 1);
+    p += exp10 + 1;
+    *p++ = '.';
+    memcpy(p, digits + exp10 + 1, len - exp10 - 1);
+    p += len - exp10 - 1;
+  }
+  else
+  {
+    // 1234e-6 -> 0.001234
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -exp10 - 1);
+    p += -exp10 - 1;
+    memcpy(p, digits, len);
+    p += len;
+  }
   return p - buf;
 }
 
@@ -73,6 +426,7 @@ size_t convertHex(char buf[], uintptr_t value)
 }
 
 template class FixedBuffer<kSmallBuffer>;
+template class FixedBuffer<kMediumBuffer>;
 template class FixedBuffer<kLargeBuffer>;
 
 }
@@ -127,42 +481,70 @@ LogStream& LogStream::operator<<(unsigned short v)
 
 LogStream& LogStream::operator<<(int v)
 {
+  if (recording_ && recordValue(kLogArgInt, v))
+  {
+    return *this;
+  }
   formatInteger(v);
   return *this;
 }
 
 LogStream& LogStream::operator<<(unsigned int v)
 {
+  if (recording_ && recordValue(kLogArgUInt, v))
+  {
+    return *this;
+  }
   formatInteger(v);
   return *this;
 }
 
 LogStream& LogStream::operator<<(long v)
 {
+  if (recording_ && recordValue(kLogArgLong, v))
+  {
+    return *this;
+  }
   formatInteger(v);
   return *this;
 }
 
 LogStream& LogStream::operator<<(unsigned long v)
 {
+  if (recording_ && recordValue(kLogArgULong, v))
+  {
+    return *this;
+  }
   formatInteger(v);
   return *this;
 }
 
 LogStream& LogStream::operator<<(long long v)
 {
+  if (recording_ && recordValue(kLogArgLongLong, v))
+  {
+    return *this;
+  }
   formatInteger(v);
   return *this;
 }
 
 LogStream& LogStream::operator<<(unsigned long long v)
 {
+  if (recording_ && recordValue(kLogArgULongLong, v))
+  {
+    return *this;
+  }
   formatInteger(v);
   return *this;
 }
 
 LogStream& LogStream::operator<<(const void* p)
 {
+  if (recording_ && recordValue(kLogArgPointer, p))
+  {
+    return *this;
+  }
   uintptr_t v = reinterpret_cast<uintptr_t>(p);
   if (buffer_.avail() >= kMaxNumericSize)
   {
@@ -175,17 +557,89 @@ LogStream& LogStream::operator<<(const void* p)
   return *this;
 }
 
-// FIXME: replace this with Grisu3 by Florian Loitsch.
 LogStream& LogStream::operator<<(double v)
 {
+  if (recording_ && recordValue(kLogArgDouble, v))
+  {
+    return *this;
+  }
   if (buffer_.avail() >= kMaxNumericSize)
   {
-    int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
+    size_t len = convertDouble(buffer_.current(), v);
     buffer_.add(len);
   }
   return *this;
 }
 
+bool LogStream::recordString(const char* data, size_t len)
+{
+  if (len >= static_cast<size_t>(kSmallBuffer))
+  {
+    // never fits in the text either
+    return true;
+  }
+  uint16_t len16 = static_cast<uint16_t>(len);
+  if (implicit_cast<size_t>(buffer_.avail()) > 1 + sizeof len16 + len)
+  {
+    char* p = buffer_.current();
+    *p = kLogArgString;
+    memcpy(p + 1, &len16, sizeof len16);
+    memcpy(p + 1 + sizeof len16, data, len);
+    buffer_.add(1 + sizeof len16 + len);
+    return true;
+  }
+  spill();
+  return false;
+}
+
+// A record can be longer than its text, e.g. of many chars.
+// The line is formatted here instead, exactly as LogDecoder would,
+// so that later arguments are truncated as in text mode.
+void LogStream::spill()
+{
+  LogStream text;
+  LogDecoder decoder;
+  decoder.decodeUnfinished(buffer_.data(), buffer_.length(), &text);
+  recording_ = false;
+  buffer_.reset();
+  buffer_.append(text.buffer_.data(), text.buffer_.length());
+}
+
+size_t muduo::formatNumber(char* buf, int v)
+{
+  return convert(buf, v);
+}
+
+size_t muduo::formatNumber(char* buf, unsigned int v)
+{
+  return convert(buf, v);
+}
+
+size_t muduo::formatNumber(char* buf, long v)
+{
+  return convert(buf, v);
+}
+
+size_t muduo::formatNumber(char* buf, unsigned long v)
+{
+  return convert(buf, v);
+}
+
+size_t muduo::formatNumber(char* buf, long long v)
+{
+  return convert(buf, v);
+}
+
+size_t muduo::formatNumber(char* buf, unsigned long long v)
+{
+  return convert(buf, v);
+}
+
+size_t muduo::formatNumber(char* buf, double v)
+{
+  return convertDouble(buf, v);
+}
+
 template<typename T>
 Fmt::Fmt(const char* fmt, T val)
 {
@@ -18,6 +18,7 @@ namespace detail
 {
 
 const int kSmallBuffer = 4000;
+const int kMediumBuffer = 256*1000;
 const int kLargeBuffer = 4000*1000;
 
 template<int SIZE>
@@ -74,6 +75,21 @@ class FixedBuffer : boost::noncopyable
   char* cur_;
 };
 
+// types of the arguments a LogStream records in binary mode, see LogDecoder
+enum LogArgType
+{
+  kLogArgChar = 1,
+  kLogArgString,   // uint16_t length, then bytes
+  kLogArgInt,
+  kLogArgUInt,
+  kLogArgLong,
+  kLogArgULong,
+  kLogArgLongLong,
+  kLogArgULongLong,
+  kLogArgDouble,
+  kLogArgPointer,
+};
+
 }
 
 class LogStream : boost::noncopyable
@@ -82,9 +98,11 @@ class LogStream : boost::noncopyable
  public:
   typedef detail::FixedBuffer<detail::kSmallBuffer> Buffer;
 
+  LogStream() : recording_(false) { }
+
   self& operator<<(bool v)
   {
-    buffer_.append(v ? "1" : "0", 1);
+    write(v ? "1" : "0", 1);
     return *this;
   }
 
@@ -109,6 +127,10 @@ class LogStream : boost::noncopyable
 
   self& operator<<(char v)
   {
+    if (recording_ && recordValue(detail::kLogArgChar, v))
+    {
+      return *this;
+    }
     buffer_.append(&v, 1);
     return *this;
   }
@@ -120,11 +142,11 @@ class LogStream : boost::noncopyable
   {
     if (str)
     {
-      buffer_.append(str, strlen(str));
+      write(str, strlen(str));
     }
     else
     {
-      buffer_.append("(null)", 6);
+      write("(null)", 6);
     }
     return *this;
   }
@@ -136,21 +158,21 @@ class LogStream : boost::noncopyable
 
   self& operator<<(const string& v)
   {
-    buffer_.append(v.c_str(), v.size());
+    write(v.c_str(), v.size());
     return *this;
   }
 
 #ifndef MUDUO_STD_STRING
   self& operator<<(const std::string& v)
   {
-    buffer_.append(v.c_str(), v.size());
+    write(v.c_str(), v.size());
     return *this;
   }
 #endif
 
   self& operator<<(const StringPiece& v)
   {
-    buffer_.append(v.data(), v.size());
+    write(v.data(), v.size());
     return *this;
   }
 
@@ -171,9 +193,21 @@ class LogStream : boost::noncopyable
       return *this;
 }
 
-  void append(const char* data, int len) { buffer_.append(data, len); }
+  void append(const char* data, int len) { write(data, len); }
   const Buffer& buffer() const { return buffer_; }
-  void resetBuffer() { buffer_.reset(); }
+  void resetBuffer() { buffer_.reset(); recording_ = false; }
+
+  /// Binary mode of Logger: starts the buffer with @c header and records
+  /// the type and raw bytes of each argument after it, instead of formatting.
+  /// LogDecoder formats them later, into the same text.
+  void startRecord(const char* header, int len)
+  {
+    buffer_.reset();
+    buffer_.append(header, len);
+    recording_ = true;
+  }
+  /// False once a record outgrows the buffer, it is then formatted on the spot.
+  bool recording() const { return recording_; }
 
  private:
   void staticCheck();
@@ -181,7 +215,35 @@ class LogStream : boost::noncopyable
   template<typename T>
   void formatInteger(T);
 
+  void write(const char* data, size_t len)
+  {
+    if (recording_ && recordString(data, len))
+    {
+      return;
+    }
+    buffer_.append(data, len);
+  }
+
+  // false if the record has been turned into text, for the caller to append
+  template<typename T>
+  bool recordValue(char type, T v)
+  {
+    if (implicit_cast<size_t>(buffer_.avail()) > sizeof v)
+    {
+      char* p = buffer_.current();
+      *p = type;
+      memcpy(p + 1, &v, sizeof v);
+      buffer_.add(1 + sizeof v);
+      return true;
+    }
+    spill();
+    return false;
+  }
+  bool recordString(const char* data, size_t len);
+  void spill();
+
   Buffer buffer_;
+  bool recording_;
 
   static const int kMaxNumericSize = 32;
 };
@@ -206,6 +268,17 @@ inline LogStream& operator<<(LogStream& s, const Fmt& fmt)
   return s;
 }
 
+/// Numbers as LogStream writes them, for other writers such as Buffer.
+/// Writes at most 32 chars to @c buf, not null terminated, returns the length.
+/// A double is written with the fewest digits that read back the same.
+size_t formatNumber(char* buf, int v);
+size_t formatNumber(char* buf, unsigned int v);
+size_t formatNumber(char* buf, long v);
+size_t formatNumber(char* buf, unsigned long v);
+size_t formatNumber(char* buf, long long v);
+size_t formatNumber(char* buf, unsigned long long v);
+size_t formatNumber(char* buf, double v);
+
 }
 #endif  // MUDUO_BASE_LOGSTREAM_H
 
@@ -1,6 +1,7 @@
 #include <muduo/base/Logging.h>
 
 #include <muduo/base/CurrentThread.h>
+#include <muduo/base/LogDecoder.h>
 #include <muduo/base/Timestamp.h>
 #include <muduo/base/TimeZone.h>
 
@@ -102,67 +103,105 @@ void defaultFlush()
 
 Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
+Logger::OutputFunc g_recordOutput = NULL;
 TimeZone g_logTimeZone;
 
-}
-
-using namespace muduo;
-
-Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line)
-  : time_(Timestamp::now()),
-    stream_(),
-    level_(level),
-    line_(line),
-    basename_(file)
-{
-  formatTime();
-  CurrentThread::tid();
-  stream_ << T(CurrentThread::tidString(), CurrentThread::tidStringLength());
-  stream_ << T(LogLevelName[level], 6);
-  if (savedErrno != 0)
-  {
-    stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
-  }
-}
-
-void Logger::Impl::formatTime()
+// shared with LogDecoder, so that both produce the same text
+void detail::formatLogTime(LogStream& s, int64_t microSecondsSinceEpoch,
+                           const TimeZone& tz, char cache[32], time_t* lastSecond)
 {
-  int64_t microSecondsSinceEpoch = time_.microSecondsSinceEpoch();
   time_t seconds = static_cast<time_t>(microSecondsSinceEpoch / Timestamp::kMicroSecondsPerSecond);
   int microseconds = static_cast<int>(microSecondsSinceEpoch % Timestamp::kMicroSecondsPerSecond);
-  if (seconds != t_lastSecond)
+  if (seconds != *lastSecond)
   {
-    t_lastSecond = seconds;
+    *lastSecond = seconds;
     struct tm tm_time;
-    if (g_logTimeZone.valid())
+    if (tz.valid())
     {
-      tm_time = g_logTimeZone.toLocalTime(seconds);
+      tm_time = tz.toLocalTime(seconds);
     }
     else
     {
       ::gmtime_r(&seconds, &tm_time); // FIXME TimeZone::fromUtcTime
     }
 
-    int len = snprintf(t_time, sizeof(t_time), "%4d%02d%02d %02d:%02d:%02d",
+    int len = snprintf(cache, 32, "%4d%02d%02d %02d:%02d:%02d",
         tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
         tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
     assert(len == 17); (void)len;
   }
 
-  if (g_logTimeZone.valid())
+  if (tz.valid())
   {
     Fmt us(".%06d ", microseconds);
     assert(us.length() == 8);
-    stream_ << T(t_time, 17) << T(us.data(), 8);
+    s << T(cache, 17) << T(us.data(), 8);
   }
   else
   {
     Fmt us(".%06dZ ", microseconds);
     assert(us.length() == 9);
-    stream_ << T(t_time, 17) << T(us.data(), 9);
+    s << T(cache, 17) << T(us.data(), 9);
+  }
+}
+
+}
+
+using namespace muduo;
+
+Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line,
+                   const char* func)
+  : time_(Timestamp::now()),
+    stream_(),
+    level_(level),
+    line_(line),
+    basename_(file),
+    binary_(g_recordOutput != NULL)
+{
+  if (binary_)
+  {
+    startRecord(savedErrno, func);
+    return;
+  }
+  formatTime();
+  CurrentThread::tid();
+  stream_ << T(CurrentThread::tidString(), CurrentThread::tidStringLength());
+  stream_ << T(LogLevelName[level], 6);
+  if (savedErrno != 0)
+  {
+    stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
+  }
+  if (func)
+  {
+    stream_ << func << ' ';
   }
 }
 
+void Logger::Impl::formatTime()
+{
+  detail::formatLogTime(stream_, time_.microSecondsSinceEpoch(),
+                        g_logTimeZone, t_time, &t_lastSecond);
+}
+
+// everything formatTime() and the rest would need, LogDecoder formats it
+void Logger::Impl::startRecord(int savedErrno, const char* func)
+{
+  char record[1 + sizeof(detail::LogLineHeader)];
+  detail::LogLineHeader header;
+  ::bzero(&header, sizeof header);
+  header.microSecondsSinceEpoch = time_.microSecondsSinceEpoch();
+  header.file = basename_.data_;
+  header.func = func;
+  header.line = line_;
+  header.tid = CurrentThread::tid();
+  header.savedErrno = savedErrno;
+  header.fileLength = static_cast<int16_t>(basename_.size_);
+  header.level = static_cast<int8_t>(level_);
+  record[0] = detail::kLogRecordLine;
+  memcpy(record + 1, &header, sizeof header);
+  stream_.startRecord(record, sizeof record);
+}
+
 void Logger::Impl::finish()
 {
   stream_ << " - " << basename_ << ':' << line_ << '\n';
@@ -174,9 +213,8 @@ Logger::Logger(SourceFile file, int line)
 }
 
 Logger::Logger(SourceFile file, int line, LogLevel level, const char* func)
-  : impl_(level, 0, file, line)
+  : impl_(level, 0, file, line, func)
 {
-  impl_.stream_ << func << ' ';
 }
 
 Logger::Logger(SourceFile file, int line, LogLevel level)
@@ -191,9 +229,27 @@ Logger::Logger(SourceFile file, int line, bool toAbort)
 
 Logger::~Logger()
 {
-  impl_.finish();
-  const LogStream::Buffer& buf(stream().buffer());
-  g_output(buf.data(), buf.length());
+  if (impl_.stream_.recording())
+  {
+    const LogStream::Buffer& buf(stream().buffer());
+    g_recordOutput(buf.data(), buf.length());
+  }
+  else if (impl_.binary_)
+  {
+    // too long to record, see LogStream::spill()
+    impl_.finish();
+    const LogStream::Buffer& buf(stream().buffer());
+    char record[1 + detail::kSmallBuffer];
+    record[0] = detail::kLogRecordText;
+    memcpy(record + 1, buf.data(), buf.length());
+    g_recordOutput(record, 1 + buf.length());
+  }
+  else
+  {
+    impl_.finish();
+    const LogStream::Buffer& buf(stream().buffer());
+    g_output(buf.data(), buf.length());
+  }
   if (impl_.level_ == FATAL)
   {
     g_flush();
@@ -220,3 +276,13 @@ void Logger::setTimeZone(const TimeZone& tz)
 {
   g_logTimeZone = tz;
 }
+
+const TimeZone& Logger::timeZone()
+{
+  return g_logTimeZone;
+}
+
+void Logger::setRecordOutput(OutputFunc out)
+{
+  g_recordOutput = out;
+}
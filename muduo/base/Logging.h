@@ -71,6 +71,14 @@ class Logger
   static void setOutput(OutputFunc);
   static void setFlush(FlushFunc);
   static void setTimeZone(const TimeZone& tz);
+  static const TimeZone& timeZone();
+
+  /// Binary mode, if @c out is not NULL: lines are passed to it as records
+  /// of the call site and raw arguments, to be formatted by LogDecoder
+  /// elsewhere, e.g. AsyncLogging::appendRecord().
+  /// Files and functions are referred to by address, so they must be static,
+  /// as with the LOG_* macros.
+  static void setRecordOutput(OutputFunc out);
 
  private:
 
@@ -78,8 +86,10 @@ class Impl
 {
  public:
   typedef Logger::LogLevel LogLevel;
-  Impl(LogLevel level, int old_errno, const SourceFile& file, int line);
+  Impl(LogLevel level, int old_errno, const SourceFile& file, int line,
+       const char* func = NULL);
   void formatTime();
+  void startRecord(int savedErrno, const char* func);
   void finish();
 
   Timestamp time_;
@@ -87,6 +97,7 @@ class Impl
   LogLevel level_;
   int line_;
   SourceFile basename_;
+  bool binary_;
 };
 
   Impl impl_;
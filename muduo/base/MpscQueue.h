@@ -0,0 +1,129 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#ifndef MUDUO_BASE_MPSCQUEUE_H
+#define MUDUO_BASE_MPSCQUEUE_H
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// Unbounded lock-free multi-producer single-consumer queue,
+/// intrusive list after Dmitry Vyukov's.
+///
+/// push() is wait-free, an atomic exchange and an add on the same cache line.
+/// Only one thread may call the consumer side: empty() and popAll().
+///
+template<typename T>
+class MpscQueue : boost::noncopyable
+{
+ public:
+  MpscQueue()
+    : head_(new Node),
+      tail_(head_),
+      size_(0)
+  {
+  }
+
+  ~MpscQueue()
+  {
+    while (head_)
+    {
+      Node* next = head_->next;
+      delete head_;
+      head_ = next;
+    }
+  }
+
+  void push(const T& x)
+  {
+    link(new Node(x));
+  }
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  void push(T&& x)
+  {
+    link(new Node(std::move(x)));
+  }
+#endif
+
+  /// Consumer side.  False as soon as a push() has swung tail_,
+  /// even while popAll() can't take its item yet.
+  bool empty() const
+  {
+    return __atomic_load_n(&tail_, __ATOMIC_SEQ_CST) == head_;
+  }
+
+  /// Consumer side, appends items pushed before the call to @c out,
+  /// leaves those pushed meanwhile for the next call.
+  size_t popAll(std::vector<T>* out)
+  {
+    Node* last = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (head_ != last)
+    {
+      Node* next = __atomic_load_n(&head_->next, __ATOMIC_ACQUIRE);
+      if (next == NULL)
+      {
+        // a producer has swung tail_ but not yet linked its node
+        break;
+      }
+      out->push_back(T());
+      using std::swap;
+      swap(out->back(), next->value);
+      delete head_;
+      head_ = next;  // becomes the new stub
+      ++n;
+    }
+    __atomic_sub_fetch(&size_, static_cast<int64_t>(n), __ATOMIC_RELAXED);
+    return n;
+  }
+
+  /// Thread safe, items pushed and not yet popped,
+  /// counting those whose push() is half way through.
+  size_t size() const
+  {
+    return static_cast<size_t>(__atomic_load_n(&size_, __ATOMIC_RELAXED));
+  }
+
+ private:
+  struct Node
+  {
+    Node() : value(), next(NULL) { }
+    explicit Node(const T& x) : value(x), next(NULL) { }
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+    explicit Node(T&& x) : value(std::move(x)), next(NULL) { }
+#endif
+
+    T value;
+    Node* next;
+  };
+
+  void link(Node* node)
+  {
+    // before the node can be popped, so that size_ never goes below 0
+    __atomic_add_fetch(&size_, 1, __ATOMIC_RELAXED);
+    Node* prev = __atomic_exchange_n(&tail_, node, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+  }
+
+  // consumer only
+  Node* head_;
+  // padding, so that producers do not bounce the cache line of head_
+  char pad_[64 - sizeof(Node*)];
+  // aligned so that both share the line each push() takes for its exchange
+  Node* tail_ __attribute__ ((aligned (16)));
+  int64_t size_;
+};
+
+}
+
+#endif  // MUDUO_BASE_MPSCQUEUE_H
@@ -0,0 +1,310 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/base/WorkStealingThreadPool.h>
+
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Exception.h>
+
+#include <boost/bind.hpp>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace muduo;
+
+namespace
+{
+// which pool and worker the current thread belongs to
+__thread const void* t_pool = NULL;
+__thread int t_workerIndex = -1;
+// round-robin cursor of outside callers
+__thread unsigned t_nextWorker = 0;
+}
+
+WorkStealingThreadPool::WorkStealingThreadPool(const string& nameArg)
+  : mutex_(),
+    notEmpty_(mutex_),
+    notFull_(mutex_),
+    name_(nameArg),
+    numSleeping_(0),
+    maxQueueSize_(0),
+    affinity_(false),
+    running_(false)
+{
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void WorkStealingThreadPool::start(int numThreads)
+{
+  assert(threads_.empty());
+  running_ = true;
+  // all queues exist before any worker starts stealing
+  workers_.reserve(numThreads);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    workers_.push_back(new Worker);
+  }
+  threads_.reserve(numThreads);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    char id[32];
+    snprintf(id, sizeof id, "%d", i+1);
+    threads_.push_back(new muduo::Thread(
+          boost::bind(&WorkStealingThreadPool::runInThread, this, i), name_+id));
+    threads_[i].start();
+  }
+  if (numThreads == 0 && threadInitCallback_)
+  {
+    threadInitCallback_();
+  }
+}
+
+void WorkStealingThreadPool::stop()
+{
+  {
+  MutexLockGuard lock(mutex_);
+  running_ = false;
+  notEmpty_.notifyAll();
+  }
+  for_each(threads_.begin(),
+           threads_.end(),
+           boost::bind(&muduo::Thread::join, _1));
+}
+
+size_t WorkStealingThreadPool::queueSize() const
+{
+  size_t size = 0;
+  for (size_t i = 0; i < workers_.size(); ++i)
+  {
+    MutexLockGuard lock(workers_[i].mutex);
+    size += workers_[i].tasks.size();
+  }
+  return size;
+}
+
+void WorkStealingThreadPool::run(const Task& task)
+{
+  if (threads_.empty())
+  {
+    task();
+  }
+  else
+  {
+    reserve();
+    Worker& worker = pickWorker();
+    {
+    MutexLockGuard lock(worker.mutex);
+    worker.tasks.push_back(task);
+    }
+    notifyIfSleeping();
+  }
+}
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+void WorkStealingThreadPool::run(Task&& task)
+{
+  if (threads_.empty())
+  {
+    task();
+  }
+  else
+  {
+    reserve();
+    Worker& worker = pickWorker();
+    {
+    MutexLockGuard lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+    }
+    notifyIfSleeping();
+  }
+}
+#endif
+
+// counts the task in before queueing it, blocks if full
+void WorkStealingThreadPool::reserve()
+{
+  if (maxQueueSize_ > 0)
+  {
+    MutexLockGuard lock(mutex_);
+    while (numReserved_.get() >= static_cast<int64_t>(maxQueueSize_))
+    {
+      notFull_.wait();
+    }
+    numReserved_.increment();
+  }
+}
+
+void WorkStealingThreadPool::notifyIfSleeping()
+{
+  // pairs with waitForTask(), the task must be visible before the check
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&numSleeping_, __ATOMIC_SEQ_CST) > 0)
+  {
+    MutexLockGuard lock(mutex_);
+    notEmpty_.notify();
+  }
+}
+
+WorkStealingThreadPool::Worker& WorkStealingThreadPool::pickWorker()
+{
+  if (t_pool == this)
+  {
+    // tasks spawned by a task stay on the same worker
+    return workers_[t_workerIndex];
+  }
+  unsigned index = t_nextWorker++ + static_cast<unsigned>(CurrentThread::tid());
+  return workers_[index % workers_.size()];
+}
+
+bool WorkStealingThreadPool::take(int index, Task* task)
+{
+  Worker& worker = workers_[index];
+  MutexLockGuard lock(worker.mutex);
+  if (worker.tasks.empty())
+  {
+    return false;
+  }
+  task->swap(worker.tasks.front());
+  worker.tasks.pop_front();
+  return true;
+}
+
+// takes the newest task of another worker, the oldest are left to the owner
+bool WorkStealingThreadPool::steal(int index, Task* task)
+{
+  const int numWorkers = static_cast<int>(workers_.size());
+  for (int i = 1; i < numWorkers; ++i)
+  {
+    Worker& victim = workers_[(index + i) % numWorkers];
+    MutexLockGuard lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      task->swap(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadPool::taken()
+{
+  // producers wait only while it is full, so wake them when it stops being so
+  if (maxQueueSize_ > 0
+      && numReserved_.decrementAndGet() == static_cast<int64_t>(maxQueueSize_) - 1)
+  {
+    MutexLockGuard lock(mutex_);
+    notFull_.notifyAll();
+  }
+}
+
+bool WorkStealingThreadPool::hasTask() const
+{
+  for (size_t i = 0; i < workers_.size(); ++i)
+  {
+    MutexLockGuard lock(workers_[i].mutex);
+    if (!workers_[i].tasks.empty())
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadPool::waitForTask()
+{
+  MutexLockGuard lock(mutex_);
+  // run() notifies after it sees numSleeping_, which is raised before
+  // checking the queues, so a task queued meanwhile is not missed.
+  __atomic_fetch_add(&numSleeping_, 1, __ATOMIC_SEQ_CST);
+  while (running_ && !hasTask())
+  {
+    notEmpty_.wait();
+  }
+  __atomic_fetch_sub(&numSleeping_, 1, __ATOMIC_SEQ_CST);
+}
+
+void WorkStealingThreadPool::setAffinityOfCurrentThread(int index)
+{
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (::sched_getaffinity(0, sizeof allowed, &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+  {
+    return;
+  }
+  int nth = index % CPU_COUNT(&allowed);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+  {
+    if (CPU_ISSET(cpu, &allowed) && nth-- == 0)
+    {
+      cpu_set_t one;
+      CPU_ZERO(&one);
+      CPU_SET(cpu, &one);
+      int err = ::pthread_setaffinity_np(::pthread_self(), sizeof one, &one);
+      if (err != 0)
+      {
+        fprintf(stderr, "%s failed to pin to cpu %d: %s\n",
+                CurrentThread::name(), cpu, strerror(err));
+      }
+      break;
+    }
+  }
+}
+
+void WorkStealingThreadPool::runInThread(int index)
+{
+  t_pool = this;
+  t_workerIndex = index;
+  if (affinity_)
+  {
+    setAffinityOfCurrentThread(index);
+  }
+  try
+  {
+    if (threadInitCallback_)
+    {
+      threadInitCallback_();
+    }
+    while (running_)
+    {
+      Task task;
+      if (take(index, &task) || steal(index, &task))
+      {
+        taken();
+        task();
+      }
+      else
+      {
+        waitForTask();
+      }
+    }
+  }
+  catch (const Exception& ex)
+  {
+    fprintf(stderr, "exception caught in WorkStealingThreadPool %s\n", name_.c_str());
+    fprintf(stderr, "reason: %s\n", ex.what());
+    fprintf(stderr, "stack trace: %s\n", ex.stackTrace());
+    abort();
+  }
+  catch (const std::exception& ex)
+  {
+    fprintf(stderr, "exception caught in WorkStealingThreadPool %s\n", name_.c_str());
+    fprintf(stderr, "reason: %s\n", ex.what());
+    abort();
+  }
+  catch (...)
+  {
+    fprintf(stderr, "unknown exception caught in WorkStealingThreadPool %s\n", name_.c_str());
+    throw; // rethrow
+  }
+}
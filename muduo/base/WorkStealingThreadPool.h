@@ -0,0 +1,94 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#ifndef MUDUO_BASE_WORKSTEALINGTHREADPOOL_H
+#define MUDUO_BASE_WORKSTEALINGTHREADPOOL_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Condition.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Types.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <deque>
+
+namespace muduo
+{
+
+///
+/// Drop-in alternative to ThreadPool, with one task queue per worker.
+///
+/// run() from outside spreads tasks round-robin, run() from a worker
+/// queues to its own. An idle worker steals from the others before it
+/// sleeps, so workers only contend on each other's locks when imbalanced.
+/// Tasks queued to the same worker run in FIFO order, there is no global
+/// order among workers.
+///
+class WorkStealingThreadPool : boost::noncopyable
+{
+ public:
+  typedef boost::function<void ()> Task;
+
+  explicit WorkStealingThreadPool(const string& nameArg = string("WorkStealingThreadPool"));
+  ~WorkStealingThreadPool();
+
+  // Must be called before start().
+  void setMaxQueueSize(int maxSize) { maxQueueSize_ = maxSize; }
+  void setThreadInitCallback(const Task& cb)
+  { threadInitCallback_ = cb; }
+  /// Pins worker i to the i-th CPU this process may run on.
+  void setAffinity(bool on) { affinity_ = on; }
+
+  void start(int numThreads);
+  void stop();
+
+  const string& name() const
+  { return name_; }
+
+  size_t queueSize() const;
+
+  // Could block if maxQueueSize > 0
+  void run(const Task& f);
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  void run(Task&& f);
+#endif
+
+ private:
+  struct Worker : boost::noncopyable
+  {
+    mutable MutexLock mutex;
+    std::deque<Task> tasks;  // @GuardedBy mutex
+  };
+
+  void reserve();
+  void notifyIfSleeping();
+  Worker& pickWorker();
+  void runInThread(int index);
+  bool take(int index, Task* task);
+  bool steal(int index, Task* task);
+  void taken();
+  bool hasTask() const;
+  void waitForTask();
+  void setAffinityOfCurrentThread(int index);
+
+  mutable MutexLock mutex_;  // for sleeping and blocking
+  Condition notEmpty_;
+  Condition notFull_;
+  string name_;
+  Task threadInitCallback_;
+  boost::ptr_vector<muduo::Thread> threads_;
+  boost::ptr_vector<Worker> workers_;
+  AtomicInt64 numReserved_;  // queued in all workers, if maxQueueSize_ > 0
+  int numSleeping_;  /* atomic */
+  size_t maxQueueSize_;
+  bool affinity_;
+  bool running_;
+};
+
+}
+
+#endif  // MUDUO_BASE_WORKSTEALINGTHREADPOOL_H
@@ -1,7 +1,8 @@
 project "base"
     kind "StaticLib"
     language "C++"
-    links{'pthread', 'rt'}
+    links{'pthread', 'rt', 'z'}
+    defines 'HAVE_ZLIB'
     targetdir(libdir)
     targetname('muduo_base')
     headersdir('muduo/base')
@@ -10,9 +11,11 @@ project "base"
             'AsyncLogging.cc',
             'Condition.cc',
             'CountDownLatch.cc',
+            'Crc32c.cc',
             'Date.cc',
             'Exception.cc',
             'FileUtil.cc',
+            'LogDecoder.cc',
             'LogFile.cc',
             'Logging.cc',
             'LogStream.cc',
@@ -21,4 +24,5 @@ project "base"
             'TimeZone.cc',
             'Thread.cc',
             'ThreadPool.cc',
+            'WorkStealingThreadPool.cc',
      }
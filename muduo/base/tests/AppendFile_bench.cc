@@ -0,0 +1,74 @@
+#include <muduo/base/FileUtil.h>
+#include <muduo/base/Timestamp.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace muduo;
+
+// Appends lines as LogFile does, flushing every second,
+// for the sustained rate and the latency of each append.
+//
+// usage: appendfile_bench [dir] [MB]
+
+int64_t nowNanos()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void bench(const string& dir, FileUtil::AppendFile::Backend backend, const char* name, int megabytes)
+{
+  string filename = dir + "/appendfile_bench." + name;
+  ::unlink(filename.c_str());
+
+  char line[101];
+  memset(line, 'x', sizeof line - 1);
+  line[sizeof line - 2] = '\n';
+  const size_t kLine = sizeof line - 1;
+  const size_t n = static_cast<size_t>(megabytes) * 1000 * 1000 / kLine;
+  std::vector<int64_t> latencies(n);
+
+  Timestamp start(Timestamp::now());
+  FileUtil::AppendFile::Backend actual;
+  {
+    FileUtil::AppendFile file(filename, backend);
+    actual = file.backend();
+    int64_t lastFlush = nowNanos();
+    for (size_t i = 0; i < n; ++i)
+    {
+      int64_t begin = nowNanos();
+      file.append(line, kLine);
+      if (begin - lastFlush > 1000000000)
+      {
+        lastFlush = begin;
+        file.flush();
+      }
+      latencies[i] = nowNanos() - begin;
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  ::unlink(filename.c_str());
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("%-12s %s%8.1f MB/s  p50 %5ld ns  p99 %5ld ns  p99.9 %7ld ns  max %9ld ns\n",
+         name, actual == backend ? "" : "(fell back) ",
+         static_cast<double>(n * kLine) / seconds / 1e6,
+         latencies[n/2], latencies[n*99/100], latencies[n*999/1000], latencies[n-1]);
+}
+
+int main(int argc, char* argv[])
+{
+  string dir = argc > 1 ? argv[1] : ".";
+  int megabytes = argc > 2 ? atoi(argv[2]) : 256;
+  bench(dir, FileUtil::AppendFile::kStdio, "stdio", megabytes);
+  bench(dir, FileUtil::AppendFile::kPreallocate, "preallocate", megabytes);
+  bench(dir, FileUtil::AppendFile::kDirectIO, "directio", megabytes);
+}
@@ -1,46 +1,123 @@
 #include <muduo/base/AsyncLogging.h>
+#include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
 #include <muduo/base/Timestamp.h>
 
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <algorithm>
+#include <vector>
 #include <stdio.h>
+#include <string.h>
 #include <sys/resource.h>
 
+// Throughput of AsyncLogging and latency of LOG_INFO,
+// with N threads logging at once, like the IO threads of a busy server.
+// Contention between them only shows with several CPUs.
+//
+// usage: asynclogging_test [threads] [long] [block] [record|raw] [compress]
+//                          [preallocate|directio]
+//
+// record: binary mode of Logger, formatted by the backend thread.
+// raw: binary mode written as it is, see logdecoder.
+// compress: gzip rolled files, delete the oldest beyond 10 roll sizes.
+// preallocate, directio: the FileUtil::AppendFile backend of the log file.
+
 int kRollSize = 500*1000*1000;
 
 muduo::AsyncLogging* g_asyncLog = NULL;
+bool g_longLog = false;
+const int kBatch = 1000;
+const int kRounds = 30;
 
 void asyncOutput(const char* msg, int len)
 {
   g_asyncLog->append(msg, len);
 }
 
-void bench(bool longLog)
+void asyncRecordOutput(const char* record, int len)
 {
-  muduo::Logger::setOutput(asyncOutput);
+  g_asyncLog->appendRecord(record, len);
+}
 
-  int cnt = 0;
-  const int kBatch = 1000;
+// latencies in ns of every LOG_INFO of this thread
+void logInThread(muduo::CountDownLatch* start, std::vector<int64_t>* latencies)
+{
   muduo::string empty = " ";
   muduo::string longStr(3000, 'X');
   longStr += " ";
+  latencies->reserve(kRounds * kBatch);
 
-  for (int t = 0; t < 30; ++t)
+  start->wait();
+  int cnt = 0;
+  for (int t = 0; t < kRounds; ++t)
   {
-    muduo::Timestamp start = muduo::Timestamp::now();
     for (int i = 0; i < kBatch; ++i)
     {
+      struct timespec before, after;
+      clock_gettime(CLOCK_MONOTONIC, &before);
       LOG_INFO << "Hello 0123456789" << " abcdefghijklmnopqrstuvwxyz "
-               << (longLog ? longStr : empty)
+               << (g_longLog ? longStr : empty)
                << cnt;
+      clock_gettime(CLOCK_MONOTONIC, &after);
+      latencies->push_back((after.tv_sec - before.tv_sec) * 1000000000LL
+                           + after.tv_nsec - before.tv_nsec);
       ++cnt;
     }
-    muduo::Timestamp end = muduo::Timestamp::now();
-    printf("%f\n", timeDifference(end, start)*1000000/kBatch);
-    struct timespec ts = { 0, 500*1000*1000 };
+    // bursts, as in the original single threaded test
+    struct timespec ts = { 0, 50*1000*1000 };
     nanosleep(&ts, NULL);
   }
 }
 
+void bench(int numThreads, bool binary)
+{
+  muduo::Logger::setOutput(asyncOutput);
+  if (binary)
+  {
+    muduo::Logger::setRecordOutput(asyncRecordOutput);
+  }
+
+  muduo::CountDownLatch start(1);
+  std::vector<std::vector<int64_t> > latencies(numThreads);
+  boost::ptr_vector<muduo::Thread> threads;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads.push_back(new muduo::Thread(
+          boost::bind(logInThread, &start, &latencies[i])));
+    threads.back().start();
+  }
+
+  muduo::Timestamp begin = muduo::Timestamp::now();
+  start.countDown();
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads[i].join();
+  }
+  double seconds = timeDifference(muduo::Timestamp::now(), begin);
+
+  std::vector<int64_t> all;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+  }
+  std::sort(all.begin(), all.end());
+  size_t n = all.size();
+  // sleeps between bursts are not counted
+  double busy = seconds - kRounds * 0.05;
+  printf("%d threads, %zd messages, %.0f messages/s while logging\n",
+         numThreads, n, static_cast<double>(n) / busy);
+  printf("LOG_INFO latency ns: p50 %lld p99 %lld p99.9 %lld max %lld\n",
+         static_cast<long long>(all[n / 2]),
+         static_cast<long long>(all[n * 99 / 100]),
+         static_cast<long long>(all[n * 999 / 1000]),
+         static_cast<long long>(all[n - 1]));
+  printf("dropped %lld messages\n",
+         static_cast<long long>(g_asyncLog->droppedMessages()));
+}
+
 int main(int argc, char* argv[])
 {
   {
@@ -52,12 +129,45 @@ int main(int argc, char* argv[])
 
   printf("pid = %d\n", getpid());
 
+  int numThreads = argc > 1 ? atoi(argv[1]) : 1;
+  bool block = false;
+  bool compress = false;
+  muduo::FileUtil::AppendFile::Backend backend = muduo::FileUtil::AppendFile::kStdio;
+  muduo::AsyncLogging::Format format = muduo::AsyncLogging::kText;
+  for (int i = 2; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "long") == 0)
+      g_longLog = true;
+    else if (strcmp(argv[i], "block") == 0)
+      block = true;
+    else if (strcmp(argv[i], "compress") == 0)
+      compress = true;
+    else if (strcmp(argv[i], "preallocate") == 0)
+      backend = muduo::FileUtil::AppendFile::kPreallocate;
+    else if (strcmp(argv[i], "directio") == 0)
+      backend = muduo::FileUtil::AppendFile::kDirectIO;
+    else if (strcmp(argv[i], "record") == 0)
+      format = muduo::AsyncLogging::kDecodedRecords;
+    else if (strcmp(argv[i], "raw") == 0)
+      format = muduo::AsyncLogging::kRawRecords;
+  }
+
   char name[256];
   strncpy(name, argv[0], 256);
   muduo::AsyncLogging log(::basename(name), kRollSize);
+  if (block)
+  {
+    log.setOverflowPolicy(muduo::AsyncLogging::kBlockOnOverflow, 64*1000*1000);
+  }
+  log.setFormat(format);
+  if (compress)
+  {
+    log.setCompressRolledFiles(true);
+    log.setMaxTotalBytes(10 * static_cast<size_t>(kRollSize));
+  }
+  log.setFileBackend(backend);
   log.start();
   g_asyncLog = &log;
 
-  bool longLog = argc > 1;
-  bench(longLog);
+  bench(numThreads, format != muduo::AsyncLogging::kText);
 }
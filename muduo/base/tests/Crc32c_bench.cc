@@ -0,0 +1,86 @@
+#include <muduo/base/Crc32c.h>
+#include <muduo/base/Timestamp.h>
+
+#include <boost/crc.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <zlib.h>
+
+using namespace muduo;
+
+// The checksums of the codecs, over messages of typical sizes:
+// CRC-16 of rudp datagrams, adler32 of protobuf messages, and CRC32C.
+
+uint32_t crc16(const void* data, size_t len)
+{
+  boost::crc_16_type crc;
+  crc.process_bytes(data, len);
+  return crc.checksum();
+}
+
+uint32_t adler(const void* data, size_t len)
+{
+  return static_cast<uint32_t>(::adler32(1, static_cast<const Bytef*>(data), static_cast<uInt>(len)));
+}
+
+uint32_t crc32c(const void* data, size_t len)
+{
+  return Crc32c::value(data, len);
+}
+
+uint32_t crc32cPortable(const void* data, size_t len)
+{
+  return Crc32c::extendPortable(0, data, len);
+}
+
+void bench(const char* name, uint32_t (*checksum)(const void*, size_t),
+           const std::vector<char>& data, size_t len)
+{
+  const size_t kTotal = 256*1024*1024;
+  size_t rounds = kTotal / len;
+  uint32_t sum = 0;
+  Timestamp start(Timestamp::now());
+  for (size_t i = 0; i < rounds; ++i)
+  {
+    // the offset changes, so it is not computed once
+    sum += checksum(&data[i & 63], len);
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("%-16s %6zd bytes  %8.1f MiB/s  %6.1f ns/message  (%08x)\n",
+         name, len, static_cast<double>(rounds * len) / seconds / 1024 / 1024,
+         seconds * 1e9 / static_cast<double>(rounds), sum);
+}
+
+int main(int argc, char* argv[])
+{
+  printf("crc32c hardware accelerated: %d\n", Crc32c::hardwareAccelerated());
+  std::vector<char> data(64*1024 + 64);
+  for (size_t i = 0; i < data.size(); ++i)
+  {
+    data[i] = static_cast<char>(rand());
+  }
+
+  size_t sizes[] = { 64, 548, 1232, 4096, 64*1024 };
+  size_t last = sizeof sizes / sizeof sizes[0];
+  if (argc > 1)
+  {
+    sizes[0] = static_cast<size_t>(atoi(argv[1]));
+    last = 1;
+    if (sizes[0] == 0 || sizes[0] > data.size() - 64)
+    {
+      fprintf(stderr, "Usage: %s [message size, at most 64KiB]\n", argv[0]);
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < last; ++i)
+  {
+    bench("crc16 (boost)", crc16, data, sizes[i]);
+    bench("adler32 (zlib)", adler, data, sizes[i]);
+    bench("crc32c portable", crc32cPortable, data, sizes[i]);
+    bench("crc32c", crc32c, data, sizes[i]);
+    printf("\n");
+  }
+}
@@ -0,0 +1,68 @@
+#include <muduo/base/Crc32c.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using muduo::Crc32c::extend;
+using muduo::Crc32c::extendPortable;
+using muduo::Crc32c::value;
+
+int g_failures = 0;
+
+void check(bool ok, const char* what, size_t offset, size_t len)
+{
+  if (!ok)
+  {
+    printf("FAILED %s, offset %zd, len %zd\n", what, offset, len);
+    ++g_failures;
+  }
+}
+
+int main()
+{
+  printf("hardware accelerated: %d\n", muduo::Crc32c::hardwareAccelerated());
+
+  // RFC 3720, B.4
+  char buf[32];
+  memset(buf, 0, sizeof buf);
+  check(value(buf, sizeof buf) == 0x8a9136aa, "zeros", 0, sizeof buf);
+  memset(buf, 0xff, sizeof buf);
+  check(value(buf, sizeof buf) == 0x62a8ab43, "ones", 0, sizeof buf);
+  for (int i = 0; i < 32; ++i)
+  {
+    buf[i] = static_cast<char>(i);
+  }
+  check(value(buf, sizeof buf) == 0x46dd794e, "incrementing", 0, sizeof buf);
+  for (int i = 0; i < 32; ++i)
+  {
+    buf[i] = static_cast<char>(31 - i);
+  }
+  check(value(buf, sizeof buf) == 0x113fdb5c, "decrementing", 0, sizeof buf);
+  check(value("123456789", 9) == 0xe3069283, "123456789", 0, 9);
+  check(value("", 0) == 0, "empty", 0, 0);
+
+  // of any alignment and length, and in pieces
+  char data[1024];
+  srand(1);
+  for (size_t i = 0; i < sizeof data; ++i)
+  {
+    data[i] = static_cast<char>(rand());
+  }
+  for (size_t offset = 0; offset < 16; ++offset)
+  {
+    for (size_t len = 0; len + offset <= sizeof data; len += 7)
+    {
+      uint32_t crc = value(data + offset, len);
+      check(crc == extendPortable(0, data + offset, len), "portable", offset, len);
+      size_t head = len / 3;
+      check(crc == extend(extend(0, data + offset, head), data + offset + head, len - head),
+            "extend", offset, len);
+    }
+  }
+  if (g_failures > 0)
+  {
+    return 1;
+  }
+  printf("all tests passed\n");
+}
@@ -0,0 +1,174 @@
+#include <muduo/base/LogDecoder.h>
+#include <muduo/base/Logging.h>
+
+#include <errno.h>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+
+string g_text;
+string g_record;
+
+void textOutput(const char* msg, int len)
+{
+  g_text.assign(msg, len);
+}
+
+void recordOutput(const char* record, int len)
+{
+  g_record.assign(record, len);
+}
+
+string decode(const string& record)
+{
+  muduo::LogDecoder decoder;
+  muduo::LogStream line;
+  BOOST_CHECK(decoder.decode(record.data(), static_cast<int>(record.size()), &line));
+  return line.buffer().toString();
+}
+
+// logs the same line as text and as a record, from the same call site
+template<typename Func>
+void checkSameText(Func logLine)
+{
+  muduo::Logger::setOutput(textOutput);
+  muduo::Logger::setRecordOutput(NULL);
+  logLine();
+  muduo::Logger::setRecordOutput(recordOutput);
+  logLine();
+  muduo::Logger::setRecordOutput(NULL);
+
+  string text = decode(g_record);
+  // but the microseconds, "20150101 08:00:00.123456Z "
+  const size_t kTime = 26;
+  BOOST_REQUIRE_GT(text.size(), kTime);
+  BOOST_CHECK_EQUAL(text.substr(kTime), g_text.substr(kTime));
+  BOOST_CHECK_EQUAL(text.size(), g_text.size());
+}
+
+void logValues()
+{
+  string str("string");
+  muduo::StringPiece piece("piece");
+  short s = -3;
+  LOG_INFO << "Hello " << 1 << ' ' << -2L << ' ' << 3u << ' ' << 4ULL << ' '
+           << -5LL << ' ' << 6UL << ' ' << s << ' ' << 7.5 << ' ' << 1.0/3 << ' '
+           << 0.1f << ' ' << true << false << ' ' << reinterpret_cast<void*>(0x1234)
+           << ' ' << str << ' ' << piece << ' ' << muduo::Fmt("%4.2f", 1.5)
+           << static_cast<const char*>(NULL);
+}
+
+void logDebug()
+{
+  LOG_DEBUG << "in a function";
+}
+
+void logSysErr()
+{
+  errno = EACCES;
+  LOG_SYSERR << "syserr";
+}
+
+void logManyChars()
+{
+  // the record is longer than the text, and spills
+  muduo::Logger logger(__FILE__, __LINE__);
+  for (int i = 0; i < 3000; ++i)
+  {
+    logger.stream() << 'x';
+  }
+  logger.stream() << 12345 << string(500, 'y') << 'z' << 6789;
+}
+
+void logLongStrings()
+{
+  // the text has no room for the number, but the record has
+  string tooLong(5000, 'c');
+  LOG_INFO << tooLong << string(3945, 'a') << 12345 << 'z';
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeValues)
+{
+  checkSameText(logValues);
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeFunctionAndErrno)
+{
+  muduo::Logger::LogLevel level = muduo::Logger::logLevel();
+  muduo::Logger::setLogLevel(muduo::Logger::DEBUG);
+  checkSameText(logDebug);
+  muduo::Logger::setLogLevel(level);
+  checkSameText(logSysErr);
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeTruncated)
+{
+  checkSameText(logManyChars);
+  BOOST_CHECK_EQUAL(g_record[0], muduo::detail::kLogRecordText);
+  checkSameText(logLongStrings);
+  BOOST_CHECK_EQUAL(g_record[0], muduo::detail::kLogRecordLine);
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeTime)
+{
+  muduo::Logger::setRecordOutput(recordOutput);
+  LOG_INFO << "time";
+  muduo::Logger::setRecordOutput(NULL);
+
+  muduo::detail::LogLineHeader header;
+  memcpy(&header, g_record.data() + 1, sizeof header);
+  muduo::Timestamp time(header.microSecondsSinceEpoch);
+  string text = decode(g_record);
+  BOOST_CHECK_EQUAL(text.substr(0, 26), time.toFormattedString() + "Z ");
+
+  muduo::LogDecoder decoder;
+  decoder.setTimeZone(muduo::TimeZone(8*3600, "CST"));
+  muduo::LogStream line;
+  decoder.decode(g_record.data(), static_cast<int>(g_record.size()), &line);
+  muduo::Timestamp cst(header.microSecondsSinceEpoch + 8*3600*1000000LL);
+  BOOST_CHECK_EQUAL(line.buffer().toString().substr(0, 25),
+                    cst.toFormattedString() + " ");
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeFromFile)
+{
+  muduo::Logger::setRecordOutput(recordOutput);
+  LOG_WARN << "from file " << 42;
+  muduo::Logger::setRecordOutput(NULL);
+  string expected = decode(g_record);
+
+  // what AsyncLogging::kRawRecords writes: header, strings, then records
+  muduo::LogDecoder decoder;
+  muduo::LogStream line;
+  muduo::detail::LogFileHeader fileHeader;
+  memcpy(fileHeader.magic, "muduolog", sizeof fileHeader.magic);
+  fileHeader.byteOrder = muduo::detail::kLogByteOrder;
+  fileHeader.pointerSize = sizeof(void*);
+  string record(1, muduo::detail::kLogRecordFileHeader);
+  record.append(reinterpret_cast<const char*>(&fileHeader), sizeof fileHeader);
+  BOOST_CHECK(decoder.decode(record.data(), static_cast<int>(record.size()), &line));
+
+  muduo::detail::LogLineHeader header;
+  memcpy(&header, g_record.data() + 1, sizeof header);
+  uint64_t address = reinterpret_cast<uintptr_t>(header.file);
+  record.assign(1, muduo::detail::kLogRecordString);
+  record.append(reinterpret_cast<const char*>(&address), sizeof address);
+  record.append(header.file, header.fileLength);
+  BOOST_CHECK(decoder.decode(record.data(), static_cast<int>(record.size()), &line));
+  BOOST_CHECK_EQUAL(line.buffer().length(), 0);
+
+  // an address the file has not defined
+  string file(header.file, header.fileLength);
+  header.file = file.c_str() + 1;
+  record = g_record;
+  memcpy(&record[1], &header, sizeof header);
+  BOOST_CHECK(decoder.decode(record.data(), static_cast<int>(record.size()), &line));
+  BOOST_CHECK(line.buffer().toString().find(" - ?:") != string::npos);
+
+  line.resetBuffer();
+  BOOST_CHECK(decoder.decode(g_record.data(), static_cast<int>(g_record.size()), &line));
+  BOOST_CHECK_EQUAL(line.buffer().toString(), expected);
+}
@@ -1,6 +1,8 @@
 #include <muduo/base/LogFile.h>
 #include <muduo/base/Logging.h>
 
+#include <stdlib.h>
+
 boost::scoped_ptr<muduo::LogFile> g_logFile;
 
 void outputFunc(const char* msg, int len)
@@ -13,11 +15,20 @@ void flushFunc()
   g_logFile->flush();
 }
 
+// usage: logfile_test [compress] [max total KB]
 int main(int argc, char* argv[])
 {
   char name[256];
   strncpy(name, argv[0], 256);
   g_logFile.reset(new muduo::LogFile(::basename(name), 200*1000));
+  if (argc > 1)
+  {
+    g_logFile->setCompressRolledFiles(strcmp(argv[1], "compress") == 0);
+  }
+  if (argc > 2)
+  {
+    g_logFile->setMaxTotalBytes(atoi(argv[2]) * 1000);
+  }
   muduo::Logger::setOutput(outputFunc);
   muduo::Logger::setFlush(flushFunc);
 
@@ -12,27 +12,46 @@ const size_t N = 1000000;
 
 #pragma GCC diagnostic ignored "-Wold-style-cast"
 
+// small counters, as well as values of every magnitude, as in metrics
 template<typename T>
-void benchPrintf(const char* fmt)
+T counter(size_t i)
+{
+  return (T)(i);
+}
+
+template<typename T>
+T scattered(size_t i)
+{
+  uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ULL;
+  return (T)(x >> (x % 64));
+}
+
+double fraction(size_t i)
+{
+  return (double)(i) / 7 + 0.001;
+}
+
+template<typename T>
+void benchPrintf(const char* fmt, T (*make)(size_t) = counter<T>)
 {
   char buf[32];
   Timestamp start(Timestamp::now());
   for (size_t i = 0; i < N; ++i)
-    snprintf(buf, sizeof buf, fmt, (T)(i));
+    snprintf(buf, sizeof buf, fmt, make(i));
   Timestamp end(Timestamp::now());
 
   printf("benchPrintf %f\n", timeDifference(end, start));
 }
 
 template<typename T>
-void benchStringStream()
+void benchStringStream(T (*make)(size_t) = counter<T>)
 {
   Timestamp start(Timestamp::now());
   std::ostringstream os;
 
   for (size_t i = 0; i < N; ++i)
   {
-    os << (T)(i);
+    os << make(i);
     os.seekp(0, std::ios_base::beg);
   }
   Timestamp end(Timestamp::now());
@@ -41,13 +60,13 @@ void benchStringStream()
 }
 
 template<typename T>
-void benchLogStream()
+void benchLogStream(T (*make)(size_t) = counter<T>)
 {
   Timestamp start(Timestamp::now());
   LogStream os;
   for (size_t i = 0; i < N; ++i)
   {
-    os << (T)(i);
+    os << make(i);
     os.resetBuffer();
   }
   Timestamp end(Timestamp::now());
@@ -79,4 +98,14 @@ int main()
   benchStringStream<void*>();
   benchLogStream<void*>();
 
+  puts("int64_t scattered");
+  benchPrintf<int64_t>("%" PRId64, scattered<int64_t>);
+  benchStringStream<int64_t>(scattered<int64_t>);
+  benchLogStream<int64_t>(scattered<int64_t>);
+
+  puts("double fraction");
+  benchPrintf<double>("%.12g", fraction);
+  benchPrintf<double>("%.17g", fraction);
+  benchStringStream<double>(fraction);
+  benchLogStream<double>(fraction);
 }
@@ -76,6 +76,11 @@ int main()
   sleep(1);
   bench("nop");
 
+  // formatting is left to whoever decodes the records
+  muduo::Logger::setRecordOutput(dummyOutput);
+  bench("record nop");
+  muduo::Logger::setRecordOutput(NULL);
+
   char buffer[64*1024];
 
   g_file = fopen("/dev/null", "w");
@@ -0,0 +1,107 @@
+#include <muduo/base/Atomic.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/base/WorkStealingThreadPool.h>
+
+#include <boost/bind.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Throughput of a pool vs. number of threads,
+// for CPU-heavy tasks posted by one thread (requests from an IO loop)
+// and for tasks that spawn subtasks.
+// Scaling only shows with at least as many CPUs as threads.
+
+muduo::AtomicInt64 g_done;
+int64_t g_total = 0;
+muduo::CountDownLatch* g_latch = NULL;
+volatile uint64_t g_sink;
+
+void finish()
+{
+  if (g_done.incrementAndGet() == g_total)
+  {
+    g_latch->countDown();
+  }
+}
+
+void work(int iterations)
+{
+  uint64_t x = iterations;
+  for (int i = 0; i < iterations; ++i)
+  {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  g_sink = x;
+  finish();
+}
+
+template<typename Pool>
+void spawn(Pool* pool, int fanout, int iterations)
+{
+  for (int i = 0; i < fanout; ++i)
+  {
+    pool->run(boost::bind(work, iterations));
+  }
+  finish();
+}
+
+template<typename Pool>
+double bench(int numThreads, int numTasks, int iterations, int fanout)
+{
+  Pool pool("bench");
+  pool.start(numThreads);
+
+  muduo::CountDownLatch latch(1);
+  g_latch = &latch;
+  g_done.getAndSet(0);
+  muduo::Timestamp start(muduo::Timestamp::now());
+  if (fanout == 0)
+  {
+    g_total = numTasks;
+    for (int i = 0; i < numTasks; ++i)
+    {
+      pool.run(boost::bind(work, iterations));
+    }
+  }
+  else
+  {
+    int parents = numTasks / (fanout + 1);
+    g_total = static_cast<int64_t>(parents) * (fanout + 1);
+    for (int i = 0; i < parents; ++i)
+    {
+      pool.run(boost::bind(spawn<Pool>, &pool, fanout, iterations));
+    }
+  }
+  latch.wait();
+  double seconds = timeDifference(muduo::Timestamp::now(), start);
+  pool.stop();
+  return static_cast<double>(g_total) / seconds;
+}
+
+int main(int argc, char* argv[])
+{
+  int maxThreads = argc > 1 ? atoi(argv[1]) : 32;
+  int numTasks = argc > 2 ? atoi(argv[2]) : 1000*1000;
+  const int kIterations[] = { 0, 1000 };
+  const int kFanouts[] = { 0, 10 };
+
+  for (size_t f = 0; f < sizeof kFanouts / sizeof kFanouts[0]; ++f)
+  {
+    for (size_t w = 0; w < sizeof kIterations / sizeof kIterations[0]; ++w)
+    {
+      printf("fanout %d, %d iterations per task\n", kFanouts[f], kIterations[w]);
+      printf("threads   ThreadPool  WorkStealing (tasks/s)\n");
+      for (int threads = 1; threads <= maxThreads; threads *= 2)
+      {
+        double plain = bench<muduo::ThreadPool>(
+            threads, numTasks, kIterations[w], kFanouts[f]);
+        double stealing = bench<muduo::WorkStealingThreadPool>(
+            threads, numTasks, kIterations[w], kFanouts[f]);
+        printf("%7d %12.0f %12.0f\n", threads, plain, stealing);
+      }
+    }
+  }
+}
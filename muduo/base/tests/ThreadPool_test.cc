@@ -1,4 +1,5 @@
 #include <muduo/base/ThreadPool.h>
+#include <muduo/base/WorkStealingThreadPool.h>
 #include <muduo/base/CountDownLatch.h>
 #include <muduo/base/CurrentThread.h>
 #include <muduo/base/Logging.h>
@@ -17,10 +18,11 @@ void printString(const std::string& str)
   usleep(100*1000);
 }
 
+template<typename Pool>
 void test(int maxSize)
 {
   LOG_WARN << "Test ThreadPool with max queue size = " << maxSize;
-  muduo::ThreadPool pool("MainThreadPool");
+  Pool pool("MainThreadPool");
   pool.setMaxQueueSize(maxSize);
   pool.start(5);
 
@@ -43,9 +45,15 @@ void test(int maxSize)
 
 int main()
 {
-  test(0);
-  test(1);
-  test(5);
-  test(10);
-  test(50);
+  test<muduo::ThreadPool>(0);
+  test<muduo::ThreadPool>(1);
+  test<muduo::ThreadPool>(5);
+  test<muduo::ThreadPool>(10);
+  test<muduo::ThreadPool>(50);
+
+  test<muduo::WorkStealingThreadPool>(0);
+  test<muduo::WorkStealingThreadPool>(1);
+  test<muduo::WorkStealingThreadPool>(5);
+  test<muduo::WorkStealingThreadPool>(10);
+  test<muduo::WorkStealingThreadPool>(50);
 }
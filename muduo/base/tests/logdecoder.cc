@@ -0,0 +1,69 @@
+#include <muduo/base/LogDecoder.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Prints log files of AsyncLogging::kRawRecords as text,
+// the same text the logging process would have written.
+//
+// usage: logdecoder [-z zonefile] file...
+
+bool decodeFile(muduo::LogDecoder* decoder, const char* filename)
+{
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL)
+  {
+    perror(filename);
+    return false;
+  }
+
+  bool ok = true;
+  bool first = true;
+  uint16_t length = 0;
+  char record[65536];
+  while (ok && fread(&length, sizeof length, 1, fp) == 1)
+  {
+    muduo::LogStream line;
+    ok = fread(record, 1, length, fp) == length
+        && (!first || (length > 0 && record[0] == muduo::detail::kLogRecordFileHeader))
+        && decoder->decode(record, length, &line);
+    if (ok)
+    {
+      fwrite(line.buffer().data(), 1, line.buffer().length(), stdout);
+      first = false;
+    }
+    else
+    {
+      fprintf(stderr, "%s: bad record at offset %ld\n",
+              filename, ftell(fp) - length - static_cast<long>(sizeof length));
+    }
+  }
+  fclose(fp);
+  return ok;
+}
+
+int main(int argc, char* argv[])
+{
+  muduo::LogDecoder decoder;
+  int i = 1;
+  if (argc > 2 && strcmp(argv[1], "-z") == 0)
+  {
+    decoder.setTimeZone(muduo::TimeZone(argv[2]));
+    i = 3;
+  }
+  if (i >= argc)
+  {
+    fprintf(stderr, "usage: %s [-z zonefile] file...\n", argv[0]);
+    return 1;
+  }
+
+  int failed = 0;
+  for (; i < argc; ++i)
+  {
+    if (!decodeFile(&decoder, argv[i]))
+    {
+      ++failed;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}
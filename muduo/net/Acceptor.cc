@@ -11,6 +11,7 @@
 #include <muduo/base/Logging.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/InetAddress.h>
+#include <muduo/net/Poller.h>
 #include <muduo/net/SocketsOps.h>
 
 #include <boost/bind.hpp>
@@ -28,7 +29,9 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reusepor
     acceptSocket_(sockets::createNonblockingOrDie(listenAddr.family())),
     acceptChannel_(loop, acceptSocket_.fd()),
     listenning_(false),
-    idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+    idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+    completionPoller_(loop->poller()->hasCompletionIo() ? loop->poller() : NULL),
+    acceptOperation_(0)
 {
   assert(idleFd_ >= 0);
   acceptSocket_.setReuseAddr(true);
@@ -40,6 +43,11 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reusepor
 
 Acceptor::~Acceptor()
 {
+  if (acceptOperation_ != 0)
+  {
+    // an accepted socket is closed by the poller
+    completionPoller_->cancel(acceptOperation_);
+  }
   acceptChannel_.disableAll();
   acceptChannel_.remove();
   ::close(idleFd_);
@@ -50,7 +58,14 @@ void Acceptor::listen()
   loop_->assertInLoopThread();
   listenning_ = true;
   acceptSocket_.listen();
-  acceptChannel_.enableReading();
+  if (completionPoller_)
+  {
+    submitAccept();
+  }
+  else
+  {
+    acceptChannel_.enableReading();
+  }
 }
 
 void Acceptor::handleRead()
@@ -59,6 +74,16 @@ void Acceptor::handleRead()
   InetAddress peerAddr;
   //FIXME loop until no more
   int connfd = acceptSocket_.accept(&peerAddr);
+  if (connfd < 0)
+  {
+    LOG_SYSERR << "in Acceptor::handleRead";
+  }
+  handleAccepted(connfd, peerAddr);
+}
+
+// errno is of accept(2) if connfd < 0
+void Acceptor::handleAccepted(int connfd, const InetAddress& peerAddr)
+{
   if (connfd >= 0)
   {
     // string hostport = peerAddr.toIpPort();
@@ -74,7 +99,6 @@ void Acceptor::handleRead()
   }
   else
   {
-    LOG_SYSERR << "in Acceptor::handleRead";
     // Read the section named "The special problem of
     // accept()ing when you can't" in libev's doc.
     // By Marc Lehmann, author of libev.
@@ -88,3 +112,29 @@ void Acceptor::handleRead()
   }
 }
 
+
+void Acceptor::submitAccept()
+{
+  assert(acceptOperation_ == 0);
+  acceptOperation_ = completionPoller_->submitAccept(
+      acceptSocket_.fd(),
+      boost::bind(&Acceptor::handleAcceptCompletion, this, _1, _2));
+}
+
+void Acceptor::handleAcceptCompletion(const IoCompletion& completion, Timestamp)
+{
+  loop_->assertInLoopThread();
+  acceptOperation_ = 0;
+  InetAddress peerAddr;
+  if (completion.result >= 0)
+  {
+    peerAddr.setSockAddrInet6(*completion.peer);
+  }
+  else
+  {
+    errno = -completion.result;
+    LOG_SYSERR << "in Acceptor::handleAcceptCompletion";
+  }
+  handleAccepted(completion.result, peerAddr);
+  submitAccept();
+}
@@ -14,9 +14,12 @@
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 
+#include <muduo/base/Timestamp.h>
 #include <muduo/net/Channel.h>
 #include <muduo/net/Socket.h>
 
+#include <stdint.h>
+
 namespace muduo
 {
 namespace net
@@ -24,10 +27,15 @@ namespace net
 
 class EventLoop;
 class InetAddress;
+class Poller;
+struct IoCompletion;
 
 ///
 /// Acceptor of incoming TCP connections.
 ///
+/// With a poller of completion I/O, accept(2) is submitted to it
+/// instead of being called on readiness.
+///
 class Acceptor : boost::noncopyable
 {
  public:
@@ -45,6 +53,9 @@ class Acceptor : boost::noncopyable
 
  private:
   void handleRead();
+  void handleAccepted(int connfd, const InetAddress& peerAddr);
+  void submitAccept();
+  void handleAcceptCompletion(const IoCompletion& completion, Timestamp);
 
   EventLoop* loop_;
   Socket acceptSocket_;
@@ -52,6 +63,8 @@ class Acceptor : boost::noncopyable
   NewConnectionCallback newConnectionCallback_;
   bool listenning_;
   int idleFd_;
+  Poller* completionPoller_;  // NULL unless accepts are submitted to it
+  uint64_t acceptOperation_;  // in flight, 0 if none
 };
 
 }
@@ -0,0 +1,71 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/net/Broadcaster.h>
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+
+#include <boost/bind.hpp>
+
+using namespace muduo;
+using namespace muduo::net;
+
+Broadcaster::Broadcaster(const SharedPayload& payload)
+  : payload_(payload),
+    last_(0)
+{
+}
+
+Broadcaster::~Broadcaster()
+{
+  post();
+}
+
+void Broadcaster::add(const TcpConnectionPtr& conn)
+{
+  EventLoop* loop = conn->getLoop();
+  if (loop->isInLoopThread())
+  {
+    conn->send(payload_);
+    return;
+  }
+
+  // connections of a loop often come in a row
+  if (last_ >= groups_.size() || groups_[last_].loop != loop)
+  {
+    last_ = 0;
+    while (last_ < groups_.size() && groups_[last_].loop != loop)
+    {
+      ++last_;
+    }
+    if (last_ == groups_.size())
+    {
+      Group group = { loop, ConnectionListPtr(new ConnectionList) };
+      groups_.push_back(group);
+    }
+  }
+  groups_[last_].connections->push_back(conn);
+}
+
+void Broadcaster::post()
+{
+  for (size_t i = 0; i < groups_.size(); ++i)
+  {
+    groups_[i].loop->queueInLoop(
+        boost::bind(&Broadcaster::sendInLoop, groups_[i].connections, payload_));
+  }
+  groups_.clear();
+  last_ = 0;
+}
+
+void Broadcaster::sendInLoop(const ConnectionListPtr& connections,
+                             const SharedPayload& payload)
+{
+  for (ConnectionList::const_iterator it = connections->begin();
+       it != connections->end();
+       ++it)
+  {
+    (*it)->send(payload);
+  }
+}
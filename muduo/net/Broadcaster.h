@@ -0,0 +1,70 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_BROADCASTER_H
+#define MUDUO_NET_BROADCASTER_H
+
+#include <muduo/net/Callbacks.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+
+///
+/// Sends one payload to many connections, which may live in many loops.
+///
+/// Connections of the calling thread's loop get the payload right away,
+/// the others are grouped by loop, with one post to each loop in post().
+/// No connection copies the payload, unless it is shorter than a segment.
+///
+class Broadcaster : boost::noncopyable
+{
+ public:
+  explicit Broadcaster(const SharedPayload& payload);
+  ~Broadcaster();  // calls post()
+
+  void add(const TcpConnectionPtr& conn);
+  void post();
+
+ private:
+  typedef std::vector<TcpConnectionPtr> ConnectionList;
+  typedef boost::shared_ptr<ConnectionList> ConnectionListPtr;
+
+  struct Group
+  {
+    EventLoop* loop;
+    ConnectionListPtr connections;
+  };
+
+  static void sendInLoop(const ConnectionListPtr& connections,
+                         const SharedPayload& payload);
+
+  SharedPayload payload_;
+  std::vector<Group> groups_;  // few, as loops are
+  size_t last_;
+};
+
+/// Encodes once, sends to all of [first, last) of TcpConnectionPtr.
+template<typename Iterator>
+void broadcast(Iterator first, Iterator last, const SharedPayload& payload)
+{
+  Broadcaster broadcaster(payload);
+  for (; first != last; ++first)
+  {
+    broadcaster.add(*first);
+  }
+}
+
+}
+}
+
+#endif  // MUDUO_NET_BROADCASTER_H
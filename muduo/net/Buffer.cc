@@ -9,6 +9,7 @@
 
 #include <muduo/net/Buffer.h>
 
+#include <muduo/net/BufferPool.h>
 #include <muduo/net/SocketsOps.h>
 
 #include <errno.h>
@@ -18,12 +19,91 @@ using namespace muduo;
 using namespace muduo::net;
 
 const char Buffer::kCRLF[] = "\r\n";
+const char Buffer::kEmpty[kCheapPrepend] = { 0 };
 
 const size_t Buffer::kCheapPrepend;
 const size_t Buffer::kInitialSize;
 
+Buffer::Buffer(const Buffer& rhs)
+  : data_(NULL),
+    capacity_(0),
+    size_(rhs.size_),
+    readerIndex_(rhs.readerIndex_),
+    writerIndex_(rhs.writerIndex_)
+{
+  if (rhs.data_)
+  {
+    ::memcpy(begin()+readerIndex_, rhs.peek(), readableBytes());
+  }
+}
+
+void Buffer::reallocate(size_t size)
+{
+  assert(data_);
+  size_t capacity = 0;
+  char* data = allocate(size, &capacity);
+  ::memcpy(data+readerIndex_, peek(), readableBytes());
+  deallocate(data_, capacity_);
+  data_ = data;
+  capacity_ = capacity;
+}
+
+char* Buffer::allocate(size_t size, size_t* capacity)
+{
+  return BufferPool::allocateInThread(size, capacity);
+}
+
+void Buffer::deallocate(char* data, size_t capacity)
+{
+  BufferPool::deallocateInThread(data, capacity);
+}
+
 ssize_t Buffer::readFd(int fd, int* savedErrno)
 {
+  const size_t kExtraSize = 65536;
+  if (readableBytes() == 0)
+  {
+    // readerIndex_ may be past kCheapPrepend after unwrite()
+    retrieveAll();
+  }
+  if (readableBytes() == 0
+      && writableBytes() < kExtraSize
+      && BufferPool::ofCurrentThread())
+  {
+    // Read the overflow into a big pooled block, at the offset it would
+    // have in that block.  Keep the block if it's used, so we copy at most
+    // writableBytes() instead of appending from extrabuf.
+    size_t capacity = 0;
+    char* block = allocate(kCheapPrepend + kExtraSize, &capacity);
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = begin()+writerIndex_;
+    vec[0].iov_len = writable;
+    vec[1].iov_base = block+kCheapPrepend+writable;
+    vec[1].iov_len = capacity-kCheapPrepend-writable;
+    const ssize_t n = sockets::readv(fd, vec, 2);
+    if (n < 0)
+    {
+      *savedErrno = errno;
+      deallocate(block, capacity);
+    }
+    else if (implicit_cast<size_t>(n) <= writable)
+    {
+      writerIndex_ += n;
+      deallocate(block, capacity);
+    }
+    else
+    {
+      ::memcpy(block+kCheapPrepend, peek(), writable);
+      deallocate(data_, capacity_);
+      data_ = block;
+      capacity_ = capacity;
+      size_ = capacity;
+      writerIndex_ = kCheapPrepend + n;
+    }
+    return n;
+  }
+
   // saved an ioctl()/FIONREAD call to tell how much to read
   char extrabuf[65536];
   struct iovec vec[2];
@@ -46,7 +126,7 @@ ssize_t Buffer::readFd(int fd, int* savedErrno)
   }
   else
   {
-    writerIndex_ = buffer_.size();
+    writerIndex_ = size_;
     append(extrabuf, n - writable);
   }
   // if (n == writable + sizeof extrabuf)
@@ -39,6 +39,9 @@ namespace net
 /// |                   |                  |                  |
 /// 0      <=      readerIndex   <=   writerIndex    <=     size
 /// @endcode
+///
+/// Storage is taken from the BufferPool of current EventLoop on first write,
+/// an empty Buffer holds no memory.
 class Buffer : public muduo::copyable
 {
  public:
@@ -46,7 +49,9 @@ class Buffer : public muduo::copyable
   static const size_t kInitialSize = 1024;
 
   explicit Buffer(size_t initialSize = kInitialSize)
-    : buffer_(kCheapPrepend + initialSize),
+    : data_(NULL),
+      capacity_(0),
+      size_(kCheapPrepend + initialSize),
       readerIndex_(kCheapPrepend),
       writerIndex_(kCheapPrepend)
   {
@@ -55,12 +60,49 @@ class Buffer : public muduo::copyable
     assert(prependableBytes() == kCheapPrepend);
   }
 
-  // implicit copy-ctor, move-ctor, dtor and assignment are fine
-  // NOTE: implicit move-ctor is added in g++ 4.6
+  Buffer(const Buffer& rhs);
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  Buffer(Buffer&& rhs)
+    : data_(rhs.data_),
+      capacity_(rhs.capacity_),
+      size_(rhs.size_),
+      readerIndex_(rhs.readerIndex_),
+      writerIndex_(rhs.writerIndex_)
+  {
+    rhs.data_ = NULL;
+    rhs.capacity_ = 0;
+    rhs.readerIndex_ = kCheapPrepend;
+    rhs.writerIndex_ = kCheapPrepend;
+  }
+
+  Buffer& operator=(Buffer&& rhs)
+  {
+    swap(rhs);
+    return *this;
+  }
+#endif
+
+  ~Buffer()
+  {
+    if (data_)
+    {
+      deallocate(data_, capacity_);
+    }
+  }
+
+  Buffer& operator=(const Buffer& rhs)
+  {
+    Buffer copy(rhs);
+    swap(copy);
+    return *this;
+  }
 
   void swap(Buffer& rhs)
   {
-    buffer_.swap(rhs.buffer_);
+    std::swap(data_, rhs.data_);
+    std::swap(capacity_, rhs.capacity_);
+    std::swap(size_, rhs.size_);
     std::swap(readerIndex_, rhs.readerIndex_);
     std::swap(writerIndex_, rhs.writerIndex_);
   }
@@ -69,7 +111,7 @@ class Buffer : public muduo::copyable
   { return writerIndex_ - readerIndex_; }
 
   size_t writableBytes() const
-  { return buffer_.size() - writerIndex_; }
+  { return size_ - writerIndex_; }
 
   size_t prependableBytes() const
   { return readerIndex_; }
@@ -368,9 +410,23 @@ class Buffer : public muduo::copyable
     swap(other);
   }
 
+  /// Returns storage to the pool if there is nothing to read,
+  /// next write takes kInitialSize bytes again.
+  void releaseIfEmpty()
+  {
+    if (readableBytes() == 0 && data_)
+    {
+      deallocate(data_, capacity_);
+      data_ = NULL;
+      capacity_ = 0;
+      size_ = kCheapPrepend + kInitialSize;
+      retrieveAll();
+    }
+  }
+
   size_t internalCapacity() const
   {
-    return buffer_.capacity();
+    return capacity_;
   }
 
   /// Read data directly into buffer.
@@ -382,38 +438,59 @@ class Buffer : public muduo::copyable
  private:
 
   char* begin()
-  { return &*buffer_.begin(); }
+  {
+    if (data_ == NULL)
+    {
+      data_ = allocate(size_, &capacity_);
+    }
+    return data_;
+  }
 
   const char* begin() const
-  { return &*buffer_.begin(); }
+  {
+    // nothing to read when there is no storage
+    return data_ ? data_ : kEmpty;
+  }
 
   void makeSpace(size_t len)
   {
     if (writableBytes() + prependableBytes() < len + kCheapPrepend)
     {
       // FIXME: move readable data
-      buffer_.resize(writerIndex_+len);
+      if (data_ && writerIndex_+len > capacity_)
+      {
+        reallocate(writerIndex_+len);
+      }
+      size_ = writerIndex_+len;
     }
     else
     {
       // move readable data to the front, make space inside buffer
       assert(kCheapPrepend < readerIndex_);
       size_t readable = readableBytes();
-      std::copy(begin()+readerIndex_,
-                begin()+writerIndex_,
-                begin()+kCheapPrepend);
+      char* base = begin();
+      std::copy(base+readerIndex_,
+                base+writerIndex_,
+                base+kCheapPrepend);
       readerIndex_ = kCheapPrepend;
       writerIndex_ = readerIndex_ + readable;
       assert(readable == readableBytes());
     }
   }
 
+  void reallocate(size_t size);
+  static char* allocate(size_t size, size_t* capacity);
+  static void deallocate(char* data, size_t capacity);
+
  private:
-  std::vector<char> buffer_;
+  char* data_;
+  size_t capacity_;  // of data_, may be larger than size_
+  size_t size_;
   size_t readerIndex_;
   size_t writerIndex_;
 
   static const char kCRLF[];
+  static const char kEmpty[kCheapPrepend];
 };
 
 }
@@ -0,0 +1,136 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/net/BufferPool.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int BufferPool::kNumClasses;
+const size_t BufferPool::kMinBlockData;
+const size_t BufferPool::kMaxBlockData;
+const size_t BufferPool::kMaxCachedBytesPerClass;
+
+BufferPool::BufferPool()
+  : cachedBytes_(0),
+    allocations_(0),
+    mallocs_(0)
+{
+  for (int i = 0; i < kNumClasses; ++i)
+  {
+    freeLists_[i] = NULL;
+    numFree_[i] = 0;
+  }
+}
+
+BufferPool::~BufferPool()
+{
+  for (int i = 0; i < kNumClasses; ++i)
+  {
+    while (freeLists_[i])
+    {
+      FreeBlock* block = freeLists_[i];
+      freeLists_[i] = block->next;
+      ::free(block);
+    }
+  }
+}
+
+char* BufferPool::allocate(size_t size, size_t* blockSize)
+{
+  ++allocations_;
+  int klass = sizeClass(size);
+  if (klass < kNumClasses && freeLists_[klass])
+  {
+    FreeBlock* block = freeLists_[klass];
+    freeLists_[klass] = block->next;
+    --numFree_[klass];
+    *blockSize = classSize(klass);
+    cachedBytes_ -= *blockSize;
+    return reinterpret_cast<char*>(block);
+  }
+  ++mallocs_;
+  return newBlock(size, blockSize);
+}
+
+void BufferPool::deallocate(char* block, size_t blockSize)
+{
+  int klass = sizeClass(blockSize);
+  if (klass < kNumClasses
+      && classSize(klass) == blockSize
+      && (numFree_[klass] + 1) * blockSize <= kMaxCachedBytesPerClass)
+  {
+    FreeBlock* freeBlock = reinterpret_cast<FreeBlock*>(block);
+    freeBlock->next = freeLists_[klass];
+    freeLists_[klass] = freeBlock;
+    ++numFree_[klass];
+    cachedBytes_ += blockSize;
+  }
+  else
+  {
+    ::free(block);
+  }
+}
+
+BufferPool* BufferPool::ofCurrentThread()
+{
+  EventLoop* loop = EventLoop::getEventLoopOfCurrentThread();
+  return loop ? loop->bufferPool() : NULL;
+}
+
+char* BufferPool::allocateInThread(size_t size, size_t* blockSize)
+{
+  BufferPool* pool = ofCurrentThread();
+  if (pool)
+  {
+    return pool->allocate(size, blockSize);
+  }
+  return newBlock(size, blockSize);
+}
+
+void BufferPool::deallocateInThread(char* block, size_t blockSize)
+{
+  BufferPool* pool = ofCurrentThread();
+  if (pool)
+  {
+    pool->deallocate(block, blockSize);
+  }
+  else
+  {
+    ::free(block);
+  }
+}
+
+int BufferPool::sizeClass(size_t size)
+{
+  int klass = 0;
+  while (klass < kNumClasses && classSize(klass) < size)
+  {
+    ++klass;
+  }
+  return klass;
+}
+
+size_t BufferPool::classSize(int klass)
+{
+  return Buffer::kCheapPrepend + (kMinBlockData << klass);
+}
+
+// rounds up to size class, so that the block can be cached by any pool.
+char* BufferPool::newBlock(size_t size, size_t* blockSize)
+{
+  int klass = sizeClass(size);
+  *blockSize = klass < kNumClasses ? classSize(klass) : size;
+  void* block = ::malloc(*blockSize);
+  if (block == NULL)
+  {
+    LOG_SYSFATAL << "BufferPool::newBlock " << *blockSize;
+  }
+  return static_cast<char*>(block);
+}
@@ -0,0 +1,74 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_BUFFERPOOL_H
+#define MUDUO_NET_BUFFERPOOL_H
+
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+///
+/// Per EventLoop cache of Buffer storage blocks.
+///
+/// Blocks come in size classes of kCheapPrepend + 1KiB, +2KiB ... +64KiB,
+/// larger ones are plain malloc(3).  A block may be freed to any pool,
+/// or to none, so Buffers can freely move across threads.
+/// Not thread safe, only used in the loop thread.
+class BufferPool : boost::noncopyable
+{
+ public:
+  static const int kNumClasses = 7;
+  static const size_t kMinBlockData = 1024;
+  static const size_t kMaxBlockData = kMinBlockData << (kNumClasses - 1);
+  /// free blocks kept per size class, in bytes.
+  static const size_t kMaxCachedBytesPerClass = 1024*1024;
+
+  BufferPool();
+  ~BufferPool();
+
+  /// Returns a block of at least size bytes, its real size in *blockSize.
+  char* allocate(size_t size, size_t* blockSize);
+  /// Takes back a block returned by allocate() of any pool.
+  void deallocate(char* block, size_t blockSize);
+
+  int64_t allocations() const { return allocations_; }
+  int64_t mallocs() const { return mallocs_; }
+  size_t cachedBytes() const { return cachedBytes_; }
+
+  /// Pool of current EventLoop, NULL if none.
+  static BufferPool* ofCurrentThread();
+
+  /// Same as allocate() and deallocate(), but of current EventLoop's pool,
+  /// if any.
+  static char* allocateInThread(size_t size, size_t* blockSize);
+  static void deallocateInThread(char* block, size_t blockSize);
+
+ private:
+  struct FreeBlock
+  {
+    FreeBlock* next;
+  };
+
+  static int sizeClass(size_t size);
+  static size_t classSize(int klass);
+  static char* newBlock(size_t size, size_t* blockSize);
+
+  FreeBlock* freeLists_[kNumClasses];
+  size_t numFree_[kNumClasses];
+  size_t cachedBytes_;
+  int64_t allocations_;
+  int64_t mallocs_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_BUFFERPOOL_H
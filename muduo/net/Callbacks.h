@@ -43,6 +43,8 @@ namespace net
 class Buffer;
 class TcpConnection;
 typedef boost::shared_ptr<TcpConnection> TcpConnectionPtr;
+/// Immutable bytes, encoded once and queued by many connections.
+typedef boost::shared_ptr<const string> SharedPayload;
 typedef boost::function<void()> TimerCallback;
 typedef boost::function<void (const TcpConnectionPtr&)> ConnectionCallback;
 typedef boost::function<void (const TcpConnectionPtr&)> CloseCallback;
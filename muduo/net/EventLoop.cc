@@ -10,6 +10,7 @@
 
 #include <muduo/base/Logging.h>
 #include <muduo/base/Mutex.h>
+#include <muduo/net/BufferPool.h>
 #include <muduo/net/Channel.h>
 #include <muduo/net/Poller.h>
 #include <muduo/net/SocketsOps.h>
@@ -65,10 +66,12 @@ EventLoop::EventLoop()
     quit_(false),
     eventHandling_(false),
     callingPendingFunctors_(false),
+    sleeping_(false),
     iteration_(0),
     threadId_(CurrentThread::tid()),
     poller_(Poller::newDefaultPoller(this)),
     timerQueue_(new TimerQueue(this)),
+    bufferPool_(new BufferPool),
     wakeupFd_(createEventfd()),
     wakeupChannel_(new Channel(this, wakeupFd_)),
     currentActiveChannel_(NULL)
@@ -110,7 +113,12 @@ void EventLoop::loop()
   while (!quit_)
   {
     activeChannels_.clear();
-    pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+    // Producers wake us up only after seeing sleeping_,
+    // so check once more for functors queued before it was set.
+    __atomic_store_n(&sleeping_, true, __ATOMIC_SEQ_CST);
+    int timeoutMs = pendingFunctors_.empty() ? kPollTimeMs : 0;
+    pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+    __atomic_store_n(&sleeping_, false, __ATOMIC_SEQ_CST);
     ++iteration_;
     if (Logger::logLevel() <= Logger::TRACE)
     {
@@ -125,6 +133,7 @@ void EventLoop::loop()
       currentActiveChannel_->handleEvent(pollReturnTime_);
     }
     currentActiveChannel_ = NULL;
+    poller_->handleCompletions(pollReturnTime_);
     eventHandling_ = false;
     doPendingFunctors();
   }
@@ -159,20 +168,12 @@ void EventLoop::runInLoop(const Functor& cb)
 
 void EventLoop::queueInLoop(const Functor& cb)
 {
-  {
-  MutexLockGuard lock(mutex_);
-  pendingFunctors_.push_back(cb);
-  }
-
-  if (!isInLoopThread() || callingPendingFunctors_)
-  {
-    wakeup();
-  }
+  pendingFunctors_.push(cb);
+  wakeupIfSleeping();
 }
 
 size_t EventLoop::queueSize() const
 {
-  MutexLockGuard lock(mutex_);
   return pendingFunctors_.size();
 }
 
@@ -209,15 +210,8 @@ void EventLoop::runInLoop(Functor&& cb)
 
 void EventLoop::queueInLoop(Functor&& cb)
 {
-  {
-  MutexLockGuard lock(mutex_);
-  pendingFunctors_.push_back(std::move(cb));  // emplace_back
-  }
-
-  if (!isInLoopThread() || callingPendingFunctors_)
-  {
-    wakeup();
-  }
+  pendingFunctors_.push(std::move(cb));
+  wakeupIfSleeping();
 }
 
 TimerId EventLoop::runAt(const Timestamp& time, TimerCallback&& cb)
@@ -262,6 +256,11 @@ void EventLoop::removeChannel(Channel* channel)
   poller_->removeChannel(channel);
 }
 
+const char* EventLoop::pollerName() const
+{
+  return poller_->name();
+}
+
 bool EventLoop::hasChannel(Channel* channel)
 {
   assert(channel->ownerLoop() == this);
@@ -286,6 +285,18 @@ void EventLoop::wakeup()
   }
 }
 
+void EventLoop::wakeupIfSleeping()
+{
+  // pairs with the store of sleeping_ in loop(), after the push.
+  // A running loop drains the queue before it sleeps, no wakeup needed.
+  // Only the first producer who sees it sleeping writes the eventfd.
+  if (__atomic_load_n(&sleeping_, __ATOMIC_SEQ_CST)
+      && __atomic_exchange_n(&sleeping_, false, __ATOMIC_SEQ_CST))
+  {
+    wakeup();
+  }
+}
+
 void EventLoop::handleRead()
 {
   uint64_t one = 1;
@@ -298,13 +309,12 @@ void EventLoop::handleRead()
 
 void EventLoop::doPendingFunctors()
 {
-  std::vector<Functor> functors;
   callingPendingFunctors_ = true;
 
-  {
-  MutexLockGuard lock(mutex_);
-  functors.swap(pendingFunctors_);
-  }
+  // functors queued by these ones run in the next iteration
+  std::vector<Functor> functors;
+  functors.swap(functors_);
+  pendingFunctors_.popAll(&functors);
 
   for (std::vector<Functor>::iterator it = functors.begin();
        it != functors.end();
@@ -312,6 +322,9 @@ void EventLoop::doPendingFunctors()
 
       (*it)();
   }
+  functors.clear();
+  // keeps the capacity for next time
+  functors.swap(functors_);
   callingPendingFunctors_ = false;
 }
 
@@ -21,6 +21,7 @@
 
 #include <muduo/base/Mutex.h>
 #include <muduo/base/CurrentThread.h>
+#include <muduo/base/MpscQueue.h>
 #include <muduo/base/Timestamp.h>
 #include <muduo/net/Callbacks.h>
 #include <muduo/net/TimerId.h>
@@ -30,6 +31,7 @@ namespace muduo
 namespace net
 {
 
+class BufferPool;
 class Channel;
 class Poller;
 class TimerQueue;
@@ -66,6 +68,10 @@ class EventLoop : boost::noncopyable
 
   int64_t iteration() const { return iteration_; }
 
+  /// The I/O multiplexing backend, "epoll", "poll" or "io_uring",
+  /// after any fallback when the requested one is not supported.
+  const char* pollerName() const;
+
   /// Runs callback immediately in the loop thread.
   /// It wakes up the loop, and run the cb.
   /// If in the same loop thread, cb is run within the function.
@@ -74,6 +80,7 @@ class EventLoop : boost::noncopyable
   /// Queues callback in the loop thread.
   /// Runs after finish pooling.
   /// Safe to call from other threads.
+  /// Lock-free, the loop is woken up only if it is about to sleep in poll.
   void queueInLoop(const Functor& cb);
 
   size_t queueSize() const;
@@ -117,6 +124,8 @@ class EventLoop : boost::noncopyable
   void updateChannel(Channel* channel);
   void removeChannel(Channel* channel);
   bool hasChannel(Channel* channel);
+  BufferPool* bufferPool() { return get_pointer(bufferPool_); }
+  Poller* poller() { return get_pointer(poller_); }
 
   // pid_t threadId() const { return threadId_; }
   void assertInLoopThread()
@@ -144,6 +153,7 @@ class EventLoop : boost::noncopyable
  private:
   void abortNotInLoopThread();
   void handleRead();  // waked up
+  void wakeupIfSleeping();
   void doPendingFunctors();
 
   void printActiveChannels() const; // DEBUG
@@ -154,11 +164,13 @@ class EventLoop : boost::noncopyable
   bool quit_; /* atomic and shared between threads, okay on x86, I guess. */
   bool eventHandling_; /* atomic */
   bool callingPendingFunctors_; /* atomic */
+  bool sleeping_; /* atomic, in or about to enter poll */
   int64_t iteration_;
   const pid_t threadId_;
   Timestamp pollReturnTime_;
   boost::scoped_ptr<Poller> poller_;
   boost::scoped_ptr<TimerQueue> timerQueue_;
+  boost::scoped_ptr<BufferPool> bufferPool_;
   int wakeupFd_;
   // unlike in TimerQueue, which is an internal class,
   // we don't expose Channel to client.
@@ -169,8 +181,9 @@ class EventLoop : boost::noncopyable
   ChannelList activeChannels_;
   Channel* currentActiveChannel_;
 
-  mutable MutexLock mutex_;
-  std::vector<Functor> pendingFunctors_; // @GuardedBy mutex_
+  MpscQueue<Functor> pendingFunctors_;
+  // scratch variable of doPendingFunctors()
+  std::vector<Functor> functors_;
 };
 
 }
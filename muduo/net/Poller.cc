@@ -8,6 +8,7 @@
 
 #include <muduo/net/Poller.h>
 
+#include <muduo/base/Logging.h>
 #include <muduo/net/Channel.h>
 
 using namespace muduo;
@@ -29,3 +30,30 @@ bool Poller::hasChannel(Channel* channel) const
   return it != channels_.end() && it->second == channel;
 }
 
+
+Poller::OperationId Poller::submitRecv(int, const CompletionCallback&)
+{
+  LOG_FATAL << "Poller::submitRecv() without completion I/O";
+  return 0;
+}
+
+Poller::OperationId Poller::submitWritev(int, const struct iovec*, int, const CompletionCallback&)
+{
+  LOG_FATAL << "Poller::submitWritev() without completion I/O";
+  return 0;
+}
+
+Poller::OperationId Poller::submitAccept(int, const CompletionCallback&)
+{
+  LOG_FATAL << "Poller::submitAccept() without completion I/O";
+  return 0;
+}
+
+void Poller::cancel(OperationId)
+{
+  LOG_FATAL << "Poller::cancel() without completion I/O";
+}
+
+void Poller::handleCompletions(Timestamp)
+{
+}
@@ -13,11 +13,15 @@
 
 #include <map>
 #include <vector>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 
 #include <muduo/base/Timestamp.h>
 #include <muduo/net/EventLoop.h>
 
+struct iovec;
+struct sockaddr_in6;
+
 namespace muduo
 {
 namespace net
@@ -25,6 +29,14 @@ namespace net
 
 class Channel;
 
+/// Result of an operation submitted with Poller::submitRecv() etc.
+struct IoCompletion
+{
+  int result;  // of the syscall, -errno on failure
+  const char* data;  // the bytes received, by submitRecv()
+  const struct sockaddr_in6* peer;  // by submitAccept()
+};
+
 ///
 /// Base class for IO Multiplexing
 ///
@@ -33,6 +45,9 @@ class Poller : boost::noncopyable
 {
  public:
   typedef std::vector<Channel*> ChannelList;
+  typedef boost::function<void (const IoCompletion&, Timestamp)> CompletionCallback;
+  // never 0
+  typedef uint64_t OperationId;
 
   Poller(EventLoop* loop);
   virtual ~Poller();
@@ -51,6 +66,27 @@ class Poller : boost::noncopyable
 
   virtual bool hasChannel(Channel* channel) const;
 
+  /// Name of the backend, for logging and benchmarks.
+  virtual const char* name() const = 0;
+
+  /// Whether reads, writes and accepts can be completed by the kernel,
+  /// with the operations below, instead of being done on readiness.
+  virtual bool hasCompletionIo() const { return false; }
+
+  /// Receives into a buffer of the poller, valid during the callback.
+  virtual OperationId submitRecv(int fd, const CompletionCallback& cb);
+  /// What iov refers to must stay valid until the callback, the array not.
+  virtual OperationId submitWritev(int fd, const struct iovec* iov, int iovcnt,
+                                   const CompletionCallback& cb);
+  /// Accepts a nonblocking, close-on-exec socket.
+  virtual OperationId submitAccept(int fd, const CompletionCallback& cb);
+  /// The callback will not be called.  It is destroyed when the kernel
+  /// is done with the operation, so it may hold what the operation uses.
+  virtual void cancel(OperationId id);
+
+  /// Calls the callbacks of the operations completed in the last poll().
+  virtual void handleCompletions(Timestamp receiveTime);
+
   static Poller* newDefaultPoller(EventLoop* loop);
 
   void assertInLoopThread() const
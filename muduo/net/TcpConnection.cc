@@ -12,16 +12,31 @@
 #include <muduo/base/WeakCallback.h>
 #include <muduo/net/Channel.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/Poller.h>
 #include <muduo/net/Socket.h>
 #include <muduo/net/SocketsOps.h>
 
 #include <boost/bind.hpp>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+// Small writes are coalesced into the last output segment up to this size,
+// larger ones get a segment of their own, so queued data is never moved.
+const size_t kOutputSegmentSize = 64*1024;
+// at most this many segments per writev(2)
+const int kMaxOutputIovecs = 64;
+// Shared payloads shorter than this are copied, as a segment costs more.
+const size_t kMinSharedSegment = 1024;
+}
+
 void muduo::net::defaultConnectionCallback(const TcpConnectionPtr& conn)
 {
   LOG_TRACE << conn->localAddress().toIpPort() << " -> "
@@ -41,16 +56,22 @@ TcpConnection::TcpConnection(EventLoop* loop,
                              const string& nameArg,
                              int sockfd,
                              const InetAddress& localAddr,
-                             const InetAddress& peerAddr)
+                             const InetAddress& peerAddr,
+                             uint64_t id)
   : loop_(CHECK_NOTNULL(loop)),
     name_(nameArg),
+    id_(id),
     state_(kConnecting),
     reading_(true),
     socket_(new Socket(sockfd)),
     channel_(new Channel(loop, sockfd)),
+    completionPoller_(loop->poller()->hasCompletionIo() ? loop->poller() : NULL),
+    readOperation_(0),
+    writeOperation_(0),
     localAddr_(localAddr),
     peerAddr_(peerAddr),
-    highWaterMark_(64*1024*1024)
+    highWaterMark_(64*1024*1024),
+    outputBytes_(0)
 {
   channel_->setReadCallback(
       boost::bind(&TcpConnection::handleRead, this, _1));
@@ -71,6 +92,16 @@ TcpConnection::~TcpConnection()
             << " fd=" << channel_->fd()
             << " state=" << stateToString();
   assert(state_ == kDisconnected);
+  assert(readOperation_ == 0 && writeOperation_ == 0);
+  for (std::deque<OutputSegment>::const_iterator it = outputQueue_.begin();
+       it != outputQueue_.end();
+       ++it)
+  {
+    if (it->isFile())
+    {
+      ::close(it->fd);
+    }
+  }
 }
 
 bool TcpConnection::getTcpInfo(struct tcp_info* tcpi) const
@@ -110,23 +141,64 @@ void TcpConnection::send(const StringPiece& message)
   }
 }
 
-// FIXME efficiency!!!
 void TcpConnection::send(Buffer* buf)
 {
   if (state_ == kConnected)
   {
     if (loop_->isInLoopThread())
     {
-      sendInLoop(buf->peek(), buf->readableBytes());
-      buf->retrieveAll();
+      sendBufferInLoop(buf);
     }
     else
     {
+      boost::shared_ptr<Buffer> message(new Buffer);
+      message->swap(*buf);
       loop_->runInLoop(
-          boost::bind(&TcpConnection::sendInLoop,
+          boost::bind(&TcpConnection::sendMovedBufferInLoop,
                       this,     // FIXME
-                      buf->retrieveAllAsString()));
-                    //std::forward<string>(message)));
+                      message));
+    }
+  }
+}
+
+void TcpConnection::sendFile(int fd, int64_t offset, size_t length)
+{
+  if (state_ == kConnected)
+  {
+    int dupfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dupfd < 0)
+    {
+      LOG_SYSERR << "TcpConnection::sendFile";
+      return;
+    }
+    if (loop_->isInLoopThread())
+    {
+      sendFileInLoop(dupfd, offset, length);
+    }
+    else
+    {
+      loop_->runInLoop(
+          boost::bind(&TcpConnection::sendFileInLoop,
+                      this,     // FIXME
+                      dupfd, offset, length));
+    }
+  }
+}
+
+void TcpConnection::send(const SharedPayload& payload)
+{
+  if (state_ == kConnected)
+  {
+    if (loop_->isInLoopThread())
+    {
+      sendPayloadInLoop(payload);
+    }
+    else
+    {
+      loop_->runInLoop(
+          boost::bind(&TcpConnection::sendPayloadInLoop,
+                      this,     // FIXME
+                      payload));
     }
   }
 }
@@ -139,54 +211,286 @@ void TcpConnection::sendInLoop(const StringPiece& message)
 void TcpConnection::sendInLoop(const void* data, size_t len)
 {
   loop_->assertInLoopThread();
-  ssize_t nwrote = 0;
-  size_t remaining = len;
+  if (state_ == kDisconnected)
+  {
+    LOG_WARN << "disconnected, give up writing";
+    return;
+  }
   bool faultError = false;
+  size_t nwrote = writeDirectly(data, len, &faultError);
+  size_t remaining = len - nwrote;
+  if (!faultError && remaining > 0)
+  {
+    willQueueOutput(remaining);
+    appendToOutputQueue(static_cast<const char*>(data)+nwrote, remaining);
+    startWriting();
+  }
+}
+
+void TcpConnection::sendBufferInLoop(Buffer* buf)
+{
+  loop_->assertInLoopThread();
   if (state_ == kDisconnected)
   {
     LOG_WARN << "disconnected, give up writing";
+    buf->retrieveAll();
     return;
   }
-  // if no thing in output queue, try writing directly
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+  bool faultError = false;
+  buf->retrieve(writeDirectly(buf->peek(), buf->readableBytes(), &faultError));
+  size_t remaining = buf->readableBytes();
+  if (!faultError && remaining > 0)
   {
-    nwrote = sockets::write(channel_->fd(), data, len);
-    if (nwrote >= 0)
+    willQueueOutput(remaining);
+    if (remaining < kOutputSegmentSize / 2)
     {
-      remaining = len - nwrote;
-      if (remaining == 0 && writeCompleteCallback_)
-      {
-        loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
-      }
+      appendToOutputQueue(buf->peek(), remaining);
     }
-    else // nwrote < 0
+    else
     {
-      nwrote = 0;
-      if (errno != EWOULDBLOCK)
+      // take over the storage, no copying
+      outputQueue_.push_back(OutputSegment(0));
+      outputQueue_.back().buffer.swap(*buf);
+      outputBytes_ += remaining;
+    }
+    startWriting();
+  }
+  buf->retrieveAll();
+}
+
+void TcpConnection::sendMovedBufferInLoop(const boost::shared_ptr<Buffer>& message)
+{
+  sendBufferInLoop(get_pointer(message));
+}
+
+void TcpConnection::sendFileInLoop(int fd, int64_t offset, size_t length)
+{
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected)
+  {
+    LOG_WARN << "disconnected, give up writing";
+    ::close(fd);
+    return;
+  }
+  bool faultError = false;
+  size_t nwrote = sendFileDirectly(fd, offset, length, &faultError);
+  size_t remaining = length - nwrote;
+  if (!faultError && remaining > 0)
+  {
+    willQueueOutput(remaining);
+    outputQueue_.push_back(OutputSegment(fd, offset + static_cast<int64_t>(nwrote), remaining));
+    outputBytes_ += remaining;
+    startWriting();
+  }
+  else
+  {
+    ::close(fd);
+  }
+}
+
+void TcpConnection::sendPayloadInLoop(const SharedPayload& payload)
+{
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected)
+  {
+    LOG_WARN << "disconnected, give up writing";
+    return;
+  }
+  bool faultError = false;
+  size_t nwrote = writeDirectly(payload->data(), payload->size(), &faultError);
+  size_t remaining = payload->size() - nwrote;
+  if (!faultError && remaining > 0)
+  {
+    willQueueOutput(remaining);
+    if (remaining < kMinSharedSegment)
+    {
+      appendToOutputQueue(payload->data() + nwrote, remaining);
+    }
+    else
+    {
+      outputQueue_.push_back(OutputSegment(payload, nwrote));
+      outputBytes_ += remaining;
+    }
+    startWriting();
+  }
+}
+
+// if no thing in output queue, try writing directly
+size_t TcpConnection::writeDirectly(const void* data, size_t len, bool* faultError)
+{
+  if (!isWriting() && outputBytes_ == 0)
+  {
+    return checkDirectWrite(sockets::write(channel_->fd(), data, len), len, faultError);
+  }
+  return 0;
+}
+
+size_t TcpConnection::sendFileDirectly(int fd, int64_t offset, size_t len, bool* faultError)
+{
+  if (!isWriting() && outputBytes_ == 0)
+  {
+    off_t off = offset;
+    return checkDirectWrite(sockets::sendfile(channel_->fd(), fd, &off, len), len, faultError);
+  }
+  return 0;
+}
+
+size_t TcpConnection::checkDirectWrite(ssize_t nwrote, size_t len, bool* faultError)
+{
+  if (nwrote >= 0)
+  {
+    if (implicit_cast<size_t>(nwrote) == len && writeCompleteCallback_)
+    {
+      loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
+    }
+  }
+  else // nwrote < 0
+  {
+    nwrote = 0;
+    if (errno != EWOULDBLOCK)
+    {
+      LOG_SYSERR << "TcpConnection::sendInLoop";
+      if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
       {
-        LOG_SYSERR << "TcpConnection::sendInLoop";
-        if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
-        {
-          faultError = true;
-        }
+        *faultError = true;
       }
     }
   }
+  assert(implicit_cast<size_t>(nwrote) <= len);
+  return nwrote;
+}
 
-  assert(remaining <= len);
-  if (!faultError && remaining > 0)
+// called before len bytes are queued
+void TcpConnection::willQueueOutput(size_t len)
+{
+  size_t oldLen = outputBytes_;
+  if (oldLen + len >= highWaterMark_
+      && oldLen < highWaterMark_
+      && highWaterMarkCallback_)
   {
-    size_t oldLen = outputBuffer_.readableBytes();
-    if (oldLen + remaining >= highWaterMark_
-        && oldLen < highWaterMark_
-        && highWaterMarkCallback_)
+    loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), oldLen + len));
+  }
+}
+
+// called after output is queued
+void TcpConnection::startWriting()
+{
+  if (completionPoller_ && !outputQueue_.front().isFile())
+  {
+    if (writeOperation_ == 0)
+    {
+      struct iovec vec[kMaxOutputIovecs];
+      int iovcnt = gatherOutput(vec);
+      writeOperation_ = completionPoller_->submitWritev(
+          channel_->fd(), vec, iovcnt,
+          boost::bind(&TcpConnection::handleWriteCompletion, shared_from_this(), _1, _2));
+    }
+  }
+  else if (!channel_->isWriting())
+  {
+    channel_->enableWriting();
+  }
+}
+
+bool TcpConnection::isWriting() const
+{
+  return channel_->isWriting() || writeOperation_ != 0;
+}
+
+void TcpConnection::appendToOutputQueue(const char* data, size_t len)
+{
+  if (outputQueue_.empty()
+      || outputQueue_.back().isFile()
+      || outputQueue_.back().isPayload()
+      || (outputQueue_.back().buffer.writableBytes() < len
+          // data being written by the kernel must not move
+          && (writeOperation_ != 0
+              || outputQueue_.back().buffer.readableBytes() + len > kOutputSegmentSize)))
+  {
+    outputQueue_.push_back(OutputSegment(std::max(len, Buffer::kInitialSize)));
+  }
+  outputQueue_.back().buffer.append(data, len);
+  outputBytes_ += len;
+}
+
+ssize_t TcpConnection::writeOutputQueue()
+{
+  assert(!outputQueue_.empty());
+  OutputSegment& front = outputQueue_.front();
+  if (front.isFile())
+  {
+    off_t offset = front.offset;
+    ssize_t n = sockets::sendfile(channel_->fd(), front.fd, &offset, front.length);
+    if (n > 0)
+    {
+      retrieveOutput(n);
+    }
+    else if (n == 0)
+    {
+      LOG_ERROR << "TcpConnection::writeOutputQueue [" << name_
+                << "] - file ends before " << front.length << " more bytes";
+    }
+    return n;
+  }
+
+  struct iovec vec[kMaxOutputIovecs];
+  int iovcnt = gatherOutput(vec);
+  ssize_t n = sockets::writev(channel_->fd(), vec, iovcnt);
+  if (n > 0)
+  {
+    retrieveOutput(n);
+  }
+  return n;
+}
+
+// in-memory segments up to the first file
+int TcpConnection::gatherOutput(struct iovec* vec) const
+{
+  int iovcnt = 0;
+  for (std::deque<OutputSegment>::const_iterator it = outputQueue_.begin();
+       it != outputQueue_.end() && !it->isFile() && iovcnt < kMaxOutputIovecs;
+       ++it)
+  {
+    if (it->readableBytes() > 0)
     {
-      loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+      vec[iovcnt].iov_base = const_cast<char*>(it->peek());
+      vec[iovcnt].iov_len = it->readableBytes();
+      ++iovcnt;
+    }
+  }
+  return iovcnt;
+}
+
+void TcpConnection::retrieveOutput(size_t len)
+{
+  assert(len <= outputBytes_);
+  outputBytes_ -= len;
+  while (len > 0)
+  {
+    OutputSegment& front = outputQueue_.front();
+    size_t n = std::min(len, front.readableBytes());
+    len -= n;
+    if (front.isFile() || front.isPayload())
+    {
+      front.offset += static_cast<int64_t>(n);
+      front.length -= n;
+      if (front.length == 0)
+      {
+        if (front.isFile())
+        {
+          ::close(front.fd);
+        }
+        outputQueue_.pop_front();
+      }
     }
-    outputBuffer_.append(static_cast<const char*>(data)+nwrote, remaining);
-    if (!channel_->isWriting())
+    else
     {
-      channel_->enableWriting();
+      front.buffer.retrieve(n);
+      if (front.buffer.readableBytes() == 0)
+      {
+        // storage goes back to BufferPool
+        outputQueue_.pop_front();
+      }
     }
   }
 }
@@ -205,7 +509,7 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
   loop_->assertInLoopThread();
-  if (!channel_->isWriting())
+  if (!isWriting())
   {
     // we are not writing
     socket_->shutdownWrite();
@@ -298,7 +602,15 @@ void TcpConnection::startRead()
 void TcpConnection::startReadInLoop()
 {
   loop_->assertInLoopThread();
-  if (!reading_ || !channel_->isReading())
+  if (completionPoller_)
+  {
+    reading_ = true;
+    if (readOperation_ == 0 && (state_ == kConnected || state_ == kDisconnecting))
+    {
+      submitRead();
+    }
+  }
+  else if (!reading_ || !channel_->isReading())
   {
     channel_->enableReading();
     reading_ = true;
@@ -313,7 +625,12 @@ void TcpConnection::stopRead()
 void TcpConnection::stopReadInLoop()
 {
   loop_->assertInLoopThread();
-  if (reading_ || channel_->isReading())
+  if (completionPoller_)
+  {
+    // a receive in flight is still delivered
+    reading_ = false;
+  }
+  else if (reading_ || channel_->isReading())
   {
     channel_->disableReading();
     reading_ = false;
@@ -326,7 +643,14 @@ void TcpConnection::connectEstablished()
   assert(state_ == kConnecting);
   setState(kConnected);
   channel_->tie(shared_from_this());
-  channel_->enableReading();
+  if (completionPoller_)
+  {
+    submitRead();
+  }
+  else
+  {
+    channel_->enableReading();
+  }
 
   connectionCallback_(shared_from_this());
 }
@@ -338,6 +662,7 @@ void TcpConnection::connectDestroyed()
   {
     setState(kDisconnected);
     channel_->disableAll();
+    cancelOperations();
 
     connectionCallback_(shared_from_this());
   }
@@ -352,6 +677,8 @@ void TcpConnection::handleRead(Timestamp receiveTime)
   if (n > 0)
   {
     messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+    // idle connections hold no input storage
+    inputBuffer_.releaseIfEmpty();
   }
   else if (n == 0)
   {
@@ -370,13 +697,10 @@ void TcpConnection::handleWrite()
   loop_->assertInLoopThread();
   if (channel_->isWriting())
   {
-    ssize_t n = sockets::write(channel_->fd(),
-                               outputBuffer_.peek(),
-                               outputBuffer_.readableBytes());
+    ssize_t n = writeOutputQueue();
     if (n > 0)
     {
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0)
+      if (outputBytes_ == 0)
       {
         channel_->disableWriting();
         if (writeCompleteCallback_)
@@ -388,10 +712,28 @@ void TcpConnection::handleWrite()
           shutdownInLoop();
         }
       }
+      else if (completionPoller_ && !outputQueue_.front().isFile())
+      {
+        // past the file, the rest is written by the poller
+        channel_->disableWriting();
+        startWriting();
+      }
     }
-    else
+    else if (n == 0 || (errno != EWOULDBLOCK && errno != EINTR))
     {
-      LOG_SYSERR << "TcpConnection::handleWrite";
+      // only sendfile() writes nothing, at the end of a file shorter than queued
+      if (n < 0)
+      {
+        LOG_SYSERR << "TcpConnection::handleWrite";
+      }
+      if (outputQueue_.front().isFile())
+      {
+        // a short file, EINVAL, EIO etc. persist, and the peer can't tell
+        // where the file broke off, so drop it with the connection rather
+        // than retry or send what follows it
+        retrieveOutput(outputQueue_.front().length);
+        handleClose();
+      }
       // if (state_ == kDisconnecting)
       // {
       //   shutdownInLoop();
@@ -413,6 +755,7 @@ void TcpConnection::handleClose()
   // we don't close fd, leave it to dtor, so we can find leaks easily.
   setState(kDisconnected);
   channel_->disableAll();
+  cancelOperations();
 
   TcpConnectionPtr guardThis(shared_from_this());
   connectionCallback_(guardThis);
@@ -427,3 +770,89 @@ void TcpConnection::handleError()
             << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 }
 
+
+void TcpConnection::submitRead()
+{
+  assert(readOperation_ == 0);
+  readOperation_ = completionPoller_->submitRecv(
+      channel_->fd(),
+      boost::bind(&TcpConnection::handleReadCompletion, shared_from_this(), _1, _2));
+}
+
+void TcpConnection::handleReadCompletion(const IoCompletion& completion, Timestamp receiveTime)
+{
+  loop_->assertInLoopThread();
+  readOperation_ = 0;
+  if (completion.result > 0)
+  {
+    inputBuffer_.append(completion.data, completion.result);
+    messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+    inputBuffer_.releaseIfEmpty();
+    if (reading_ && readOperation_ == 0
+        && (state_ == kConnected || state_ == kDisconnecting))
+    {
+      submitRead();
+    }
+  }
+  else if (completion.result == 0)
+  {
+    handleClose();
+  }
+  else
+  {
+    errno = -completion.result;
+    LOG_SYSERR << "TcpConnection::handleReadCompletion";
+    // no POLLHUP follows, as there is no poll
+    handleClose();
+  }
+}
+
+void TcpConnection::handleWriteCompletion(const IoCompletion& completion, Timestamp)
+{
+  loop_->assertInLoopThread();
+  writeOperation_ = 0;
+  if (completion.result >= 0)
+  {
+    retrieveOutput(completion.result);
+    if (outputBytes_ == 0)
+    {
+      if (writeCompleteCallback_)
+      {
+        loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
+      }
+      if (state_ == kDisconnecting)
+      {
+        shutdownInLoop();
+      }
+    }
+    else
+    {
+      startWriting();
+    }
+  }
+  else if (completion.result == -EINTR || completion.result == -EAGAIN)
+  {
+    startWriting();
+  }
+  else
+  {
+    errno = -completion.result;
+    LOG_SYSERR << "TcpConnection::handleWriteCompletion";
+    handleClose();
+  }
+}
+
+// Their callbacks hold this connection until the kernel is done with them.
+void TcpConnection::cancelOperations()
+{
+  if (readOperation_ != 0)
+  {
+    completionPoller_->cancel(readOperation_);
+    readOperation_ = 0;
+  }
+  if (writeOperation_ != 0)
+  {
+    completionPoller_->cancel(writeOperation_);
+    writeOperation_ = 0;
+  }
+}
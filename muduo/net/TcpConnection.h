@@ -23,8 +23,11 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <deque>
+
 // struct tcp_info is in <netinet/tcp.h>
 struct tcp_info;
+struct iovec;
 
 namespace muduo
 {
@@ -33,7 +36,9 @@ namespace net
 
 class Channel;
 class EventLoop;
+class Poller;
 class Socket;
+struct IoCompletion;
 
 ///
 /// TCP connection, for both client and server usage.
@@ -50,11 +55,14 @@ class TcpConnection : boost::noncopyable,
                 const string& name,
                 int sockfd,
                 const InetAddress& localAddr,
-                const InetAddress& peerAddr);
+                const InetAddress& peerAddr,
+                uint64_t id = 0);
   ~TcpConnection();
 
   EventLoop* getLoop() const { return loop_; }
   const string& name() const { return name_; }
+  /// Unique among the connections of a TcpServer, 0 for TcpClient.
+  uint64_t id() const { return id_; }
   const InetAddress& localAddress() const { return localAddr_; }
   const InetAddress& peerAddress() const { return peerAddr_; }
   bool connected() const { return state_ == kConnected; }
@@ -68,6 +76,11 @@ class TcpConnection : boost::noncopyable,
   void send(const StringPiece& message);
   // void send(Buffer&& message); // C++11
   void send(Buffer* message);  // this one will swap data
+  /// Sends length bytes of file fd starting at offset with sendfile(2),
+  /// after everything sent before. fd is dup()ed, caller may close it.
+  void sendFile(int fd, int64_t offset, size_t length);
+  /// Queues @c payload by reference, what it holds must not change.
+  void send(const SharedPayload& payload);
   void shutdown(); // NOT thread safe, no simultaneous calling
   // void shutdownAndForceCloseAfter(double seconds); // NOT thread safe, no simultaneous calling
   void forceClose();
@@ -103,8 +116,9 @@ class TcpConnection : boost::noncopyable,
   Buffer* inputBuffer()
   { return &inputBuffer_; }
 
-  Buffer* outputBuffer()
-  { return &outputBuffer_; }
+  /// Bytes queued in output segments, not yet written to socket.
+  size_t outputBytes() const
+  { return outputBytes_; }
 
   /// Internal use only.
   void setCloseCallback(const CloseCallback& cb)
@@ -121,9 +135,28 @@ class TcpConnection : boost::noncopyable,
   void handleWrite();
   void handleClose();
   void handleError();
+  // with a poller of completion I/O
+  void submitRead();
+  void handleReadCompletion(const IoCompletion& completion, Timestamp receiveTime);
+  void handleWriteCompletion(const IoCompletion& completion, Timestamp);
+  void cancelOperations();
   // void sendInLoop(string&& message);
   void sendInLoop(const StringPiece& message);
   void sendInLoop(const void* message, size_t len);
+  void sendBufferInLoop(Buffer* message);
+  void sendMovedBufferInLoop(const boost::shared_ptr<Buffer>& message);
+  void sendFileInLoop(int fd, int64_t offset, size_t length);
+  void sendPayloadInLoop(const SharedPayload& payload);
+  size_t writeDirectly(const void* data, size_t len, bool* faultError);
+  size_t sendFileDirectly(int fd, int64_t offset, size_t len, bool* faultError);
+  size_t checkDirectWrite(ssize_t nwrote, size_t len, bool* faultError);
+  void appendToOutputQueue(const char* data, size_t len);
+  void willQueueOutput(size_t len);
+  void startWriting();
+  bool isWriting() const;
+  int gatherOutput(struct iovec* vec) const;
+  ssize_t writeOutputQueue();
+  void retrieveOutput(size_t len);
   void shutdownInLoop();
   // void shutdownAndForceCloseInLoop(double seconds);
   void forceCloseInLoop();
@@ -134,11 +167,17 @@ class TcpConnection : boost::noncopyable,
 
   EventLoop* loop_;
   const string name_;
+  const uint64_t id_;
   StateE state_;  // FIXME: use atomic variable
   bool reading_;
   // we don't expose those classes to client.
   boost::scoped_ptr<Socket> socket_;
   boost::scoped_ptr<Channel> channel_;
+  // reads and writes are completed by it if not NULL, the channel is for
+  // sendfile(2) only then
+  Poller* completionPoller_;
+  uint64_t readOperation_;  // in flight, 0 if none
+  uint64_t writeOperation_;
   const InetAddress localAddr_;
   const InetAddress peerAddr_;
   ConnectionCallback connectionCallback_;
@@ -148,7 +187,38 @@ class TcpConnection : boost::noncopyable,
   CloseCallback closeCallback_;
   size_t highWaterMark_;
   Buffer inputBuffer_;
-  Buffer outputBuffer_; // FIXME: use list<Buffer> as output buffer.
+  struct OutputSegment
+  {
+    explicit OutputSegment(size_t initialSize)
+      : buffer(initialSize), fd(-1), offset(0), length(0)
+    { }
+
+    OutputSegment(int fileFd, int64_t fileOffset, size_t fileLength)
+      : buffer(0), fd(fileFd), offset(fileOffset), length(fileLength)
+    { }
+
+    OutputSegment(const SharedPayload& shared, size_t begin)
+      : buffer(0), fd(-1), offset(static_cast<int64_t>(begin)),
+        length(shared->size() - begin), payload(shared)
+    { }
+
+    bool isFile() const { return fd >= 0; }
+    bool isPayload() const { return payload != NULL; }
+    size_t readableBytes() const
+    { return isFile() || isPayload() ? length : buffer.readableBytes(); }
+    const char* peek() const
+    { return isPayload() ? payload->data() + offset : buffer.peek(); }
+
+    Buffer buffer;
+    int fd;  // owned file region, -1 for in-memory segment
+    int64_t offset;  // in the file or in the payload
+    size_t length;
+    SharedPayload payload;  // shared region, if not NULL
+  };
+  // output segments, flushed with writev(2) or sendfile(2),
+  // never reallocated as a whole.
+  std::deque<OutputSegment> outputQueue_;
+  size_t outputBytes_;
   boost::any context_;
   // FIXME: creationTime_, lastReceiveTime_
   //        bytesReceived_, bytesSent_
@@ -8,6 +8,7 @@
 
 #include <muduo/net/TcpServer.h>
 
+#include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
 #include <muduo/net/Acceptor.h>
 #include <muduo/net/EventLoop.h>
@@ -16,8 +17,6 @@
 
 #include <boost/bind.hpp>
 
-#include <stdio.h>  // snprintf
-
 using namespace muduo;
 using namespace muduo::net;
 
@@ -28,14 +27,115 @@ TcpServer::TcpServer(EventLoop* loop,
   : loop_(CHECK_NOTNULL(loop)),
     ipPort_(listenAddr.toIpPort()),
     name_(nameArg),
-    acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+    listenAddr_(listenAddr),
+    option_(option),
+    connNamePrefix_(name_ + "-" + ipPort_ + "#"),
+    nextShard_(0),
     threadPool_(new EventLoopThreadPool(loop, name_)),
     connectionCallback_(defaultConnectionCallback),
-    messageCallback_(defaultMessageCallback),
-    nextConnId_(1)
+    messageCallback_(defaultMessageCallback)
+{
+  nextConnId_.getAndSet(1);
+  // the per loop acceptors are created in start(), once the loops exist
+  if (option_ != kReusePortPerLoop)
+  {
+    acceptor_.reset(new Acceptor(loop, listenAddr, option_ == kReusePort));
+    acceptor_->setNewConnectionCallback(
+        boost::bind(&TcpServer::newConnection, this, _1, _2));
+  }
+}
+
+TcpServer::ConnectionTable::ConnectionTable(int shard)
+  : shard_(shard)
+{
+  assert(0 <= shard && shard < (1 << kShardBits));
+}
+
+uint64_t TcpServer::ConnectionTable::nextId() const
+{
+  uint32_t slot = freeSlots_.empty() ? static_cast<uint32_t>(slots_.size())
+                                     : freeSlots_.back();
+  assert(slot < (1U << kSlotBits));
+  uint32_t generation = slot < slots_.size() ? slots_[slot].generation : 1;
+  return static_cast<uint64_t>(generation) << (kSlotBits + kShardBits)
+       | static_cast<uint64_t>(slot) << kShardBits
+       | static_cast<uint64_t>(shard_);
+}
+
+void TcpServer::ConnectionTable::add(const TcpConnectionPtr& conn)
+{
+  assert(conn->id() == nextId());
+  if (freeSlots_.empty())
+  {
+    slots_.push_back(Slot());
+    slots_.back().conn = conn;
+  }
+  else
+  {
+    slots_[freeSlots_.back()].conn = conn;
+    freeSlots_.pop_back();
+  }
+}
+
+void TcpServer::ConnectionTable::remove(const TcpConnectionPtr& conn)
+{
+  uint32_t slot = slotOf(conn->id());
+  assert(shardOf(conn->id()) == shard_);
+  assert(slot < slots_.size() && slots_[slot].conn == conn);
+  slots_[slot].conn.reset();
+  if (++slots_[slot].generation == 0)
+  {
+    slots_[slot].generation = 1;
+  }
+  freeSlots_.push_back(slot);
+}
+
+TcpConnectionPtr TcpServer::ConnectionTable::find(uint64_t id) const
+{
+  uint32_t slot = slotOf(id);
+  if (shardOf(id) == shard_
+      && slot < slots_.size()
+      && slots_[slot].generation == static_cast<uint32_t>(id >> (kSlotBits + kShardBits)))
+  {
+    return slots_[slot].conn;
+  }
+  return TcpConnectionPtr();
+}
+
+void TcpServer::ConnectionTable::forEach(const ConnectionVisitor& visit) const
+{
+  // by index and by copy, for visit may close a connection, which frees its slot
+  for (size_t i = 0; i < slots_.size(); ++i)
+  {
+    if (slots_[i].conn)
+    {
+      TcpConnectionPtr conn(slots_[i].conn);
+      visit(conn);
+    }
+  }
+}
+
+void TcpServer::ConnectionTable::swap(std::vector<TcpConnectionPtr>* connections)
+{
+  for (size_t i = 0; i < slots_.size(); ++i)
+  {
+    if (slots_[i].conn)
+    {
+      connections->push_back(slots_[i].conn);
+    }
+  }
+  slots_.clear();
+  freeSlots_.clear();
+}
+
+TcpServer::Shard::Shard(EventLoop* loopArg, int index)
+  : loop(loopArg),
+    connections(index)
+{
+}
+
+TcpServer::Shard::~Shard()
 {
-  acceptor_->setNewConnectionCallback(
-      boost::bind(&TcpServer::newConnection, this, _1, _2));
 }
 
 TcpServer::~TcpServer()
@@ -43,15 +143,28 @@ TcpServer::~TcpServer()
   loop_->assertInLoopThread();
   LOG_TRACE << "TcpServer::~TcpServer [" << name_ << "] destructing";
 
-  for (ConnectionMap::iterator it(connections_.begin());
-      it != connections_.end(); ++it)
+  // an IO loop may be accepting or establishing right now,
+  // wait for each to let go of this
+  for (size_t i = 0; i < shards_.size(); ++i)
   {
-    TcpConnectionPtr conn = it->second;
-    it->second.reset();
-    conn->getLoop()->runInLoop(
-      boost::bind(&TcpConnection::connectDestroyed, conn));
-    conn.reset();
+    CountDownLatch latch(1);
+    shards_[i].loop->runInLoop(
+        boost::bind(&TcpServer::destroyShard, &shards_[i], &latch));
+    latch.wait();
+  }
+}
+
+void TcpServer::destroyShard(Shard* shard, CountDownLatch* latch)
+{
+  shard->loop->assertInLoopThread();
+  shard->acceptor.reset();
+  std::vector<TcpConnectionPtr> connections;
+  shard->connections.swap(&connections);
+  for (size_t i = 0; i < connections.size(); ++i)
+  {
+    connections[i]->connectDestroyed();
   }
+  latch->countDown();
 }
 
 void TcpServer::setThreadNum(int numThreads)
@@ -66,20 +179,102 @@ void TcpServer::start()
   {
     threadPool_->start(threadInitCallback_);
 
-    assert(!acceptor_->listenning());
-    loop_->runInLoop(
-        boost::bind(&Acceptor::listen, get_pointer(acceptor_)));
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+      shards_.push_back(new Shard(loops[i], static_cast<int>(i)));
+    }
+
+    if (option_ == kReusePortPerLoop)
+    {
+      // the kernel spreads incoming connections among the sockets
+      for (size_t i = 0; i < shards_.size(); ++i)
+      {
+        Shard* shard = &shards_[i];
+        shard->acceptor.reset(new Acceptor(shard->loop, listenAddr_, true));
+        shard->acceptor->setNewConnectionCallback(
+            boost::bind(&TcpServer::newConnectionInLoop, this, shard, _1, _2));
+      }
+      for (size_t i = 0; i < shards_.size(); ++i)
+      {
+        shards_[i].loop->runInLoop(
+            boost::bind(&Acceptor::listen, get_pointer(shards_[i].acceptor)));
+      }
+    }
+    else
+    {
+      assert(!acceptor_->listenning());
+      loop_->runInLoop(
+          boost::bind(&Acceptor::listen, get_pointer(acceptor_)));
+    }
+  }
+}
+
+void TcpServer::forEachConnection(const ConnectionVisitor& visit)
+{
+  for (size_t i = 0; i < shards_.size(); ++i)
+  {
+    shards_[i].loop->runInLoop(
+        boost::bind(&TcpServer::visitShard, &shards_[i], visit));
+  }
+}
+
+void TcpServer::visitShard(Shard* shard, const ConnectionVisitor& visit)
+{
+  shard->loop->assertInLoopThread();
+  shard->connections.forEach(visit);
+}
+
+void TcpServer::broadcast(const SharedPayload& payload)
+{
+  for (size_t i = 0; i < shards_.size(); ++i)
+  {
+    shards_[i].loop->runInLoop(
+        boost::bind(&TcpServer::broadcastInShard, &shards_[i], payload));
+  }
+}
+
+void TcpServer::broadcastInShard(Shard* shard, const SharedPayload& payload)
+{
+  shard->loop->assertInLoopThread();
+  shard->connections.forEach(
+      boost::bind(static_cast<void (TcpConnection::*)(const SharedPayload&)>(&TcpConnection::send),
+                  _1, payload));
+}
+
+TcpConnectionPtr TcpServer::findConnection(uint64_t id) const
+{
+  size_t shard = static_cast<size_t>(ConnectionTable::shardOf(id));
+  if (shard < shards_.size())
+  {
+    shards_[shard].loop->assertInLoopThread();
+    return shards_[shard].connections.find(id);
   }
+  return TcpConnectionPtr();
 }
 
 void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
 {
   loop_->assertInLoopThread();
-  EventLoop* ioLoop = threadPool_->getNextLoop();
-  char buf[64];
-  snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-  ++nextConnId_;
-  string connName = name_ + buf;
+  // round-robin, as EventLoopThreadPool::getNextLoop()
+  Shard* shard = &shards_[nextShard_];
+  if (++nextShard_ >= shards_.size())
+  {
+    nextShard_ = 0;
+  }
+  // the connection is created, kept and removed in its own loop
+  shard->loop->runInLoop(
+      boost::bind(&TcpServer::newConnectionInLoop, this, shard, sockfd, peerAddr));
+}
+
+void TcpServer::newConnectionInLoop(Shard* shard,
+                                    int sockfd,
+                                    const InetAddress& peerAddr)
+{
+  shard->loop->assertInLoopThread();
+  char buf[32];
+  string connName = connNamePrefix_;
+  connName.append(buf, formatNumber(buf, nextConnId_.getAndAdd(1)));
 
   LOG_INFO << "TcpServer::newConnection [" << name_
            << "] - new connection [" << connName
@@ -87,36 +282,27 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
   InetAddress localAddr(sockets::getLocalAddr(sockfd));
   // FIXME poll with zero timeout to double confirm the new connection
   // FIXME use make_shared if necessary
-  TcpConnectionPtr conn(new TcpConnection(ioLoop,
+  TcpConnectionPtr conn(new TcpConnection(shard->loop,
                                           connName,
                                           sockfd,
                                           localAddr,
-                                          peerAddr));
-  connections_[connName] = conn;
+                                          peerAddr,
+                                          shard->connections.nextId()));
   conn->setConnectionCallback(connectionCallback_);
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
+  shard->connections.add(conn);
   conn->setCloseCallback(
-      boost::bind(&TcpServer::removeConnection, this, _1)); // FIXME: unsafe
-  ioLoop->runInLoop(boost::bind(&TcpConnection::connectEstablished, conn));
+      boost::bind(&TcpServer::removeConnection, this, shard, _1)); // FIXME: unsafe
+  conn->connectEstablished();
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr& conn)
+void TcpServer::removeConnection(Shard* shard, const TcpConnectionPtr& conn)
 {
-  // FIXME: unsafe
-  loop_->runInLoop(boost::bind(&TcpServer::removeConnectionInLoop, this, conn));
-}
-
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn)
-{
-  loop_->assertInLoopThread();
-  LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_
+  shard->loop->assertInLoopThread();
+  LOG_INFO << "TcpServer::removeConnection [" << name_
            << "] - connection " << conn->name();
-  size_t n = connections_.erase(conn->name());
-  (void)n;
-  assert(n == 1);
-  EventLoop* ioLoop = conn->getLoop();
-  ioLoop->queueInLoop(
+  shard->connections.remove(conn);
+  shard->loop->queueInLoop(
       boost::bind(&TcpConnection::connectDestroyed, conn));
 }
-
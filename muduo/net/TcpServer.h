@@ -16,12 +16,17 @@
 #include <muduo/net/TcpConnection.h>
 
 #include <map>
+#include <vector>
 #include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 namespace muduo
 {
+
+class CountDownLatch;
+
 namespace net
 {
 
@@ -37,10 +42,14 @@ class TcpServer : boost::noncopyable
 {
  public:
   typedef boost::function<void(EventLoop*)> ThreadInitCallback;
+  typedef boost::function<void(const TcpConnectionPtr&)> ConnectionVisitor;
   enum Option
   {
     kNoReusePort,
     kReusePort,
+    /// Every IO loop listens on its own SO_REUSEPORT socket and keeps
+    /// the connections it accepts, no connection crosses threads.
+    kReusePortPerLoop,
   };
 
   //TcpServer(EventLoop* loop, const InetAddress& listenAddr);
@@ -56,7 +65,8 @@ class TcpServer : boost::noncopyable
 
   /// Set the number of threads for handling input.
   ///
-  /// Always accepts new connection in loop's thread.
+  /// Always accepts new connection in loop's thread,
+  /// or in each IO thread with @c kReusePortPerLoop.
   /// Must be called before @c start
   /// @param numThreads
   /// - 0 means all I/O in loop's thread, no thread will created.
@@ -92,29 +102,100 @@ class TcpServer : boost::noncopyable
   void setWriteCompleteCallback(const WriteCompleteCallback& cb)
   { writeCompleteCallback_ = cb; }
 
+  /// Calls @c visit with every connection, in the loop of the connection,
+  /// with one post to each IO loop.
+  /// Thread safe, valid after calling start().
+  void forEachConnection(const ConnectionVisitor& visit);
+
+  /// Sends @c payload to every connection, with one post to each IO loop.
+  /// Thread safe, valid after calling start().
+  void broadcast(const SharedPayload& payload);
+
+  /// Returns the connection of @c id, or an empty pointer if it's gone.
+  /// Not thread safe, but in the loop of the connection.
+  ///
+  /// An id names a slot of its IO loop and a 32-bit generation of it,
+  /// bumped when the slot is freed.  A stale id can only find another
+  /// connection after its slot has been reused 2^32 times, e.g. after
+  /// 12 hours of 100k short connections per second all landing in it.
+  TcpConnectionPtr findConnection(uint64_t id) const;
+
  private:
+  /// Connections by id, which names a slot and a use of it.
+  /// Taking and freeing a slot is O(1), no string is involved.
+  class ConnectionTable : boost::noncopyable
+  {
+   public:
+    explicit ConnectionTable(int shard);
+
+    /// The id add() gives to the next connection.
+    uint64_t nextId() const;
+    void add(const TcpConnectionPtr& conn);
+    void remove(const TcpConnectionPtr& conn);
+    TcpConnectionPtr find(uint64_t id) const;
+    void forEach(const ConnectionVisitor& visit) const;
+    void swap(std::vector<TcpConnectionPtr>* connections);
+
+    // generation:32 | slot:22 | shard:10
+    const static int kShardBits = 10;
+    const static int kSlotBits = 22;
+
+    static int shardOf(uint64_t id)
+    { return static_cast<int>(id & ((1 << kShardBits) - 1)); }
+    static uint32_t slotOf(uint64_t id)
+    { return static_cast<uint32_t>(id >> kShardBits) & ((1U << kSlotBits) - 1); }
+
+   private:
+    struct Slot
+    {
+      Slot() : generation(1) { }
+      TcpConnectionPtr conn;
+      uint32_t generation;  // never 0, nor is an id
+    };
+
+    const int shard_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> freeSlots_;
+  };
+
+  /// The connections of one IO loop, and its listening socket for
+  /// kReusePortPerLoop.  Touched only in that loop.
+  struct Shard : boost::noncopyable
+  {
+    Shard(EventLoop* loopArg, int index);
+    ~Shard();  // out-line, for scoped_ptr members.
+
+    EventLoop* loop;
+    boost::scoped_ptr<Acceptor> acceptor;
+    ConnectionTable connections;
+  };
+
   /// Not thread safe, but in loop
   void newConnection(int sockfd, const InetAddress& peerAddr);
-  /// Thread safe.
-  void removeConnection(const TcpConnectionPtr& conn);
-  /// Not thread safe, but in loop
-  void removeConnectionInLoop(const TcpConnectionPtr& conn);
-
-  typedef std::map<string, TcpConnectionPtr> ConnectionMap;
+  /// Not thread safe, but in the loop of the shard
+  void newConnectionInLoop(Shard* shard, int sockfd, const InetAddress& peerAddr);
+  /// Not thread safe, but in the loop of the shard
+  void removeConnection(Shard* shard, const TcpConnectionPtr& conn);
+  static void visitShard(Shard* shard, const ConnectionVisitor& visit);
+  static void broadcastInShard(Shard* shard, const SharedPayload& payload);
+  static void destroyShard(Shard* shard, CountDownLatch* latch);
 
   EventLoop* loop_;  // the acceptor loop
   const string ipPort_;
   const string name_;
-  boost::scoped_ptr<Acceptor> acceptor_; // avoid revealing Acceptor
+  const InetAddress listenAddr_;
+  const Option option_;
+  const string connNamePrefix_;  // "name-ip:port#"
+  boost::scoped_ptr<Acceptor> acceptor_; // avoid revealing Acceptor, NULL if kReusePortPerLoop
+  boost::ptr_vector<Shard> shards_;  // one for each IO loop, after start()
+  size_t nextShard_;  // always in loop thread
   boost::shared_ptr<EventLoopThreadPool> threadPool_;
   ConnectionCallback connectionCallback_;
   MessageCallback messageCallback_;
   WriteCompleteCallback writeCompleteCallback_;
   ThreadInitCallback threadInitCallback_;
   AtomicInt32 started_;
-  // always in loop thread
-  int nextConnId_;
-  ConnectionMap connections_;
+  AtomicInt32 nextConnId_;
 };
 
 }
@@ -32,7 +32,11 @@ class Timer : boost::noncopyable
       expiration_(when),
       interval_(interval),
       repeat_(interval > 0.0),
-      sequence_(s_numCreated_.incrementAndGet())
+      sequence_(s_numCreated_.incrementAndGet()),
+      wheelPrev_(NULL),
+      wheelNext_(NULL),
+      wheelTick_(0),
+      wheelSlot_(-1)
   { }
 
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
@@ -41,7 +45,11 @@ class Timer : boost::noncopyable
       expiration_(when),
       interval_(interval),
       repeat_(interval > 0.0),
-      sequence_(s_numCreated_.incrementAndGet())
+      sequence_(s_numCreated_.incrementAndGet()),
+      wheelPrev_(NULL),
+      wheelNext_(NULL),
+      wheelTick_(0),
+      wheelSlot_(-1)
   { }
 #endif
 
@@ -56,14 +64,55 @@ class Timer : boost::noncopyable
 
   void restart(Timestamp now);
 
+  /// Reinitializes a recycled timer with a fresh sequence,
+  /// so that stale TimerIds of its previous life never match.
+  void reuse(const TimerCallback& cb, Timestamp when, double interval)
+  {
+    callback_ = cb;
+    renew(when, interval);
+  }
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  void reuse(TimerCallback&& cb, Timestamp when, double interval)
+  {
+    callback_ = std::move(cb);
+    renew(when, interval);
+  }
+#endif
+
+  /// Drops the callback and its bound objects before the timer
+  /// goes back to the free list of TimerQueue.
+  void recycle()
+  {
+    callback_ = TimerCallback();
+    expiration_ = Timestamp::invalid();
+    sequence_ = 0;
+  }
+
   static int64_t numCreated() { return s_numCreated_.get(); }
 
  private:
-  const TimerCallback callback_;
+  friend class TimingWheel;
+
+  void renew(Timestamp when, double interval)
+  {
+    expiration_ = when;
+    interval_ = interval;
+    repeat_ = interval > 0.0;
+    sequence_ = s_numCreated_.incrementAndGet();
+  }
+
+  TimerCallback callback_;
   Timestamp expiration_;
-  const double interval_;
-  const bool repeat_;
-  const int64_t sequence_;
+  double interval_;
+  bool repeat_;
+  int64_t sequence_;
+
+  // intrusive links, owned by TimingWheel
+  Timer* wheelPrev_;
+  Timer* wheelNext_;
+  int64_t wheelTick_;
+  int wheelSlot_;
 
   static AtomicInt64 s_numCreated_;
 };
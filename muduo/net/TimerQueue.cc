@@ -16,9 +16,11 @@
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/Timer.h>
 #include <muduo/net/TimerId.h>
+#include <muduo/net/TimingWheel.h>
 
 #include <boost/bind.hpp>
 
+#include <stdlib.h>
 #include <sys/timerfd.h>
 
 namespace muduo
@@ -28,6 +30,10 @@ namespace net
 namespace detail
 {
 
+// stale TimerIds are looked up in activeTimers_ or liveTimers_,
+// never dereferenced, so cached timers can be bounded.
+const size_t kMaxFreeTimers = 65536;
+
 int createTimerfd()
 {
   int timerfd = ::timerfd_create(CLOCK_MONOTONIC,
@@ -94,7 +100,8 @@ TimerQueue::TimerQueue(EventLoop* loop)
     timerfd_(createTimerfd()),
     timerfdChannel_(loop, timerfd_),
     timers_(),
-    callingExpiredTimers_(false)
+    callingExpiredTimers_(false),
+    wheel_(::getenv("MUDUO_USE_TIMING_WHEEL") ? new TimingWheel : NULL)
 {
   timerfdChannel_.setReadCallback(
       boost::bind(&TimerQueue::handleRead, this));
@@ -113,13 +120,26 @@ TimerQueue::~TimerQueue()
   {
     delete it->second;
   }
+  if (wheel_)
+  {
+    std::vector<Timer*> timers;
+    wheel_->takeAll(&timers);
+    for (size_t i = 0; i < timers.size(); ++i)
+    {
+      delete timers[i];
+    }
+  }
+  for (size_t i = 0; i < freeTimers_.size(); ++i)
+  {
+    delete freeTimers_[i];
+  }
 }
 
 TimerId TimerQueue::addTimer(const TimerCallback& cb,
                              Timestamp when,
                              double interval)
 {
-  Timer* timer = new Timer(cb, when, interval);
+  Timer* timer = newTimer(cb, when, interval);
   loop_->runInLoop(
       boost::bind(&TimerQueue::addTimerInLoop, this, timer));
   return TimerId(timer, timer->sequence());
@@ -130,7 +150,7 @@ TimerId TimerQueue::addTimer(TimerCallback&& cb,
                              Timestamp when,
                              double interval)
 {
-  Timer* timer = new Timer(std::move(cb), when, interval);
+  Timer* timer = newTimer(std::move(cb), when, interval);
   loop_->runInLoop(
       boost::bind(&TimerQueue::addTimerInLoop, this, timer));
   return TimerId(timer, timer->sequence());
@@ -150,7 +170,7 @@ void TimerQueue::addTimerInLoop(Timer* timer)
 
   if (earliestChanged)
   {
-    resetTimerfd(timerfd_, timer->expiration());
+    resetTimerfd(timerfd_, wheel_ ? wheel_->nextExpiration() : timer->expiration());
   }
 }
 
@@ -159,12 +179,31 @@ void TimerQueue::cancelInLoop(TimerId timerId)
   loop_->assertInLoopThread();
   assert(timers_.size() == activeTimers_.size());
   ActiveTimer timer(timerId.timer_, timerId.sequence_);
+  if (wheel_)
+  {
+    // recycled timers have new sequences, so stale ids do not match
+    LiveTimerMap::iterator it = liveTimers_.find(timer.second);
+    if (it != liveTimers_.end() && it->second == timer.first)
+    {
+      if (wheel_->contains(timer.first))
+      {
+        wheel_->remove(timer.first);
+        deleteTimer(timer.first);
+      }
+      else if (callingExpiredTimers_)
+      {
+        cancelingTimers_.insert(timer);
+      }
+    }
+    return;
+  }
+
   ActiveTimerSet::iterator it = activeTimers_.find(timer);
   if (it != activeTimers_.end())
   {
     size_t n = timers_.erase(Entry(it->first->expiration(), it->first));
     assert(n == 1); (void)n;
-    delete it->first; // FIXME: no delete please
+    deleteTimer(it->first);
     activeTimers_.erase(it);
   }
   else if (callingExpiredTimers_)
@@ -199,6 +238,18 @@ std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
 {
   assert(timers_.size() == activeTimers_.size());
   std::vector<Entry> expired;
+  if (wheel_)
+  {
+    std::vector<Timer*> timers;
+    wheel_->getExpired(now, &timers);
+    expired.reserve(timers.size());
+    for (size_t i = 0; i < timers.size(); ++i)
+    {
+      expired.push_back(Entry(timers[i]->expiration(), timers[i]));
+    }
+    return expired;
+  }
+
   Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
   TimerList::iterator end = timers_.lower_bound(sentry);
   assert(end == timers_.end() || now < end->first);
@@ -233,12 +284,15 @@ void TimerQueue::reset(const std::vector<Entry>& expired, Timestamp now)
     }
     else
     {
-      // FIXME move to a free list
-      delete it->second; // FIXME: no delete please
+      deleteTimer(it->second);
     }
   }
 
-  if (!timers_.empty())
+  if (wheel_)
+  {
+    nextExpire = wheel_->nextExpiration();
+  }
+  else if (!timers_.empty())
   {
     nextExpire = timers_.begin()->second->expiration();
   }
@@ -252,6 +306,11 @@ void TimerQueue::reset(const std::vector<Entry>& expired, Timestamp now)
 bool TimerQueue::insert(Timer* timer)
 {
   loop_->assertInLoopThread();
+  if (wheel_)
+  {
+    liveTimers_[timer->sequence()] = timer;
+    return wheel_->insert(timer);
+  }
   assert(timers_.size() == activeTimers_.size());
   bool earliestChanged = false;
   Timestamp when = timer->expiration();
@@ -275,3 +334,48 @@ bool TimerQueue::insert(Timer* timer)
   return earliestChanged;
 }
 
+Timer* TimerQueue::newTimer(const TimerCallback& cb, Timestamp when, double interval)
+{
+  // only the loop thread touches freeTimers_
+  if (loop_->isInLoopThread() && !freeTimers_.empty())
+  {
+    Timer* timer = freeTimers_.back();
+    freeTimers_.pop_back();
+    timer->reuse(cb, when, interval);
+    return timer;
+  }
+  return new Timer(cb, when, interval);
+}
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+Timer* TimerQueue::newTimer(TimerCallback&& cb, Timestamp when, double interval)
+{
+  if (loop_->isInLoopThread() && !freeTimers_.empty())
+  {
+    Timer* timer = freeTimers_.back();
+    freeTimers_.pop_back();
+    timer->reuse(std::move(cb), when, interval);
+    return timer;
+  }
+  return new Timer(std::move(cb), when, interval);
+}
+#endif
+
+void TimerQueue::deleteTimer(Timer* timer)
+{
+  loop_->assertInLoopThread();
+  if (wheel_)
+  {
+    size_t n = liveTimers_.erase(timer->sequence());
+    assert(n == 1); (void)n;
+  }
+  if (freeTimers_.size() < kMaxFreeTimers)
+  {
+    timer->recycle();
+    freeTimers_.push_back(timer);
+  }
+  else
+  {
+    delete timer;
+  }
+}
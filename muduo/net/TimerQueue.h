@@ -15,6 +15,8 @@
 #include <vector>
 
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <muduo/base/Mutex.h>
 #include <muduo/base/Timestamp.h>
@@ -29,11 +31,16 @@ namespace net
 class EventLoop;
 class Timer;
 class TimerId;
+class TimingWheel;
 
 ///
 /// A best efforts timer queue.
 /// No guarantee that the callback will be on time.
 ///
+/// Timers are kept in a std::set ordered by expiration, or in a TimingWheel
+/// if MUDUO_USE_TIMING_WHEEL is set in the environment.
+/// Timers added in the loop thread are recycled through a free list.
+///
 class TimerQueue : boost::noncopyable
 {
  public:
@@ -63,6 +70,7 @@ class TimerQueue : boost::noncopyable
   typedef std::set<Entry> TimerList;
   typedef std::pair<Timer*, int64_t> ActiveTimer;
   typedef std::set<ActiveTimer> ActiveTimerSet;
+  typedef boost::unordered_map<int64_t, Timer*> LiveTimerMap;
 
   void addTimerInLoop(Timer* timer);
   void cancelInLoop(TimerId timerId);
@@ -74,6 +82,12 @@ class TimerQueue : boost::noncopyable
 
   bool insert(Timer* timer);
 
+  Timer* newTimer(const TimerCallback& cb, Timestamp when, double interval);
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  Timer* newTimer(TimerCallback&& cb, Timestamp when, double interval);
+#endif
+  void deleteTimer(Timer* timer);
+
   EventLoop* loop_;
   const int timerfd_;
   Channel timerfdChannel_;
@@ -84,6 +98,12 @@ class TimerQueue : boost::noncopyable
   ActiveTimerSet activeTimers_;
   bool callingExpiredTimers_; /* atomic */
   ActiveTimerSet cancelingTimers_;
+
+  // replaces timers_ and activeTimers_ if not null
+  boost::scoped_ptr<TimingWheel> wheel_;
+  // by sequence, for cancel() in wheel mode, from insert() to deleteTimer()
+  LiveTimerMap liveTimers_;
+  std::vector<Timer*> freeTimers_;
 };
 
 }
@@ -0,0 +1,299 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/net/TimingWheel.h>
+
+#include <muduo/net/Timer.h>
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+const int64_t kNoTick = static_cast<int64_t>(~static_cast<uint64_t>(0) >> 1);
+}
+
+TimingWheel::TimingWheel()
+  : currentTick_(0),
+    earliestTick_(kNoTick),
+    size_(0)
+{
+  bzero(slots_, sizeof slots_);
+  bzero(bitmap_, sizeof bitmap_);
+}
+
+TimingWheel::~TimingWheel()
+{
+}
+
+int64_t TimingWheel::toTick(Timestamp when)
+{
+  // round up, so that a timer never runs before its expiration
+  int64_t us = when.microSecondsSinceEpoch();
+  return us > 0 ? (us + kTickUs - 1) / kTickUs : 0;
+}
+
+bool TimingWheel::insert(Timer* timer)
+{
+  assert(!contains(timer));
+  if (size_ == 0)
+  {
+    // nothing to process in between, skip the idle ticks
+    currentTick_ = std::max(currentTick_,
+        Timestamp::now().microSecondsSinceEpoch() / kTickUs);
+  }
+  timer->wheelTick_ = toTick(timer->expiration());
+  place(timer);
+
+  int64_t tick = std::max(timer->wheelTick_, currentTick_);
+  if (tick < earliestTick_)
+  {
+    earliestTick_ = tick;
+    return true;
+  }
+  return false;
+}
+
+void TimingWheel::remove(Timer* timer)
+{
+  assert(contains(timer));
+  // earliestTick_ stays as a lower bound, costing one spurious wakeup at most
+  unlink(timer);
+}
+
+bool TimingWheel::contains(const Timer* timer) const
+{
+  return timer->wheelSlot_ >= 0;
+}
+
+void TimingWheel::getExpired(Timestamp now, std::vector<Timer*>* expired)
+{
+  const int64_t nowTick = now.microSecondsSinceEpoch() / kTickUs;
+  std::vector<Timer*> later;
+  while (currentTick_ <= nowTick && size_ > 0)
+  {
+    int index = static_cast<int>(currentTick_ & kSlotMask);
+    if (index == 0)
+    {
+      cascade();
+    }
+    const int64_t blockStart = currentTick_ - index;
+    int slot = findSlot(0, index, false);
+    if (slot < 0)
+    {
+      currentTick_ = std::min(blockStart + kSlots, nowTick + 1);
+      continue;
+    }
+
+    const int64_t tick = blockStart + slot;
+    if (tick > nowTick)
+    {
+      break;
+    }
+    while (Timer* timer = slots_[0][slot])
+    {
+      unlink(timer);
+      // only timers beyond the range of the wheel come here early
+      if (timer->wheelTick_ > tick)
+      {
+        later.push_back(timer);
+      }
+      else
+      {
+        expired->push_back(timer);
+      }
+    }
+    currentTick_ = tick + 1;
+  }
+  currentTick_ = std::max(currentTick_, nowTick + 1);
+
+  for (size_t i = 0; i < later.size(); ++i)
+  {
+    place(later[i]);
+  }
+  updateEarliest();
+}
+
+Timestamp TimingWheel::nextExpiration() const
+{
+  return earliestTick_ == kNoTick ? Timestamp::invalid()
+                                  : Timestamp(earliestTick_ * kTickUs);
+}
+
+void TimingWheel::takeAll(std::vector<Timer*>* timers)
+{
+  for (int level = 0; level < kLevels; ++level)
+  {
+    for (int slot = 0; slot < kSlots; ++slot)
+    {
+      while (Timer* timer = slots_[level][slot])
+      {
+        unlink(timer);
+        timers->push_back(timer);
+      }
+    }
+  }
+  assert(size_ == 0);
+  earliestTick_ = kNoTick;
+}
+
+void TimingWheel::place(Timer* timer)
+{
+  const int64_t kRange = static_cast<int64_t>(1) << (kLevels * kSlotBits);
+  int64_t tick = std::max(timer->wheelTick_, currentTick_);
+  int64_t delta = tick - currentTick_;
+  if (delta >= kRange)
+  {
+    // re-queued when it reaches level 0
+    delta = kRange - 1;
+    tick = currentTick_ + delta;
+  }
+
+  int level = 0;
+  while (level < kLevels - 1
+         && delta >= (static_cast<int64_t>(1) << (kSlotBits * (level + 1))))
+  {
+    ++level;
+  }
+  int slot = static_cast<int>((tick >> (kSlotBits * level)) & kSlotMask);
+  link(timer, level, slot);
+}
+
+void TimingWheel::link(Timer* timer, int level, int slot)
+{
+  Timer*& head = slots_[level][slot];
+  timer->wheelPrev_ = NULL;
+  timer->wheelNext_ = head;
+  if (head)
+  {
+    head->wheelPrev_ = timer;
+  }
+  head = timer;
+  timer->wheelSlot_ = level * kSlots + slot;
+  bitmap_[level][slot >> 6] |= static_cast<uint64_t>(1) << (slot & 63);
+  ++size_;
+}
+
+void TimingWheel::unlink(Timer* timer)
+{
+  assert(contains(timer));
+  int level = timer->wheelSlot_ / kSlots;
+  int slot = timer->wheelSlot_ % kSlots;
+  if (timer->wheelPrev_)
+  {
+    timer->wheelPrev_->wheelNext_ = timer->wheelNext_;
+  }
+  else
+  {
+    assert(slots_[level][slot] == timer);
+    slots_[level][slot] = timer->wheelNext_;
+    if (timer->wheelNext_ == NULL)
+    {
+      bitmap_[level][slot >> 6] &= ~(static_cast<uint64_t>(1) << (slot & 63));
+    }
+  }
+  if (timer->wheelNext_)
+  {
+    timer->wheelNext_->wheelPrev_ = timer->wheelPrev_;
+  }
+  timer->wheelPrev_ = NULL;
+  timer->wheelNext_ = NULL;
+  timer->wheelSlot_ = -1;
+  --size_;
+}
+
+// level 0 wrapped around, redistribute the due slots of upper levels
+void TimingWheel::cascade()
+{
+  assert((currentTick_ & kSlotMask) == 0);
+  for (int level = 1; level < kLevels; ++level)
+  {
+    int slot = static_cast<int>((currentTick_ >> (kSlotBits * level)) & kSlotMask);
+    Timer* timer = slots_[level][slot];
+    while (timer)
+    {
+      Timer* next = timer->wheelNext_;
+      unlink(timer);
+      place(timer);
+      timer = next;
+    }
+    if (slot != 0)
+    {
+      break;
+    }
+  }
+}
+
+// first non-empty slot at or after start, then before start if wrap
+int TimingWheel::findSlot(int level, int start, bool wrap) const
+{
+  const uint64_t kAll = ~static_cast<uint64_t>(0);
+  const int startWord = start >> 6;
+  uint64_t bits = bitmap_[level][startWord] & (kAll << (start & 63));
+  for (int word = startWord; ; )
+  {
+    if (bits)
+    {
+      return (word << 6) | __builtin_ctzll(bits);
+    }
+    if (++word == kBitmapWords)
+    {
+      break;
+    }
+    bits = bitmap_[level][word];
+  }
+
+  if (wrap)
+  {
+    for (int word = 0; word <= startWord; ++word)
+    {
+      bits = bitmap_[level][word];
+      if (word == startWord)
+      {
+        bits &= ~(kAll << (start & 63));
+      }
+      if (bits)
+      {
+        return (word << 6) | __builtin_ctzll(bits);
+      }
+    }
+  }
+  return -1;
+}
+
+void TimingWheel::updateEarliest()
+{
+  int64_t earliest = kNoTick;
+  if (size_ > 0)
+  {
+    // level 0 holds exact ticks
+    int index = static_cast<int>(currentTick_ & kSlotMask);
+    int slot = findSlot(0, index, true);
+    if (slot >= 0)
+    {
+      earliest = currentTick_ + ((slot - index) & kSlotMask);
+    }
+
+    // upper levels need to cascade at the start of their slots
+    for (int level = 1; level < kLevels; ++level)
+    {
+      const int shift = kSlotBits * level;
+      const int64_t base = currentTick_ >> shift;
+      const int64_t first =
+        (currentTick_ & ((static_cast<int64_t>(1) << shift) - 1)) == 0 ? base : base + 1;
+      const int start = static_cast<int>(first & kSlotMask);
+      slot = findSlot(level, start, true);
+      if (slot >= 0)
+      {
+        int64_t tick = (first + ((slot - start) & kSlotMask)) << shift;
+        earliest = std::min(earliest, tick);
+      }
+    }
+  }
+  earliestTick_ = earliest;
+}
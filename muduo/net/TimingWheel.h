@@ -0,0 +1,86 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_TIMINGWHEEL_H
+#define MUDUO_NET_TIMINGWHEEL_H
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <muduo/base/Timestamp.h>
+
+#include <stdint.h>
+
+namespace muduo
+{
+namespace net
+{
+
+class Timer;
+
+///
+/// Hierarchical timing wheel of 1ms ticks, 4 levels of 256 slots,
+/// covering 2^32 ticks (49.7 days), farther timers are re-queued.
+///
+/// Insert and remove are O(1) on intrusive lists in Timer.
+/// Timers of level 1..3 cascade down when the lower level wraps around.
+/// A timer never expires before its expiration, but may be up to 1ms late.
+///
+/// It does not own the timers.
+///
+class TimingWheel : boost::noncopyable
+{
+ public:
+  TimingWheel();
+  ~TimingWheel();
+
+  /// Returns true if the earliest wakeup time becomes earlier.
+  bool insert(Timer* timer);
+  void remove(Timer* timer);
+  bool contains(const Timer* timer) const;
+
+  /// Moves out all timers expired at @c now.
+  void getExpired(Timestamp now, std::vector<Timer*>* expired);
+
+  /// When the wheel needs to advance next, never later than the earliest
+  /// expiration. Invalid if empty.
+  Timestamp nextExpiration() const;
+
+  /// Moves out all timers, for destruction.
+  void takeAll(std::vector<Timer*>* timers);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  static const int kLevels = 4;
+  static const int kSlotBits = 8;
+  static const int kSlots = 1 << kSlotBits;
+  static const int kSlotMask = kSlots - 1;
+  static const int kBitmapWords = kSlots / 64;
+  static const int64_t kTickUs = 1000;
+
+  static int64_t toTick(Timestamp when);
+
+  void place(Timer* timer);
+  void link(Timer* timer, int level, int slot);
+  void unlink(Timer* timer);
+  void cascade();
+  int findSlot(int level, int start, bool wrap) const;
+  void updateEarliest();
+
+  Timer* slots_[kLevels][kSlots];
+  uint64_t bitmap_[kLevels][kBitmapWords];
+  // all ticks before it have been processed
+  int64_t currentTick_;
+  // lower bound of the earliest tick to process
+  int64_t earliestTick_;
+  size_t size_;
+};
+
+}
+}
+#endif  // MUDUO_NET_TIMINGWHEEL_H
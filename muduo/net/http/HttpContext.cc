@@ -10,9 +10,122 @@
 #include <muduo/net/Buffer.h>
 #include <muduo/net/http/HttpContext.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include <ctype.h>
+#include <string.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
+const size_t HttpContext::kMaxHeaderBytes;
+const size_t HttpContext::kMaxBodyBytes;
+
+namespace
+{
+
+// Returns the first control character other than HTAB in [p, end),
+// or end if none.  In a well-formed header block that is the CR of CRLF,
+// anything else is a bad request.
+const char* findControl(const char* p, const char* end)
+{
+#if defined(__AVX2__)
+  const __m256i kMaxControl = _mm256_set1_epi8(0x1f);
+  const __m256i kTab = _mm256_set1_epi8('\t');
+  const __m256i kDel = _mm256_set1_epi8(0x7f);
+  for (; end - p >= 32; p += 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, kMaxControl), v);
+    control = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, kTab), control);
+    control = _mm256_or_si256(control, _mm256_cmpeq_epi8(v, kDel));
+    int mask = _mm256_movemask_epi8(control);
+    if (mask != 0)
+    {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE4_2__)
+  // 0x00-0x08, 0x0a-0x1f and 0x7f, in pairs of inclusive ranges
+  static const char kRanges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+  const __m128i ranges = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kRanges));
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int index = _mm_cmpestri(ranges, 6, v, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+    if (index != 16)
+    {
+      return p + index;
+    }
+  }
+#endif
+  for (; p < end; ++p)
+  {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if ((c < 0x20 && c != '\t') || c == 0x7f)
+    {
+      break;
+    }
+  }
+  return p;
+}
+
+// Returns one past the CRLFCRLF ending the headers, NULL if not yet received.
+const char* findHeaderEnd(const char* p, const char* end)
+{
+  while (end - p >= 4)
+  {
+    const char* cr = static_cast<const char*>(memchr(p, '\r', end - p - 3));
+    if (cr == NULL)
+    {
+      break;
+    }
+    if (cr[1] == '\n' && cr[2] == '\r' && cr[3] == '\n')
+    {
+      return cr + 4;
+    }
+    p = cr + 1;
+  }
+  return NULL;
+}
+
+bool isCRLF(const char* p)
+{
+  return p[0] == '\r' && p[1] == '\n';
+}
+
+bool equalsIgnoreCase(const StringPiece& s, const char* lower)
+{
+  size_t len = strlen(lower);
+  return static_cast<size_t>(s.size()) == len && ::strncasecmp(s.data(), lower, len) == 0;
+}
+
+// Content-Length is a plain decimal, anything else is rejected.
+bool parseLength(const StringPiece& s, size_t* length)
+{
+  size_t n = 0;
+  for (int i = 0; i < s.size(); ++i)
+  {
+    if (s[i] < '0' || s[i] > '9' || n > (static_cast<size_t>(-1) - 9) / 10)
+    {
+      return false;
+    }
+    n = n * 10 + (s[i] - '0');
+  }
+  *length = n;
+  return !s.empty();
+}
+
+// A chunk line does not need to be long, beyond this it is an attack.
+const size_t kMaxChunkLine = 1024;
+
+}
+
 bool HttpContext::processRequestLine(const char* begin, const char* end)
 {
   bool succeed = false;
@@ -56,63 +169,199 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
   return succeed;
 }
 
+// [begin, end) is the whole header block, including the empty line.
+bool HttpContext::processHeaders(const char* begin, const char* end)
+{
+  const char* crlf = findControl(begin, end);
+  bool ok = isCRLF(crlf) && processRequestLine(begin, crlf);
+  const char* line = crlf + 2;
+  while (ok && line < end - 2)
+  {
+    crlf = findControl(line, end);
+    const char* colon = static_cast<const char*>(memchr(line, ':', crlf - line));
+    ok = isCRLF(crlf) && colon != NULL && colon != line;
+    if (ok)
+    {
+      request_.addHeader(line, colon, crlf);
+      line = crlf + 2;
+    }
+  }
+  return ok;
+}
+
 // return false if any error
 bool HttpContext::parseRequest(Buffer* buf, Timestamp receiveTime)
 {
   bool ok = true;
-  bool hasMore = true;
-  while (hasMore)
+  if (state_ == kExpectRequestLine)
   {
-    if (state_ == kExpectRequestLine)
+    const char* begin = buf->peek();
+    const char* end = begin + buf->readableBytes();
+    // the terminator may straddle what was searched before
+    const char* headerEnd = findHeaderEnd(begin + (scanned_ > 3 ? scanned_ - 3 : 0), end);
+    if (headerEnd == NULL)
     {
-      const char* crlf = buf->findCRLF();
-      if (crlf)
-      {
-        ok = processRequestLine(buf->peek(), crlf);
-        if (ok)
-        {
-          request_.setReceiveTime(receiveTime);
-          buf->retrieveUntil(crlf + 2);
-          state_ = kExpectHeaders;
-        }
-        else
-        {
-          hasMore = false;
-        }
-      }
-      else
-      {
-        hasMore = false;
-      }
+      scanned_ = buf->readableBytes();
+      return scanned_ <= kMaxHeaderBytes;
     }
-    else if (state_ == kExpectHeaders)
+
+    size_t headerBytes = headerEnd - begin;
+    ok = headerBytes <= kMaxHeaderBytes && processHeaders(begin, headerEnd);
+    if (ok)
     {
-      const char* crlf = buf->findCRLF();
-      if (crlf)
+      request_.setReceiveTime(receiveTime);
+      ok = startBody(buf, headerBytes);
+    }
+  }
+  if (ok && state_ == kExpectBody)
+  {
+    ok = processBody(buf);
+  }
+  return ok;
+}
+
+bool HttpContext::startBody(Buffer* buf, size_t headerBytes)
+{
+  StringPiece transferEncoding = request_.header("Transfer-Encoding");
+  StringPiece contentLength = request_.header("Content-Length");
+  size_t length = 0;
+  if (!transferEncoding.empty())
+  {
+    // with both, the framing is ambiguous, a way to smuggle requests
+    if (!equalsIgnoreCase(transferEncoding, "chunked") || !contentLength.empty())
+    {
+      return false;
+    }
+    chunked_ = true;
+  }
+  else if (!contentLength.empty() && !parseLength(contentLength, &length))
+  {
+    return false;
+  }
+
+  if (!chunked_ && (length == 0
+                    || (!bodyCallback_ && buf->readableBytes() - headerBytes >= length)))
+  {
+    // all here, stays in place
+    const char* body = buf->peek() + headerBytes;
+    request_.setBody(body, body + length);
+    requestBytes_ = headerBytes + length;
+    state_ = kGotAll;
+    return true;
+  }
+  if (!bodyCallback_ && length > kMaxBodyBytes)
+  {
+    return false;
+  }
+
+  // the body is retrieved as it comes, so move the headers out of the way
+  Timestamp receiveTime = request_.receiveTime();
+  headerBlock_.assign(buf->peek(), headerBytes);
+  buf->retrieve(headerBytes);
+  request_.clear();
+  bool ok = processHeaders(headerBlock_.data(), headerBlock_.data() + headerBlock_.size());
+  assert(ok); (void)ok;
+  request_.setReceiveTime(receiveTime);
+  bodyRemaining_ = length;
+  state_ = kExpectBody;
+  return true;
+}
+
+bool HttpContext::processBody(Buffer* buf)
+{
+  bool ok = true;
+  while (ok && state_ == kExpectBody && buf->readableBytes() > 0)
+  {
+    if (!chunked_ || chunkState_ == kChunkData)
+    {
+      size_t n = std::min(buf->readableBytes(), bodyRemaining_);
+      ok = appendBody(StringPiece(buf->peek(), static_cast<int>(n)));
+      buf->retrieve(n);
+      bodyRemaining_ -= n;
+      if (bodyRemaining_ == 0)
       {
-        const char* colon = std::find(buf->peek(), crlf, ':');
-        if (colon != crlf)
+        if (chunked_)
         {
-          request_.addHeader(buf->peek(), colon, crlf);
+          chunkState_ = kChunkDataEnd;
         }
         else
         {
-          // empty line, end of header
-          // FIXME:
           state_ = kGotAll;
-          hasMore = false;
         }
-        buf->retrieveUntil(crlf + 2);
       }
-      else
+    }
+    else
+    {
+      const char* crlf = buf->findCRLF();
+      if (crlf == NULL)
       {
-        hasMore = false;
+        ok = buf->readableBytes() <= kMaxChunkLine;
+        break;
       }
+      ok = processChunkLine(buf->peek(), crlf);
+      buf->retrieveUntil(crlf + 2);
     }
-    else if (state_ == kExpectBody)
+  }
+  return ok;
+}
+
+// the line before a chunk, after its data, or of the trailer
+bool HttpContext::processChunkLine(const char* begin, const char* end)
+{
+  bool ok = true;
+  if (chunkState_ == kChunkSize)
+  {
+    // hex size, then maybe extensions after ';', which are ignored
+    const size_t kMaxChunkSize = static_cast<size_t>(-1) >> 4;
+    size_t size = 0;
+    const char* p = begin;
+    for (; p < end && isxdigit(*p) && size <= kMaxChunkSize; ++p)
+    {
+      size = size * 16 + (isdigit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+    }
+    ok = p != begin && size <= kMaxChunkSize
+      && (p == end || *p == ';' || *p == ' ' || *p == '\t');
+    bodyRemaining_ = size;
+    chunkState_ = size > 0 ? kChunkData : kChunkTrailer;
+  }
+  else if (chunkState_ == kChunkDataEnd)
+  {
+    ok = begin == end;
+    chunkState_ = kChunkSize;
+  }
+  else if (chunkState_ == kChunkTrailer)
+  {
+    // trailer fields are skipped, an empty line ends the request
+    if (begin == end)
     {
-      // FIXME:
+      state_ = kGotAll;
     }
   }
   return ok;
 }
+
+bool HttpContext::appendBody(const StringPiece& data)
+{
+  if (bodyCallback_)
+  {
+    if (!data.empty())
+    {
+      bodyCallback_(&request_, data);
+    }
+    return true;
+  }
+  if (static_cast<size_t>(request_.body().size() + data.size()) > kMaxBodyBytes)
+  {
+    return false;
+  }
+  request_.appendBody(data);
+  return true;
+}
+
+void HttpContext::finishRequest(Buffer* buf)
+{
+  assert(gotAll());
+  assert(buf->readableBytes() >= requestBytes_);
+  buf->retrieve(requestBytes_);
+  reset();
+}
@@ -15,12 +15,16 @@
 
 #include <muduo/net/http/HttpRequest.h>
 
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
 namespace muduo
 {
 namespace net
 {
 
 class Buffer;
+class HttpStream;
 
 class HttpContext : public muduo::copyable
 {
@@ -33,24 +37,55 @@ class HttpContext : public muduo::copyable
     kGotAll,
   };
 
+  typedef boost::function<void (HttpRequest*, const StringPiece&)> BodyCallback;
+
+  /// A request whose headers do not end within this is rejected.
+  static const size_t kMaxHeaderBytes = 64 * 1024;
+  /// Largest body collected into HttpRequest::body(), stream bigger ones.
+  static const size_t kMaxBodyBytes = 4 * 1024 * 1024;
+
   HttpContext()
-    : state_(kExpectRequestLine)
+    : state_(kExpectRequestLine),
+      chunkState_(kChunkSize),
+      scanned_(0),
+      requestBytes_(0),
+      bodyRemaining_(0),
+      chunked_(false)
   {
   }
 
-  // default copy-ctor, dtor and assignment are fine
+  // default copy-ctor, dtor and assignment are fine,
+  // as long as no request is half way through.
+
+  /// Bodies are passed to @c cb piece by piece instead of being collected.
+  void setBodyCallback(const BodyCallback& cb)
+  { bodyCallback_ = cb; }
 
   // return false if any error
+  // Waits for the whole header block, then parses it in place:
+  // the request refers to the bytes at the front of buf,
+  // which are left there until finishRequest().
+  // A body that has not fully arrived is consumed as it comes,
+  // then the headers are kept in a copy.
   bool parseRequest(Buffer* buf, Timestamp receiveTime);
 
   bool gotAll() const
   { return state_ == kGotAll; }
 
+  /// Retrieves the request from buf once it has been handled,
+  /// and gets ready for the next one.
+  void finishRequest(Buffer* buf);
+
   void reset()
   {
     state_ = kExpectRequestLine;
-    HttpRequest dummy;
-    request_.swap(dummy);
+    chunkState_ = kChunkSize;
+    scanned_ = 0;
+    requestBytes_ = 0;
+    bodyRemaining_ = 0;
+    chunked_ = false;
+    headerBlock_.clear();
+    request_.clear();
   }
 
   const HttpRequest& request() const
@@ -59,11 +94,39 @@ class HttpContext : public muduo::copyable
   HttpRequest& request()
   { return request_; }
 
+  /// The streamed response in progress, requests pipelined after it wait.
+  const boost::shared_ptr<HttpStream>& stream() const
+  { return stream_; }
+
+  void setStream(const boost::shared_ptr<HttpStream>& stream)
+  { stream_ = stream; }
+
  private:
+  enum ChunkState
+  {
+    kChunkSize,
+    kChunkData,
+    kChunkDataEnd,
+    kChunkTrailer,
+  };
+
   bool processRequestLine(const char* begin, const char* end);
+  bool processHeaders(const char* begin, const char* end);
+  bool startBody(Buffer* buf, size_t headerBytes);
+  bool processBody(Buffer* buf);
+  bool processChunkLine(const char* begin, const char* end);
+  bool appendBody(const StringPiece& data);
 
   HttpRequestParseState state_;
+  ChunkState chunkState_;
+  size_t scanned_;  // bytes searched for the end of headers
+  size_t requestBytes_;  // left in the buffer for finishRequest()
+  size_t bodyRemaining_;  // of the body or of the current chunk
+  bool chunked_;
+  string headerBlock_;  // headers of a body consumed as it comes
   HttpRequest request_;
+  BodyCallback bodyCallback_;
+  boost::shared_ptr<HttpStream> stream_;
 };
 
 }
@@ -12,21 +12,35 @@
 #define MUDUO_NET_HTTP_HTTPREQUEST_H
 
 #include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
 #include <muduo/base/Timestamp.h>
 #include <muduo/base/Types.h>
 
-#include <map>
+#include <boost/any.hpp>
+
+#include <utility>
+#include <vector>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <strings.h>
 
 namespace muduo
 {
 namespace net
 {
 
+///
+/// Path, query, headers and body are views into the Buffer the request was
+/// parsed from, valid until HttpServer returns from the HttpCallback.
+/// Copy what you need to keep, e.g. with StringPiece::as_string().
+///
 class HttpRequest : public muduo::copyable
 {
  public:
+  typedef std::pair<StringPiece, StringPiece> Header;
+  typedef std::vector<Header> HeaderList;
+
   enum Method
   {
     kInvalid, kGet, kPost, kHead, kPut, kDelete
@@ -38,7 +52,8 @@ class HttpRequest : public muduo::copyable
 
   HttpRequest()
     : method_(kInvalid),
-      version_(kUnknown)
+      version_(kUnknown),
+      bodyOwned_(false)
   {
   }
 
@@ -53,30 +68,36 @@ class HttpRequest : public muduo::copyable
   bool setMethod(const char* start, const char* end)
   {
     assert(method_ == kInvalid);
-    string m(start, end);
-    if (m == "GET")
+    switch (end - start)
     {
-      method_ = kGet;
-    }
-    else if (m == "POST")
-    {
-      method_ = kPost;
-    }
-    else if (m == "HEAD")
-    {
-      method_ = kHead;
-    }
-    else if (m == "PUT")
-    {
-      method_ = kPut;
-    }
-    else if (m == "DELETE")
-    {
-      method_ = kDelete;
-    }
-    else
-    {
-      method_ = kInvalid;
+      case 3:
+        if (memcmp(start, "GET", 3) == 0)
+        {
+          method_ = kGet;
+        }
+        else if (memcmp(start, "PUT", 3) == 0)
+        {
+          method_ = kPut;
+        }
+        break;
+      case 4:
+        if (memcmp(start, "POST", 4) == 0)
+        {
+          method_ = kPost;
+        }
+        else if (memcmp(start, "HEAD", 4) == 0)
+        {
+          method_ = kHead;
+        }
+        break;
+      case 6:
+        if (memcmp(start, "DELETE", 6) == 0)
+        {
+          method_ = kDelete;
+        }
+        break;
+      default:
+        break;
     }
     return method_ != kInvalid;
   }
@@ -112,18 +133,18 @@ class HttpRequest : public muduo::copyable
 
   void setPath(const char* start, const char* end)
   {
-    path_.assign(start, end);
+    path_.set(start, static_cast<int>(end - start));
   }
 
-  const string& path() const
+  StringPiece path() const
   { return path_; }
 
   void setQuery(const char* start, const char* end)
   {
-    query_.assign(start, end);
+    query_.set(start, static_cast<int>(end - start));
   }
 
-  const string& query() const
+  StringPiece query() const
   { return query_; }
 
   void setReceiveTime(Timestamp t)
@@ -134,51 +155,111 @@ class HttpRequest : public muduo::copyable
 
   void addHeader(const char* start, const char* colon, const char* end)
   {
-    string field(start, colon);
-    ++colon;
-    while (colon < end && isspace(*colon))
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t'))
     {
-      ++colon;
+      ++value;
     }
-    string value(colon, end);
-    while (!value.empty() && isspace(value[value.size()-1]))
+    while (value < end && (end[-1] == ' ' || end[-1] == '\t'))
     {
-      value.resize(value.size()-1);
+      --end;
     }
-    headers_[field] = value;
+    headers_.push_back(Header(StringPiece(start, static_cast<int>(colon - start)),
+                              StringPiece(value, static_cast<int>(end - value))));
   }
 
-  string getHeader(const string& field) const
+  /// Case-insensitive, the first one if repeated, empty if absent.
+  StringPiece header(const StringPiece& field) const
   {
-    string result;
-    std::map<string, string>::const_iterator it = headers_.find(field);
-    if (it != headers_.end())
+    for (size_t i = 0; i < headers_.size(); ++i)
     {
-      result = it->second;
+      const StringPiece& f = headers_[i].first;
+      if (f.size() == field.size()
+          && ::strncasecmp(f.data(), field.data(), f.size()) == 0)
+      {
+        return headers_[i].second;
+      }
     }
-    return result;
+    return StringPiece();
   }
 
-  const std::map<string, string>& headers() const
+  string getHeader(const StringPiece& field) const
+  {
+    return header(field).as_string();
+  }
+
+  const HeaderList& headers() const
   { return headers_; }
 
+  /// Body in place, when it arrived in one piece.
+  void setBody(const char* start, const char* end)
+  {
+    body_.set(start, static_cast<int>(end - start));
+    bodyOwned_ = false;
+  }
+
+  /// Body collected piece by piece, e.g. chunked.
+  void appendBody(const StringPiece& data)
+  {
+    ownedBody_.append(data.data(), data.size());
+    bodyOwned_ = true;
+  }
+
+  /// Empty if streamed to an HttpServer::HttpBodyCallback.
+  StringPiece body() const
+  { return bodyOwned_ ? StringPiece(ownedBody_) : body_; }
+
+  /// For HttpServer::HttpBodyCallback to keep state across the pieces
+  /// of a body, cleared for each request.
+  void setContext(const boost::any& context)
+  { context_ = context; }
+
+  const boost::any& getContext() const
+  { return context_; }
+
+  boost::any* getMutableContext()
+  { return &context_; }
+
+  /// Forgets the request but keeps the capacity for the next one.
+  void clear()
+  {
+    method_ = kInvalid;
+    version_ = kUnknown;
+    path_.clear();
+    query_.clear();
+    receiveTime_ = Timestamp();
+    headers_.clear();
+    body_.clear();
+    ownedBody_.clear();
+    bodyOwned_ = false;
+    context_ = boost::any();
+  }
+
   void swap(HttpRequest& that)
   {
     std::swap(method_, that.method_);
     std::swap(version_, that.version_);
-    path_.swap(that.path_);
-    query_.swap(that.query_);
+    std::swap(path_, that.path_);
+    std::swap(query_, that.query_);
     receiveTime_.swap(that.receiveTime_);
     headers_.swap(that.headers_);
+    std::swap(body_, that.body_);
+    ownedBody_.swap(that.ownedBody_);
+    std::swap(bodyOwned_, that.bodyOwned_);
+    context_.swap(that.context_);
   }
 
  private:
   Method method_;
   Version version_;
-  string path_;
-  string query_;
+  StringPiece path_;
+  StringPiece query_;
   Timestamp receiveTime_;
-  std::map<string, string> headers_;
+  HeaderList headers_;
+  StringPiece body_;
+  string ownedBody_;
+  bool bodyOwned_;
+  boost::any context_;
 };
 
 }
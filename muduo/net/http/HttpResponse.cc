@@ -8,29 +8,49 @@
 //
 
 #include <muduo/net/http/HttpResponse.h>
+#include <muduo/base/LogStream.h>
 #include <muduo/net/Buffer.h>
 
-#include <stdio.h>
+#include <assert.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
 void HttpResponse::appendToBuffer(Buffer* output) const
+{
+  appendHeadersToBuffer(output,
+                        closeConnection_ ? -1 : static_cast<int64_t>(body_.size()),
+                        false);
+  output->append(body_);
+}
+
+void HttpResponse::appendHeadersToBuffer(Buffer* output,
+                                         int64_t contentLength,
+                                         bool chunked) const
 {
   char buf[32];
-  snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
-  output->append(buf);
+  output->append("HTTP/1.1 ");
+  output->append(buf, formatNumber(buf, statusCode_));
+  output->append(" ");
   output->append(statusMessage_);
   output->append("\r\n");
 
+  if (chunked)
+  {
+    output->append("Transfer-Encoding: chunked\r\n");
+  }
+  else if (contentLength >= 0)
+  {
+    output->append("Content-Length: ");
+    output->append(buf, formatNumber(buf, contentLength));
+    output->append("\r\n");
+  }
   if (closeConnection_)
   {
     output->append("Connection: close\r\n");
   }
   else
   {
-    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-    output->append(buf);
     output->append("Connection: Keep-Alive\r\n");
   }
 
@@ -45,5 +65,12 @@ void HttpResponse::appendToBuffer(Buffer* output) const
   }
 
   output->append("\r\n");
-  output->append(body_);
+}
+
+boost::shared_ptr<HttpStream> HttpResponse::startStream(int64_t contentLength)
+{
+  assert(streamStarter_);
+  assert(!streaming_);
+  streaming_ = true;
+  return streamStarter_(this, contentLength);
 }
@@ -14,6 +14,9 @@
 #include <muduo/base/copyable.h>
 #include <muduo/base/Types.h>
 
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include <map>
 
 namespace muduo
@@ -22,9 +25,13 @@ namespace net
 {
 
 class Buffer;
+class HttpStream;
+
 class HttpResponse : public muduo::copyable
 {
  public:
+  typedef boost::function<boost::shared_ptr<HttpStream> (HttpResponse*, int64_t)> StreamStarter;
+
   enum HttpStatusCode
   {
     kUnknown,
@@ -36,7 +43,8 @@ class HttpResponse : public muduo::copyable
 
   explicit HttpResponse(bool close)
     : statusCode_(kUnknown),
-      closeConnection_(close)
+      closeConnection_(close),
+      streaming_(false)
   {
   }
 
@@ -64,6 +72,22 @@ class HttpResponse : public muduo::copyable
 
   void appendToBuffer(Buffer* output) const;
 
+  /// Sends the status line and headers set so far, and returns
+  /// the stream to write the body with, of @c contentLength bytes
+  /// or -1 if not known.  Only from within HttpServer's HttpCallback.
+  boost::shared_ptr<HttpStream> startStream(int64_t contentLength = -1);
+
+  bool streaming() const
+  { return streaming_; }
+
+  /// For HttpServer.
+  void setStreamStarter(const StreamStarter& starter)
+  { streamStarter_ = starter; }
+
+  /// Headers only, the body is to follow as @c contentLength bytes,
+  /// or chunks if @c chunked, or until the connection closes.
+  void appendHeadersToBuffer(Buffer* output, int64_t contentLength, bool chunked) const;
+
  private:
   std::map<string, string> headers_;
   HttpStatusCode statusCode_;
@@ -71,6 +95,8 @@ class HttpResponse : public muduo::copyable
   string statusMessage_;
   bool closeConnection_;
   string body_;
+  StreamStarter streamStarter_;
+  bool streaming_;
 };
 
 }
@@ -10,9 +10,11 @@
 #include <muduo/net/http/HttpServer.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
 #include <muduo/net/http/HttpContext.h>
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/HttpStream.h>
 
 #include <boost/bind.hpp>
 
@@ -42,12 +44,15 @@ HttpServer::HttpServer(EventLoop* loop,
                        const string& name,
                        TcpServer::Option option)
   : server_(loop, listenAddr, name, option),
-    httpCallback_(detail::defaultHttpCallback)
+    httpCallback_(detail::defaultHttpCallback),
+    highWaterMark_(1024 * 1024)
 {
   server_.setConnectionCallback(
       boost::bind(&HttpServer::onConnection, this, _1));
   server_.setMessageCallback(
       boost::bind(&HttpServer::onMessage, this, _1, _2, _3));
+  server_.setWriteCompleteCallback(
+      boost::bind(&HttpServer::onWriteComplete, this, _1));
 }
 
 HttpServer::~HttpServer()
@@ -65,7 +70,11 @@ void HttpServer::onConnection(const TcpConnectionPtr& conn)
 {
   if (conn->connected())
   {
-    conn->setContext(HttpContext());
+    HttpContext context;
+    context.setBodyCallback(bodyCallback_);
+    conn->setContext(context);
+    conn->setHighWaterMarkCallback(
+        boost::bind(&HttpServer::onHighWaterMark, this, _1, _2), highWaterMark_);
   }
 }
 
@@ -75,26 +84,50 @@ void HttpServer::onMessage(const TcpConnectionPtr& conn,
 {
   HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
 
-  if (!context->parseRequest(buf, receiveTime))
+  // all requests already received, one after another
+  while (!context->stream())
   {
-    conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-    conn->shutdown();
-  }
-
-  if (context->gotAll())
-  {
-    onRequest(conn, context->request());
-    context->reset();
+    if (!context->parseRequest(buf, receiveTime))
+    {
+      conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+      conn->shutdown();
+      buf->retrieveAll();
+      break;
+    }
+    if (!context->gotAll())
+    {
+      break;
+    }
+
+    bool close = onRequest(conn, context->request());
+    context->finishRequest(buf);
+    if (context->stream())
+    {
+      // the next requests wait in the socket until the stream finishes
+      conn->stopRead();
+    }
+    if (close)
+    {
+      buf->retrieveAll();
+      break;
+    }
   }
 }
 
-void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
+bool HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
 {
-  const string& connection = req.getHeader("Connection");
+  StringPiece connection = req.header("Connection");
   bool close = connection == "close" ||
     (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
   HttpResponse response(close);
+  response.setStreamStarter(
+      boost::bind(&HttpServer::startStream, this, conn, req.getVersion(), _1, _2));
   httpCallback_(req, &response);
+  if (response.streaming())
+  {
+    // the stream closes the connection when it finishes
+    return false;
+  }
   Buffer buf;
   response.appendToBuffer(&buf);
   conn->send(&buf);
@@ -102,5 +135,71 @@ void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
   {
     conn->shutdown();
   }
+  return response.closeConnection();
+}
+
+HttpStreamPtr HttpServer::startStream(const TcpConnectionPtr& conn,
+                                      HttpRequest::Version version,
+                                      HttpResponse* response,
+                                      int64_t contentLength)
+{
+  conn->getLoop()->assertInLoopThread();
+  bool chunked = contentLength < 0 && version == HttpRequest::kHttp11;
+  if (contentLength < 0 && !chunked)
+  {
+    // HTTP/1.0 knows no chunks, the body ends with the connection
+    response->setCloseConnection(true);
+  }
+  Buffer buf;
+  response->appendHeadersToBuffer(&buf, contentLength, chunked);
+  conn->send(&buf);
+
+  HttpStreamPtr stream(new HttpStream(
+      conn, chunked, response->closeConnection(),
+      boost::bind(&HttpServer::onStreamFinished, this, boost::weak_ptr<TcpConnection>(conn))));
+  boost::any_cast<HttpContext>(conn->getMutableContext())->setStream(stream);
+  return stream;
+}
+
+void HttpServer::onStreamFinished(const boost::weak_ptr<TcpConnection>& weakConn)
+{
+  TcpConnectionPtr conn(weakConn.lock());
+  if (conn)
+  {
+    // queued even in the loop thread, as finish() may be called from onMessage()
+    conn->getLoop()->queueInLoop(
+        boost::bind(&HttpServer::resumeRequests, this, conn));
+  }
 }
 
+void HttpServer::resumeRequests(const TcpConnectionPtr& conn)
+{
+  HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  context->setStream(HttpStreamPtr());
+  if (conn->connected())
+  {
+    conn->startRead();
+    if (conn->inputBuffer()->readableBytes() > 0)
+    {
+      onMessage(conn, conn->inputBuffer(), Timestamp::now());
+    }
+  }
+}
+
+void HttpServer::onHighWaterMark(const TcpConnectionPtr& conn, size_t)
+{
+  HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (context->stream())
+  {
+    context->stream()->pause();
+  }
+}
+
+void HttpServer::onWriteComplete(const TcpConnectionPtr& conn)
+{
+  HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+  if (context->stream())
+  {
+    context->stream()->resume();
+  }
+}
@@ -12,25 +12,31 @@
 #define MUDUO_NET_HTTP_HTTPSERVER_H
 
 #include <muduo/net/TcpServer.h>
+#include <muduo/net/http/HttpRequest.h>
 #include <boost/noncopyable.hpp>
+#include <boost/weak_ptr.hpp>
 
 namespace muduo
 {
 namespace net
 {
 
-class HttpRequest;
 class HttpResponse;
+class HttpStream;
 
 /// A simple embeddable HTTP server designed for report status of a program.
 /// It is not a fully HTTP 1.1 compliant server, but provides minimum features
 /// that can communicate with HttpClient and Web browser.
 /// It is synchronous, just like Java Servlet.
+/// Pipelined requests are answered in order, a response streamed with
+/// HttpResponse::startStream() holds back those after it until it finishes.
 class HttpServer : boost::noncopyable
 {
  public:
   typedef boost::function<void (const HttpRequest&,
                                 HttpResponse*)> HttpCallback;
+  typedef boost::function<void (HttpRequest*,
+                                const StringPiece&)> HttpBodyCallback;
 
   HttpServer(EventLoop* loop,
              const InetAddress& listenAddr,
@@ -47,6 +53,21 @@ class HttpServer : boost::noncopyable
     httpCallback_ = cb;
   }
 
+  /// Not thread safe, callback be registered before calling start().
+  /// Request bodies are passed piece by piece as they arrive, instead of
+  /// collected into HttpRequest::body(), then the HttpCallback is called.
+  void setHttpBodyCallback(const HttpBodyCallback& cb)
+  {
+    bodyCallback_ = cb;
+  }
+
+  /// A streamed response stops being writable above this many bytes
+  /// queued on its connection.  Must be called before start().
+  void setHighWaterMark(size_t bytes)
+  {
+    highWaterMark_ = bytes;
+  }
+
   void setThreadNum(int numThreads)
   {
     server_.setThreadNum(numThreads);
@@ -59,10 +80,20 @@ class HttpServer : boost::noncopyable
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
-  void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+  void onHighWaterMark(const TcpConnectionPtr& conn, size_t bytes);
+  void onWriteComplete(const TcpConnectionPtr& conn);
+  bool onRequest(const TcpConnectionPtr&, const HttpRequest&);
+  boost::shared_ptr<HttpStream> startStream(const TcpConnectionPtr& conn,
+                                            HttpRequest::Version version,
+                                            HttpResponse* response,
+                                            int64_t contentLength);
+  void onStreamFinished(const boost::weak_ptr<TcpConnection>& weakConn);
+  void resumeRequests(const TcpConnectionPtr& conn);
 
   TcpServer server_;
   HttpCallback httpCallback_;
+  HttpBodyCallback bodyCallback_;
+  size_t highWaterMark_;
 };
 
 }
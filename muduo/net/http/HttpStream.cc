@@ -0,0 +1,121 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/net/http/HttpStream.h>
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+HttpStream::HttpStream(const TcpConnectionPtr& conn,
+                       bool chunked,
+                       bool closeConnection,
+                       const FinishCallback& cb)
+  : loop_(conn->getLoop()),
+    conn_(conn),
+    chunked_(chunked),
+    closeConnection_(closeConnection),
+    finishCallback_(cb),
+    ended_(false)
+{
+}
+
+bool HttpStream::write(const StringPiece& data)
+{
+  TcpConnectionPtr conn(conn_.lock());
+  if (!conn || !conn->connected() || finished())
+  {
+    return false;
+  }
+  if (data.empty())
+  {
+    // an empty chunk would end the body
+    return true;
+  }
+  string piece;
+  if (chunked_)
+  {
+    char size[32];
+    snprintf(size, sizeof size, "%x\r\n", static_cast<unsigned>(data.size()));
+    piece.reserve(strlen(size) + data.size() + 2);
+    piece += size;
+    piece.append(data.data(), data.size());
+    piece += "\r\n";
+  }
+  if (loop_->isInLoopThread())
+  {
+    writeInLoop(chunked_ ? StringPiece(piece) : data);
+  }
+  else
+  {
+    if (!chunked_)
+    {
+      data.CopyToString(&piece);
+    }
+    // a copy, data may be gone by then
+    loop_->queueInLoop(boost::bind(&HttpStream::writeInLoop, shared_from_this(), piece));
+  }
+  return true;
+}
+
+void HttpStream::writeInLoop(const StringPiece& piece)
+{
+  loop_->assertInLoopThread();
+  TcpConnectionPtr conn(conn_.lock());
+  // not after the end, where finish() from another thread got first
+  if (conn && !ended_)
+  {
+    conn->send(piece);
+  }
+}
+
+void HttpStream::finish()
+{
+  if (finished_.getAndSet(1) != 0)
+  {
+    return;
+  }
+  loop_->runInLoop(boost::bind(&HttpStream::finishInLoop, shared_from_this()));
+}
+
+void HttpStream::finishInLoop()
+{
+  loop_->assertInLoopThread();
+  ended_ = true;
+  TcpConnectionPtr conn(conn_.lock());
+  if (conn)
+  {
+    if (chunked_)
+    {
+      conn->send("0\r\n\r\n");
+    }
+    if (closeConnection_)
+    {
+      conn->shutdown();
+    }
+  }
+  if (finishCallback_)
+  {
+    finishCallback_();
+  }
+}
+
+void HttpStream::pause()
+{
+  paused_.getAndSet(1);
+}
+
+void HttpStream::resume()
+{
+  if (paused_.getAndSet(0) != 0 && writableCallback_)
+  {
+    writableCallback_();
+  }
+}
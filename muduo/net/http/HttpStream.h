@@ -0,0 +1,93 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPSTREAM_H
+#define MUDUO_NET_HTTP_HTTPSTREAM_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/net/Callbacks.h>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+
+///
+/// Body of a response written piece by piece as it is produced,
+/// from HttpResponse::startStream().
+///
+/// Chunked for HTTP/1.1 unless the length was given,
+/// for HTTP/1.0 the end of the body is the end of the connection.
+/// Requests pipelined after this one are handled once it finishes.
+///
+/// Pieces are sent in the loop of the connection, in the order they reach it,
+/// those reaching it after finish() are dropped.
+///
+class HttpStream : boost::noncopyable,
+                   public boost::enable_shared_from_this<HttpStream>
+{
+ public:
+  typedef boost::function<void ()> WritableCallback;
+  typedef boost::function<void ()> FinishCallback;
+
+  HttpStream(const TcpConnectionPtr& conn,
+             bool chunked,
+             bool closeConnection,
+             const FinishCallback& cb);
+
+  /// Sends a piece of body, false if the connection is gone or finish()
+  /// has been called.
+  /// Thread safe, but pieces from different threads may interleave.
+  bool write(const StringPiece& data);
+
+  /// Ends the body, after the pieces written before it. Thread safe.
+  void finish();
+
+  bool finished() const
+  { return finished_.get() != 0; }
+
+  /// False once the connection has queued more than the high water mark,
+  /// until it has written everything out. Thread safe.
+  bool writable() const
+  { return paused_.get() == 0; }
+
+  /// Called in the connection's loop when writable() turns true again.
+  /// Not thread safe, set it before writing.
+  void setWritableCallback(const WritableCallback& cb)
+  { writableCallback_ = cb; }
+
+  // for HttpServer, in loop thread
+  void pause();
+  void resume();
+
+ private:
+  void writeInLoop(const StringPiece& piece);
+  void finishInLoop();
+
+  EventLoop* loop_;
+  boost::weak_ptr<TcpConnection> conn_;
+  const bool chunked_;
+  const bool closeConnection_;
+  FinishCallback finishCallback_;
+  WritableCallback writableCallback_;
+  mutable AtomicInt32 paused_;
+  mutable AtomicInt32 finished_;
+  bool ended_;  // in loop thread, the body has been ended
+};
+
+typedef boost::shared_ptr<HttpStream> HttpStreamPtr;
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPSTREAM_H
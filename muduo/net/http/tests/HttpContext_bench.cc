@@ -0,0 +1,128 @@
+#include <muduo/net/http/HttpContext.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/Buffer.h>
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Parsing throughput of HttpContext, against the line by line parser
+// it replaced, which copied every header into a std::map.
+
+const char* kRequests[] = {
+  // curl
+  "GET /hello HTTP/1.1\r\n"
+  "Host: 127.0.0.1:8000\r\n"
+  "User-Agent: curl/7.88.1\r\n"
+  "Accept: */*\r\n"
+  "\r\n",
+  // browser
+  "GET /cgi-bin/forum.cgi?topic=muduo&page=12 HTTP/1.1\r\n"
+  "Host: www.chenshuo.com\r\n"
+  "Connection: keep-alive\r\n"
+  "Cache-Control: max-age=0\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+      "image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+  "Referer: http://www.chenshuo.com/cgi-bin/forum.cgi?topic=muduo&page=11\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8,zh;q=0.7\r\n"
+  "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; "
+      "_ga=GA1.2.1234567890.1234567890\r\n"
+  "\r\n",
+};
+
+// the former HttpContext::parseRequest, with headers in a std::map
+bool parseByLine(Buffer* buf, std::map<string, string>* headers)
+{
+  const char* crlf = buf->findCRLF();
+  if (!crlf)
+  {
+    return false;
+  }
+  string method(buf->peek(), std::find(buf->peek(), crlf, ' '));
+  buf->retrieveUntil(crlf + 2);
+  while ((crlf = buf->findCRLF()) != NULL)
+  {
+    const char* colon = std::find(buf->peek(), crlf, ':');
+    if (colon == crlf)
+    {
+      buf->retrieveUntil(crlf + 2);
+      return true;
+    }
+    const char* value = colon + 1;
+    while (value < crlf && *value == ' ')
+    {
+      ++value;
+    }
+    (*headers)[string(buf->peek(), colon)] = string(value, crlf);
+    buf->retrieveUntil(crlf + 2);
+  }
+  return false;
+}
+
+void bench(const char* request, int batch, int rounds)
+{
+  string input;
+  for (int i = 0; i < batch; ++i)
+  {
+    input += request;
+  }
+  const double mbytes = static_cast<double>(input.size()) * rounds / 1e6;
+  const int total = batch * rounds;
+
+  Buffer buf;
+  HttpContext context;
+  int parsed = 0;
+  Timestamp start(Timestamp::now());
+  for (int r = 0; r < rounds; ++r)
+  {
+    buf.append(input);
+    while (context.parseRequest(&buf, start) && context.gotAll())
+    {
+      ++parsed;
+      context.finishRequest(&buf);
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("  HttpContext %8.3f M req/s %8.1f MB/s\n",
+         total / seconds / 1e6, mbytes / seconds);
+
+  int byLine = 0;
+  std::map<string, string> headers;
+  start = Timestamp::now();
+  for (int r = 0; r < rounds; ++r)
+  {
+    buf.append(input);
+    while (parseByLine(&buf, &headers))
+    {
+      ++byLine;
+      headers.clear();
+    }
+  }
+  seconds = timeDifference(Timestamp::now(), start);
+  printf("  by line     %8.3f M req/s %8.1f MB/s\n",
+         total / seconds / 1e6, mbytes / seconds);
+  if (parsed != total || byLine != total)
+  {
+    printf("parsed %d by line %d, expected %d\n", parsed, byLine, total);
+    abort();
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int rounds = argc > 1 ? atoi(argv[1]) : 100*1000;
+  for (size_t i = 0; i < sizeof kRequests / sizeof kRequests[0]; ++i)
+  {
+    const int kBatch = 10;  // pipelined requests per read
+    printf("%zd bytes request, %d per read\n", strlen(kRequests[i]), kBatch);
+    bench(kRequests[i], kBatch, rounds);
+  }
+}
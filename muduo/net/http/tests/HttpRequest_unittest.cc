@@ -1,6 +1,8 @@
 #include <muduo/net/http/HttpContext.h>
 #include <muduo/net/Buffer.h>
 
+#include <boost/bind.hpp>
+
 //#define BOOST_TEST_MODULE BufferTest
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
@@ -24,7 +26,7 @@ BOOST_AUTO_TEST_CASE(testParseRequestAllInOne)
   BOOST_CHECK(context.gotAll());
   const HttpRequest& request = context.request();
   BOOST_CHECK_EQUAL(request.method(), HttpRequest::kGet);
-  BOOST_CHECK_EQUAL(request.path(), string("/index.html"));
+  BOOST_CHECK_EQUAL(request.path().as_string(), string("/index.html"));
   BOOST_CHECK_EQUAL(request.getVersion(), HttpRequest::kHttp11);
   BOOST_CHECK_EQUAL(request.getHeader("Host"), string("www.chenshuo.com"));
   BOOST_CHECK_EQUAL(request.getHeader("User-Agent"), string(""));
@@ -50,7 +52,7 @@ BOOST_AUTO_TEST_CASE(testParseRequestInTwoPieces)
     BOOST_CHECK(context.gotAll());
     const HttpRequest& request = context.request();
     BOOST_CHECK_EQUAL(request.method(), HttpRequest::kGet);
-    BOOST_CHECK_EQUAL(request.path(), string("/index.html"));
+    BOOST_CHECK_EQUAL(request.path().as_string(), string("/index.html"));
     BOOST_CHECK_EQUAL(request.getVersion(), HttpRequest::kHttp11);
     BOOST_CHECK_EQUAL(request.getHeader("Host"), string("www.chenshuo.com"));
     BOOST_CHECK_EQUAL(request.getHeader("User-Agent"), string(""));
@@ -71,9 +73,211 @@ BOOST_AUTO_TEST_CASE(testParseRequestEmptyHeaderValue)
   BOOST_CHECK(context.gotAll());
   const HttpRequest& request = context.request();
   BOOST_CHECK_EQUAL(request.method(), HttpRequest::kGet);
-  BOOST_CHECK_EQUAL(request.path(), string("/index.html"));
+  BOOST_CHECK_EQUAL(request.path().as_string(), string("/index.html"));
   BOOST_CHECK_EQUAL(request.getVersion(), HttpRequest::kHttp11);
   BOOST_CHECK_EQUAL(request.getHeader("Host"), string("www.chenshuo.com"));
   BOOST_CHECK_EQUAL(request.getHeader("User-Agent"), string(""));
   BOOST_CHECK_EQUAL(request.getHeader("Accept-Encoding"), string(""));
 }
+
+BOOST_AUTO_TEST_CASE(testParseRequestQueryAndHeaders)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("POST /search?q=muduo&page=2 HTTP/1.0\r\n"
+       "host: www.chenshuo.com\r\n"
+       "X-Padding:\t0123456789abcdef0123456789abcdef0123456789abcdef \t\r\n"
+       "Connection: close\r\n"
+       "\r\n");
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  const HttpRequest& request = context.request();
+  BOOST_CHECK_EQUAL(request.method(), HttpRequest::kPost);
+  BOOST_CHECK_EQUAL(request.path().as_string(), string("/search"));
+  BOOST_CHECK_EQUAL(request.query().as_string(), string("?q=muduo&page=2"));
+  BOOST_CHECK_EQUAL(request.getVersion(), HttpRequest::kHttp10);
+  BOOST_CHECK_EQUAL(request.headers().size(), 3);
+  BOOST_CHECK_EQUAL(request.getHeader("Host"), string("www.chenshuo.com"));
+  BOOST_CHECK(request.header("CONNECTION") == "close");
+  BOOST_CHECK_EQUAL(request.getHeader("x-padding"),
+                    string("0123456789abcdef0123456789abcdef0123456789abcdef"));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestPipelined)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("GET /first HTTP/1.1\r\n"
+       "Host: a\r\n"
+       "\r\n"
+       "GET /second HTTP/1.1\r\n"
+       "Host: b\r\n"
+       "\r\n");
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path().as_string(), string("/first"));
+  BOOST_CHECK_EQUAL(context.request().getHeader("Host"), string("a"));
+  context.finishRequest(&input);
+
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path().as_string(), string("/second"));
+  BOOST_CHECK_EQUAL(context.request().getHeader("Host"), string("b"));
+  context.finishRequest(&input);
+  BOOST_CHECK_EQUAL(input.readableBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBad)
+{
+  const char* bad[] = {
+    "FETCH /index.html HTTP/1.1\r\n\r\n",
+    "GET /index.html HTTP/2.0\r\n\r\n",
+    "GET /index.html HTTP/1.1\r\nHost www.chenshuo.com\r\n\r\n",
+    "GET /index.html HTTP/1.1\r\n: empty\r\n\r\n",
+    "GET /index.html HTTP/1.1\r\nHost: www.chen\nshuo.com\r\n\r\n",
+    "GET /index.html HTTP/1.1\r\nHost: 0123456789abcdef0123456789abcdef\x7f\r\n\r\n",
+  };
+
+  for (size_t i = 0; i < sizeof bad / sizeof bad[0]; ++i)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(bad[i]);
+    BOOST_CHECK(!context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(!context.gotAll());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestTooLarge)
+{
+  HttpContext context;
+  Buffer input;
+  input.append("GET / HTTP/1.1\r\n");
+  string header("X-Large: ");
+  header += string(HttpContext::kMaxHeaderBytes, 'x');
+  input.append(header);
+  BOOST_CHECK(!context.parseRequest(&input, Timestamp::now()));
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestContentLength)
+{
+  string all("POST /upload HTTP/1.1\r\n"
+       "Content-Length: 11\r\n"
+       "\r\n"
+       "hello world"
+       "GET /next HTTP/1.1\r\n"
+       "\r\n");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.request().path().as_string(), string("/upload"));
+    BOOST_CHECK_EQUAL(context.request().getHeader("Content-Length"), string("11"));
+    BOOST_CHECK_EQUAL(context.request().body().as_string(), string("hello world"));
+    context.finishRequest(&input);
+
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.request().path().as_string(), string("/next"));
+    BOOST_CHECK(context.request().body().empty());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestChunked)
+{
+  string all("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "5\r\nhello\r\n"
+       "1;ext=1\r\n \r\n"
+       "0000005\r\nworld\r\n"
+       "0\r\n"
+       "X-Trailer: ignored\r\n"
+       "\r\n"
+       "GET /next HTTP/1.1\r\n"
+       "\r\n");
+
+  // byte by byte
+  HttpContext context;
+  Buffer input;
+  for (size_t i = 0; i < all.size() && !context.gotAll(); ++i)
+  {
+    input.append(all.c_str() + i, 1);
+    BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  }
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path().as_string(), string("/upload"));
+  BOOST_CHECK_EQUAL(context.request().getHeader("transfer-encoding"), string("chunked"));
+  BOOST_CHECK_EQUAL(context.request().body().as_string(), string("hello world"));
+  context.finishRequest(&input);
+  BOOST_CHECK_EQUAL(input.readableBytes(), 0);
+
+  // all in one, followed by another request
+  input.append(all);
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().body().as_string(), string("hello world"));
+  context.finishRequest(&input);
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.request().path().as_string(), string("/next"));
+}
+
+void appendPiece(string* body, int* pieces, muduo::net::HttpRequest* req,
+                 const muduo::StringPiece& data)
+{
+  BOOST_CHECK_EQUAL(req->path().as_string(), string("/upload"));
+  body->append(data.data(), data.size());
+  ++*pieces;
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBodyCallback)
+{
+  string body;
+  int pieces = 0;
+  HttpContext context;
+  context.setBodyCallback(boost::bind(appendPiece, &body, &pieces, _1, _2));
+  Buffer input;
+  input.append("POST /upload HTTP/1.1\r\n"
+       "Content-Length: 10\r\n"
+       "\r\n"
+       "01234");
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(!context.gotAll());
+  BOOST_CHECK_EQUAL(input.readableBytes(), 0);
+  input.append("56789");
+  BOOST_CHECK(context.parseRequest(&input, Timestamp::now()));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(body, string("0123456789"));
+  BOOST_CHECK_EQUAL(pieces, 2);
+  BOOST_CHECK(context.request().body().empty());
+}
+
+BOOST_AUTO_TEST_CASE(testParseRequestBadBody)
+{
+  const char* bad[] = {
+    "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcd\r\n",
+  };
+
+  for (size_t i = 0; i < sizeof bad / sizeof bad[0]; ++i)
+  {
+    HttpContext context;
+    Buffer input;
+    input.append(bad[i]);
+    BOOST_CHECK(!context.parseRequest(&input, Timestamp::now()));
+  }
+}
@@ -1,11 +1,15 @@
 #include <muduo/net/http/HttpServer.h>
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/HttpStream.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/base/Logging.h>
 
+#include <boost/bind.hpp>
+#include <boost/weak_ptr.hpp>
+
 #include <iostream>
-#include <map>
+#include <stdio.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -13,17 +17,36 @@ using namespace muduo::net;
 extern char favicon[555];
 bool benchmark = false;
 
+const int kStreamLines = 100*1000;
+
+// writes as much as the client takes, then waits for it to catch up
+void streamLines(const boost::weak_ptr<HttpStream>& weakStream,
+                 const boost::shared_ptr<int>& next)
+{
+  HttpStreamPtr stream(weakStream.lock());
+  while (stream && *next < kStreamLines && stream->writable())
+  {
+    char line[64];
+    snprintf(line, sizeof line, "line %d of %d\n", ++*next, kStreamLines);
+    stream->write(line);
+  }
+  if (stream && *next == kStreamLines)
+  {
+    stream->finish();
+  }
+}
+
 void onRequest(const HttpRequest& req, HttpResponse* resp)
 {
-  std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
+  std::cout << "Headers " << req.methodString() << " " << req.path().as_string() << std::endl;
   if (!benchmark)
   {
-    const std::map<string, string>& headers = req.headers();
-    for (std::map<string, string>::const_iterator it = headers.begin();
+    const HttpRequest::HeaderList& headers = req.headers();
+    for (HttpRequest::HeaderList::const_iterator it = headers.begin();
          it != headers.end();
          ++it)
     {
-      std::cout << it->first << ": " << it->second << std::endl;
+      std::cout << it->first.as_string() << ": " << it->second.as_string() << std::endl;
     }
   }
 
@@ -45,6 +68,17 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
     resp->setContentType("image/png");
     resp->setBody(string(favicon, sizeof favicon));
   }
+  else if (req.path() == "/stream")
+  {
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    HttpStreamPtr stream = resp->startStream();
+    boost::shared_ptr<int> next(new int(0));
+    stream->setWritableCallback(
+        boost::bind(streamLines, boost::weak_ptr<HttpStream>(stream), next));
+    streamLines(stream, next);
+  }
   else if (req.path() == "/hello")
   {
     resp->setStatusCode(HttpResponse::k200Ok);
@@ -144,7 +144,7 @@ void Inspector::onRequest(const HttpRequest& req, HttpResponse* resp)
   }
   else
   {
-    std::vector<string> result = split(req.path());
+    std::vector<string> result = split(req.path().as_string());
     // boost::split(result, req.path(), boost::is_any_of("/"));
     //std::copy(result.begin(), result.end(), std::ostream_iterator<string>(std::cout, ", "));
     //std::cout << "\n";
@@ -9,6 +9,9 @@
 #include <muduo/net/Poller.h>
 #include <muduo/net/poller/PollPoller.h>
 #include <muduo/net/poller/EPollPoller.h>
+#include <muduo/net/poller/IoUringPoller.h>
+
+#include <muduo/base/Logging.h>
 
 #include <stdlib.h>
 
@@ -16,7 +19,16 @@ using namespace muduo::net;
 
 Poller* Poller::newDefaultPoller(EventLoop* loop)
 {
-  if (::getenv("MUDUO_USE_POLL"))
+  if (::getenv("MUDUO_USE_IOURING"))
+  {
+    if (IoUringPoller::isSupported())
+    {
+      return new IoUringPoller(loop);
+    }
+    LOG_WARN << "io_uring is not supported, fall back to epoll";
+    return new EPollPoller(loop);
+  }
+  else if (::getenv("MUDUO_USE_POLL"))
   {
     return new PollPoller(loop);
   }
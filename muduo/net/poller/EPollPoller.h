@@ -34,6 +34,7 @@ class EPollPoller : public Poller
   virtual Timestamp poll(int timeoutMs, ChannelList* activeChannels);
   virtual void updateChannel(Channel* channel);
   virtual void removeChannel(Channel* channel);
+  virtual const char* name() const { return "epoll"; }
 
  private:
   static const int kInitEventListSize = 16;
@@ -0,0 +1,634 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+#include <muduo/net/poller/IoUringPoller.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/Channel.h>
+
+#include <algorithm>
+
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+const int kNew = -1;
+const int kAdded = 1;
+
+// completions of POLL_REMOVE, ASYNC_CANCEL and PROVIDE_BUFFERS requests
+// carry this tag and are skipped
+const uint64_t kInternalTag = ~static_cast<uint64_t>(0);
+// user_data of operations, the others are of poll requests
+const uint64_t kOperationTag = static_cast<uint64_t>(1) << 63;
+const uint32_t kSeqMask = 0x7fffffff;
+const uint16_t kRecvBufferGroup = 1;
+
+int ioUringSetup(unsigned entries, struct io_uring_params* params)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ringfd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags, void* arg, size_t argSize)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ringfd, toSubmit,
+                                    minComplete, flags, arg, argSize));
+}
+
+uint64_t makeUserData(int fd, uint32_t seq)
+{
+  assert(seq <= kSeqMask);
+  return (static_cast<uint64_t>(seq) << 32) | static_cast<uint32_t>(fd);
+}
+
+unsigned loadAcquire(const unsigned* p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void storeRelease(unsigned* p, unsigned v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+void* mapRing(int ringfd, size_t size, off_t offset)
+{
+  void* p = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringfd, offset);
+  if (p == MAP_FAILED)
+  {
+    LOG_SYSFATAL << "IoUringPoller mmap";
+  }
+  return p;
+}
+}
+
+bool IoUringPoller::isSupported()
+{
+  struct io_uring_params params;
+  bzero(&params, sizeof params);
+  int fd = ioUringSetup(1, &params);
+  if (fd < 0)
+  {
+    return false;
+  }
+  ::close(fd);
+  return (params.features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+  : Poller(loop),
+    ringfd_(-1),
+    features_(0),
+    sqRing_(NULL),
+    sqRingSize_(0),
+    cqRing_(NULL),
+    cqRingSize_(0),
+    sqes_(NULL),
+    sqesSize_(0),
+    sqHead_(NULL),
+    sqTail_(NULL),
+    sqMask_(0),
+    sqArray_(NULL),
+    sqLocalTail_(0),
+    toSubmit_(0),
+    cqHead_(NULL),
+    cqTail_(NULL),
+    cqMask_(0),
+    cqes_(NULL),
+    recvBuffers_(NULL)
+{
+  setupRing();
+}
+
+IoUringPoller::~IoUringPoller()
+{
+  // closing the ring cancels all outstanding requests
+  ::munmap(sqes_, sqesSize_);
+  if (cqRing_ != sqRing_)
+  {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  ::munmap(sqRing_, sqRingSize_);
+  ::close(ringfd_);
+
+  // Operations still in flight are leaked, the kernel may not be done with
+  // them yet, nor with the receive buffers.
+  bool inFlight = false;
+  for (size_t i = 0; i < operations_.size(); ++i)
+  {
+    if (operations_[i]->inUse)
+    {
+      inFlight = true;
+    }
+    else
+    {
+      delete operations_[i];
+    }
+  }
+  if (!inFlight)
+  {
+    delete[] recvBuffers_;
+  }
+}
+
+void IoUringPoller::setupRing()
+{
+  struct io_uring_params params;
+  bzero(&params, sizeof params);
+  params.flags = IORING_SETUP_CLAMP;
+  ringfd_ = ioUringSetup(kRingEntries, &params);
+  if (ringfd_ < 0)
+  {
+    LOG_SYSFATAL << "IoUringPoller::IoUringPoller";
+  }
+  features_ = params.features;
+  if (!(features_ & IORING_FEAT_EXT_ARG))
+  {
+    LOG_FATAL << "IoUringPoller needs IORING_FEAT_EXT_ARG (Linux 5.11)";
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (features_ & IORING_FEAT_SINGLE_MMAP)
+  {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+  sqRing_ = mapRing(ringfd_, sqRingSize_, IORING_OFF_SQ_RING);
+  cqRing_ = (features_ & IORING_FEAT_SINGLE_MMAP)
+            ? sqRing_
+            : mapRing(ringfd_, cqRingSize_, IORING_OFF_CQ_RING);
+  sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = static_cast<struct io_uring_sqe*>(mapRing(ringfd_, sqesSize_, IORING_OFF_SQES));
+
+  char* sq = static_cast<char*>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sqLocalTail_ = *sqTail_;
+  // SQEs are always filled in ring order, so the indirection array is fixed.
+  for (unsigned i = 0; i < params.sq_entries; ++i)
+  {
+    sqArray_[i] = i;
+  }
+
+  char* cq = static_cast<char*>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  LOG_DEBUG << "io_uring fd " << ringfd_ << " sq " << params.sq_entries
+            << " cq " << params.cq_entries;
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels)
+{
+  LOG_TRACE << "fd total count " << channels_.size();
+  armDirtyChannels();
+  int ret = submit(1, timeoutMs);
+  int savedErrno = errno;
+  Timestamp now(Timestamp::now());
+  int numEvents = reapCompletions(activeChannels);
+  if (numEvents > 0)
+  {
+    LOG_TRACE << numEvents << " events happended";
+  }
+  else if (ret >= 0 || savedErrno == ETIME)
+  {
+    LOG_TRACE << "nothing happended";
+  }
+  else if (savedErrno != EINTR)
+  {
+    errno = savedErrno;
+    LOG_SYSERR << "IoUringPoller::poll()";
+  }
+  return now;
+}
+
+int IoUringPoller::reapCompletions(ChannelList* activeChannels)
+{
+  int numEvents = 0;
+  unsigned head = *cqHead_;
+  unsigned tail = loadAcquire(cqTail_);
+  for (; head != tail; ++head)
+  {
+    const struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+    if (cqe->user_data == kInternalTag)
+    {
+      // not found or already completing, for a removal or a cancellation
+      if (cqe->res < 0 && cqe->res != -ENOENT && cqe->res != -EALREADY)
+      {
+        errno = -cqe->res;
+        LOG_SYSERR << "IoUringPoller internal request";
+      }
+      continue;
+    }
+    if (cqe->user_data & kOperationTag)
+    {
+      Completed done;
+      done.slot = static_cast<uint32_t>(cqe->user_data & 0xffffffff);
+      done.result = cqe->res;
+      done.flags = cqe->flags;
+      assert(done.slot < operations_.size());
+      assert(operations_[done.slot]->inUse);
+      assert(operationId(done.slot) == cqe->user_data);
+      completed_.push_back(done);
+      ++numEvents;
+      continue;
+    }
+    int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+    uint32_t seq = static_cast<uint32_t>(cqe->user_data >> 32);
+    assert(fd >= 0 && static_cast<size_t>(fd) < entries_.size());
+    PollEntry& entry = entries_[fd];
+    if (entry.channel == NULL || !entry.armed || entry.seq != seq)
+    {
+      // completion of a request that has been removed or superseded
+      continue;
+    }
+
+    entry.armed = false;
+    markDirty(fd);
+    if (cqe->res > 0)
+    {
+      Channel* channel = entry.channel;
+      assert(channels_.find(fd) != channels_.end());
+      assert(channels_.find(fd)->second == channel);
+      channel->set_revents(cqe->res);
+      activeChannels->push_back(channel);
+      ++numEvents;
+    }
+    else if (cqe->res < 0)
+    {
+      errno = -cqe->res;
+      LOG_SYSERR << "IoUringPoller poll fd = " << fd;
+    }
+  }
+  storeRelease(cqHead_, head);
+  return numEvents;
+}
+
+void IoUringPoller::updateChannel(Channel* channel)
+{
+  Poller::assertInLoopThread();
+  const int index = channel->index();
+  const int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd
+    << " events = " << channel->events() << " index = " << index;
+  if (index == kNew)
+  {
+    assert(channels_.find(fd) == channels_.end());
+    channels_[fd] = channel;
+    PollEntry& entry = entryOf(fd);
+    assert(entry.channel == NULL);
+    entry.channel = channel;
+    channel->set_index(kAdded);
+  }
+  else
+  {
+    assert(index == kAdded);
+    assert(channels_.find(fd) != channels_.end());
+    assert(channels_[fd] == channel);
+    assert(entries_[fd].channel == channel);
+  }
+  // deferred until the next poll(), where it is submitted with the wait
+  markDirty(fd);
+}
+
+void IoUringPoller::removeChannel(Channel* channel)
+{
+  Poller::assertInLoopThread();
+  int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd;
+  assert(channels_.find(fd) != channels_.end());
+  assert(channels_[fd] == channel);
+  assert(channel->isNoneEvent());
+  assert(channel->index() == kAdded);
+  size_t n = channels_.erase(fd);
+  (void)n;
+  assert(n == 1);
+
+  PollEntry& entry = entries_[fd];
+  assert(entry.channel == channel);
+  if (entry.armed)
+  {
+    disarm(fd, entry);
+  }
+  entry.channel = NULL;
+  entry.seq = (entry.seq + 1) & kSeqMask;
+  channel->set_index(kNew);
+}
+
+IoUringPoller::PollEntry& IoUringPoller::entryOf(int fd)
+{
+  assert(fd >= 0);
+  if (static_cast<size_t>(fd) >= entries_.size())
+  {
+    entries_.resize(std::max(static_cast<size_t>(fd) + 1, entries_.size() * 2));
+  }
+  return entries_[fd];
+}
+
+void IoUringPoller::markDirty(int fd)
+{
+  PollEntry& entry = entries_[fd];
+  if (!entry.queued)
+  {
+    entry.queued = true;
+    dirtyFds_.push_back(fd);
+  }
+}
+
+void IoUringPoller::armDirtyChannels()
+{
+  for (size_t i = 0; i < dirtyFds_.size(); ++i)
+  {
+    int fd = dirtyFds_[i];
+    PollEntry& entry = entries_[fd];
+    entry.queued = false;
+    if (entry.channel == NULL)
+    {
+      continue;
+    }
+    int events = entry.channel->events();
+    if (entry.armed && entry.armedEvents != events)
+    {
+      disarm(fd, entry);
+    }
+    if (!entry.armed && events != 0)
+    {
+      arm(fd, entry);
+    }
+  }
+  dirtyFds_.clear();
+}
+
+void IoUringPoller::arm(int fd, PollEntry& entry)
+{
+  assert(!entry.armed);
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  uint32_t events = static_cast<uint32_t>(entry.channel->events());
+#if __BYTE_ORDER == __BIG_ENDIAN
+  events = (events << 16) | (events >> 16);
+#endif
+  sqe->poll32_events = events;
+  sqe->user_data = makeUserData(fd, entry.seq);
+  entry.armed = true;
+  entry.armedEvents = entry.channel->events();
+  LOG_TRACE << "POLL_ADD fd = " << fd
+    << " event = { " << entry.channel->eventsToString() << " }";
+}
+
+void IoUringPoller::disarm(int fd, PollEntry& entry)
+{
+  assert(entry.armed);
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = makeUserData(fd, entry.seq);
+  sqe->user_data = kInternalTag;
+  // a completion racing with the removal is recognized as stale
+  entry.armed = false;
+  entry.seq = (entry.seq + 1) & kSeqMask;
+  LOG_TRACE << "POLL_REMOVE fd = " << fd;
+}
+
+struct io_uring_sqe* IoUringPoller::getSqe()
+{
+  if (sqLocalTail_ - loadAcquire(sqHead_) > sqMask_)
+  {
+    // submission queue is full, flush it without waiting
+    if (submit(0, 0) < 0)
+    {
+      LOG_SYSFATAL << "IoUringPoller::getSqe()";
+    }
+  }
+  struct io_uring_sqe* sqe = &sqes_[sqLocalTail_ & sqMask_];
+  bzero(sqe, sizeof *sqe);
+  ++sqLocalTail_;
+  ++toSubmit_;
+  return sqe;
+}
+
+int IoUringPoller::submit(unsigned minComplete, int timeoutMs)
+{
+  storeRelease(sqTail_, sqLocalTail_);
+
+  unsigned flags = 0;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  bzero(&arg, sizeof arg);
+  if (minComplete > 0)
+  {
+    flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMs >= 0)
+    {
+      ts.tv_sec = timeoutMs / 1000;
+      ts.tv_nsec = (timeoutMs % 1000) * 1000 * 1000;
+      arg.ts = reinterpret_cast<uintptr_t>(&ts);
+    }
+  }
+  int ret = ioUringEnter(ringfd_, toSubmit_, minComplete, flags,
+                         minComplete > 0 ? &arg : NULL,
+                         minComplete > 0 ? sizeof arg : 0);
+  int savedErrno = errno;
+  toSubmit_ = sqLocalTail_ - loadAcquire(sqHead_);
+  errno = savedErrno;
+  return ret;
+}
+
+Poller::OperationId IoUringPoller::submitRecv(int fd, const CompletionCallback& cb)
+{
+  assertInLoopThread();
+  if (recvBuffers_ == NULL)
+  {
+    // not touched until the kernel fills them
+    recvBuffers_ = new char[kRecvBufferCount * kRecvBufferSize];
+    provideRecvBuffers(0, kRecvBufferCount);
+  }
+  uint32_t slot = newOperation(IORING_OP_RECV, fd, cb);
+  prepareRecv(slot);
+  return operationId(slot);
+}
+
+Poller::OperationId IoUringPoller::submitWritev(int fd, const struct iovec* iov, int iovcnt,
+                                                const CompletionCallback& cb)
+{
+  assertInLoopThread();
+  assert(iovcnt > 0 && iovcnt <= kMaxIovecs);
+  uint32_t slot = newOperation(IORING_OP_WRITEV, fd, cb);
+  Operation& op = *operations_[slot];
+  std::copy(iov, iov + iovcnt, op.iov);
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(op.iov);
+  sqe->len = static_cast<uint32_t>(iovcnt);
+  sqe->user_data = operationId(slot);
+  return sqe->user_data;
+}
+
+Poller::OperationId IoUringPoller::submitAccept(int fd, const CompletionCallback& cb)
+{
+  assertInLoopThread();
+  uint32_t slot = newOperation(IORING_OP_ACCEPT, fd, cb);
+  Operation& op = *operations_[slot];
+  op.peerLen = static_cast<socklen_t>(sizeof op.peer);
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(&op.peer);
+  sqe->addr2 = reinterpret_cast<uintptr_t>(&op.peerLen);
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = operationId(slot);
+  return sqe->user_data;
+}
+
+void IoUringPoller::cancel(OperationId id)
+{
+  assertInLoopThread();
+  uint32_t slot = static_cast<uint32_t>(id & 0xffffffff);
+  assert(slot < operations_.size());
+  Operation& op = *operations_[slot];
+  if (!op.inUse || operationId(slot) != id || op.cancelled)
+  {
+    return;
+  }
+  op.cancelled = true;
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = id;
+  sqe->user_data = kInternalTag;
+  LOG_TRACE << "ASYNC_CANCEL fd = " << op.fd;
+}
+
+void IoUringPoller::handleCompletions(Timestamp receiveTime)
+{
+  std::vector<uint32_t> retries;
+  for (size_t i = 0; i < completed_.size(); ++i)
+  {
+    const Completed& done = completed_[i];
+    Operation& op = *operations_[done.slot];
+    int bid = -1;
+    if (done.flags & IORING_CQE_F_BUFFER)
+    {
+      bid = static_cast<int>(done.flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    if (done.result == -ENOBUFS && !op.cancelled)
+    {
+      // more receives completed at once than there are buffers
+      assert(op.opcode == IORING_OP_RECV);
+      retries.push_back(done.slot);
+      continue;
+    }
+
+    IoCompletion completion;
+    completion.result = done.result;
+    completion.data = bid >= 0 ? recvBuffers_ + bid * kRecvBufferSize : NULL;
+    struct sockaddr_in6 peer = op.peer;
+    completion.peer = op.opcode == IORING_OP_ACCEPT ? &peer : NULL;
+    if (op.cancelled && op.opcode == IORING_OP_ACCEPT && done.result >= 0)
+    {
+      ::close(done.result);
+    }
+    bool cancelled = op.cancelled;
+    CompletionCallback cb;
+    cb.swap(op.callback);
+    // the callback may submit another operation
+    freeOperation(done.slot);
+    if (!cancelled)
+    {
+      cb(completion, receiveTime);
+    }
+    if (bid >= 0)
+    {
+      provideRecvBuffers(bid, 1);
+    }
+  }
+  completed_.clear();
+  // after the buffers are given back
+  for (size_t i = 0; i < retries.size(); ++i)
+  {
+    prepareRecv(retries[i]);
+  }
+}
+
+uint32_t IoUringPoller::newOperation(uint8_t opcode, int fd, const CompletionCallback& cb)
+{
+  uint32_t slot;
+  if (freeOperations_.empty())
+  {
+    slot = static_cast<uint32_t>(operations_.size());
+    operations_.push_back(new Operation);
+  }
+  else
+  {
+    slot = freeOperations_.back();
+    freeOperations_.pop_back();
+  }
+  Operation& op = *operations_[slot];
+  assert(!op.inUse);
+  op.inUse = true;
+  op.cancelled = false;
+  op.opcode = opcode;
+  op.fd = fd;
+  op.callback = cb;
+  return slot;
+}
+
+void IoUringPoller::freeOperation(uint32_t slot)
+{
+  Operation& op = *operations_[slot];
+  assert(op.inUse);
+  op.inUse = false;
+  op.seq = (op.seq + 1) & kSeqMask;
+  op.callback = CompletionCallback();
+  freeOperations_.push_back(slot);
+}
+
+Poller::OperationId IoUringPoller::operationId(uint32_t slot) const
+{
+  return kOperationTag | (static_cast<uint64_t>(operations_[slot]->seq) << 32) | slot;
+}
+
+void IoUringPoller::prepareRecv(uint32_t slot)
+{
+  Operation& op = *operations_[slot];
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = op.fd;
+  sqe->len = kRecvBufferSize;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kRecvBufferGroup;
+  sqe->user_data = operationId(slot);
+}
+
+void IoUringPoller::provideRecvBuffers(int bid, int count)
+{
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr = reinterpret_cast<uintptr_t>(recvBuffers_ + bid * kRecvBufferSize);
+  sqe->len = kRecvBufferSize;
+  sqe->off = static_cast<uint64_t>(bid);
+  sqe->buf_group = kRecvBufferGroup;
+  sqe->user_data = kInternalTag;
+}
@@ -0,0 +1,145 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_POLLER_IOURINGPOLLER_H
+#define MUDUO_NET_POLLER_IOURINGPOLLER_H
+
+#include <muduo/net/Poller.h>
+
+#include <vector>
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace muduo
+{
+namespace net
+{
+
+///
+/// IO Multiplexing with io_uring(7) one-shot poll requests.
+///
+/// Interest changes are queued as SQEs and submitted together with the wait
+/// in a single io_uring_enter(2), and every completion available is reaped
+/// without another syscall.  A fired channel is re-armed on the next poll(),
+/// after its callbacks ran, which keeps the level-triggered semantics of
+/// EPollPoller.
+///
+/// It also completes reads, writes and accepts.  Receives take a buffer
+/// from a group provided to the kernel, so idle connections hold none.
+///
+class IoUringPoller : public Poller
+{
+ public:
+  IoUringPoller(EventLoop* loop);
+  virtual ~IoUringPoller();
+
+  virtual Timestamp poll(int timeoutMs, ChannelList* activeChannels);
+  virtual void updateChannel(Channel* channel);
+  virtual void removeChannel(Channel* channel);
+  virtual const char* name() const { return "io_uring"; }
+
+  virtual bool hasCompletionIo() const { return true; }
+  virtual OperationId submitRecv(int fd, const CompletionCallback& cb);
+  virtual OperationId submitWritev(int fd, const struct iovec* iov, int iovcnt,
+                                   const CompletionCallback& cb);
+  virtual OperationId submitAccept(int fd, const CompletionCallback& cb);
+  virtual void cancel(OperationId id);
+  virtual void handleCompletions(Timestamp receiveTime);
+
+  /// Whether the running kernel provides what this poller needs.
+  static bool isSupported();
+
+ private:
+  static const unsigned kRingEntries = 4096;
+  static const int kMaxIovecs = 64;
+  static const int kRecvBufferSize = 16*1024;
+  static const int kRecvBufferCount = 1024;
+
+  struct Operation
+  {
+    Operation() : seq(0), opcode(0), fd(-1), inUse(false), cancelled(false) { }
+    CompletionCallback callback;
+    uint32_t seq;
+    uint8_t opcode;
+    int fd;
+    bool inUse;
+    bool cancelled;
+    struct sockaddr_in6 peer;
+    socklen_t peerLen;
+    struct iovec iov[kMaxIovecs];
+  };
+
+  struct Completed
+  {
+    uint32_t slot;
+    int result;
+    uint32_t flags;
+  };
+
+  struct PollEntry
+  {
+    PollEntry() : channel(NULL), armedEvents(0), seq(0), armed(false), queued(false) { }
+    Channel* channel;
+    int armedEvents;
+    uint32_t seq;
+    bool armed;
+    bool queued;
+  };
+
+  void setupRing();
+  PollEntry& entryOf(int fd);
+  void markDirty(int fd);
+  void armDirtyChannels();
+  void arm(int fd, PollEntry& entry);
+  void disarm(int fd, PollEntry& entry);
+  struct io_uring_sqe* getSqe();
+  int submit(unsigned minComplete, int timeoutMs);
+  int reapCompletions(ChannelList* activeChannels);
+  uint32_t newOperation(uint8_t opcode, int fd, const CompletionCallback& cb);
+  void freeOperation(uint32_t slot);
+  OperationId operationId(uint32_t slot) const;
+  void prepareRecv(uint32_t slot);
+  void provideRecvBuffers(int bid, int count);
+
+  int ringfd_;
+  unsigned features_;
+
+  void* sqRing_;
+  size_t sqRingSize_;
+  void* cqRing_;
+  size_t cqRingSize_;
+  struct io_uring_sqe* sqes_;
+  size_t sqesSize_;
+
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned sqMask_;
+  unsigned* sqArray_;
+  unsigned sqLocalTail_;
+  unsigned toSubmit_;
+
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  unsigned cqMask_;
+  struct io_uring_cqe* cqes_;
+
+  std::vector<PollEntry> entries_;  // indexed by fd
+  std::vector<int> dirtyFds_;
+
+  // in flight ones are leaked at destruction, with what their callbacks hold
+  std::vector<Operation*> operations_;
+  std::vector<uint32_t> freeOperations_;
+  std::vector<Completed> completed_;
+  char* recvBuffers_;  // kRecvBufferCount of kRecvBufferSize, allocated on first use
+};
+
+}
+}
+#endif  // MUDUO_NET_POLLER_IOURINGPOLLER_H
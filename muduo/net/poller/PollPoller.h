@@ -35,6 +35,7 @@ class PollPoller : public Poller
   virtual Timestamp poll(int timeoutMs, ChannelList* activeChannels);
   virtual void updateChannel(Channel* channel);
   virtual void removeChannel(Channel* channel);
+  virtual const char* name() const { return "poll"; }
 
  private:
   void fillActiveChannels(int numEvents,
@@ -7,6 +7,7 @@ project "net"
     includedirs('../..')
     headersdir('muduo/net')
     headers {
+        'Broadcaster.h',
         'Buffer.h',
         'Callbacks.h',
         'Channel.h',
@@ -23,7 +24,9 @@ project "net"
 
     files {
         'Acceptor.cc',
+        'Broadcaster.cc',
         'Buffer.cc',
+        'BufferPool.cc',
         'Channel.cc',
         'Connector.cc',
         'EventLoop.cc',
@@ -33,6 +36,7 @@ project "net"
         'Poller.cc',
         'poller/DefaultPoller.cc',
         'poller/EPollPoller.cc',
+        'poller/IoUringPoller.cc',
         'poller/PollPoller.cc',
         'Socket.cc',
         'SocketsOps.cc',
@@ -41,5 +45,6 @@ project "net"
         'TcpServer.cc',
         'Timer.cc',
         'TimerQueue.cc',
+        'TimingWheel.cc',
      }
 
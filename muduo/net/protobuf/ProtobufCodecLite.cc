@@ -9,6 +9,7 @@
 #include <muduo/net/protobuf/ProtobufCodecLite.h>
 // #include <muduo/net/protobuf/BufferStream.h>
 
+#include <muduo/base/Crc32c.h>
 #include <muduo/base/Logging.h>
 #include <muduo/net/Endian.h>
 #include <muduo/net/TcpConnection.h>
@@ -48,10 +49,11 @@ void ProtobufCodecLite::fillEmptyBuffer(muduo::net::Buffer* buf,
 
   int byte_size = serializeToBuffer(message, buf);
 
-  int32_t checkSum = checksum(buf->peek(), static_cast<int>(buf->readableBytes()));
+  int32_t checkSum = checksum(checksumType_, buf->peek(), static_cast<int>(buf->readableBytes()));
   buf->appendInt32(checkSum);
   assert(buf->readableBytes() == tag_.size() + byte_size + kChecksumLen); (void) byte_size;
-  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
+  int32_t flag = checksumType_ == kCrc32c ? kCrc32cFlag : 0;
+  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()) | flag);
   buf->prepend(&len, sizeof len);
 }
 
@@ -61,7 +63,9 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
 {
   while (buf->readableBytes() >= static_cast<uint32_t>(kMinMessageLen+kHeaderLen))
   {
-    const int32_t len = buf->peekInt32();
+    const int32_t size = buf->peekInt32();
+    const ChecksumType type = (size & kCrc32cFlag) ? kCrc32c : kAdler32;
+    const int32_t len = size & ~kCrc32cFlag;
     if (len > kMaxMessageLen || len < kMinMessageLen)
     {
       errorCallback_(conn, buf, receiveTime, kInvalidLength);
@@ -76,7 +80,7 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
       }
       MessagePtr message(prototype_->New());
       // FIXME: can we move deserialization & callback to other thread?
-      ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get());
+      ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get(), type);
       if (errorCode == kNoError)
       {
         // FIXME: try { } catch (...) { }
@@ -181,21 +185,31 @@ int32_t ProtobufCodecLite::checksum(const void* buf, int len)
       ::adler32(1, static_cast<const Bytef*>(buf), len));
 }
 
-bool ProtobufCodecLite::validateChecksum(const char* buf, int len)
+int32_t ProtobufCodecLite::checksum(ChecksumType type, const void* buf, int len)
+{
+  if (type == kCrc32c)
+  {
+    return static_cast<int32_t>(Crc32c::value(buf, static_cast<size_t>(len)));
+  }
+  return checksum(buf, len);
+}
+
+bool ProtobufCodecLite::validateChecksum(const char* buf, int len, ChecksumType type)
 {
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kChecksumLen);
-  int32_t checkSum = checksum(buf, len - kChecksumLen);
+  int32_t checkSum = checksum(type, buf, len - kChecksumLen);
   return checkSum == expectedCheckSum;
 }
 
 ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
                                                       int len,
-                                                      ::google::protobuf::Message* message)
+                                                      ::google::protobuf::Message* message,
+                                                      ChecksumType type)
 {
   ErrorCode error = kNoError;
 
-  if (validateChecksum(buf, len))
+  if (validateChecksum(buf, len, type))
   {
     if (memcmp(buf, tag_.data(), tag_.size()) == 0)
     {
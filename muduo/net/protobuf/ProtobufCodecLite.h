@@ -52,10 +52,13 @@ typedef boost::shared_ptr<google::protobuf::Message> MessagePtr;
 //
 // Field     Length  Content
 //
-// size      4-byte  M+N+4
+// size      4-byte  M+N+4, with kCrc32cFlag if the checksum is CRC32C
 // tag       M-byte  could be "RPC0", etc.
 // payload   N-byte
-// checksum  4-byte  adler32 of tag+payload
+// checksum  4-byte  adler32 of tag+payload, or CRC32C of them
+//
+// Both are accepted on receiving. Adler32 is sent by default, peers
+// without CRC32C would see kCrc32cFlag as an invalid length.
 //
 // This is an internal class, you should use ProtobufCodecT instead.
 class ProtobufCodecLite : boost::noncopyable
@@ -64,6 +67,13 @@ class ProtobufCodecLite : boost::noncopyable
   const static int kHeaderLen = sizeof(int32_t);
   const static int kChecksumLen = sizeof(int32_t);
   const static int kMaxMessageLen = 64*1024*1024; // same as codec_stream.h kDefaultTotalBytesLimit
+  const static int32_t kCrc32cFlag = 0x40000000; // above kMaxMessageLen
+
+  enum ChecksumType
+  {
+    kAdler32,
+    kCrc32c,
+  };
 
   enum ErrorCode
   {
@@ -99,7 +109,8 @@ class ProtobufCodecLite : boost::noncopyable
       messageCallback_(messageCb),
       rawCb_(rawCb),
       errorCallback_(errorCb),
-      kMinMessageLen(tagArg.size() + kChecksumLen)
+      kMinMessageLen(tagArg.size() + kChecksumLen),
+      checksumType_(kAdler32)
   {
   }
 
@@ -107,6 +118,10 @@ class ProtobufCodecLite : boost::noncopyable
 
   const string& tag() const { return tag_; }
 
+  // of the messages sent
+  void setChecksumType(ChecksumType type) { checksumType_ = type; }
+  ChecksumType checksumType() const { return checksumType_; }
+
   void send(const TcpConnectionPtr& conn,
             const ::google::protobuf::Message& message);
 
@@ -120,11 +135,13 @@ class ProtobufCodecLite : boost::noncopyable
   static const string& errorCodeToString(ErrorCode errorCode);
 
   // public for unit tests
-  ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message);
+  ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message,
+                  ChecksumType type = kAdler32);
   void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
 
   static int32_t checksum(const void* buf, int len);
-  static bool validateChecksum(const char* buf, int len);
+  static int32_t checksum(ChecksumType type, const void* buf, int len);
+  static bool validateChecksum(const char* buf, int len, ChecksumType type = kAdler32);
   static int32_t asInt32(const char* buf);
   static void defaultErrorCallback(const TcpConnectionPtr&,
                                    Buffer*,
@@ -138,6 +155,7 @@ class ProtobufCodecLite : boost::noncopyable
   RawMessageCallback rawCb_;
   ErrorCallback errorCallback_;
   const int kMinMessageLen;
+  ChecksumType checksumType_;
 };
 
 template<typename MSG, const char* TAG, typename CODEC=ProtobufCodecLite>  // TAG must be a variable with external linkage, not a string literal
@@ -168,6 +186,8 @@ class ProtobufCodecLiteT
 
   const string& tag() const { return codec_.tag(); }
 
+  void setChecksumType(ProtobufCodecLite::ChecksumType type) { codec_.setChecksumType(type); }
+
   void send(const TcpConnectionPtr& conn,
             const MSG& message)
   {
@@ -35,10 +35,10 @@ extern const char rpctag[];// = "RPC0";
 //
 // Field     Length  Content
 //
-// size      4-byte  N+8
+// size      4-byte  N+8, with kCrc32cFlag if CRC32C
 // "RPC0"    4-byte
 // payload   N-byte
-// checksum  4-byte  adler32 of "RPC0"+payload
+// checksum  4-byte  adler32 or CRC32C of "RPC0"+payload
 //
 
 typedef ProtobufCodecLiteT<RpcMessage, rpctag> RpcCodec;
@@ -23,6 +23,15 @@ void messageCallback(const TcpConnectionPtr&,
   g_msgptr = msg;
 }
 
+ProtobufCodecLite::ErrorCode g_errorCode = ProtobufCodecLite::kNoError;
+void errorCallback(const TcpConnectionPtr&,
+                   Buffer*,
+                   Timestamp,
+                   ProtobufCodecLite::ErrorCode errorCode)
+{
+  g_errorCode = errorCode;
+}
+
 void print(const Buffer& buf)
 {
   printf("encoded to %zd bytes\n", buf.readableBytes());
@@ -75,6 +84,66 @@ int main()
   codec.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
   assert(g_msgptr);
   assert(g_msgptr->DebugString() == message.DebugString());
+  g_msgptr.reset();
+  }
+
+  string crcFrame;
+  {
+  // CRC32C, flagged in the size, read by a codec sending Adler32
+  Buffer buf;
+  RpcCodec codec(rpcMessageCallback);
+  codec.setChecksumType(ProtobufCodecLite::kCrc32c);
+  codec.fillEmptyBuffer(&buf, message);
+  print(buf);
+  crcFrame = buf.toStringPiece().as_string();
+  assert(crcFrame.size() == expected.size());
+  assert(buf.peekInt32() == (0x13 | ProtobufCodecLite::kCrc32cFlag));
+  assert(crcFrame.substr(4, 15) == expected.substr(4, 15));
+  assert(crcFrame.substr(19) != expected.substr(19));
+
+  ProtobufCodecLite reader(&RpcMessage::default_instance(), "RPC0", messageCallback,
+                           ProtobufCodecLite::RawMessageCallback(), errorCallback);
+  reader.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  assert(g_errorCode == ProtobufCodecLite::kNoError);
+  assert(g_msgptr);
+  assert(g_msgptr->DebugString() == message.DebugString());
+  assert(buf.readableBytes() == 0);
+  g_msgptr.reset();
+  }
+
+  {
+  // legacy Adler32 frames, read by a codec sending CRC32C
+  ProtobufCodecLite reader(&RpcMessage::default_instance(), "RPC0", messageCallback,
+                           ProtobufCodecLite::RawMessageCallback(), errorCallback);
+  reader.setChecksumType(ProtobufCodecLite::kCrc32c);
+  Buffer buf;
+  buf.append(expected);
+  reader.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  assert(g_errorCode == ProtobufCodecLite::kNoError);
+  assert(g_msgptr);
+  assert(g_msgptr->DebugString() == message.DebugString());
+  g_msgptr.reset();
+  }
+
+  {
+  // a flipped payload bit, and a checksum of the other kind, are rejected
+  ProtobufCodecLite reader(&RpcMessage::default_instance(), "RPC0", messageCallback,
+                           ProtobufCodecLite::RawMessageCallback(), errorCallback);
+  string corrupted(crcFrame);
+  corrupted[10] = static_cast<char>(corrupted[10] ^ 0x01);
+  string mislabeled(expected);
+  mislabeled[0] = static_cast<char>(mislabeled[0] | 0x40);
+  const string frames[] = { corrupted, mislabeled };
+  for (size_t i = 0; i < sizeof frames / sizeof frames[0]; ++i)
+  {
+    g_errorCode = ProtobufCodecLite::kNoError;
+    Buffer buf;
+    buf.append(frames[i]);
+    reader.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+    assert(g_errorCode == ProtobufCodecLite::kCheckSumError);
+    assert(!g_msgptr);
+    assert(buf.readableBytes() == frames[i].size());
+  }
   }
 
   google::protobuf::ShutdownProtobufLibrary();
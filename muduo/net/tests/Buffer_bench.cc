@@ -0,0 +1,118 @@
+#include <muduo/base/ProcessInfo.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/BufferPool.h>
+#include <muduo/net/EventLoop.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// counts every malloc(3) of this process, including those of operator new.
+extern "C" void* __libc_malloc(size_t size);
+int64_t g_mallocs = 0;
+
+extern "C" void* malloc(size_t size)
+{
+  ++g_mallocs;
+  return __libc_malloc(size);
+}
+
+string rss()
+{
+  string status = ProcessInfo::procStatus();
+  size_t pos = status.find("VmRSS:");
+  if (pos == string::npos)
+    return "unknown";
+  size_t end = status.find('\n', pos);
+  return status.substr(pos + 6, end - pos - 6);
+}
+
+// Simulates idle connections which receive one message now and then,
+// pooled: Buffers with an EventLoop in thread, released after each message,
+//         as TcpConnection does.
+// plain:  no EventLoop, storage is kept, as before BufferPool.
+void bench(bool pooled, int numConns, int numMessages, int messageSize)
+{
+  boost::scoped_ptr<EventLoop> loop(pooled ? new EventLoop : NULL);
+  int fds[2];
+  if (::pipe(fds) < 0)
+  {
+    perror("pipe");
+    exit(1);
+  }
+  string message(messageSize, 'x');
+  Buffer* conns = new Buffer[numConns];
+
+  Timestamp start(Timestamp::now());
+  int64_t mallocs = g_mallocs;
+  for (int i = 0; i < numMessages; ++i)
+  {
+    Buffer& input = conns[i % numConns];
+    ssize_t nw = ::write(fds[1], message.data(), message.size());
+    int savedErrno = 0;
+    ssize_t nr = input.readFd(fds[0], &savedErrno);
+    if (nr != nw)
+    {
+      fprintf(stderr, "read %zd, written %zd\n", nr, nw);
+      exit(1);
+    }
+    input.retrieveAll();
+    if (pooled)
+    {
+      input.releaseIfEmpty();
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  mallocs = g_mallocs - mallocs;
+
+  printf("%6s conns %7d messages %8d size %6d: %5.2f us/msg, "
+         "%.3f mallocs/msg, RSS%s\n",
+         pooled ? "pooled" : "plain",
+         numConns, numMessages, messageSize,
+         seconds * 1e6 / numMessages,
+         static_cast<double>(mallocs) / numMessages,
+         rss().c_str());
+  if (loop)
+  {
+    BufferPool* pool = loop->bufferPool();
+    printf("       pool allocations %" PRId64 " mallocs %" PRId64 " cached %zu bytes\n",
+           pool->allocations(), pool->mallocs(), pool->cachedBytes());
+  }
+  delete[] conns;
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+void forkAndBench(bool pooled, int numConns, int numMessages, int messageSize)
+{
+  fflush(stdout);
+  pid_t pid = ::fork();
+  if (pid == 0)
+  {
+    bench(pooled, numConns, numMessages, messageSize);
+    fflush(stdout);
+    _exit(0);
+  }
+  ::waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char* argv[])
+{
+  int numConns = argc > 1 ? atoi(argv[1]) : 100000;
+  int numMessages = argc > 2 ? atoi(argv[2]) : 1000000;
+  const int sizes[] = { 100, 1000, 4000 };
+  for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i)
+  {
+    forkAndBench(false, numConns, numMessages, sizes[i]);
+    forkAndBench(true, numConns, numMessages, sizes[i]);
+  }
+}
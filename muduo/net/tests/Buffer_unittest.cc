@@ -1,12 +1,18 @@
 #include <muduo/net/Buffer.h>
+#include <muduo/net/BufferPool.h>
+#include <muduo/net/EventLoop.h>
 
 //#define BOOST_TEST_MODULE BufferTest
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 
+#include <unistd.h>
+
 using muduo::string;
 using muduo::net::Buffer;
+using muduo::net::BufferPool;
+using muduo::net::EventLoop;
 
 BOOST_AUTO_TEST_CASE(testBufferAppendRetrieve)
 {
@@ -152,6 +158,101 @@ BOOST_AUTO_TEST_CASE(testBufferFindEOL)
   BOOST_CHECK_EQUAL(buf.findEOL(buf.peek()+90000), null);
 }
 
+BOOST_AUTO_TEST_CASE(testBufferCopy)
+{
+  Buffer buf;
+  buf.append(string(300, 'x'));
+  buf.retrieve(100);
+  Buffer copy(buf);
+  BOOST_CHECK_EQUAL(copy.readableBytes(), 200);
+  BOOST_CHECK_EQUAL(copy.writableBytes(), buf.writableBytes());
+  BOOST_CHECK_EQUAL(copy.prependableBytes(), buf.prependableBytes());
+  BOOST_CHECK(copy.peek() != buf.peek());
+
+  buf.retrieveAll();
+  BOOST_CHECK_EQUAL(copy.retrieveAllAsString(), string(200, 'x'));
+
+  Buffer empty;
+  copy = empty;
+  BOOST_CHECK_EQUAL(copy.readableBytes(), 0);
+  BOOST_CHECK_EQUAL(copy.internalCapacity(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testBufferReleaseIfEmpty)
+{
+  Buffer buf;
+  BOOST_CHECK_EQUAL(buf.internalCapacity(), 0);
+  buf.append(string(2000, 'y'));
+  BOOST_CHECK(buf.internalCapacity() >= 2000 + Buffer::kCheapPrepend);
+
+  buf.releaseIfEmpty();
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 2000);
+
+  buf.retrieveAll();
+  buf.releaseIfEmpty();
+  BOOST_CHECK_EQUAL(buf.internalCapacity(), 0);
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 0);
+  BOOST_CHECK_EQUAL(buf.writableBytes(), Buffer::kInitialSize);
+  BOOST_CHECK_EQUAL(buf.prependableBytes(), Buffer::kCheapPrepend);
+
+  buf.append("muduo");
+  BOOST_CHECK_EQUAL(buf.retrieveAllAsString(), "muduo");
+}
+
+BOOST_AUTO_TEST_CASE(testBufferPool)
+{
+  EventLoop loop;
+  BufferPool* pool = loop.bufferPool();
+  const char* inner = NULL;
+  {
+    Buffer buf;
+    buf.append("muduo");
+    inner = buf.peek();
+  }
+  BOOST_CHECK_EQUAL(pool->allocations(), 1);
+  BOOST_CHECK_EQUAL(pool->mallocs(), 1);
+  BOOST_CHECK(pool->cachedBytes() > 0);
+
+  Buffer buf;
+  buf.append("muduo");
+  BOOST_CHECK_EQUAL(inner, buf.peek());
+  BOOST_CHECK_EQUAL(pool->allocations(), 2);
+  BOOST_CHECK_EQUAL(pool->mallocs(), 1);
+  BOOST_CHECK_EQUAL(pool->cachedBytes(), 0);
+
+  // grows into a bigger size class
+  buf.ensureWritableBytes(2*Buffer::kInitialSize);
+  buf.append(string(2*Buffer::kInitialSize, 'z'));
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 5 + 2*Buffer::kInitialSize);
+  BOOST_CHECK_EQUAL(pool->allocations(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(testBufferReadFdAfterUnwrite)
+{
+  EventLoop loop;
+  Buffer buf;
+  buf.append(string(200, 'x'));
+  buf.retrieve(100);
+  buf.unwrite(100);
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 0);
+
+  // more than writableBytes(), into a pooled block
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(::pipe(fds), 0);
+  string data;
+  for (int i = 0; data.size() < 20000; ++i)
+  {
+    data += static_cast<char>('a' + i % 26);
+  }
+  BOOST_REQUIRE_EQUAL(::write(fds[1], data.data(), data.size()),
+                      static_cast<ssize_t>(data.size()));
+  int savedErrno = 0;
+  BOOST_CHECK_EQUAL(buf.readFd(fds[0], &savedErrno), static_cast<ssize_t>(data.size()));
+  BOOST_CHECK_EQUAL(buf.retrieveAllAsString(), data);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 void output(Buffer&& buf, const void* inner)
 {
@@ -0,0 +1,90 @@
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/EventLoop.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Worker threads post functors back to one IO loop,
+// as the ThreadPool of examples/sudoku/server_prod.cc does with responses.
+
+EventLoop* g_loop;
+int64_t g_done = 0;  // in loop thread
+int64_t g_total = 0;
+
+void onPosted()
+{
+  if (++g_done == g_total)
+  {
+    g_loop->quit();
+  }
+}
+
+// burst == 0: post as fast as possible,
+// otherwise pause 50us after every burst, so that the loop falls asleep.
+void produce(CountDownLatch* start, int numPosts, int burst)
+{
+  start->wait();
+  for (int i = 0; i < numPosts; ++i)
+  {
+    g_loop->queueInLoop(onPosted);
+    if (burst > 0 && i % burst == burst - 1)
+    {
+      ::usleep(50);
+    }
+  }
+}
+
+void bench(int numThreads, int numPosts, int burst)
+{
+  EventLoop loop;
+  g_loop = &loop;
+  g_done = 0;
+  g_total = static_cast<int64_t>(numThreads) * numPosts;
+
+  CountDownLatch start(1);
+  boost::ptr_vector<Thread> threads;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads.push_back(new Thread(boost::bind(produce, &start, numPosts, burst)));
+    threads.back().start();
+  }
+
+  Timestamp begin(Timestamp::now());
+  start.countDown();
+  loop.loop();
+  double seconds = timeDifference(Timestamp::now(), begin);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads[i].join();
+  }
+
+  printf("%2d threads burst %4d: %8.3f M posts/s, %8" PRId64 " loop iterations, %6.1f posts/iteration\n",
+         numThreads, burst, static_cast<double>(g_total) / seconds / 1e6,
+         loop.iteration(), static_cast<double>(g_total) / static_cast<double>(loop.iteration()));
+}
+
+int main(int argc, char* argv[])
+{
+  int numPosts = argc > 1 ? atoi(argv[1]) : 1000*1000;
+  const int kThreads[] = { 1, 2, 4, 8 };
+  const int kBursts[] = { 0, 1, 100 };
+  for (size_t b = 0; b < sizeof kBursts / sizeof kBursts[0]; ++b)
+  {
+    for (size_t t = 0; t < sizeof kThreads / sizeof kThreads[0]; ++t)
+    {
+      int posts = kBursts[b] == 1 ? numPosts / 100 : numPosts;
+      bench(kThreads[t], posts / kThreads[t], kBursts[b]);
+    }
+  }
+}
@@ -0,0 +1,132 @@
+#include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// An echo server and pingpong clients in one process, as examples/pingpong
+// runs them in two, on each Poller in turn.  The server and the clients
+// have a loop each, so at least two cores are needed for the numbers to
+// mean something.
+
+const uint16_t kPort = 2017;
+
+EventLoop* g_serverLoop;
+int64_t g_bytesRead = 0;  // in client loop
+int64_t g_messagesRead = 0;
+
+void selectPoller(const char* name)
+{
+  ::unsetenv("MUDUO_USE_IOURING");
+  ::unsetenv("MUDUO_USE_POLL");
+  if (string(name) == "io_uring")
+  {
+    ::setenv("MUDUO_USE_IOURING", "1", 1);
+  }
+  else if (string(name) == "poll")
+  {
+    ::setenv("MUDUO_USE_POLL", "1", 1);
+  }
+}
+
+void onServerMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  conn->send(buf);
+}
+
+void onClientConnection(const string* message, const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    conn->send(*message);
+  }
+}
+
+void onClientMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  g_bytesRead += buf->readableBytes();
+  ++g_messagesRead;
+  conn->send(buf);
+}
+
+void stop(EventLoop* loop, boost::ptr_vector<TcpClient>* clients)
+{
+  for (size_t i = 0; i < clients->size(); ++i)
+  {
+    (*clients)[i].disconnect();
+  }
+  loop->quit();
+}
+
+void clientThread(int numSessions, int blockSize, double seconds, double* elapsed)
+{
+  EventLoop loop;
+  string message(blockSize, 'x');
+  boost::ptr_vector<TcpClient> clients;
+  for (int i = 0; i < numSessions; ++i)
+  {
+    clients.push_back(new TcpClient(&loop, InetAddress("127.0.0.1", kPort), "PollerBench"));
+    clients.back().setConnectionCallback(boost::bind(onClientConnection, &message, _1));
+    clients.back().setMessageCallback(onClientMessage);
+    clients.back().connect();
+  }
+  loop.runAfter(seconds, boost::bind(stop, &loop, &clients));
+  Timestamp begin(Timestamp::now());
+  loop.loop();
+  *elapsed = timeDifference(Timestamp::now(), begin);
+  g_serverLoop->quit();
+}
+
+void bench(const char* poller, int numSessions, int blockSize, double seconds)
+{
+  selectPoller(poller);
+  g_bytesRead = 0;
+  g_messagesRead = 0;
+
+  EventLoop loop;
+  g_serverLoop = &loop;
+  TcpServer server(&loop, InetAddress(kPort), "PollerBench");
+  server.setMessageCallback(onServerMessage);
+  server.start();
+
+  double elapsed = 0;
+  Thread client(boost::bind(clientThread, numSessions, blockSize, seconds, &elapsed), "client");
+  client.start();
+  loop.loop();
+  client.join();
+
+  printf("%-8s %4d sessions %6d bytes: %9.2f MiB/s %9.1f K reads/s\n",
+         loop.pollerName(), numSessions, blockSize,
+         static_cast<double>(g_bytesRead) / elapsed / 1024 / 1024,
+         static_cast<double>(g_messagesRead) / elapsed / 1000);
+}
+
+int main(int argc, char* argv[])
+{
+  Logger::setLogLevel(Logger::WARN);
+  double seconds = argc > 1 ? atof(argv[1]) : 3;
+  const char* kPollers[] = { "epoll", "poll", "io_uring" };
+  const int kSessions[] = { 1, 100 };
+  const int kBlockSizes[] = { 64, 16384 };
+  for (size_t s = 0; s < sizeof kSessions / sizeof kSessions[0]; ++s)
+  {
+    for (size_t b = 0; b < sizeof kBlockSizes / sizeof kBlockSizes[0]; ++b)
+    {
+      for (size_t p = 0; p < sizeof kPollers / sizeof kPollers[0]; ++p)
+      {
+        bench(kPollers[p], kSessions[s], kBlockSizes[b], seconds);
+      }
+    }
+  }
+}
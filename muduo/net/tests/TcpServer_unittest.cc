@@ -0,0 +1,271 @@
+#include <muduo/net/TcpServer.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+#include <muduo/net/Broadcaster.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Connects and closes raw sockets, and checks the ids the server gives,
+// its lookup by id, and its walk over the connections of every loop.
+// The server echoes, and answers "file" with buffers, a file and "end",
+// more than the socket buffers hold, so that output is queued in every way.
+// A file that can't be sent, or is shorter than asked, closes the connection.
+
+const uint16_t kPort = 2016;
+const int kClients = 10;
+const int kRepeats = 5;
+
+TcpServer* g_server;
+MutexLock g_mutex;
+std::set<uint64_t> g_live;
+std::set<uint64_t> g_everUsed;
+std::vector<TcpConnectionPtr> g_connections;
+CountDownLatch* g_changes;
+AtomicInt32 g_visited;
+string g_large;
+int g_filefd;
+int g_badfd;
+
+void check(bool ok, const char* what)
+{
+  if (!ok)
+  {
+    fprintf(stderr, "FAILED: %s\n", what);
+    abort();
+  }
+}
+
+void checkRemoved(uint64_t id)
+{
+  check(!g_server->findConnection(id), "gone once closed");
+  g_changes->countDown();
+}
+
+void onConnection(const TcpConnectionPtr& conn)
+{
+  // in the loop of conn, where the server may look it up
+  TcpConnectionPtr found = g_server->findConnection(conn->id());
+  {
+    MutexLockGuard lock(g_mutex);
+    if (conn->connected())
+    {
+      check(conn->id() != 0, "id is never 0");
+      check(found == conn, "found while connected");
+      check(g_everUsed.insert(conn->id()).second, "id reused");
+      g_live.insert(conn->id());
+      g_connections.push_back(conn);
+    }
+    else
+    {
+      // removed right after this callback
+      check(found == conn, "found while disconnecting");
+      g_live.erase(conn->id());
+      g_connections.erase(std::find(g_connections.begin(), g_connections.end(), conn));
+    }
+  }
+  if (conn->connected())
+  {
+    g_changes->countDown();
+  }
+  else
+  {
+    conn->getLoop()->queueInLoop(boost::bind(checkRemoved, conn->id()));
+  }
+}
+
+void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+{
+  if (buf->readableBytes() == 4 && string(buf->peek(), 4) == "file")
+  {
+    buf->retrieveAll();
+    for (int i = 0; i < kRepeats; ++i)
+    {
+      conn->send(g_large);
+    }
+    conn->sendFile(g_filefd, 0, kRepeats * g_large.size());
+    conn->send("end");
+  }
+  else if (buf->readableBytes() == 3 && string(buf->peek(), 3) == "bad")
+  {
+    buf->retrieveAll();
+    conn->sendFile(g_badfd, 0, 100);
+  }
+  else if (buf->readableBytes() == 5 && string(buf->peek(), 5) == "short")
+  {
+    buf->retrieveAll();
+    // 3 bytes left in the file
+    conn->sendFile(g_filefd, kRepeats * g_large.size() - 3, 100);
+    conn->send("end");
+  }
+  else
+  {
+    conn->send(buf);
+  }
+}
+
+void visit(const TcpConnectionPtr& conn, CountDownLatch* latch)
+{
+  check(conn->getLoop() == EventLoop::getEventLoopOfCurrentThread(), "visited in its loop");
+  g_visited.increment();
+  latch->countDown();
+}
+
+int connectOne()
+{
+  int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+  // a small window, so that the server queues its output
+  int rcvbuf = 16 * 1024;
+  ::setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+  InetAddress addr("127.0.0.1", kPort);
+  check(::connect(sockfd, addr.getSockAddr(), sizeof(struct sockaddr_in)) == 0, "connect");
+  return sockfd;
+}
+
+void readPayload(int sockfd, const string& payload)
+{
+  string received;
+  char buf[65536];
+  while (received.size() < payload.size())
+  {
+    ssize_t n = ::read(sockfd, buf, std::min(sizeof buf, payload.size() - received.size()));
+    check(n > 0, "read");
+    received.append(buf, n);
+  }
+  check(received == payload, "payload");
+}
+
+size_t numLive()
+{
+  MutexLockGuard lock(g_mutex);
+  return g_live.size();
+}
+
+void clientThread(EventLoop* loop)
+{
+  std::vector<int> sockets;
+  CountDownLatch connected(kClients);
+  g_changes = &connected;
+  for (int i = 0; i < kClients; ++i)
+  {
+    sockets.push_back(connectOne());
+  }
+  connected.wait();
+  check(numLive() == kClients, "all connected");
+
+  CountDownLatch visited(kClients);
+  g_server->forEachConnection(boost::bind(visit, _1, &visited));
+  visited.wait();
+  check(g_visited.get() == kClients, "visited each once");
+
+  // large enough to be queued by reference, then small enough to be copied
+  const string& large = g_large;
+  SharedPayload payload(new string(large));
+  g_server->broadcast(payload);
+  {
+    MutexLockGuard lock(g_mutex);
+    broadcast(g_connections.begin(), g_connections.end(), SharedPayload(new string("small")));
+  }
+  for (int i = 0; i < kClients; ++i)
+  {
+    readPayload(sockets[i], large + "small");
+  }
+
+  for (int i = 0; i < kClients; ++i)
+  {
+    check(::write(sockets[i], "ping", 4) == 4, "write");
+    readPayload(sockets[i], "ping");
+    check(::write(sockets[i], "file", 4) == 4, "write");
+    string repeated;
+    for (int j = 0; j < 2 * kRepeats; ++j)
+    {
+      repeated += large;
+    }
+    readPayload(sockets[i], repeated + "end");
+  }
+
+  // frees slots, which the next connections take with new ids
+  CountDownLatch closed(kClients / 2);
+  g_changes = &closed;
+  char eof;
+  check(::write(sockets[0], "bad", 3) == 3, "write");
+  check(::read(sockets[0], &eof, 1) == 0, "closed by server");
+  check(::write(sockets[1], "short", 5) == 5, "write");
+  readPayload(sockets[1], large.substr(large.size() - 3));
+  check(::read(sockets[1], &eof, 1) == 0, "closed at the end of the file");
+  for (int i = 0; i < kClients / 2; ++i)
+  {
+    ::close(sockets[i]);
+  }
+  closed.wait();
+  check(numLive() == kClients - kClients / 2, "half closed");
+
+  CountDownLatch reconnected(kClients / 2);
+  g_changes = &reconnected;
+  for (int i = 0; i < kClients / 2; ++i)
+  {
+    sockets[i] = connectOne();
+  }
+  reconnected.wait();
+  check(numLive() == kClients, "reconnected");
+
+  CountDownLatch allClosed(kClients);
+  g_changes = &allClosed;
+  for (int i = 0; i < kClients; ++i)
+  {
+    ::close(sockets[i]);
+  }
+  allClosed.wait();
+  check(numLive() == 0, "all closed");
+  check(g_everUsed.size() == kClients + kClients / 2, "ids");
+
+  loop->quit();
+}
+
+int main(int argc, char* argv[])
+{
+  Logger::setLogLevel(Logger::WARN);
+  int numThreads = argc > 1 ? atoi(argv[1]) : 3;
+  for (int i = 0; g_large.size() < 1000 * 1000; ++i)
+  {
+    g_large += static_cast<char>('a' + i % 26);
+  }
+  FILE* file = ::tmpfile();
+  for (int i = 0; i < kRepeats; ++i)
+  {
+    check(::fwrite(g_large.data(), 1, g_large.size(), file) == g_large.size(), "tmpfile");
+  }
+  ::fflush(file);
+  g_filefd = ::fileno(file);
+  g_badfd = ::open("/dev/null", O_WRONLY);
+
+  EventLoop loop;
+  TcpServer server(&loop, InetAddress(kPort), "TcpServerTest");
+  g_server = &server;
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(numThreads);
+  server.start();
+
+  Thread client(boost::bind(clientThread, &loop), "client");
+  client.start();
+  loop.loop();
+  client.join();
+  printf("%d threads, %zd ids, OK\n", numThreads, g_everUsed.size());
+}
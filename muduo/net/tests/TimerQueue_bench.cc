@@ -0,0 +1,120 @@
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TimerId.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+EventLoop* g_loop;
+int g_fired = 0;
+int g_expected = 0;
+double g_totalLate = 0;
+double g_maxLate = 0;
+int g_early = 0;
+
+void noop()
+{
+}
+
+void onTimer(Timestamp when)
+{
+  double late = timeDifference(Timestamp::now(), when);
+  if (late < 0)
+    ++g_early;
+  g_totalLate += late;
+  g_maxLate = std::max(g_maxLate, late);
+  if (++g_fired == g_expected)
+    g_loop->quit();
+}
+
+// seconds in [lo, hi)
+double randomDelay(double lo, double hi)
+{
+  return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+void addAndCancel(EventLoop* loop, int numTimers, const char* name)
+{
+  std::vector<TimerId> ids;
+  ids.reserve(numTimers);
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < numTimers; ++i)
+  {
+    // idle timeouts and heartbeats, far from firing
+    ids.push_back(loop->runAfter(randomDelay(10, 3600), noop));
+  }
+  Timestamp added(Timestamp::now());
+  std::random_shuffle(ids.begin(), ids.end());
+  for (int i = 0; i < numTimers; ++i)
+  {
+    loop->cancel(ids[i]);
+  }
+  Timestamp canceled(Timestamp::now());
+  printf("  %-6s add %6.3f us/timer, cancel %6.3f us/timer\n", name,
+         timeDifference(added, start) * 1e6 / numTimers,
+         timeDifference(canceled, added) * 1e6 / numTimers);
+}
+
+void fire(EventLoop* loop, int numTimers, double spread)
+{
+  g_fired = 0;
+  g_expected = numTimers;
+  g_totalLate = g_maxLate = 0;
+  g_early = 0;
+  for (int i = 0; i < numTimers; ++i)
+  {
+    Timestamp when = addTime(Timestamp::now(), randomDelay(0.1, 0.1 + spread));
+    loop->runAt(when, boost::bind(onTimer, when));
+  }
+  Timestamp start(Timestamp::now());
+  loop->loop();
+  double elapsed = timeDifference(Timestamp::now(), start);
+  printf("  fire   %d timers in %.3f s, late avg %.3f ms max %.3f ms, early %d\n",
+         g_fired, elapsed, g_totalLate * 1e3 / g_fired, g_maxLate * 1e3, g_early);
+}
+
+void bench(bool wheel, int numTimers)
+{
+  if (wheel)
+    ::setenv("MUDUO_USE_TIMING_WHEEL", "1", 1);
+  else
+    ::unsetenv("MUDUO_USE_TIMING_WHEEL");
+  srand(1);
+
+  printf("%s, %d timers\n", wheel ? "wheel" : "set", numTimers);
+  EventLoop loop;
+  g_loop = &loop;
+  addAndCancel(&loop, numTimers, "first");
+  // timers come from the free list now
+  addAndCancel(&loop, numTimers, "pooled");
+  fire(&loop, numTimers, 2.0);
+}
+
+int main(int argc, char* argv[])
+{
+  int numTimers = argc > 1 ? atoi(argv[1]) : 1000*1000;
+  const bool modes[] = { false, true };
+  for (size_t i = 0; i < sizeof modes / sizeof modes[0]; ++i)
+  {
+    // separate processes, so that heap state does not leak between runs
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+      bench(modes[i], numTimers);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+  }
+}
@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <sys/socket.h>
+
+#include "UdpPacketRing.h"
+#include "UdpSocket.h"
+
+
+using namespace muduo;
+using namespace muduo::net;
+
+
+UdpPacketRing::UdpPacketRing(size_t capacity, size_t slotSize)
+    : capacity_(capacity),
+      slotSize_(slotSize),
+      head_(0),
+      size_(0),
+      arena_(new char[capacity * slotSize]),
+      lengths_(new size_t[capacity]),
+      segmentSizes_(new size_t[capacity]),
+      truncated_(new bool[capacity]),
+      addresses_(new struct sockaddr_in6[capacity]),
+      addressLengths_(new socklen_t[capacity]),
+      headers_(new struct mmsghdr[capacity]),
+      iovecs_(new struct iovec[capacity]),
+      controls_(new char[capacity * kUdpControlSize]) {
+    assert(capacity > 0);
+    ::memset(segmentSizes_.get(), 0, capacity * sizeof(size_t));
+    ::memset(truncated_.get(), 0, capacity * sizeof(bool));
+}
+
+UdpPacketRing::~UdpPacketRing() {
+}
+
+bool UdpPacketRing::Push(const void* buf, size_t len, const InetAddress& address) {
+    if (Full() || len > slotSize_) {
+        return false;
+    }
+
+    SockaddrStorage storage;
+    if (!SockaddrStorage::ToSockAddr(address, &storage)) {
+        return false;
+    }
+
+    size_t idx = index(size_);
+    ::memcpy(slot(idx), buf, len);
+    lengths_[idx] = len;
+    segmentSizes_[idx] = 0;
+    truncated_[idx] = false;
+    ::memcpy(&addresses_[idx], storage.Addr, storage.AddrLen);
+    addressLengths_[idx] = storage.AddrLen;
+    ++size_;
+    return true;
+}
+
+const struct sockaddr* UdpPacketRing::Address(size_t i) const {
+    return reinterpret_cast<const struct sockaddr*>(&addresses_[index(i)]);
+}
+
+InetAddress UdpPacketRing::PeerAddress(size_t i) const {
+    InetAddress address;
+    address.setSockAddrInet6(addresses_[index(i)]);
+    return address;
+}
+
+void UdpPacketRing::AppendDatagrams(size_t n, std::vector<UdpDatagram>* datagrams) const {
+    assert(n <= size_);
+    for (size_t i = 0; i < n; ++i) {
+        if (Truncated(i)) {
+            continue;
+        }
+        UdpDatagram datagram = { Data(i), Length(i), PeerAddress(i) };
+        size_t segmentSize = SegmentSize(i);
+        if (segmentSize == 0 || segmentSize >= datagram.Length) {
+            datagrams->push_back(datagram);
+            continue;
+        }
+
+        const char* end = datagram.Data + datagram.Length;
+        for (const char* p = datagram.Data; p < end; p += segmentSize) {
+            datagram.Data = p;
+            datagram.Length = std::min(segmentSize, static_cast<size_t>(end - p));
+            datagrams->push_back(datagram);
+        }
+    }
+}
+
+void UdpPacketRing::Pop(size_t n) {
+    assert(n <= size_);
+    head_ = index(n);
+    size_ -= n;
+    if (size_ == 0) {
+        head_ = 0;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <vector>
+
+#include <muduo/net/InetAddress.h>
+
+
+struct mmsghdr;
+struct iovec;
+
+namespace muduo {
+namespace net {
+
+// A datagram received, pointing into the slot of a UdpPacketRing.
+struct UdpDatagram {
+    const char* Data;
+    size_t Length;
+    InetAddress PeerAddr;
+};
+
+// A ring of preallocated slots, each for a datagram and its peer address,
+// filled by UdpSocket::RecvBatch() and drained by UdpSocket::SendBatch()
+// with one syscall for many datagrams.
+//
+// With UDP GRO, a slot may hold several datagrams of SegmentSize() bytes
+// from the same peer, the last one may be shorter.
+class UdpPacketRing : boost::noncopyable {
+    public:
+        UdpPacketRing(size_t capacity, size_t slotSize);
+        ~UdpPacketRing();
+
+        size_t Capacity() const { return capacity_; }
+        size_t SlotSize() const { return slotSize_; }
+        size_t Size() const { return size_; }
+        bool Empty() const { return size_ == 0; }
+        bool Full() const { return size_ == capacity_; }
+
+        // copies to the back, returns false if full or len is larger than a slot
+        bool Push(const void* buf, size_t len, const InetAddress& address);
+
+        // the i-th from the front
+        const char* Data(size_t i) const { return slot(index(i)); }
+        size_t Length(size_t i) const { return lengths_[index(i)]; }
+        size_t SegmentSize(size_t i) const { return segmentSizes_[index(i)]; }
+        bool Truncated(size_t i) const { return truncated_[index(i)]; }
+        const struct sockaddr* Address(size_t i) const;
+        InetAddress PeerAddress(size_t i) const;
+
+        // datagrams of the front n slots, split by their segment size,
+        // but the truncated
+        void AppendDatagrams(size_t n, std::vector<UdpDatagram>* datagrams) const;
+
+        void Pop(size_t n);
+        void Clear() { head_ = 0; size_ = 0; }
+
+    private:
+        friend class UdpSocket;
+
+        size_t index(size_t i) const { return (head_ + i) % capacity_; }
+        char* slot(size_t idx) const { return arena_.get() + idx * slotSize_; }
+
+        const size_t capacity_;
+        const size_t slotSize_;
+        size_t head_;
+        size_t size_;
+
+        boost::scoped_array<char> arena_;
+        boost::scoped_array<size_t> lengths_;
+        boost::scoped_array<size_t> segmentSizes_;  // 0 if not coalesced
+        boost::scoped_array<bool> truncated_;
+        boost::scoped_array<struct sockaddr_in6> addresses_;
+        boost::scoped_array<socklen_t> addressLengths_;
+
+        // scratch of the syscalls, one per slot
+        boost::scoped_array<struct mmsghdr> headers_;
+        boost::scoped_array<struct iovec> iovecs_;
+        boost::scoped_array<char> controls_;
+};
+
+}
+}
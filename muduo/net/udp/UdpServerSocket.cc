@@ -1,5 +1,7 @@
 
 
+#include <algorithm>
+
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/Channel.h>
 #include <muduo/net/SocketsOps.h>
@@ -11,6 +13,14 @@
 using namespace  muduo;
 using namespace  muduo::net;
 
+const size_t UdpServerSocket::kDefaultBatchSize;
+const size_t UdpServerSocket::kDefaultSendQueueSize;
+
+namespace {
+// a slot of kMaxUdpOffloadSize each, with GRO
+const size_t kOffloadBatchSize = 16;
+}
+
 
 static void DefaultMessageCallback(const UdpServerSocketPtr& socket, Buffer* buf, Timestamp receiveTime, const InetAddress& address) {
     (void)buf;
@@ -30,7 +40,12 @@ UdpServerSocket::UdpServerSocket(EventLoop* loop,
     maxPacketSize_(maxPacketSize),
     readBuf_(maxPacketSize+ 1),
     messageCallback_(DefaultMessageCallback),
-    writeBlocked_(false) {
+    batchSize_(kDefaultBatchSize),
+    sendQueueSize_(kDefaultSendQueueSize),
+    offload_(false),
+    writeBlocked_(false),
+    flushPending_(false),
+    droppedPackets_(0) {
 
     LOG_DEBUG << "UdpServerSocket::ctor[" << name_ << "] at " << this;
 }
@@ -74,6 +89,26 @@ void UdpServerSocket::startInLoop() {
         socket_.SetReceiveBufferSize(receiveBufferSize_);
     }
 
+    if (offload_) {
+        int error = socket_.EnableReceiveOffload();
+        if (error != 0) {
+            LOG_WARN << "UdpServerSocket[" << name_ << "] no UDP GRO, errno = " << error;
+        }
+        error = socket_.EnableSendOffload();
+        if (error != 0) {
+            LOG_WARN << "UdpServerSocket[" << name_ << "] no UDP GSO, errno = " << error;
+        }
+    }
+
+    // larger ones are truncated, and dropped
+    if (socket_.ReceiveOffload()) {
+        recvRing_.reset(new UdpPacketRing(std::min(batchSize_, kOffloadBatchSize),
+                                          kMaxUdpOffloadSize));
+    } else {
+        recvRing_.reset(new UdpPacketRing(batchSize_, maxPacketSize_));
+    }
+    sendRing_.reset(new UdpPacketRing(sendQueueSize_, maxPacketSize_));
+
     assert(socket_.IsConnected());
     channel_.reset(new Channel(loop_, socket_.sockfd()));
     channel_->setReadCallback(boost::bind(&UdpServerSocket::handleRead,   this, _1));
@@ -108,63 +143,55 @@ void UdpServerSocket::SendTo(Buffer* message, const InetAddress& address) {
 
 void UdpServerSocket::handleRead(Timestamp receiveTime) {
     assert(socket_.IsConnected());
-    assert(readBuf_.writableBytes() > 0);
-
-    InetAddress address;
-    ssize_t nr = socket_.RecvFrom(readBuf_.beginWrite(),
-                              readBuf_.writableBytes(), &address);
 
+    int nr = socket_.RecvBatch(recvRing_.get());
     if (nr < 0) {
-        errno = static_cast<int>(nr);
-        LOG_SYSERR << "UdpServerSocket::HandleRead";
-        handleError();
-    } else if (muduo::implicit_cast<size_t>(nr) <= maxPacketSize_) {
-        readBuf_.hasWritten(nr);
-
-        if (messageCallback_) {
-            messageCallback_(shared_from_this(), &readBuf_, receiveTime, address);
+        if (nr != -EAGAIN && nr != -EWOULDBLOCK) {
+            handleError();
         }
+        return;
+    }
 
-        readBuf_.retrieveAll();
-    } else {
-        LOG_WARN << "received packet size is too large from " << address.toIpPort()
-                 << ", datagram has been truncated";
+    datagrams_.clear();
+    recvRing_->AppendDatagrams(recvRing_->Size(), &datagrams_);
+    recvRing_->Clear();
+
+    UdpServerSocketPtr guard(shared_from_this());
+    if (batchMessageCallback_) {
+        batchMessageCallback_(guard, datagrams_, receiveTime);
+    } else if (messageCallback_) {
+        for (size_t i = 0; i < datagrams_.size(); ++i) {
+            const UdpDatagram& datagram = datagrams_[i];
+            readBuf_.append(datagram.Data, datagram.Length);
+            messageCallback_(guard, &readBuf_, receiveTime, datagram.PeerAddr);
+            readBuf_.retrieveAll();
+        }
     }
 }
 
 void UdpServerSocket::handleWrite() {
     setWritable();
-
-    auto packetIterator = queuePackets_.begin();
-    while (!isWriteBlocked() && packetIterator != queuePackets_.end()) {
-        if (handleWrite(&(*packetIterator)) >= 0) {
-            packetIterator = queuePackets_.erase(packetIterator);
-        } else {
-            ++packetIterator;
-        }
-    }
-
-    if (queuePackets_.empty()) {
+    flush();
+    if (!isWriteBlocked()) {
         channel_->disableWriting();
     }
 }
 
-ssize_t UdpServerSocket::handleWrite(QueuePacket* packet) {
-    assert(!isWriteBlocked());
-
-
-    ssize_t nw = socket_.SendTo(packet->Data, packet->Size, packet->PeerAddr);
-    if (nw < 0) {
-        if (nw == EAGAIN || nw == EWOULDBLOCK) {
-            setWriteBlocked();
-        }
-
-        errno = static_cast<int>(nw);
-        LOG_SYSERR << "UdpServerSocket::HanleWrite";
+void UdpServerSocket::flush() {
+    flushPending_ = false;
+    if (isWriteBlocked() || sendRing_->Empty()) {
+        return;
+    }
 
+    int nw = socket_.SendBatch(sendRing_.get());
+    if (nw < 0 && nw != -EAGAIN && nw != -EWOULDBLOCK && nw != -ENOBUFS) {
         handleError();
     }
-    return nw;
+
+    if (!sendRing_->Empty()) {
+        setWriteBlocked();
+        channel_->enableWriting();
+    }
 }
 
 void UdpServerSocket::sendToInLoop(const StringPiece& message, const InetAddress& address) {
@@ -176,24 +203,25 @@ void UdpServerSocket::sendToInLoop(const void* message, size_t len, const InetAd
 
     assert(socket_.IsConnected());
 
-    if (isWriteBlocked()) {
-        queuePackets_.push_back(new QueuePacket(message, len, address));
+    if (len > sendRing_->SlotSize()) {
+        LOG_ERROR << "UdpServerSocket::SendToInLoop packet of " << len
+                  << " bytes is larger than " << sendRing_->SlotSize();
+        ++droppedPackets_;
         return;
     }
 
-    ssize_t nw = socket_.SendTo(message, len, address);
-
-    if (nw < 0) {
-        if (nw == EAGAIN || nw == EWOULDBLOCK) {
-            setWriteBlocked();
-            channel_->enableWriting();
-            queuePackets_.push_back(new QueuePacket(message, len, address));
-        }
+    if (sendRing_->Full()) {
+        flush();
+    }
 
-        errno = static_cast<int>(nw);
-        LOG_SYSERR << "UdpServerSocket::SendToInLoop";
+    if (!sendRing_->Push(message, len, address)) {
+        ++droppedPackets_;
+        return;
+    }
 
-        handleError();
+    if (!flushPending_ && !isWriteBlocked()) {
+        flushPending_ = true;
+        loop_->queueInLoop(boost::bind(&UdpServerSocket::flush, shared_from_this()));
     }
 }
 
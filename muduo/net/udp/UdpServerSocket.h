@@ -4,7 +4,7 @@
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
-#include <boost/ptr_container/ptr_list.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 #include <muduo/base/Atomic.h>
@@ -15,6 +15,9 @@
 
 
 #include "UdpSocket.h"
+#include "UdpPacketRing.h"
+
+#include <vector>
 
 
 
@@ -33,23 +36,13 @@ class UdpServerSocket : boost::noncopyable, public boost::enable_shared_from_thi
     public:
         typedef boost::function<void(const UdpServerSocketPtr&, Buffer*, Timestamp,
                                      const InetAddress&)> MessageCallback;
+        // all datagrams of a recvmmsg(), valid in the callback only
+        typedef boost::function<void(const UdpServerSocketPtr&,
+                                     const std::vector<UdpDatagram>&,
+                                     Timestamp)> BatchMessageCallback;
 
-        struct QueuePacket {
-            QueuePacket(const void* buf, size_t len,
-                        const InetAddress& addr)
-                : Data(new char[len]), Size(len), PeerAddr(addr) {
-                ::memcpy(Data, buf, len);
-            }
-
-            ~QueuePacket() {
-                delete[] Data;
-                Data = NULL;
-            }
-
-            char* Data;
-            const size_t Size;
-            const InetAddress PeerAddr;
-        };
+        static const size_t kDefaultBatchSize = 64;
+        static const size_t kDefaultSendQueueSize = 256;
 
         UdpServerSocket(EventLoop* loop,
                 const InetAddress& listenAddr,
@@ -83,6 +76,38 @@ class UdpServerSocket : boost::noncopyable, public boost::enable_shared_from_thi
             messageCallback_ = cb;
         }
 
+        // takes over from the message callback if set
+        void SetBatchMessageCallback(const BatchMessageCallback& cb) {
+            batchMessageCallback_ = cb;
+        }
+
+        // datagrams received by a recvmmsg(), before Start()
+        void SetBatchSize(size_t size) {
+            assert(size > 0);
+            batchSize_ = size;
+        }
+
+        // datagrams queued for sendmmsg(), those sent when full are dropped,
+        // before Start()
+        void SetSendQueueSize(size_t size) {
+            assert(size > 0);
+            sendQueueSize_ = size;
+        }
+
+        // UDP GRO and GSO where the kernel supports them, before Start()
+        void EnableOffload(bool on) {
+            offload_ = on;
+        }
+
+        // see UdpSocket::SteerReusePort(), once bound by Start()
+        int SteerReusePort(uint32_t offset, uint32_t groupSize) {
+            return socket_.SteerReusePort(offset, groupSize);
+        }
+
+        int64_t DroppedPackets() const {
+            return droppedPackets_;
+        }
+
         void SetReceiveBufferSize(int32_t size) {
             assert(size > 0);
             receiveBufferSize_ = size;
@@ -90,7 +115,7 @@ class UdpServerSocket : boost::noncopyable, public boost::enable_shared_from_thi
 
         void SetSendBufferSize(int32_t size) {
             assert(size > 0);
-            sendBufferSize_ = 0;
+            sendBufferSize_ = size;
         }
     private:
         // in loop execute
@@ -102,8 +127,9 @@ class UdpServerSocket : boost::noncopyable, public boost::enable_shared_from_thi
 
         void handleRead(Timestamp receiveTime);
         void handleWrite();
-        ssize_t handleWrite(QueuePacket* packet);
         void handleError();
+        // sends the queue by sendmmsg(), once per loop iteration
+        void flush();
 
 
         void sendToInLoop(const StringPiece& message, const InetAddress& address);
@@ -125,11 +151,20 @@ class UdpServerSocket : boost::noncopyable, public boost::enable_shared_from_thi
         Buffer  readBuf_;
 
         MessageCallback messageCallback_;
+        BatchMessageCallback batchMessageCallback_;
         AtomicInt32 started_;
 
+        size_t batchSize_;
+        size_t sendQueueSize_;
+        bool offload_;
+
         bool writeBlocked_;
+        bool flushPending_;
+        int64_t droppedPackets_;
 
-        boost::ptr_list<QueuePacket> queuePackets_;
+        boost::scoped_ptr<UdpPacketRing> recvRing_;
+        boost::scoped_ptr<UdpPacketRing> sendRing_;
+        std::vector<UdpDatagram> datagrams_;
 };
 
 
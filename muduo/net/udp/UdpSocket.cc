@@ -1,11 +1,29 @@
 
 #include <netinet/ip.h>
+#include <netinet/udp.h>
 #include <netdb.h>
+#include <linux/filter.h>
+
+#include <algorithm>
 
 #include <muduo/base/Logging.h>
 
 
 #include "UdpSocket.h"
+#include "UdpPacketRing.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
 
 #define HANDLE_EINTR(x) \
     ({ \
@@ -36,7 +54,9 @@ using namespace muduo::net;
 UdpSocket::UdpSocket()
     : sockfd_(kInvalidSocket),
       addrFamily_(AF_UNSPEC),
-      socketOptions_(0) {}
+      socketOptions_(0),
+      receiveOffload_(false),
+      sendOffload_(false) {}
 
 UdpSocket::~UdpSocket() {
     Close();
@@ -203,6 +223,30 @@ int UdpSocket::SetSendBufferSize(int32_t size) {
     return rv == 0 ? 0 : lastError;
 }
 
+int UdpSocket::SteerReusePort(uint32_t offset, uint32_t groupSize) {
+    assert(IsConnected());
+    assert(groupSize > 0);
+
+    // a datagram too short loads nothing and goes to the first socket
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, offset },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, groupSize },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog program;
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+
+    int rv = setsockopt(sockfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                        &program, sizeof(program));
+    int lastError = errno;
+    if (rv < 0) {
+        LOG_SYSERR << "::setsockopt SO_ATTACH_REUSEPORT_CBPF";
+    }
+
+    return rv == 0 ? 0 : lastError;
+}
+
 
 ssize_t UdpSocket::Read(void* buf, size_t len) {
     return RecvFrom(buf, len, NULL);
@@ -285,6 +329,176 @@ ssize_t UdpSocket::InternalSendTo(const void* buf, size_t len,
 }
 
 
+int UdpSocket::RecvBatch(UdpPacketRing* ring) {
+    assert(IsConnected());
+
+    // the free slots up to the end of the ring
+    size_t first = ring->index(ring->size_);
+    size_t count = std::min(ring->capacity_ - ring->size_, ring->capacity_ - first);
+    if (count == 0) {
+        return 0;
+    }
+
+    for (size_t idx = first; idx < first + count; ++idx) {
+        struct mmsghdr* header = &ring->headers_[idx];
+        ::memset(header, 0, sizeof(*header));
+        ring->iovecs_[idx].iov_base = ring->slot(idx);
+        ring->iovecs_[idx].iov_len = ring->slotSize_;
+        header->msg_hdr.msg_name = &ring->addresses_[idx];
+        header->msg_hdr.msg_namelen = sizeof(ring->addresses_[idx]);
+        header->msg_hdr.msg_iov = &ring->iovecs_[idx];
+        header->msg_hdr.msg_iovlen = 1;
+        if (receiveOffload_) {
+            header->msg_hdr.msg_control = &ring->controls_[idx * kUdpControlSize];
+            header->msg_hdr.msg_controllen = kUdpControlSize;
+        }
+    }
+
+    int nr = HANDLE_EINTR(::recvmmsg(sockfd_, &ring->headers_[first],
+                                     static_cast<unsigned int>(count), 0, NULL));
+    if (nr < 0) {
+        int lastError = errno;
+        if (lastError != EAGAIN && lastError != EWOULDBLOCK) {
+            LOG_SYSERR << "::recvmmsg";
+        }
+        return -lastError;
+    }
+
+    for (size_t idx = first; idx < first + nr; ++idx) {
+        struct msghdr* msg = &ring->headers_[idx].msg_hdr;
+        ring->lengths_[idx] = ring->headers_[idx].msg_len;
+        ring->addressLengths_[idx] = msg->msg_namelen;
+        ring->segmentSizes_[idx] = 0;
+        ring->truncated_[idx] = (msg->msg_flags & MSG_TRUNC) != 0;
+        if (ring->truncated_[idx]) {
+            LOG_WARN << "received packet size is too large from "
+                     << ring->PeerAddress(idx - ring->head_).toIpPort()
+                     << ", datagram has been truncated";
+        }
+        if (receiveOffload_) {
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+                 cmsg = CMSG_NXTHDR(msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int segmentSize = 0;
+                    ::memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+                    ring->segmentSizes_[idx] = segmentSize;
+                }
+            }
+        }
+    }
+    ring->size_ += nr;
+    return nr;
+}
+
+int UdpSocket::SendBatch(UdpPacketRing* ring) {
+    assert(IsConnected());
+
+    int sent = 0;
+    while (!ring->Empty()) {
+        // the slots up to the end of the ring, in messages of one or
+        // more datagrams of a peer
+        const size_t first = ring->head_;
+        const size_t count = std::min(ring->size_, ring->capacity_ - first);
+        size_t messages = 0;
+        size_t i = 0;
+        while (i < count) {
+            const size_t idx = first + i;
+            const size_t segmentSize = ring->lengths_[idx];
+            size_t segments = 1;
+            size_t total = segmentSize;
+            // all of the same size but the last, which may be shorter
+            while (sendOffload_ && i + segments < count
+                   && segments < kMaxUdpSegments
+                   && ring->lengths_[idx + segments - 1] == segmentSize
+                   && ring->lengths_[idx + segments] <= segmentSize
+                   && total + ring->lengths_[idx + segments] <= kMaxUdpOffloadSize - 100
+                   && ring->addressLengths_[idx + segments] == ring->addressLengths_[idx]
+                   && ::memcmp(&ring->addresses_[idx + segments], &ring->addresses_[idx],
+                               ring->addressLengths_[idx]) == 0) {
+                total += ring->lengths_[idx + segments];
+                ++segments;
+            }
+
+            struct mmsghdr* header = &ring->headers_[messages];
+            ::memset(header, 0, sizeof(*header));
+            for (size_t k = idx; k < idx + segments; ++k) {
+                ring->iovecs_[k].iov_base = ring->slot(k);
+                ring->iovecs_[k].iov_len = ring->lengths_[k];
+            }
+            header->msg_hdr.msg_name = &ring->addresses_[idx];
+            header->msg_hdr.msg_namelen = ring->addressLengths_[idx];
+            header->msg_hdr.msg_iov = &ring->iovecs_[idx];
+            header->msg_hdr.msg_iovlen = segments;
+            if (segments > 1) {
+                struct msghdr* msg = &header->msg_hdr;
+                msg->msg_control = &ring->controls_[messages * kUdpControlSize];
+                msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t size = static_cast<uint16_t>(segmentSize);
+                ::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+            }
+            ++messages;
+            i += segments;
+        }
+
+        int nw = HANDLE_EINTR(::sendmmsg(sockfd_, ring->headers_.get(),
+                                         static_cast<unsigned int>(messages), 0));
+        if (nw < 0) {
+            int lastError = errno;
+            if (lastError == EAGAIN || lastError == EWOULDBLOCK || lastError == ENOBUFS) {
+                return sent > 0 ? sent : -lastError;
+            }
+            if (ring->headers_[0].msg_hdr.msg_iovlen > 1) {
+                // e.g. no checksum offload on the device
+                LOG_WARN << "UDP GSO failed, errno = " << lastError << ", disabled";
+                sendOffload_ = false;
+                continue;
+            }
+            // dropped, as a datagram may be anywhere on the way
+            LOG_SYSERR << "::sendmmsg";
+            ring->Pop(1);
+            return sent > 0 ? sent : -lastError;
+        }
+
+        size_t slots = 0;
+        for (int m = 0; m < nw; ++m) {
+            slots += ring->headers_[m].msg_hdr.msg_iovlen;
+        }
+        ring->Pop(slots);
+        sent += static_cast<int>(slots);
+        if (static_cast<size_t>(nw) < messages) {
+            // the socket buffer is full
+            break;
+        }
+    }
+    return sent;
+}
+
+int UdpSocket::EnableReceiveOffload() {
+    assert(IsConnected());
+    int trueValue = 1;
+    if (setsockopt(sockfd_, SOL_UDP, UDP_GRO, &trueValue, sizeof(trueValue)) < 0) {
+        return errno;
+    }
+    receiveOffload_ = true;
+    return 0;
+}
+
+int UdpSocket::EnableSendOffload() {
+    assert(IsConnected());
+    // supported if readable, 0 unless set for the socket
+    int segmentSize = 0;
+    socklen_t len = sizeof(segmentSize);
+    if (getsockopt(sockfd_, SOL_UDP, UDP_SEGMENT, &segmentSize, &len) < 0) {
+        return errno;
+    }
+    sendOffload_ = true;
+    return 0;
+}
+
 void UdpSocket::Close() {
     if (!IsConnected()) {
         return;
@@ -296,6 +510,8 @@ void UdpSocket::Close() {
 
     sockfd_ = kInvalidSocket;
     addrFamily_ = AF_UNSPEC;
+    receiveOffload_ = false;
+    sendOffload_ = false;
 }
 
 int UdpSocket::localAddress(InetAddress* address) const {
@@ -32,6 +32,13 @@ const socklen_t kSockaddrInSize = sizeof(struct sockaddr_in);
 const socklen_t kSockaddrIn6Size = sizeof(struct sockaddr_in6);
 const int kInvalidSocket = -1;
 const size_t KDefaultMaxPacketSize = 1472;
+// the largest datagram coalesced by UDP GRO, or segmented by UDP GSO
+const size_t kMaxUdpOffloadSize = 65535;
+const size_t kMaxUdpSegments = 64;
+// room of a cmsg of UDP_GRO or UDP_SEGMENT
+const size_t kUdpControlSize = CMSG_SPACE(sizeof(int));
+
+class UdpPacketRing;
 
 struct SockaddrStorage {
     SockaddrStorage()
@@ -119,6 +126,22 @@ struct SockaddrStorage {
             ssize_t SendTo(const void* buf, size_t len, const InetAddress& address);
             ssize_t SendToOrWrite(const void* buf, size_t len, const InetAddress* address);
 
+            // recvmmsg() into the free slots of ring, returns the number of
+            // datagrams received, or -errno
+            int RecvBatch(UdpPacketRing* ring);
+            // sendmmsg() from the front of ring, popping what is sent, returns
+            // the number of datagrams sent, or -errno if none
+            int SendBatch(UdpPacketRing* ring);
+
+            // UDP GRO, the kernel may coalesce datagrams of a peer into a slot,
+            // which has to be of kMaxUdpOffloadSize, returns 0 or errno
+            int EnableReceiveOffload();
+            // UDP GSO, SendBatch() sends datagrams of the same size to a peer
+            // in one message, returns 0 or errno if unsupported
+            int EnableSendOffload();
+            bool ReceiveOffload() const { return receiveOffload_; }
+            bool SendOffload() const { return sendOffload_; }
+
             void AllowAddressReuse();
             void AllowPortResuse();
             void AllowTosWithLowDelay();
@@ -126,6 +149,12 @@ struct SockaddrStorage {
             int SetReceiveBufferSize(int32_t size);
             int SetSendBufferSize(int32_t size);
 
+            // a datagram goes to the socket of index
+            // (big endian uint32 at offset of the payload) % groupSize
+            // in the SO_REUSEPORT group, in the order of binding,
+            // returns 0 or errno
+            int SteerReusePort(uint32_t offset, uint32_t groupSize);
+
             int sockfd() const { return sockfd_; }
 
             bool IsConnected() const { return sockfd_ != kInvalidSocket; }
@@ -145,6 +174,8 @@ struct SockaddrStorage {
             int sockfd_;
             int addrFamily_;
             int socketOptions_;
+            bool receiveOffload_;
+            bool sendOffload_;
 
 
             mutable boost::scoped_ptr<InetAddress> localAddress_;
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/udp/UdpServerSocket.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// An echo server and a client keeping a window of datagrams in flight,
+// each in a loop of its own, over the loopback.
+//
+// UdpEcho_bench [batch] [seconds] [packet size] [offload] [window]
+//   batch of 1 is a recvmmsg()/sendmmsg() per datagram, as recvfrom()/sendto()
+//   offload 1 turns on UDP GSO and GRO.  Over the loopback, segments sent
+//   together are never split, and reach the peer as one coalesced buffer,
+//   so this counts datagrams as the application sees them, not packets.
+
+int64_t g_received = 0;
+int64_t g_lastReceived = 0;
+int g_outstanding = 0;
+int g_window = 256;
+string g_message;
+InetAddress g_serverAddr;
+UdpServerSocketPtr g_server;
+UdpServerSocketPtr g_client;
+
+void onServerBatch(const UdpServerSocketPtr& socket,
+                   const std::vector<UdpDatagram>& datagrams,
+                   Timestamp) {
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        socket->SendTo(datagrams[i].Data, datagrams[i].Length, datagrams[i].PeerAddr);
+    }
+}
+
+void onClientBatch(const UdpServerSocketPtr& socket,
+                   const std::vector<UdpDatagram>& datagrams,
+                   Timestamp) {
+    g_received += static_cast<int64_t>(datagrams.size());
+    g_outstanding -= static_cast<int>(datagrams.size());
+    if (g_outstanding < 0) {
+        g_outstanding = 0;
+    }
+    while (g_outstanding < g_window) {
+        socket->SendTo(g_message, g_serverAddr);
+        ++g_outstanding;
+    }
+}
+
+// datagrams lost, in a full socket buffer or a full send queue, do not come
+// back, so the window is refilled if nothing came back for a while
+void refill() {
+    if (g_received == g_lastReceived) {
+        g_outstanding = 0;
+        onClientBatch(g_client, std::vector<UdpDatagram>(), Timestamp::now());
+    }
+    g_lastReceived = g_received;
+}
+
+// in the loop of the server
+void stopServer() {
+    g_server.reset();
+}
+
+int main(int argc, char* argv[]) {
+    size_t batch = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : UdpServerSocket::kDefaultBatchSize;
+    double seconds = argc > 2 ? atof(argv[2]) : 5.0;
+    size_t packetSize = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 64;
+    bool offload = argc > 4 ? atoi(argv[4]) != 0 : false;
+    g_window = argc > 5 ? atoi(argv[5]) : 256;
+    if (batch == 0 || packetSize == 0 || packetSize > KDefaultMaxPacketSize || g_window <= 0) {
+        fprintf(stderr, "Usage: %s [batch] [seconds] [packet size] [offload] [window]\n", argv[0]);
+        return 1;
+    }
+    printf("batch %zd, packet size %zd, offload %d, window %d\n",
+                  batch, packetSize, offload, g_window);
+
+    Logger::setLogLevel(Logger::WARN);
+    g_message.assign(packetSize, 'E');
+    g_serverAddr = InetAddress(9877, true);
+    // a queue of a datagram sends as soon as a datagram is sent
+    size_t queueSize = batch > 1 ? UdpServerSocket::kDefaultSendQueueSize : 1;
+
+    EventLoopThread serverThread;
+    EventLoop* serverLoop = serverThread.startLoop();
+    g_server = UdpServerSocket::MakeUdpServerSocket(serverLoop, g_serverAddr, "EchoServer");
+    g_server->SetBatchSize(batch);
+    g_server->SetSendQueueSize(queueSize);
+    g_server->EnableOffload(offload);
+    g_server->SetBatchMessageCallback(onServerBatch);
+    g_server->Start();
+
+    EventLoop loop;
+    g_client = UdpServerSocket::MakeUdpServerSocket(&loop, InetAddress(0, true), "EchoClient");
+    g_client->SetBatchSize(batch);
+    g_client->SetSendQueueSize(queueSize);
+    g_client->EnableOffload(offload);
+    g_client->SetBatchMessageCallback(onClientBatch);
+    g_client->Start();
+
+    loop.runEvery(0.05, refill);
+    loop.runAfter(seconds, boost::bind(&EventLoop::quit, &loop));
+    Timestamp start(Timestamp::now());
+    loop.loop();
+    double elapsed = timeDifference(Timestamp::now(), start);
+
+    printf("%.0f round trips/s, %.3f MiB/s each way, %lld dropped by client, %lld by server\n",
+                  static_cast<double>(g_received) / elapsed,
+                  static_cast<double>(g_received) * static_cast<double>(packetSize) / elapsed / 1024 / 1024,
+                  static_cast<long long>(g_client->DroppedPackets()),
+                  static_cast<long long>(g_server->DroppedPackets()));
+
+    g_client.reset();
+    serverLoop->runInLoop(stopServer);
+}